@@ -21,6 +21,7 @@
 #include <stdio.h>
 
 #include "lz_common.h"
+#include "lz_sha256.h"
 #include "lz_flash_handler.h"
 #include "lzport_debug_output.h"
 #include "lzport_memory.h"
@@ -39,7 +40,32 @@ __attribute__((section(".STAGING_AREA"))) volatile lz_staging_area_t lz_staging_
 // Before loading a subsequent layer, we write the next layers boot parameters to RAM_DATA as well
 __attribute__((section(".RAM_DATA.Alias"))) volatile lz_img_boot_params_t lz_img_boot_params;
 __attribute__((section(".RAM_DATA.Certs"))) volatile lz_img_cert_store_t lz_img_cert_store;
+
+// Directory of the staging area which is prepared in RAM while a staging element is written.
+// To limit the wear of the directory page, new entries are only written to flash together with
+// the boot mode request or the journal
+static lz_staging_dir_t staging_dir;
+static bool staging_dir_pending = false;
+
+// State of the staging element which is currently written
+static uint8_t *staging_elem_start = NULL;
+static uint8_t *staging_elem_cursor = NULL;
+static lz_sha256_ctx staging_elem_ctx;
+static bool staging_elem_journaled = false;
+
 static LZ_RESULT lz_get_next_staging_slot(uint8_t **staging_slot, uint32_t size_req);
+static lz_auth_hdr_t *lz_staging_next_elem(uint32_t *cursor);
+static bool lz_staging_elem_matches(lz_auth_hdr_t *hdr, hdr_type_t hdr_type, uint8_t *nonce,
+									uint32_t num);
+static uint32_t lz_staging_nonce_hash(const volatile uint8_t *nonce);
+static bool lz_staging_dir_is_valid(void);
+static uint32_t lz_staging_dir_num_indexed(uint32_t *cursor);
+static lz_auth_hdr_t *lz_staging_dir_get_hdr(const volatile lz_staging_dir_entry_t *entry);
+static void lz_staging_dir_set_entry(lz_staging_dir_entry_t *entry, lz_auth_hdr_t *hdr);
+static LZ_RESULT lz_staging_dir_add_elem(lz_auth_hdr_t *hdr);
+static LZ_RESULT lz_staging_dir_write(void);
+static LZ_RESULT lz_staging_journal_start(lz_auth_hdr_t *hdr);
+static LZ_RESULT lz_staging_journal_update(bool finished);
 
 void lz_get_uuid(uint8_t uuid[LEN_UUID_V4_BIN])
 {
@@ -64,6 +90,12 @@ bool lz_firmware_update_necessary(void)
 {
 	return lz_img_boot_params.info.firmware_update_necessary;
 }
+
+bool lz_delta_update_failed(void)
+{
+	return lz_img_boot_params.info.delta_update_failed;
+}
+
 /**
  * Write the boot mode request for the next boot to the staging area
  * @param boot_mode_param The requested boot mode
@@ -82,9 +114,13 @@ LZ_RESULT lz_set_boot_mode_request(boot_mode_t boot_mode_param)
 	// Copy last page of staging area into RAM
 	memcpy(overwrite_area, flash_start, FLASH_PAGE_SIZE);
 
+	// The last page holds the directory as well, so pending entries are written along with it
+	if (staging_dir_pending) {
+		memcpy(overwrite_area, &staging_dir, sizeof(staging_dir));
+	}
+
 	// Overwrite last 4 byte with boot mode flag
-	memcpy((uint8_t *)(((uint32_t)overwrite_area) + FLASH_PAGE_SIZE - sizeof(uint32_t)), &boot_mode,
-		   sizeof(uint32_t));
+	memcpy(&overwrite_area[FLASH_PAGE_SIZE - sizeof(uint32_t)], &boot_mode, sizeof(uint32_t));
 
 	// Write the page back to flash
 	bool result =
@@ -97,6 +133,7 @@ LZ_RESULT lz_set_boot_mode_request(boot_mode_t boot_mode_param)
 				 result);
 		return LZ_ERROR;
 	}
+	staging_dir_pending = false;
 
 	return LZ_SUCCESS;
 }
@@ -124,7 +161,11 @@ bool lz_is_mem_zero(const void *start, uint32_t size)
 }
 
 /**
- * Find the next free slot in the staging area and return its address
+ * Find the next free slot in the staging area and return its address. All elements of the next
+ * boot cycle are kept, the slot is located directly after them. The directory of the kept
+ * elements is prepared in RAM, the new element is added once it was completely written. If the
+ * slot overwrites elements which are indexed by the directory in flash, their entries are removed
+ * from flash first, so that the directory never refers to overwritten elements
  *
  * @param staging_elem_slot The address of the next free slot that is returned
  * @param size_req The size of the requested slot including the header
@@ -133,66 +174,171 @@ bool lz_is_mem_zero(const void *start, uint32_t size)
 static LZ_RESULT lz_get_next_staging_slot(uint8_t **staging_slot, uint32_t size_req)
 {
 	uint32_t staging_area_size = sizeof(lz_staging_area.content);
+	uint32_t nonce_hash = lz_staging_nonce_hash(lz_img_boot_params.info.next_nonce);
+	uint32_t num_indexed;
+	uint32_t next;
 	uint32_t cursor = 0;
-	LZ_RESULT result = LZ_ERROR;
+	lz_auth_hdr_t *staging_elem_hdr;
+
+	memset(&staging_dir, 0xFF, sizeof(staging_dir));
+	staging_dir.magic = LZ_MAGIC;
+	staging_dir.num_entries = 0;
+
+	if (lz_staging_dir_is_valid()) {
+		memcpy(&staging_dir.journal, (void *)&lz_staging_area.dir.journal,
+			   sizeof(staging_dir.journal));
+	}
 
-	while (cursor < staging_area_size) {
-		lz_auth_hdr_t *staging_elem_hdr =
-			(lz_auth_hdr_t *)(((uint32_t)&lz_staging_area.content) + cursor);
+	num_indexed = lz_staging_dir_num_indexed(&next);
+
+	while (staging_dir.num_entries < LZ_STAGING_DIR_MAX_ENTRIES) {
+		next = cursor;
+		if (staging_dir.num_entries < num_indexed) {
+			// Entries of other boot cycles are recognized by their nonce hash
+			volatile lz_staging_dir_entry_t *entry =
+				&lz_staging_area.dir.entries[staging_dir.num_entries];
+			staging_elem_hdr =
+				(entry->nonce_hash == nonce_hash) ? lz_staging_dir_get_hdr(entry) : NULL;
+			next += sizeof(lz_auth_hdr_t) + entry->size;
+		} else {
+			staging_elem_hdr = lz_staging_next_elem(&next);
+		}
 
-		// If the header is invalid or there is no header at all, we can override it
-		if (!(staging_elem_hdr->content.magic == LZ_MAGIC) ||
-			(staging_elem_hdr->content.payload_size == 0) ||
+		// If the element belongs to another boot cycle, it and all subsequent elements can be
+		// overridden
+		if ((staging_elem_hdr == NULL) ||
 			memcmp((void *)staging_elem_hdr->content.nonce,
 				   (void *)lz_img_boot_params.info.next_nonce,
 				   sizeof(staging_elem_hdr->content.nonce))) {
-			// Check if the element fits into the staging area
-			if (size_req < (staging_area_size - cursor)) {
-				*staging_slot = (uint8_t *)staging_elem_hdr;
-				dbgprint(DBG_VERB, "VERB: Found staging element slot at location: 0x%x\n",
-						 staging_elem_hdr);
-
-				result = LZ_SUCCESS;
-				break;
-			} else {
-				result = LZ_ERROR;
-				break;
-			}
+			break;
 		}
 
-		// Move cursor to next element
-		cursor += (staging_elem_hdr->content.payload_size + sizeof(lz_auth_hdr_t));
+		lz_staging_dir_set_entry(&staging_dir.entries[staging_dir.num_entries++],
+								 staging_elem_hdr);
+		cursor = next;
 	}
 
-	// Staging area already filled, cannot find slot
-	return result;
+	if (staging_dir.num_entries >= LZ_STAGING_DIR_MAX_ENTRIES) {
+		dbgprint(DBG_ERR, "ERROR: Staging area directory is full\n");
+		return LZ_ERROR;
+	}
+
+	// This happens at most once per boot cycle, afterwards the entries in flash are all kept
+	if (lz_staging_dir_is_valid() && (lz_staging_area.dir.num_entries > staging_dir.num_entries) &&
+		(lz_staging_dir_write() != LZ_SUCCESS)) {
+		return LZ_ERROR;
+	}
+
+	// Check if the element fits into the staging area
+	if ((cursor > staging_area_size) || (size_req > (staging_area_size - cursor))) {
+		return LZ_ERROR;
+	}
+
+	*staging_slot = (uint8_t *)(((uint32_t)&lz_staging_area.content) + cursor);
+	dbgprint(DBG_VERB, "VERB: Found staging element slot at location: %p\n", *staging_slot);
+
+	return LZ_SUCCESS;
 }
 
+/**
+ * Writes a staging element, which might be received in multiple chunks, to the staging area. The
+ * payload is hashed while it is written, so that a corrupted element is detected right after the
+ * last chunk was received and is not added to the staging area directory. The progress of large
+ * elements is journaled, so that an interrupted download can be continued with
+ * lz_resume_staging_element()
+ * @param buf The current chunk of the staging element
+ * @param buf_size The size of the current chunk
+ * @param total_size The total size of the staging element including the header
+ * @param pending The number of bytes of the staging element that are still pending, including
+ * the current chunk
+ * @return LZ_SUCCESS if the chunk was written (and the element is intact, if it was the last
+ * chunk), otherwise LZ_ERROR
+ */
 LZ_RESULT
 lz_flash_staging_element(uint8_t *buf, uint32_t buf_size, uint32_t total_size, uint32_t pending)
 {
-	static uint8_t *start = NULL;
+	uint32_t written;
+	uint32_t hdr_part;
+	uint8_t digest[SHA256_DIGEST_LENGTH];
 	LZ_RESULT result = LZ_ERROR;
 
 	// Get next slot in staging area if a new firmware is to be flashed
 	if (pending == total_size) {
-		if (lz_get_next_staging_slot(&start, buf_size) != LZ_SUCCESS) {
+		if (lz_get_next_staging_slot(&staging_elem_cursor, total_size) != LZ_SUCCESS) {
 			dbgprint(DBG_ERR, "ERROR: Could not find a place on staging area.\n");
 			goto exit;
 		}
+		staging_elem_start = staging_elem_cursor;
+		staging_elem_journaled = false;
+
+		if (lz_sha256_start(&staging_elem_ctx) != 0) {
+			dbgprint(DBG_ERR, "ERROR: Failed to start hashing of staging element\n");
+			goto exit;
+		}
+
+		if ((total_size > LZ_STAGING_JOURNAL_INTERVAL) && (buf_size >= sizeof(lz_auth_hdr_t))) {
+			if (lz_staging_journal_start((lz_auth_hdr_t *)buf) != LZ_SUCCESS) {
+				goto exit;
+			}
+		} else if ((staging_dir.journal.magic == LZ_MAGIC) &&
+				   (staging_dir.journal.offset <
+					(uint32_t)(staging_elem_start - (uint8_t *)&lz_staging_area.content) +
+						total_size)) {
+			// The element overwrites a partially downloaded element, which cannot be continued
+			staging_dir.journal.magic = 0;
+			if (lz_staging_dir_write() != LZ_SUCCESS) {
+				goto exit;
+			}
+		}
 	}
 
 	dbgprint(DBG_VERB,
-			 "Writing %d bytes (RAM Address 0x%x, total %d, pending %d) to flash address "
-			 "0x%x\n",
-			 buf_size, buf, total_size, pending, start);
+			 "Writing %d bytes (RAM Address %p, total %d, pending %d) to flash address "
+			 "%p\n",
+			 buf_size, buf, total_size, pending, staging_elem_cursor);
 
-	if (!(lz_flash_write_nse((void *)start, (void *)buf, buf_size))) {
+	if (!(lz_flash_write_nse((void *)staging_elem_cursor, (void *)buf, buf_size))) {
 		dbgprint(DBG_ERR, "ERROR: Failed to write staging element to flash.\n");
 		goto exit;
 	}
 
-	start += buf_size;
+	// Hash the payload of the element, i.e. the part of the chunk after the header
+	written = (uint32_t)(staging_elem_cursor - staging_elem_start);
+	hdr_part = (written < sizeof(lz_auth_hdr_t)) ? (sizeof(lz_auth_hdr_t) - written) : 0;
+	if ((buf_size > hdr_part) &&
+		(lz_sha256_update(&staging_elem_ctx, buf + hdr_part, buf_size - hdr_part) != 0)) {
+		dbgprint(DBG_ERR, "ERROR: Failed to hash staging element\n");
+		goto exit;
+	}
+
+	staging_elem_cursor += buf_size;
+
+	if (buf_size < pending) {
+		result = lz_staging_journal_update(false);
+		goto exit;
+	}
+
+	// The element is only added to the directory once it was written completely and intact
+	if (lz_sha256_finish(&staging_elem_ctx, digest) != 0) {
+		dbgprint(DBG_ERR, "ERROR: Failed to hash staging element\n");
+		goto exit;
+	}
+
+	if (memcmp(digest, ((lz_auth_hdr_t *)staging_elem_start)->content.digest, sizeof(digest))) {
+		dbgprint(DBG_ERR, "ERROR: Digest of received staging element does not match\n");
+		// Do not continue a corrupted element, it must be downloaded completely again
+		lz_staging_journal_update(true);
+		goto exit;
+	}
+
+	if (staging_elem_journaled) {
+		staging_dir.journal.magic = 0;
+		staging_elem_journaled = false;
+	}
+
+	if (lz_staging_dir_add_elem((lz_auth_hdr_t *)staging_elem_start) != LZ_SUCCESS) {
+		goto exit;
+	}
 
 	result = LZ_SUCCESS;
 
@@ -200,6 +346,95 @@ exit:
 	return result;
 }
 
+/**
+ * Checks whether the staging area holds the beginning of an element of the specified type from an
+ * interrupted download, which can be continued in the current boot cycle
+ * @param type The type of the staging element, for a delta update the type of the updated image
+ * @param offset Returns the number of payload bytes which are already in flash
+ * @param digest Returns the payload digest of the partially downloaded element
+ * @return LZ_SUCCESS if the download can be continued, otherwise LZ_NOT_FOUND
+ */
+LZ_RESULT lz_get_staging_resume_info(hdr_type_t type, uint32_t *offset, uint8_t *digest)
+{
+	uint32_t staging_area_size = sizeof(lz_staging_area.content);
+	lz_staging_journal_t *journal = &staging_dir.journal;
+	lz_delta_hdr_t *delta_hdr;
+	uint8_t *slot;
+
+	// Prepares the directory of the kept elements and loads the journal. A download of an image
+	// update may also have been a delta update of the image
+	if ((lz_get_next_staging_slot(&slot, 0) != LZ_SUCCESS) || (journal->magic != LZ_MAGIC) ||
+		((journal->type != type) && (journal->type != DELTA_UPDATE))) {
+		return LZ_NOT_FOUND;
+	}
+
+	// The journal is written by the untrusted layers as well, so it must be checked
+	if ((journal->written <= sizeof(lz_auth_hdr_t)) ||
+		(journal->written - sizeof(lz_auth_hdr_t) >= journal->size) ||
+		(journal->offset > staging_area_size - sizeof(lz_auth_hdr_t)) ||
+		(journal->size > staging_area_size - sizeof(lz_auth_hdr_t) - journal->offset)) {
+		return LZ_NOT_FOUND;
+	}
+
+	// The delta header is the first part of the payload and names the image it updates
+	if ((journal->type == DELTA_UPDATE) && (journal->type != type)) {
+		delta_hdr = (lz_delta_hdr_t *)((uint8_t *)&lz_staging_area.content + journal->offset +
+									   sizeof(lz_auth_hdr_t));
+		if ((journal->written < sizeof(lz_auth_hdr_t) + sizeof(lz_delta_hdr_t)) ||
+			(delta_hdr->magic != LZ_MAGIC) || (delta_hdr->type != type)) {
+			return LZ_NOT_FOUND;
+		}
+	}
+
+	// The element must not overlap elements that are kept for the next boot cycle
+	if (slot > (uint8_t *)&lz_staging_area.content + journal->offset) {
+		return LZ_NOT_FOUND;
+	}
+
+	*offset = journal->written - sizeof(lz_auth_hdr_t);
+	memcpy(digest, journal->digest, sizeof(journal->digest));
+
+	return LZ_SUCCESS;
+}
+
+/**
+ * Continues writing a partially downloaded staging element reported by
+ * lz_get_staging_resume_info(). The element receives the new header, as it is signed with the
+ * nonce of the current boot cycle, and the payload which is already in flash is hashed again.
+ * Afterwards, the remaining payload is written with lz_flash_staging_element()
+ * @param hdr The new header of the staging element
+ * @return LZ_SUCCESS if the element can be continued, LZ_NOT_FOUND if the header does not
+ * belong to the partially downloaded element and LZ_ERROR if an error occurred
+ */
+LZ_RESULT lz_resume_staging_element(lz_auth_hdr_t *hdr)
+{
+	lz_staging_journal_t *journal = &staging_dir.journal;
+
+	if ((journal->magic != LZ_MAGIC) || (hdr->content.type != journal->type) ||
+		(hdr->content.payload_size != journal->size) ||
+		memcmp(hdr->content.digest, journal->digest, sizeof(journal->digest))) {
+		return LZ_NOT_FOUND;
+	}
+
+	staging_elem_start = (uint8_t *)&lz_staging_area.content + journal->offset;
+	staging_elem_cursor = staging_elem_start + journal->written;
+	staging_elem_journaled = true;
+
+	if (!(lz_flash_write_nse((void *)staging_elem_start, (void *)hdr, sizeof(lz_auth_hdr_t)))) {
+		dbgprint(DBG_ERR, "ERROR: Failed to write staging element header to flash.\n");
+		return LZ_ERROR;
+	}
+
+	if ((lz_sha256_start(&staging_elem_ctx) != 0) ||
+		(lz_sha256_update(&staging_elem_ctx, staging_elem_start + sizeof(lz_auth_hdr_t),
+						  journal->written - sizeof(lz_auth_hdr_t)) != 0)) {
+		dbgprint(DBG_ERR, "ERROR: Failed to hash staging element\n");
+		return LZ_ERROR;
+	}
+
+	return LZ_SUCCESS;
+}
+
 /**
  * Get next valid staging header
  * @param hdr Address of a header that should be moved to the next header address
@@ -226,7 +461,7 @@ LZ_RESULT lz_get_next_staging_hdr(lz_auth_hdr_t **hdr)
 	staging_elem_size = hdr_tmp->content.payload_size + sizeof(lz_auth_hdr_t);
 	next_header = ((uint8_t *)hdr_tmp) + staging_elem_size;
 
-	dbgprint(DBG_VERB, "INFO: Next header at 0x%x\n", next_header);
+	dbgprint(DBG_VERB, "INFO: Next header at %p\n", next_header);
 
 	// See whether next header still fits within bounds of staging area
 	if (next_header > (uint8_t *)(((uint32_t)&lz_staging_area.content) + staging_area_size) ||
@@ -244,87 +479,115 @@ LZ_RESULT lz_get_next_staging_hdr(lz_auth_hdr_t **hdr)
 	}
 
 	*hdr = (lz_auth_hdr_t *)next_header;
-	dbgprint(DBG_VERB, "INFO: Set hdr pointer to 0x%x\n", hdr);
+	dbgprint(DBG_VERB, "INFO: Set hdr pointer to %p\n", *hdr);
 
 	return LZ_SUCCESS;
 }
 
 /**
- * Gets pointer to the specified staging element header, if the header is present
+ * Gets pointer to the specified staging element header, if the header is present. The elements
+ * indexed by the directory are selected by the type and nonce hash of their entries, so that only
+ * the headers of matching elements are read
  * @param requested_elem_type The requested element type
  * @param return_hdr Pointer to the header, if found, otherwise NULL
  * @return LZ_SUCCESS if the staging element was found, otherwise LZ_ERROR or LZ_NOT_FOUND
  */
 LZ_RESULT lz_get_staging_hdr(hdr_type_t hdr_type, lz_auth_hdr_t **return_hdr, uint8_t *nonce)
 {
-	uint32_t staging_area_size = sizeof(lz_staging_area.content);
-	uint32_t staging_elem_size;
-	uint32_t cursor = 0;
-	uint8_t num_elements = 0;
-	uint32_t result = LZ_ERROR;
+	uint32_t nonce_hash = lz_staging_nonce_hash(nonce);
+	uint32_t cursor;
+	uint32_t num_indexed = lz_staging_dir_num_indexed(&cursor);
+	uint32_t num_elements;
 	lz_auth_hdr_t *hdr;
 
-	// Cursor holds the current position in the staging area
-	while (cursor < staging_area_size) {
-		hdr = (lz_auth_hdr_t *)(((uint32_t)&lz_staging_area.content) + cursor);
-		staging_elem_size = 0;
-
-		// Check whether header is sane
-		if (hdr->content.magic != LZ_MAGIC) {
-			dbgprint(DBG_INFO,
-					 "INFO: Element type %s not present among the %u elements in "
-					 "staging area.\n",
-					 HDR_TYPE_STRING[hdr_type], num_elements);
-			result = LZ_NOT_FOUND;
-			goto Cleanup;
-		}
-
-		num_elements++;
-		staging_elem_size = hdr->content.payload_size;
-
-		// There must be at least 1 byte of payload
-		if (staging_elem_size == 0) {
-			dbgprint(DBG_ERR, "ERROR: Element %u in staging area corrupted (element size 0).\n",
-					 num_elements);
-			result = LZ_ERROR;
-			goto Cleanup;
-		}
+	for (num_elements = 0; num_elements < num_indexed; num_elements++) {
+		volatile lz_staging_dir_entry_t *entry = &lz_staging_area.dir.entries[num_elements];
 
-		// But the payload must not exceed the remaining size of the staging area
-		if (staging_elem_size > staging_area_size - cursor) {
-			dbgprint(DBG_ERR,
-					 "ERROR: Element %u in staging area corrupted (area size limit exceeded).\n",
-					 num_elements);
-			result = LZ_ERROR;
-			goto Cleanup;
+		if (entry->type != hdr_type) {
+			continue;
 		}
 
-		// Check whether nonce in header equals our current nonce
-		if (memcmp(&(hdr->content.nonce), nonce, sizeof(hdr->content.nonce))) {
+		if (entry->nonce_hash != nonce_hash) {
 			dbgprint(DBG_WARN,
 					 "WARNING: Nonce of staging element %u differs from current nonce, "
 					 "skipping it.\n",
-					 num_elements);
-		} else {
-			// Header seems to be in good state and belong to the current boot cycle, let's see whether it refers to the requested element type
-			if (hdr_type == hdr->content.type) {
-				dbgprint(DBG_INFO,
-						 "INFO: Element %u in staging area matches searched element type %s.\n",
-						 num_elements, HDR_TYPE_STRING[hdr_type]);
-
-				*return_hdr = hdr;
-				result = LZ_SUCCESS;
-				return result;
-			}
+					 num_elements + 1);
+			continue;
+		}
+
+		hdr = lz_staging_dir_get_hdr(entry);
+		if ((hdr != NULL) && lz_staging_elem_matches(hdr, hdr_type, nonce, num_elements + 1)) {
+			*return_hdr = hdr;
+			return LZ_SUCCESS;
 		}
+	}
+
+	// Elements written after the directory was last written to flash
+	while ((hdr = lz_staging_next_elem(&cursor)) != NULL) {
+		num_elements++;
 
-		// Move the cursor to the next header
-		cursor += (staging_elem_size + sizeof(lz_auth_hdr_t));
+		if (lz_staging_elem_matches(hdr, hdr_type, nonce, num_elements)) {
+			*return_hdr = hdr;
+			return LZ_SUCCESS;
+		}
 	}
 
-Cleanup:
+	dbgprint(DBG_INFO, "INFO: Element type %s not present among the %u elements in staging area.\n",
+			 HDR_TYPE_STRING[hdr_type], num_elements);
 	*return_hdr = NULL;
-	return result;
+	return LZ_NOT_FOUND;
+}
+
+/**
+ * Gets the headers of all staging elements that belong to the boot cycle of the specified nonce,
+ * in the order they were written to the staging area
+ * @param nonce The nonce of the boot cycle
+ * @param hdrs Array the headers are returned in
+ * @param max_hdrs Size of the array
+ * @return The number of headers that were found
+ */
+uint32_t lz_get_staging_hdrs(uint8_t *nonce, lz_auth_hdr_t **hdrs, uint32_t max_hdrs)
+{
+	uint32_t nonce_hash = lz_staging_nonce_hash(nonce);
+	uint32_t cursor;
+	uint32_t num_indexed = lz_staging_dir_num_indexed(&cursor);
+	uint32_t num_hdrs = 0;
+	lz_auth_hdr_t *hdr;
+
+	// Only the headers of indexed elements with a matching nonce hash are read
+	for (uint32_t i = 0; (num_hdrs < max_hdrs) && (i < num_indexed); i++) {
+		volatile lz_staging_dir_entry_t *entry = &lz_staging_area.dir.entries[i];
+
+		if ((entry->nonce_hash == nonce_hash) && ((hdr = lz_staging_dir_get_hdr(entry)) != NULL) &&
+			!memcmp(&(hdr->content.nonce), nonce, sizeof(hdr->content.nonce))) {
+			hdrs[num_hdrs++] = hdr;
+		}
+	}
+
+	while ((num_hdrs < max_hdrs) && ((hdr = lz_staging_next_elem(&cursor)) != NULL)) {
+		if (!memcmp(&(hdr->content.nonce), nonce, sizeof(hdr->content.nonce))) {
+			hdrs[num_hdrs++] = hdr;
+		}
+	}
+
+	return num_hdrs;
+}
+
+/**
+ * Returns the number of elements in the staging area
+ * @return The number of elements in the staging area, regardless of their nonce
+ */
+uint32_t lz_get_num_staging_elems(void)
+{
+	uint32_t cursor;
+	uint32_t num_elements = lz_staging_dir_num_indexed(&cursor);
+
+	while (lz_staging_next_elem(&cursor) != NULL) {
+		num_elements++;
+	}
+
+	dbgprint(DBG_INFO, "INFO: Staging area contains %d elements\n", num_elements);
+	return num_elements;
 }
 
 /**
@@ -334,10 +597,21 @@ Cleanup:
  */
 bool lz_check_update_size(lz_auth_hdr_t *staging_elem_hdr)
 {
-	uint32_t image_size = staging_elem_hdr->content.payload_size;
+	return lz_check_img_size(staging_elem_hdr->content.type,
+							 staging_elem_hdr->content.payload_size);
+}
+
+/**
+ * Check if an image including its header does not exceed the maximum size in the flash
+ * @param type The update type of the image
+ * @param image_size The size of the image including the image header
+ * @return True if the image fits, otherwise false
+ */
+bool lz_check_img_size(hdr_type_t type, uint32_t image_size)
+{
 	bool retVal = true;
 
-	switch (staging_elem_hdr->content.type) {
+	switch (type) {
 	case LZ_CORE_UPDATE:
 		retVal = (image_size <= (sizeof(lz_img_hdr_t) + LZ_CORE_CODE_SIZE + LZ_CORE_NSC_SIZE));
 		break;
@@ -357,6 +631,26 @@ bool lz_check_update_size(lz_auth_hdr_t *staging_elem_hdr)
 	return retVal;
 }
 
+/**
+ * Returns the header of the installed image which is replaced by an update of the specified type.
+ * The Lazarus Core header is not accessible for the non-secure layers and therefore not returned
+ * @param type The update type
+ * @return The image header, or NULL if the type is not an image update of the non-secure images
+ */
+volatile lz_img_hdr_t *lz_get_img_hdr(hdr_type_t type)
+{
+	switch (type) {
+	case LZ_UDOWNLOADER_UPDATE:
+		return &lz_udownloader_hdr;
+	case LZ_CPATCHER_UPDATE:
+		return &lz_cpatcher_hdr;
+	case APP_UPDATE:
+		return &lz_app_hdr;
+	default:
+		return NULL;
+	}
+}
+
 void lz_print_img_info(const char *img_name, volatile lz_img_hdr_t *img_hdr)
 {
 	if (img_hdr) {
@@ -378,3 +672,246 @@ void lz_print_img_info(const char *img_name, volatile lz_img_hdr_t *img_hdr)
 				 img_name);
 	}
 }
+
+/**
+ * Calculates the 32-bit FNV-1a hash of a nonce as stored in the staging area directory
+ * @param nonce The nonce to be hashed
+ * @return The hash of the nonce
+ */
+static uint32_t lz_staging_nonce_hash(const volatile uint8_t *nonce)
+{
+	uint32_t hash = 0x811C9DC5;
+
+	for (uint32_t i = 0; i < LEN_NONCE; i++) {
+		hash = (hash ^ nonce[i]) * 0x01000193;
+	}
+
+	return hash;
+}
+
+/**
+ * Checks whether a staging element has the requested type and belongs to the boot cycle of the
+ * specified nonce
+ * @param hdr The header of the staging element
+ * @param hdr_type The requested element type
+ * @param nonce The nonce of the boot cycle
+ * @param num The number of the element in the staging area, for the log output
+ * @return true, if the element matches, otherwise false
+ */
+static bool lz_staging_elem_matches(lz_auth_hdr_t *hdr, hdr_type_t hdr_type, uint8_t *nonce,
+									uint32_t num)
+{
+	if (hdr->content.type != hdr_type) {
+		return false;
+	}
+
+	if (memcmp(&(hdr->content.nonce), nonce, sizeof(hdr->content.nonce))) {
+		dbgprint(DBG_WARN,
+				 "WARNING: Nonce of staging element %u differs from current nonce, "
+				 "skipping it.\n",
+				 num);
+		return false;
+	}
+
+	dbgprint(DBG_INFO, "INFO: Element %u in staging area matches searched element type %s.\n",
+			 num, HDR_TYPE_STRING[hdr_type]);
+	return true;
+}
+
+/**
+ * Check whether the staging area contains a directory
+ * @return true, if the directory is present and sane, otherwise false
+ */
+static bool lz_staging_dir_is_valid(void)
+{
+	return (lz_staging_area.dir.magic == LZ_MAGIC) &&
+		   (lz_staging_area.dir.num_entries <= LZ_STAGING_DIR_MAX_ENTRIES);
+}
+
+/**
+ * Returns the staging element header a directory entry refers to. As the directory is written
+ * by the untrusted layers, the entry must lie within the staging area and match the header
+ * @param entry The directory entry
+ * @return The header of the staging element, or NULL if the entry is invalid
+ */
+static lz_auth_hdr_t *lz_staging_dir_get_hdr(const volatile lz_staging_dir_entry_t *entry)
+{
+	uint32_t staging_area_size = sizeof(lz_staging_area.content);
+	lz_auth_hdr_t *hdr;
+
+	if ((entry->size == 0) || (entry->offset > staging_area_size - sizeof(lz_auth_hdr_t)) ||
+		(entry->size > staging_area_size - sizeof(lz_auth_hdr_t) - entry->offset)) {
+		return NULL;
+	}
+
+	hdr = (lz_auth_hdr_t *)(((uint32_t)&lz_staging_area.content) + entry->offset);
+
+	// An entry of a previous boot cycle may refer to the offset of a newer element
+	if ((hdr->content.magic != LZ_MAGIC) || (hdr->content.type != entry->type) ||
+		(hdr->content.payload_size != entry->size) ||
+		(lz_staging_nonce_hash(hdr->content.nonce) != entry->nonce_hash)) {
+		return NULL;
+	}
+
+	return hdr;
+}
+
+/**
+ * Returns the number of staging elements indexed by the directory in flash. The entries are only
+ * used if they describe contiguous elements from the start of the staging area, otherwise the
+ * whole staging area is walked. The header of an entry is only checked once the entry is selected
+ * @param cursor Returns the offset behind the last indexed element, where the elements which are
+ * not indexed yet start
+ * @return The number of indexed elements
+ */
+static uint32_t lz_staging_dir_num_indexed(uint32_t *cursor)
+{
+	uint32_t staging_area_size = sizeof(lz_staging_area.content);
+	uint32_t num_entries;
+
+	*cursor = 0;
+	if (!lz_staging_dir_is_valid()) {
+		return 0;
+	}
+
+	for (num_entries = 0; num_entries < lz_staging_area.dir.num_entries; num_entries++) {
+		volatile lz_staging_dir_entry_t *entry = &lz_staging_area.dir.entries[num_entries];
+
+		if ((entry->offset != *cursor) || (entry->size == 0) ||
+			(entry->offset > staging_area_size - sizeof(lz_auth_hdr_t)) ||
+			(entry->size > staging_area_size - sizeof(lz_auth_hdr_t) - entry->offset)) {
+			*cursor = 0;
+			return 0;
+		}
+		*cursor += sizeof(lz_auth_hdr_t) + entry->size;
+	}
+
+	return num_entries;
+}
+
+/**
+ * Walks the headers of the staging elements which are not indexed by the directory, starting
+ * behind the indexed elements, or of all elements if the staging area has no directory
+ * @param cursor Offset of the next element within the staging area content
+ * @return The header of the next element, or NULL if there are no further elements
+ */
+static lz_auth_hdr_t *lz_staging_next_elem(uint32_t *cursor)
+{
+	uint32_t staging_area_size = sizeof(lz_staging_area.content);
+	lz_auth_hdr_t *hdr;
+
+	if (*cursor > staging_area_size - sizeof(lz_auth_hdr_t)) {
+		return NULL;
+	}
+
+	// An element which is still being downloaded is not complete yet
+	if (lz_staging_dir_is_valid() && (lz_staging_area.dir.journal.magic == LZ_MAGIC) &&
+		(lz_staging_area.dir.journal.offset == *cursor)) {
+		return NULL;
+	}
+
+	hdr = (lz_auth_hdr_t *)(((uint32_t)&lz_staging_area.content) + *cursor);
+
+	if ((hdr->content.magic != LZ_MAGIC) || (hdr->content.payload_size == 0) ||
+		(hdr->content.payload_size > staging_area_size - sizeof(lz_auth_hdr_t) - *cursor)) {
+		return NULL;
+	}
+
+	*cursor += sizeof(lz_auth_hdr_t) + hdr->content.payload_size;
+	return hdr;
+}
+
+/**
+ * Fills a directory entry with the values of a staging element header
+ * @param entry The directory entry to be filled
+ * @param hdr The header of the staging element in the staging area
+ */
+static void lz_staging_dir_set_entry(lz_staging_dir_entry_t *entry, lz_auth_hdr_t *hdr)
+{
+	entry->type = hdr->content.type;
+	entry->offset = ((uint32_t)hdr) - ((uint32_t)&lz_staging_area.content);
+	entry->size = hdr->content.payload_size;
+	entry->nonce_hash = lz_staging_nonce_hash(hdr->content.nonce);
+}
+
+/**
+ * Adds a completely written staging element to the directory prepared by
+ * lz_get_next_staging_slot(). The directory is written to flash with the next boot mode request
+ * or journal update, elements written until then are found by lz_staging_next_elem()
+ * @param hdr The header of the staging element in the staging area
+ * @return LZ_SUCCESS, if the directory was written, otherwise LZ_ERROR
+ */
+static LZ_RESULT lz_staging_dir_add_elem(lz_auth_hdr_t *hdr)
+{
+	if ((hdr->content.magic != LZ_MAGIC) || (hdr->content.payload_size == 0)) {
+		dbgprint(DBG_ERR, "ERROR: Staging element at %p has no valid header\n", (void *)hdr);
+		return LZ_ERROR;
+	}
+
+	lz_staging_dir_set_entry(&staging_dir.entries[staging_dir.num_entries++], hdr);
+	staging_dir_pending = true;
+
+	return LZ_SUCCESS;
+}
+
+/**
+ * Writes the directory prepared in RAM to the staging area
+ * @return LZ_SUCCESS, if the directory was written, otherwise LZ_ERROR
+ */
+static LZ_RESULT lz_staging_dir_write(void)
+{
+	if (!lz_flash_write_nse((void *)&lz_staging_area.dir, (void *)&staging_dir,
+							sizeof(staging_dir))) {
+		dbgprint(DBG_ERR, "ERROR: Failed to write staging area directory to flash.\n");
+		return LZ_ERROR;
+	}
+	staging_dir_pending = false;
+
+	return LZ_SUCCESS;
+}
+
+/**
+ * Starts the journal for the staging element which is currently written
+ * @param hdr The header of the staging element as received
+ * @return LZ_SUCCESS, if the journal was written, otherwise LZ_ERROR
+ */
+static LZ_RESULT lz_staging_journal_start(lz_auth_hdr_t *hdr)
+{
+	lz_staging_journal_t *journal = &staging_dir.journal;
+
+	journal->magic = LZ_MAGIC;
+	journal->type = hdr->content.type;
+	journal->offset = (uint32_t)(staging_elem_start - (uint8_t *)&lz_staging_area.content);
+	journal->size = hdr->content.payload_size;
+	journal->written = 0;
+	memcpy(journal->digest, hdr->content.digest, sizeof(journal->digest));
+	staging_elem_journaled = true;
+
+	return lz_staging_dir_write();
+}
+
+/**
+ * Records the progress of the journaled staging element. To limit the flash wear, the journal is
+ * only written every LZ_STAGING_JOURNAL_INTERVAL bytes
+ * @param finished If true, the journal is removed, as the element cannot be continued
+ * @return LZ_SUCCESS, if the journal is up to date, otherwise LZ_ERROR
+ */
+static LZ_RESULT lz_staging_journal_update(bool finished)
+{
+	uint32_t written = (uint32_t)(staging_elem_cursor - staging_elem_start);
+
+	if (!staging_elem_journaled) {
+		return LZ_SUCCESS;
+	}
+
+	if (finished) {
+		staging_dir.journal.magic = 0;
+		staging_elem_journaled = false;
+	} else if (written - staging_dir.journal.written >= LZ_STAGING_JOURNAL_INTERVAL) {
+		staging_dir.journal.written = written;
+	} else {
+		return LZ_SUCCESS;
+	}
+
+	return lz_staging_dir_write();
+}
@@ -21,6 +21,7 @@
 #define LZ_COMMON_H_
 
 #include <time.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "lz_error.h"
 #include "lzport_memory.h"
@@ -53,6 +54,12 @@
 /** The certificate chain consists of the hub cert, DeviceID cert and AliasID cert */
 #define NUM_CERTS (3)
 
+/**
+ * Layout version of the trust anchors and the image certificate store. Version 2 stores public
+ * keys as uncompressed SEC1 points and certificates and CSRs DER encoded (version 1 used PEM)
+ */
+#define LZ_CERT_STORE_VERSION (2)
+
 /**
  * Command that can be sent as payload of a hdr_type_t CMD packet as the payload to
  * acknowledge the reception of a packet
@@ -80,7 +87,9 @@
 	GEN_HDR_TYPE(BOOT_TICKET)                                                                      \
 	GEN_HDR_TYPE(DEFERRAL_TICKET)                                                                  \
 	GEN_HDR_TYPE(CMD)                                                                              \
-	GEN_HDR_TYPE(SENSOR_DATA)
+	GEN_HDR_TYPE(SENSOR_DATA)                                                                      \
+	GEN_HDR_TYPE(DELTA_UPDATE)                                                                     \
+	GEN_HDR_TYPE(DEFERRAL_TICKET_BATCH)
 
 #define GENERATE_ENUM(ENUM) ENUM,
 #define GENERATE_STRING(STRING) #STRING,
@@ -103,12 +112,63 @@ __attribute__((unused)) static const char *HDR_TYPE_STRING[] = { FOREACH_GEN_HDR
  */
 typedef enum { APP, LZ_UDOWNLOADER, LZ_CPATCHER } boot_mode_t;
 
+/** Maximum number of staging elements that can be indexed by the staging area directory */
+#define LZ_STAGING_DIR_MAX_ENTRIES 27
+
+/** Interval in bytes in which the progress of a journaled staging element is written to flash */
+#define LZ_STAGING_JOURNAL_INTERVAL 0x4000
+
+/**
+ * Entry of the staging area directory, describing a single staging element. The nonce hash
+ * allows to skip elements of other boot cycles without reading their headers
+ */
+typedef struct {
+	uint32_t type;		 // hdr_type_t of the staging element
+	uint32_t offset;	 // Offset of the staging element header within the staging area content
+	uint32_t size;		 // Payload size of the staging element
+	uint32_t nonce_hash; // Hash of the nonce of the staging element
+} lz_staging_dir_entry_t;
+
+/**
+ * Journal of a large staging element which is currently being downloaded. It records how much of
+ * the element is already in flash, so that an interrupted download, e.g. through a reset, can be
+ * continued instead of being restarted
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t type;						  // hdr_type_t of the staging element
+	uint32_t offset;					  // Offset of the staging element header
+	uint32_t size;						  // Payload size of the staging element
+	uint32_t written;					  // Bytes of the element (incl. header) in flash
+	uint8_t digest[SHA256_DIGEST_LENGTH]; // Payload digest of the staging element
+} lz_staging_journal_t;
+
 /**
- * Structure that represents the staging area in flash. The last word of the staging area is used
- * to indicate a boot mode request from an upper layer to Dice++ and Lazarus Core
+ * Directory of the staging area, which indexes the staging elements in the order they were
+ * written. Lookups select the entries by type and nonce hash and only read the headers of the
+ * selected elements. To limit the wear of its page, the directory is only written with the boot
+ * mode request and the journal, or when its entries are about to be overwritten, elements behind
+ * the last entry are found through their headers. The directory is written by the untrusted layers
+ * and is therefore only a hint: a selected entry is checked against the staging element header it
+ * refers to before it is used
  */
 typedef struct {
-	uint8_t content[LZ_STAGING_AREA_SIZE - sizeof(uint32_t)];
+	uint32_t magic;
+	uint32_t num_entries;
+	lz_staging_journal_t journal;
+	lz_staging_dir_entry_t entries[LZ_STAGING_DIR_MAX_ENTRIES];
+	uint8_t reserved[FLASH_PAGE_SIZE - (3 * sizeof(uint32_t)) - sizeof(lz_staging_journal_t) -
+					 (LZ_STAGING_DIR_MAX_ENTRIES * sizeof(lz_staging_dir_entry_t))];
+} lz_staging_dir_t;
+
+/**
+ * Structure that represents the staging area in flash. The last page of the staging area holds
+ * the staging area directory. The last word of the staging area is used to indicate a boot mode
+ * request from an upper layer to Dice++ and Lazarus Core
+ */
+typedef struct {
+	uint8_t content[LZ_STAGING_AREA_SIZE - FLASH_PAGE_SIZE];
+	lz_staging_dir_t dir;
 	uint32_t boot_mode_flag;
 } lz_staging_area_t;
 
@@ -149,6 +209,47 @@ typedef struct {
 	lz_ecc_signature signature;
 } lz_auth_hdr_t;
 
+/**
+ * Payload of an update request. If the device holds the beginning of the update from an
+ * interrupted download, it requests only the payload from offset on. The server honours the
+ * offset only if the digest matches its update, otherwise it sends the complete update. If the
+ * base digest is set, the server may send a DELTA_UPDATE against the installed image instead
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t offset;						   // Payload bytes already held by the device
+	uint8_t digest[SHA256_DIGEST_LENGTH];	   // Payload digest of the partial update
+	uint8_t base_digest[SHA256_DIGEST_LENGTH]; // Code digest of the installed image or zero
+} lz_update_request_t;
+
+// Maximum number of deferral tickets the hub issues at once
+#define LZ_MAX_DEFERRAL_BATCH 16
+
+/**
+ * Payload of a DEFERRAL_TICKET_BATCH request
+ */
+typedef struct {
+	uint32_t time_ms; // Requested deferral time of each ticket
+	uint32_t count;	  // Requested number of tickets
+} lz_deferral_batch_request_t;
+
+/**
+ * Payload of a DEFERRAL_TICKET_BATCH response. The tickets are the elements of a hash chain
+ * committed to by the anchor, anchor = SHA256(chain[0]) and chain[i] = SHA256(chain[i + 1]).
+ * Only the first count elements of chain are sent. The AWDT verifies the signature of the batch
+ * once, afterwards each ticket is only checked to hash to its predecessor
+ */
+typedef struct {
+	uint32_t time_ms; // Deferral time of each ticket
+	uint32_t count;	  // Number of tickets
+	uint8_t anchor[SHA256_DIGEST_LENGTH];
+	uint8_t chain[LZ_MAX_DEFERRAL_BATCH][SHA256_DIGEST_LENGTH];
+} lz_deferral_batch_t;
+
+/** Size of the payload of a batch with count tickets */
+#define LZ_DEFERRAL_BATCH_SIZE(count)                                                              \
+	(offsetof(lz_deferral_batch_t, chain) + (count)*SHA256_DIGEST_LENGTH)
+
 /*******************************************
  * Image Header
  *******************************************/
@@ -172,6 +273,61 @@ typedef union {
 	uint8_t u8[0x800];
 } lz_img_hdr_t;
 
+/*******************************************
+ * Compressed Image
+ *******************************************/
+
+/** Magic value of a compressed image */
+#define LZ_COMPRESSED_MAGIC (0x315A4C43)
+/** Size of the window of the compression, i.e. the maximum distance of a match */
+#define LZ_COMPRESSION_WINDOW_SIZE FLASH_PAGE_SIZE
+/** Minimum length of a match of the compression */
+#define LZ_COMPRESSION_MIN_MATCH 3
+
+/**
+ * Header of the compressed code of an image update, which follows the image header instead of
+ * the code. The image header still refers to the uncompressed code. The compressed code is a
+ * sequence of groups of a control byte and eight items. Each bit of the control byte, starting
+ * with the least significant bit, determines whether the corresponding item is a literal byte or
+ * a 16-bit little endian match with the distance - 1 in the lower 9 bits and the length -
+ * LZ_COMPRESSION_MIN_MATCH in the upper 7 bits
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t size; // Size of the compressed code
+} lz_compressed_hdr_t;
+
+/*******************************************
+ * Delta Update
+ *******************************************/
+
+/** Copy len bytes from offset arg of the installed image code */
+#define LZ_DELTA_OP_COPY 0x1
+/** Insert the len bytes following the operation */
+#define LZ_DELTA_OP_DATA 0x2
+/** Insert len times the byte arg */
+#define LZ_DELTA_OP_FILL 0x3
+
+/**
+ * Payload of a DELTA_UPDATE staging element. A delta describes a new signed image (image header
+ * and code) as a sequence of operations on the code of the installed image, which is identified
+ * by the digest in its image header. The operations follow the delta header
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t type;								 // hdr_type_t of the image update
+	uint32_t target_size;						 // Size of the new image incl. image header
+	uint8_t base_digest[SHA256_DIGEST_LENGTH];	 // Code digest of the installed image
+	uint8_t target_digest[SHA256_DIGEST_LENGTH]; // Digest of the new image incl. image header
+} lz_delta_hdr_t;
+
+/** Operation of a delta update */
+typedef struct {
+	uint32_t op;
+	uint32_t len;
+	uint32_t arg;
+} lz_delta_op_t;
+
 /*******************************************
  * Image Certificate Store
  *******************************************/
@@ -185,10 +341,11 @@ typedef struct {
 // Structure that holds the trust anchor's public keys and information to locate the
 // certificates in the certificate bag
 typedef struct {
-	uint32_t magic; // Indicates the next layer that the passed structure is in good state
-	lz_ecc_pub_key_pem dev_pub_key;
-	lz_ecc_pub_key_pem code_auth_pub_key;
-	lz_ecc_pub_key_pem management_pub_key;
+	uint32_t magic;	  // Indicates the next layer that the passed structure is in good state
+	uint32_t version; // LZ_CERT_STORE_VERSION
+	lz_ecc_pub_key_raw dev_pub_key;
+	lz_ecc_pub_key_raw code_auth_pub_key;
+	lz_ecc_pub_key_raw management_pub_key;
 
 	lz_img_cert_index_t certTable[NUM_CERTS]; // Root, DeviceID and AliasID cert
 	uint32_t cursor; // Cursor points to the end of the last element in the certBag
@@ -201,7 +358,7 @@ typedef struct {
  */
 typedef struct {
 	lz_img_cert_store_info_t info;
-	// We place the different PEM-encoded certificate chain into the certBag.
+	// We place the different DER encoded certificate chain into the certBag.
 	// Attention: When adding new certificates, make sure not to exceed the bounds.
 	// Remaining size can e.g., be determined when debugging: sizeof certBag minus cursor position.
 	uint8_t certBag[0x1000 - sizeof(lz_img_cert_store_info_t)];
@@ -213,9 +370,10 @@ typedef struct {
 
 typedef struct {
 	uint32_t magic;
-	lz_ecc_pub_key_pem dev_pub_key;
-	lz_ecc_pub_key_pem code_auth_pub_key;
-	lz_ecc_pub_key_pem management_pub_key;
+	uint32_t version; // LZ_CERT_STORE_VERSION
+	lz_ecc_pub_key_raw dev_pub_key;
+	lz_ecc_pub_key_raw code_auth_pub_key;
+	lz_ecc_pub_key_raw management_pub_key;
 
 	lz_img_cert_index_t certTable[2]; // Hub and DeviceID cert
 	uint32_t cursor;				  // Cursor points to the end of the last element in the certBag
@@ -223,7 +381,7 @@ typedef struct {
 
 typedef struct {
 	trust_anchors_info_t info;
-	// certificate store for all PEM encoded certs
+	// certificate store for all DER encoded certs
 	uint8_t certBag[0x1000 - sizeof(trust_anchors_info_t)];
 } trust_anchors_t;
 
@@ -283,13 +441,14 @@ typedef struct {
 
 typedef struct {
 	uint32_t magic;
-	lz_ecc_pub_key_pem alias_id_keypair_pub;
-	lz_ecc_priv_key_pem alias_id_keypair_priv;
+	lz_ecc_pub_key_raw alias_id_keypair_pub;
+	lz_ecc_priv_key_raw alias_id_keypair_priv;
 	uint8_t cur_nonce[LEN_NONCE];
 	uint8_t next_nonce[LEN_NONCE];
 	uint8_t dev_uuid[LEN_UUID_V4_BIN];
 	bool dev_reassociation_necessary;
 	bool firmware_update_necessary;
+	bool delta_update_failed; // The complete image must be requested instead of a delta
 	uint8_t dev_auth[SHA256_DIGEST_LENGTH];
 	lz_nw_data_info_t nw_data;
 } lz_img_boot_params_info_t;
@@ -351,13 +510,20 @@ LZ_RESULT lz_set_boot_mode_request(boot_mode_t boot_mode_param);
 LZ_RESULT lz_has_valid_boot_params(void);
 LZ_RESULT lz_get_next_staging_hdr(lz_auth_hdr_t **hdr);
 LZ_RESULT lz_get_staging_hdr(hdr_type_t hdr_type, lz_auth_hdr_t **return_hdr, uint8_t *nonce);
+uint32_t lz_get_staging_hdrs(uint8_t *nonce, lz_auth_hdr_t **hdrs, uint32_t max_hdrs);
+uint32_t lz_get_num_staging_elems(void);
 bool lz_dev_reassociation_necessary(void);
 bool lz_firmware_update_necessary(void);
+bool lz_delta_update_failed(void);
 bool lz_is_mem_zero(const void *dataPtr, uint32_t dataSize);
 bool lz_check_update_size(lz_auth_hdr_t *staging_elem_hdr);
+bool lz_check_img_size(hdr_type_t type, uint32_t size);
+volatile lz_img_hdr_t *lz_get_img_hdr(hdr_type_t type);
 void lz_error_handler(void);
 LZ_RESULT
 lz_flash_staging_element(uint8_t *buf, uint32_t buf_size, uint32_t total_size, uint32_t pending);
+LZ_RESULT lz_get_staging_resume_info(hdr_type_t type, uint32_t *offset, uint8_t *digest);
+LZ_RESULT lz_resume_staging_element(lz_auth_hdr_t *hdr);
 void lz_print_img_info(const char *img_name, volatile lz_img_hdr_t *img_hdr);
 
 /**
@@ -40,6 +40,10 @@
 
 #define MAX_SIG_ECP_DER_BYTES 80
 
+// Uncompressed SEC1 point (0x04 | X | Y) and scalar of a secp256r1 key
+#define PUB_ECP_RAW_BYTES 65
+#define PRIV_ECP_RAW_BYTES 32
+
 typedef struct lz_ecc_pub_key_pem {
 	char key[MAX_PUB_ECP_PEM_BYTES];
 	// Length is not needed, since it can be figured out with strnlen(key, MAX_PUB_ECP_PEM_BYTES)-
@@ -50,6 +54,14 @@ typedef struct lz_ecc_priv_key_pem {
 	// Length is not needed, since it can be figured out with strnlen(key, MAX_PUB_ECP_PEM_BYTES)-
 } lz_ecc_priv_key_pem;
 
+typedef struct lz_ecc_pub_key_raw {
+	uint8_t point[PUB_ECP_RAW_BYTES];
+} lz_ecc_pub_key_raw;
+
+typedef struct lz_ecc_priv_key_raw {
+	uint8_t d[PRIV_ECP_RAW_BYTES];
+} lz_ecc_priv_key_raw;
+
 typedef struct lz_ecc_signature {
 	uint8_t sig[MAX_SIG_ECP_DER_BYTES];
 	uint32_t length;
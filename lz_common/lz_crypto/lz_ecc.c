@@ -120,6 +120,73 @@ clean:
 }
 #endif
 
+int lz_pub_key_to_raw(lz_ecc_keypair *keypair, lz_ecc_pub_key_raw *raw)
+{
+	int re = 0;
+	size_t length = 0;
+	mbedtls_ecp_keypair *ec = mbedtls_pk_ec(*keypair);
+
+	CHECK(mbedtls_ecp_point_write_binary(&ec->grp, &ec->Q, MBEDTLS_ECP_PF_UNCOMPRESSED, &length,
+										 raw->point, sizeof(raw->point)),
+		  "Error writing pubkey (raw)");
+	if (length != sizeof(raw->point)) {
+		dbgprint(DBG_INFO, "ERROR: Unexpected length of the raw pubkey\n");
+		re = -1;
+	}
+
+clean:
+	return re;
+}
+
+int lz_priv_key_to_raw(lz_ecc_keypair *keypair, lz_ecc_priv_key_raw *raw)
+{
+	int re = 0;
+
+	CHECK(mbedtls_mpi_write_binary(&mbedtls_pk_ec(*keypair)->d, raw->d, sizeof(raw->d)),
+		  "Error writing privkey (raw)");
+
+clean:
+	return re;
+}
+
+int lz_raw_to_pub_key(lz_ecc_keypair *keypair, const lz_ecc_pub_key_raw *raw)
+{
+	mbedtls_pk_init(keypair);
+	int re = 0;
+
+	CHECK(mbedtls_pk_setup(keypair, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY)),
+		  "Error setting up public key context");
+	mbedtls_ecp_keypair *ec = mbedtls_pk_ec(*keypair);
+	CHECK(mbedtls_ecp_group_load(&ec->grp, MBEDTLS_ECP_DP_SECP256R1), "Error loading ECC group");
+	CHECK(mbedtls_ecp_point_read_binary(&ec->grp, &ec->Q, raw->point, sizeof(raw->point)),
+		  "Error reading the raw pubkey");
+	CHECK(mbedtls_ecp_check_pubkey(&ec->grp, &ec->Q), "Raw pubkey is not on the curve");
+
+clean:
+	if (re < 0) {
+		mbedtls_pk_free(keypair);
+	}
+	return re;
+}
+
+int lz_raw_to_keypair(lz_ecc_keypair *keypair, const lz_ecc_pub_key_raw *pub,
+					  const lz_ecc_priv_key_raw *priv)
+{
+	int re = 0;
+
+	CHECK(lz_raw_to_pub_key(keypair, pub), "Error reading the raw pubkey");
+	mbedtls_ecp_keypair *ec = mbedtls_pk_ec(*keypair);
+	CHECK(mbedtls_mpi_read_binary(&ec->d, priv->d, sizeof(priv->d)),
+		  "Error reading the raw privkey");
+	CHECK(mbedtls_ecp_check_privkey(&ec->grp, &ec->d), "Raw privkey is invalid");
+
+clean:
+	if (re < 0) {
+		mbedtls_pk_free(keypair);
+	}
+	return re;
+}
+
 lz_ecc_private_key *lz_keypair_to_private(lz_ecc_keypair *keypair)
 {
 	return &mbedtls_pk_ec(*keypair)->d;
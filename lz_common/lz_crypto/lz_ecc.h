@@ -73,6 +73,36 @@ int lz_pem_to_pub_key(lz_ecc_keypair *keypair, const lz_ecc_pub_key_pem *pem);
 int lz_pem_to_priv_key(lz_ecc_keypair *keypair, const lz_ecc_priv_key_pem *pem);
 #endif
 
+/**
+ * Exports the public part of the lz_ecc_keypair as uncompressed SEC1 point.
+ * Returns 0 on success. If an error occurs, a negative number will be returned.
+ */
+int lz_pub_key_to_raw(lz_ecc_keypair *keypair, lz_ecc_pub_key_raw *raw);
+
+/**
+ * Exports the private part of the lz_ecc_keypair as big-endian scalar.
+ * Returns 0 on success. If an error occurs, a negative number will be returned.
+ */
+int lz_priv_key_to_raw(lz_ecc_keypair *keypair, lz_ecc_priv_key_raw *raw);
+
+/**
+ * Imports an uncompressed SEC1 point to the public part of an lz_ecc_keypair. The point is
+ * checked to be on the curve.
+ * Returns 0 on success. If an error occurs, a negative number will be returned.
+ *
+ * Note: key must be freed after use using `lz_free_keypair`
+ */
+int lz_raw_to_pub_key(lz_ecc_keypair *keypair, const lz_ecc_pub_key_raw *raw);
+
+/**
+ * Imports a raw public and private key to an lz_ecc_keypair.
+ * Returns 0 on success. If an error occurs, a negative number will be returned.
+ *
+ * Note: key must be freed after use using `lz_free_keypair`
+ */
+int lz_raw_to_keypair(lz_ecc_keypair *keypair, const lz_ecc_pub_key_raw *pub,
+					  const lz_ecc_priv_key_raw *priv);
+
 /**
  * Access function to the private key of a lz keypar
  */
@@ -66,6 +66,20 @@ clean:
 	return re;
 }
 
+int lz_ecdsa_sign_raw(uint8_t *data, size_t data_length, const lz_ecc_pub_key_raw *pub,
+					  const lz_ecc_priv_key_raw *priv, lz_ecc_signature *sig)
+{
+	int re = 0;
+	lz_ecc_keypair keypair;
+	CHECK(lz_raw_to_keypair(&keypair, pub, priv), "Could not import private key.");
+
+	CHECK(lz_ecdsa_sign(data, data_length, &keypair, sig), "Could not sign message");
+
+clean:
+	lz_free_keypair(&keypair);
+	return re;
+}
+
 int lz_ecdsa_verify(uint8_t *data, size_t data_length, lz_ecc_keypair *key_pair,
 					lz_ecc_signature *sig)
 {
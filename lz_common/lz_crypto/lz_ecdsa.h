@@ -40,6 +40,14 @@ int lz_ecdsa_sign(uint8_t *data, size_t data_length, lz_ecc_keypair *key_pair,
 int lz_ecdsa_sign_pem(uint8_t *data, size_t data_length, lz_ecc_priv_key_pem *key,
 					  lz_ecc_signature *sig);
 
+/**
+ * Hashes the data given in data with the length data_length and signs it with the given raw
+ * keypair. Signature will be stored in the sig parameter.
+ * Return 0 on success.
+ */
+int lz_ecdsa_sign_raw(uint8_t *data, size_t data_length, const lz_ecc_pub_key_raw *pub,
+					  const lz_ecc_priv_key_raw *priv, lz_ecc_signature *sig);
+
 /**
  * Verifies the signature sig for data with the length of data_length using key_pair as key.
  * Note: The private part of the key (d) is not used.
@@ -51,6 +51,24 @@ clean:
 	return re;
 }
 
+int lz_sha256_start(lz_sha256_ctx *ctx)
+{
+	mbedtls_sha256_init(ctx);
+	return mbedtls_sha256_starts_ret(ctx, 0);
+}
+
+int lz_sha256_update(lz_sha256_ctx *ctx, const void *data, size_t dataSize)
+{
+	return mbedtls_sha256_update_ret(ctx, data, dataSize);
+}
+
+int lz_sha256_finish(lz_sha256_ctx *ctx, uint8_t *result)
+{
+	int re = mbedtls_sha256_finish_ret(ctx, result);
+	mbedtls_sha256_free(ctx);
+	return re;
+}
+
 #endif
 
 #endif /* MBEDTLS_CONFIG_FILE */
@@ -27,6 +27,9 @@
 #ifdef MBEDTLS_SHA256_C
 
 #include <stdint.h>
+#include "mbedtls/sha256.h"
+
+typedef mbedtls_sha256_context lz_sha256_ctx;
 
 /**
  * Calculates the SHA256 hash of the data buffer and stores it into the result
@@ -43,6 +46,35 @@ int lz_sha256(uint8_t *result, const void *data, size_t dataSize);
 int lz_sha256_two_parts(uint8_t *result, const void *data1, size_t data1Size, const void *data2,
 						size_t data2Size);
 
+/**
+ * Starts a SHA256 hash calculation over data that is not available at once, e.g. because it
+ * is received in chunks
+ * @param[out] ctx The context of the hash calculation
+ *
+ * @return 0 on success. If an error occurred, returns a non-0 int
+ */
+int lz_sha256_start(lz_sha256_ctx *ctx);
+
+/**
+ * Adds data to a SHA256 hash calculation started with lz_sha256_start()
+ * @param[in] ctx      The context of the hash calculation
+ * @param[in] data     The data to be added
+ * @param[in] dataSize The size of the data buffer
+ *
+ * @return 0 on success. If an error occurred, returns a non-0 int
+ */
+int lz_sha256_update(lz_sha256_ctx *ctx, const void *data, size_t dataSize);
+
+/**
+ * Finishes a SHA256 hash calculation and stores the hash into the result buffer
+ * @param[in]  ctx    The context of the hash calculation
+ * @param[out] result The buffer in which the result will be stored (must be
+ *                    at least SHA256_DIGEST_SIZE (32) bytes large)
+ *
+ * @return 0 on success. If an error occurred, returns a non-0 int
+ */
+int lz_sha256_finish(lz_sha256_ctx *ctx, uint8_t *result);
+
 #endif
 
 #endif /* MBEDTLS_CONFIG_FILE */
@@ -24,12 +24,15 @@
 #if defined(MBEDTLS_X509_USE_C) && defined(MBEDTLS_X509_CREATE_C)
 
 #include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include "mbedtls/x509.h"
 #include "mbedtls/x509_crt.h"
 #include "mbedtls/x509_csr.h"
 #include "mbedtls/ecdsa.h"
 #include "mbedtls/pk.h"
+#include "mbedtls/pem.h"
 
 #include "lz_config.h"
 #include "lz_crypto_common.h"
@@ -56,8 +59,8 @@ int lz_x509_dn_to_string(const lz_x509_dn_info *info, char *buf, size_t buf_size
 	return n;
 }
 
-int lz_write_csr_to_pem(const lz_x509_csr_info *info, lz_ecc_keypair *keypair, unsigned char *buf,
-						size_t buf_size)
+static int lz_write_csr(const lz_x509_csr_info *info, lz_ecc_keypair *keypair, unsigned char *buf,
+						size_t buf_size, bool der)
 {
 	mbedtls_x509write_csr req;
 	mbedtls_x509write_csr_init(&req);
@@ -79,9 +82,15 @@ int lz_write_csr_to_pem(const lz_x509_csr_info *info, lz_ecc_keypair *keypair, u
 	CHECK(mbedtls_x509write_csr_set_subject_name(&req, dn_buf),
 		  "Error setting subject name for CSR");
 
-	// Writing to the buffer
-	CHECK(mbedtls_x509write_csr_pem(&req, buf, buf_size, lz_rand, NULL),
-		  "Error while writing CSR as DER");
+	// Writing to the buffer. mbedtls writes DER structures to the end of the buffer
+	if (der) {
+		CHECK(mbedtls_x509write_csr_der(&req, buf, buf_size, lz_rand, NULL),
+			  "Error while writing CSR as DER");
+		memmove(buf, buf + buf_size - re, re);
+	} else {
+		CHECK(mbedtls_x509write_csr_pem(&req, buf, buf_size, lz_rand, NULL),
+			  "Error while writing CSR as PEM");
+	}
 
 clean:
 	free(dn_buf);
@@ -89,8 +98,8 @@ clean:
 	return re;
 }
 
-int lz_write_cert_to_pem(const lz_x509_cert_info *info, lz_ecc_keypair *subject_keys,
-						 lz_ecc_keypair *issuer_keys, unsigned char *buf, size_t buf_size)
+static int lz_write_cert(const lz_x509_cert_info *info, lz_ecc_keypair *subject_keys,
+						 lz_ecc_keypair *issuer_keys, unsigned char *buf, size_t buf_size, bool der)
 {
 	mbedtls_x509write_cert cert;
 	mbedtls_x509write_crt_init(&cert);
@@ -134,8 +143,14 @@ int lz_write_cert_to_pem(const lz_x509_cert_info *info, lz_ecc_keypair *subject_
 	// TODO: Add extKeyUsage to id-kp-clientAuth
 	// CHECK(mbedtls_x509write_crt_set_extension(&cert,), "Failed setting the key usage in cert");
 
-	CHECK(mbedtls_x509write_crt_pem(&cert, buf, buf_size, lz_rand, 0),
-		  "Failed writing the cert as pem");
+	if (der) {
+		CHECK(mbedtls_x509write_crt_der(&cert, buf, buf_size, lz_rand, 0),
+			  "Failed writing the cert as der");
+		memmove(buf, buf + buf_size - re, re);
+	} else {
+		CHECK(mbedtls_x509write_crt_pem(&cert, buf, buf_size, lz_rand, 0),
+			  "Failed writing the cert as pem");
+	}
 
 	// Signed von der device ID
 
@@ -148,6 +163,71 @@ clean:
 	return re;
 }
 
+int lz_write_csr_to_pem(const lz_x509_csr_info *info, lz_ecc_keypair *keypair, unsigned char *buf,
+						size_t buf_size)
+{
+	return lz_write_csr(info, keypair, buf, buf_size, false);
+}
+
+int lz_write_csr_to_der(const lz_x509_csr_info *info, lz_ecc_keypair *keypair, unsigned char *buf,
+						size_t buf_size)
+{
+	return lz_write_csr(info, keypair, buf, buf_size, true);
+}
+
+int lz_write_cert_to_pem(const lz_x509_cert_info *info, lz_ecc_keypair *subject_keys,
+						 lz_ecc_keypair *issuer_keys, unsigned char *buf, size_t buf_size)
+{
+	return lz_write_cert(info, subject_keys, issuer_keys, buf, buf_size, false);
+}
+
+int lz_write_cert_to_der(const lz_x509_cert_info *info, lz_ecc_keypair *subject_keys,
+						 lz_ecc_keypair *issuer_keys, unsigned char *buf, size_t buf_size)
+{
+	return lz_write_cert(info, subject_keys, issuer_keys, buf, buf_size, true);
+}
+
+#ifdef MBEDTLS_PEM_PARSE_C
+
+int lz_pem_to_der(const unsigned char *pem, size_t pem_len, unsigned char *buf, size_t buf_size)
+{
+	static const char *labels[][2] = {
+		{ "-----BEGIN CERTIFICATE-----", "-----END CERTIFICATE-----" },
+		{ "-----BEGIN CERTIFICATE REQUEST-----", "-----END CERTIFICATE REQUEST-----" },
+	};
+	mbedtls_pem_context ctx;
+	size_t use_len;
+	char *pem_buf = 0;
+	int re = -1;
+
+	// mbedtls parses PEM as a string
+	pem_buf = malloc(pem_len + 1);
+	if (!pem_buf) {
+		return -1;
+	}
+	memcpy(pem_buf, pem, pem_len);
+	pem_buf[pem_len] = '\0';
+
+	for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); i++) {
+		mbedtls_pem_init(&ctx);
+		if (mbedtls_pem_read_buffer(&ctx, labels[i][0], labels[i][1],
+									(const unsigned char *)pem_buf, NULL, 0, &use_len) == 0) {
+			if (ctx.buflen <= buf_size) {
+				memcpy(buf, ctx.buf, ctx.buflen);
+				re = (int)ctx.buflen;
+			}
+			mbedtls_pem_free(&ctx);
+			break;
+		}
+		mbedtls_pem_free(&ctx);
+	}
+
+	free(pem_buf);
+	return re;
+}
+
+#endif
+
 #ifdef MBEDTLS_HKDF_C
 
 int lz_set_serial_number_csr(lz_x509_csr_info *info, const unsigned char *salt, size_t salt_len)
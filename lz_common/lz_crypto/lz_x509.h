@@ -61,10 +61,28 @@ typedef struct {
 int lz_write_csr_to_pem(const lz_x509_csr_info *info, lz_ecc_keypair *keypair, unsigned char *buf,
 						size_t buf_size);
 
+// Writes and signs an lz_x509_csr_info struct to the start of a buffer in DER format.
+// Returns the length of the CSR on success
+int lz_write_csr_to_der(const lz_x509_csr_info *info, lz_ecc_keypair *keypair, unsigned char *buf,
+						size_t buf_size);
+
 // Writes and signs an lz_x509_cert_info struct to a buffer in PEM format.
 int lz_write_cert_to_pem(const lz_x509_cert_info *info, lz_ecc_keypair *subject_keys,
 						 lz_ecc_keypair *issuer_keys, unsigned char *buf, size_t buf_size);
 
+// Writes and signs an lz_x509_cert_info struct to the start of a buffer in DER format.
+// Returns the length of the certificate on success
+int lz_write_cert_to_der(const lz_x509_cert_info *info, lz_ecc_keypair *subject_keys,
+						 lz_ecc_keypair *issuer_keys, unsigned char *buf, size_t buf_size);
+
+#ifdef MBEDTLS_PEM_PARSE_C
+
+// Converts a PEM encoded certificate or CSR, which need not be null terminated, to DER.
+// Returns the length of the DER encoding on success
+int lz_pem_to_der(const unsigned char *pem, size_t pem_len, unsigned char *buf, size_t buf_size);
+
+#endif
+
 #ifdef MBEDTLS_HKDF_C
 
 // Sets the serial number of a csr using a given salt
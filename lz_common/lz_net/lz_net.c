@@ -38,10 +38,20 @@
 // Currently the maximum size of an ESP packet
 #define MAX_CERT_SIZE 1460
 
-static LZ_RESULT lz_net_request(char *ip_addr, uint32_t port, const uint8_t *request,
-								uint32_t request_size, uint8_t *response, uint32_t response_size);
+// Within a session, all requests use socket 0, which stays open until the session ends
+static bool session_active = false;
+static bool socket_connected = false;
 
-static LZ_RESULT lz_net_update(hdr_type_t update_type, uint8_t *payload, uint32_t payload_size);
+static LZ_RESULT lz_net_connect(uint32_t timeout_ms);
+static void lz_net_disconnect(void);
+static LZ_RESULT lz_net_send(const lzport_iovec_t *request, uint32_t request_cnt,
+							 uint32_t timeout_ms);
+
+static LZ_RESULT lz_net_request(const lzport_iovec_t *request, uint32_t request_cnt,
+								const lzport_iovec_t *response, uint32_t response_cnt);
+
+static LZ_RESULT lz_net_update(hdr_type_t update_type, const lzport_iovec_t *payload,
+							   uint32_t payload_cnt, uint32_t resume_offset);
 
 LZ_RESULT lz_net_init(void)
 {
@@ -69,6 +79,17 @@ LZ_RESULT lz_net_init(void)
 	return result;
 }
 
+void lz_net_begin_session(void)
+{
+	session_active = true;
+}
+
+void lz_net_end_session(void)
+{
+	session_active = false;
+	lz_net_disconnect();
+}
+
 LZ_RESULT lz_net_send_data(uint8_t *data, uint32_t data_size)
 {
 	LZ_RESULT result = LZ_ERROR;
@@ -128,8 +149,7 @@ LZ_RESULT lz_net_send_alias_id_cert(void)
 	if (TCP_CMD_ACK == response_payload) {
 		dbgprint(DBG_INFO, "INFO: Successfully sent AliasID certificate\n");
 	} else if (response_payload == TCP_CMD_NAK) {
-		dbgprint(DBG_INFO, "INFO: Received response NAK. Server refused to update certificate\n",
-				 response_payload);
+		dbgprint(DBG_INFO, "INFO: Received response NAK. Server refused to update certificate\n");
 		goto exit;
 	} else {
 		dbgprint(DBG_INFO, "INFO: Updating AliasID not successful. Received response %d\n",
@@ -223,26 +243,82 @@ exit:
 	return result;
 }
 
+LZ_RESULT lz_net_refresh_awdt_batch(uint32_t requested_time_ms, uint32_t count,
+									 lz_deferral_batch_t *batch)
+{
+	LZ_RESULT result = LZ_ERROR;
+
+	dbgprint(DBG_INFO, "INFO: Generating request for %d tickets with nonce..\n", count);
+
+	lz_deferral_batch_request_t batch_request = { .time_ms = requested_time_ms, .count = count };
+	lz_auth_hdr_t element_request = { 0 };
+	lz_auth_hdr_t element_response = { 0 };
+	element_request.content.magic = LZ_MAGIC;
+	element_request.content.payload_size = sizeof(batch_request);
+	lz_get_uuid(element_request.content.uuid);
+	element_request.content.type = DEFERRAL_TICKET_BATCH;
+	if (lz_awdt_get_nonce_nse(element_request.content.nonce) != LZ_SUCCESS) {
+		dbgprint(DBG_INFO, "ERROR: Failed to get nonce from AWDT\n");
+		goto exit;
+	}
+
+	if (lz_request_auth_element(&element_request, (uint8_t *)&batch_request, &element_response,
+								(uint8_t *)batch, sizeof(lz_deferral_batch_t)) != LZ_SUCCESS) {
+		dbgprint(DBG_WARN, "WARN: Failed to retrieve ticket batch from backend\n");
+		goto exit;
+	}
+
+	dbgprint(DBG_INFO, "INFO: Received %d tickets from backend with deferral time %d\n",
+			 batch->count, batch->time_ms);
+
+	if (lz_awdt_put_ticket_batch_nse(&element_response, batch) != LZ_SUCCESS) {
+		dbgprint(DBG_WARN, "WARN: AWDT did not accept ticket batch\n");
+		goto exit;
+	}
+
+	result = LZ_SUCCESS;
+
+exit:
+	return result;
+}
+
 LZ_RESULT lz_net_fw_update(hdr_type_t update_type)
 {
-	// For now, just a dummy payload is sent as payload cannot be zero
-	uint32_t payload = LZ_MAGIC;
-	uint32_t payload_size = 0x4;
+	lz_update_request_t request = { 0 };
+	volatile lz_img_hdr_t *img_hdr = lz_get_img_hdr(update_type);
+	request.magic = LZ_MAGIC;
+
+	// A delta update can only be applied if the installed image is intact. If Lazarus Core could
+	// not apply the last delta, the complete image is requested, as the hub would send the same
+	// delta again
+	if ((img_hdr != NULL) && !lz_firmware_update_necessary() && !lz_delta_update_failed()) {
+		memcpy(request.base_digest, (void *)img_hdr->hdr.content.digest,
+			   sizeof(request.base_digest));
+	}
 
-	return lz_net_update(update_type, (uint8_t *)&payload, payload_size);
+	// Only request the remainder if a previous download of the update was interrupted
+	if (lz_get_staging_resume_info(update_type, &request.offset, request.digest) ==
+		LZ_SUCCESS) {
+		dbgprint(DBG_INFO, "INFO: Continuing interrupted download at offset %d\n",
+				 request.offset);
+	}
+
+	lzport_iovec_t payload = { .base = &request, .len = sizeof(request) };
+
+	return lz_net_update(update_type, &payload, 1, request.offset);
 }
 
 LZ_RESULT lz_net_reassociate_device(uint8_t *dev_uuid, uint8_t *dev_auth, uint8_t *device_id_csr,
 									uint32_t device_id_csr_size)
 {
-	// TODO scatter-list style handover of parameters to send function
-	uint8_t buf[LEN_UUID_V4_BIN + SHA256_DIGEST_LENGTH + device_id_csr_size];
-	memcpy((void *)buf, (void *)dev_uuid, LEN_UUID_V4_BIN);
-	memcpy((void *)(buf + LEN_UUID_V4_BIN), (void *)dev_auth, SHA256_DIGEST_LENGTH);
-	memcpy((void *)(buf + LEN_UUID_V4_BIN + SHA256_DIGEST_LENGTH), (void *)device_id_csr,
-		   device_id_csr_size);
-
-	return lz_net_update(DEVICE_ID_REASSOC_REQ, buf, sizeof(buf));
+	// payload = dev_uuid | dev_auth | DeviceID CSR
+	lzport_iovec_t payload[] = {
+		{ .base = dev_uuid, .len = LEN_UUID_V4_BIN },
+		{ .base = dev_auth, .len = SHA256_DIGEST_LENGTH },
+		{ .base = device_id_csr, .len = device_id_csr_size },
+	};
+
+	return lz_net_update(DEVICE_ID_REASSOC_REQ, payload, sizeof(payload) / sizeof(payload[0]), 0);
 }
 
 LZ_RESULT lz_request_element(hdr_t *request_hdr, uint8_t *request_payload, hdr_t *response_hdr,
@@ -250,31 +326,28 @@ LZ_RESULT lz_request_element(hdr_t *request_hdr, uint8_t *request_payload, hdr_t
 {
 	LZ_RESULT result = LZ_ERROR;
 
-	// tcp buffer to send and receive: header + payload
-	uint8_t tcp_buf[sizeof(hdr_t) + request_hdr->payload_size];
-	memcpy((void *)tcp_buf, (void *)request_hdr, sizeof(hdr_t));
-	memcpy((void *)(tcp_buf + sizeof(hdr_t)), (void *)request_payload, request_hdr->payload_size);
-
-	uint8_t tcp_buf_response[sizeof(hdr_t) + response_payload_size];
-
-	if (lz_net_request((char *)lz_data_store.config_data.nw_info.server_ip_addr,
-					   lz_data_store.config_data.nw_info.server_port, tcp_buf, sizeof(tcp_buf),
-					   tcp_buf_response, sizeof(tcp_buf_response)) != LZ_SUCCESS) {
+	// Header and payload are sent from and received to their original location
+	lzport_iovec_t request[] = {
+		{ .base = request_hdr, .len = sizeof(hdr_t) },
+		{ .base = request_payload, .len = request_hdr->payload_size },
+	};
+	lzport_iovec_t response[] = {
+		{ .base = response_hdr, .len = sizeof(hdr_t) },
+		{ .base = response_payload, .len = response_payload_size },
+	};
+
+	if (lz_net_request(request, 2, response, 2) != LZ_SUCCESS) {
 		dbgprint(DBG_ERR, "ERROR: Failed to receive data from network\n");
 		result = LZ_ERROR;
 		goto exit;
 	}
 
-	memcpy(response_hdr, tcp_buf_response, sizeof(hdr_t));
-
 	if (response_payload_size < response_hdr->payload_size) {
 		dbgprint(DBG_ERR, "ERROR: Specified response payload buffer too small\n");
 		result = LZ_ERROR;
 		goto exit;
 	}
 
-	memcpy(response_payload, tcp_buf_response + sizeof(hdr_t), response_hdr->payload_size);
-
 	result = LZ_SUCCESS;
 
 exit:
@@ -295,11 +368,15 @@ LZ_RESULT lz_request_auth_element(lz_auth_hdr_t *request_hdr, uint8_t *request_p
 {
 	LZ_RESULT result = LZ_ERROR;
 
-	// tcp buffer to send TODO lz_net_request should take buffer list
-	uint8_t tcp_buf[sizeof(lz_auth_hdr_t) + request_hdr->content.payload_size];
-
-	// tcp buffer to receive TODO lz_net_request should take buffer list
-	uint8_t tcp_buf_response[sizeof(lz_auth_hdr_t) + response_payload_size];
+	// Header and payload are sent from and received to their original location
+	lzport_iovec_t request[] = {
+		{ .base = request_hdr, .len = sizeof(lz_auth_hdr_t) },
+		{ .base = request_payload, .len = request_hdr->content.payload_size },
+	};
+	lzport_iovec_t response[] = {
+		{ .base = response_hdr, .len = sizeof(lz_auth_hdr_t) },
+		{ .base = response_payload, .len = response_payload_size },
+	};
 
 	dbgprint(DBG_INFO, "INFO: Signing request with AliasID..\n");
 
@@ -315,12 +392,13 @@ LZ_RESULT lz_request_auth_element(lz_auth_hdr_t *request_hdr, uint8_t *request_p
 	lz_ecc_signature ecc_sig;
 
 	int status =
-		lz_ecdsa_sign_pem((void *)&request_hdr->content, sizeof(request_hdr->content),
-						  (lz_ecc_priv_key_pem *)&lz_img_boot_params.info.alias_id_keypair_priv,
+		lz_ecdsa_sign_raw((void *)&request_hdr->content, sizeof(request_hdr->content),
+						  (lz_ecc_pub_key_raw *)&lz_img_boot_params.info.alias_id_keypair_pub,
+						  (lz_ecc_priv_key_raw *)&lz_img_boot_params.info.alias_id_keypair_priv,
 						  &ecc_sig);
 
 	if (0 != status) {
-		dbgprint(DBG_ERR, "ERROR: lz_ecdsa_sign_pem\n");
+		dbgprint(DBG_ERR, "ERROR: lz_ecdsa_sign_raw\n");
 		result = LZ_ERROR;
 		goto exit;
 	}
@@ -330,29 +408,22 @@ LZ_RESULT lz_request_auth_element(lz_auth_hdr_t *request_hdr, uint8_t *request_p
 
 	dbgprint(DBG_INFO, "INFO: Sending request to backend..\n");
 
-	// Send header + payload
-	memcpy((void *)tcp_buf, (void *)request_hdr, sizeof(lz_auth_hdr_t));
-	memcpy((void *)(tcp_buf + sizeof(lz_auth_hdr_t)), request_payload,
-		   request_hdr->content.payload_size);
-
 	// Timestamp 2 (falling edge) - begin network
 #if (1 == LZ_DBG_TRACE_DEFERRAL_ACTIVE)
 	lzport_gpio_toggle_trace();
 #endif
 
-	if (lz_net_request((char *)lz_data_store.config_data.nw_info.server_ip_addr,
-					   lz_data_store.config_data.nw_info.server_port, tcp_buf, sizeof(tcp_buf),
-					   tcp_buf_response, sizeof(tcp_buf_response)) != LZ_SUCCESS) {
+	if (lz_net_request(request, 2, response, 2) != LZ_SUCCESS) {
 		dbgprint(DBG_ERR, "ERROR: Failed to send and receive data via TCP\n");
 		result = LZ_ERROR;
 		goto exit;
 	}
 
-	// Copy header and payload
-	memcpy(response_hdr, tcp_buf_response, sizeof(lz_auth_hdr_t));
-	// Received payload must be equally sized, create generic function for all payloads
-	memcpy(response_payload, tcp_buf_response + sizeof(lz_auth_hdr_t),
-		   response_hdr->content.payload_size);
+	if (response_payload_size < response_hdr->content.payload_size) {
+		dbgprint(DBG_ERR, "ERROR: Specified response payload buffer too small\n");
+		result = LZ_ERROR;
+		goto exit;
+	}
 
 	result = LZ_SUCCESS;
 
@@ -360,68 +431,157 @@ exit:
 	return result;
 }
 
-static LZ_RESULT lz_net_request(char *ip_addr, uint32_t port, const uint8_t *request,
-								uint32_t request_size, uint8_t *response, uint32_t response_size)
+static LZ_RESULT lz_net_connect(uint32_t timeout_ms)
+{
+	if (socket_connected) {
+		return LZ_SUCCESS;
+	}
+
+	if (lzport_socket_open(0, (char *)lz_data_store.config_data.nw_info.server_ip_addr,
+						   lz_data_store.config_data.nw_info.server_port,
+						   timeout_ms) != LZ_SUCCESS) {
+		dbgprint(DBG_WARN, "WARN: Failed to open socket\n");
+		return LZ_ERROR;
+	}
+
+	socket_connected = true;
+
+	return LZ_SUCCESS;
+}
+
+static void lz_net_disconnect(void)
+{
+	if (!socket_connected) {
+		return;
+	}
+
+	dbgprint(DBG_NW, "INFO: NET - Closing socket\n");
+
+	if (lzport_socket_close(0, TIMEOUT_TCP_MS) != LZ_SUCCESS) {
+		dbgprint(DBG_WARN, "WARN: Failed to close socket\n");
+	}
+
+	socket_connected = false;
+}
+
+static LZ_RESULT lz_net_send(const lzport_iovec_t *request, uint32_t request_cnt,
+							 uint32_t timeout_ms)
+{
+	bool reused = socket_connected;
+
+	if (lz_net_connect(timeout_ms) != LZ_SUCCESS) {
+		return LZ_ERROR;
+	}
+
+	if (lzport_socket_sendv(0, request, request_cnt, TIMEOUT_TCP_MS) == LZ_SUCCESS) {
+		return LZ_SUCCESS;
+	}
+
+	if (!reused) {
+		dbgprint(DBG_NW, "WARN: Failed to send to socket\n");
+		return LZ_ERROR;
+	}
+
+	// The hub closes idle connections. If the request cannot be sent on the connection of the
+	// session, it did not reach the hub and is sent once more on a new connection
+	dbgprint(DBG_NW, "INFO: NET - Session connection lost, reconnecting\n");
+	lz_net_disconnect();
+
+	if ((lz_net_connect(timeout_ms) != LZ_SUCCESS) ||
+		(lzport_socket_sendv(0, request, request_cnt, TIMEOUT_TCP_MS) != LZ_SUCCESS)) {
+		dbgprint(DBG_NW, "WARN: Failed to send to socket\n");
+		return LZ_ERROR;
+	}
+
+	return LZ_SUCCESS;
+}
+
+static LZ_RESULT lz_net_request(const lzport_iovec_t *request, uint32_t request_cnt,
+								const lzport_iovec_t *response, uint32_t response_cnt)
 {
 	LZ_RESULT result = LZ_ERROR;
 	uint32_t received;
-	if (lzport_socket_open(0, ip_addr, port, TIMEOUT_TCP_MS) != LZ_SUCCESS) {
-		dbgprint(DBG_WARN, "WARN: Failed to open socket\n");
+
+	if (lz_net_send(request, request_cnt, TIMEOUT_TCP_MS) != LZ_SUCCESS) {
 		result = LZ_ERROR;
 		goto exit;
 	}
 
-	if (lzport_socket_send(0, (unsigned char *)request, request_size, TIMEOUT_TCP_MS) ==
+	if (lzport_socket_receivev(0, response, response_cnt, TIMEOUT_TCP_MS, &received) ==
 		LZ_SUCCESS) {
-		if (lzport_socket_receive(0, response, response_size, TIMEOUT_TCP_MS, &received) ==
-			LZ_SUCCESS) {
-			dbgprint(DBG_NW, "INFO: Successfully received data from networkr\n");
-			result = LZ_SUCCESS;
-		}
+		dbgprint(DBG_NW, "INFO: Successfully received data from networkr\n");
+		result = LZ_SUCCESS;
 	} else {
 		dbgprint(DBG_NW, "WARN: Failed to receive from socket\n");
 		result = LZ_ERROR;
 	}
 
-	dbgprint(DBG_NW, "INFO: NET - Closing socket\n");
-
-	if (lzport_socket_close(0, TIMEOUT_TCP_MS) != LZ_SUCCESS) {
-		dbgprint(DBG_WARN, "WARN: Failed to close socket\n");
+exit:
+	// After a failure, the state of the connection is unknown
+	if (!session_active || (result != LZ_SUCCESS)) {
+		lz_net_disconnect();
 	}
 
-exit:
 	return result;
 }
 
-uint8_t buf[4 * 1460] = { 0 }; // TODO magic number -> maximum of IPD receive
+// Maximum number of payload buffers of an update request
+#define MAX_UPDATE_REQUEST_IOV 3
+
+// Receive buffer of the update, which is written to the staging area in chunks
+static uint8_t buf[4 * 1460] = { 0 }; // TODO magic number -> maximum of IPD receive
 
 // TODO consider using generic element request function (first adjust it to be capable
 // of variable payload lengths)
-LZ_RESULT lz_net_update(hdr_type_t update_type, uint8_t *payload, uint32_t payload_size)
+// If resume_offset is not zero, the server continues an interrupted download and only sends the
+// payload from resume_offset on, provided that it still has the same update
+static LZ_RESULT lz_net_update(hdr_type_t update_type, const lzport_iovec_t *payload,
+							   uint32_t payload_cnt, uint32_t resume_offset)
 {
 	lz_auth_hdr_t fw_update_request_hdr = { 0 };
+	lzport_iovec_t request[1 + MAX_UPDATE_REQUEST_IOV];
+	lz_sha256_ctx ctx;
 	LZ_RESULT result = LZ_ERROR;
 
+	if (payload_cnt > MAX_UPDATE_REQUEST_IOV) {
+		dbgprint(DBG_ERR, "ERROR: Too many payload buffers of update request\n");
+		return LZ_ERROR;
+	}
+
 	fw_update_request_hdr.content.magic = LZ_MAGIC;
 	memcpy((void *)fw_update_request_hdr.content.nonce, (void *)lz_img_boot_params.info.next_nonce,
 		   LEN_NONCE);
 	fw_update_request_hdr.content.type = update_type;
-	fw_update_request_hdr.content.payload_size = payload_size;
 	lz_get_uuid(fw_update_request_hdr.content.uuid);
 
-	// Hash the payload of the ticket (which is only the requested time)
-	if (lz_sha256(fw_update_request_hdr.content.digest, payload,
-				  fw_update_request_hdr.content.payload_size) != 0) {
+	// The request is sent from the original locations of the header and the payload buffers
+	request[0].base = &fw_update_request_hdr;
+	request[0].len = sizeof(lz_auth_hdr_t);
+
+	// Hash the payload of the request
+	if (lz_sha256_start(&ctx) != 0) {
 		dbgprint(DBG_ERR, "ERROR: Failed to hash payload of ticket\n");
-		result = LZ_ERROR;
-		return result;
+		return LZ_ERROR;
+	}
+	for (uint32_t i = 0; i < payload_cnt; i++) {
+		if (lz_sha256_update(&ctx, payload[i].base, payload[i].len) != 0) {
+			dbgprint(DBG_ERR, "ERROR: Failed to hash payload of ticket\n");
+			return LZ_ERROR;
+		}
+		fw_update_request_hdr.content.payload_size += payload[i].len;
+		request[1 + i] = payload[i];
+	}
+	if (lz_sha256_finish(&ctx, fw_update_request_hdr.content.digest) != 0) {
+		dbgprint(DBG_ERR, "ERROR: Failed to hash payload of ticket\n");
+		return LZ_ERROR;
 	}
 
 	// Sign the request
 	lz_ecc_signature alias_id_sig;
-	if (0 != lz_ecdsa_sign_pem(
+	if (0 != lz_ecdsa_sign_raw(
 				 (uint8_t *)&fw_update_request_hdr.content, sizeof(fw_update_request_hdr.content),
-				 (lz_ecc_priv_key_pem *)&lz_img_boot_params.info.alias_id_keypair_priv,
+				 (lz_ecc_pub_key_raw *)&lz_img_boot_params.info.alias_id_keypair_pub,
+				 (lz_ecc_priv_key_raw *)&lz_img_boot_params.info.alias_id_keypair_priv,
 				 &alias_id_sig)) {
 		dbgprint(DBG_ERR, "ERROR: Failed to sign update request\n");
 		result = LZ_ERROR;
@@ -432,21 +592,8 @@ LZ_RESULT lz_net_update(hdr_type_t update_type, uint8_t *payload, uint32_t paylo
 
 	dbgprint(DBG_INFO, "INFO: Request %s update from server..\n", HDR_TYPE_STRING[update_type]);
 
-	if (lzport_socket_open(0, (char *)lz_data_store.config_data.nw_info.server_ip_addr,
-						   lz_data_store.config_data.nw_info.server_port,
-						   TIMEOUT_SOCKET_OPEN_MS) != LZ_SUCCESS) {
-		dbgprint(DBG_ERR, "ERROR: Failed to open socket\n");
-		result = LZ_ERROR;
-		goto exit;
-	}
-
-	// Copy header and payload into buf
-	memcpy((void *)buf, (void *)&fw_update_request_hdr, sizeof(lz_auth_hdr_t));
-	memcpy((void *)(buf + sizeof(lz_auth_hdr_t)), (void *)payload, payload_size);
-
 	// Send update request
-	if (lzport_socket_send(0, buf, sizeof(lz_auth_hdr_t) + payload_size, TIMEOUT_TCP_MS) !=
-		LZ_SUCCESS) {
+	if (lz_net_send(request, 1 + payload_cnt, TIMEOUT_SOCKET_OPEN_MS) != LZ_SUCCESS) {
 		dbgprint(DBG_WARN, "WARN: Failed to send data\n");
 		result = LZ_ERROR;
 		goto exit;
@@ -463,6 +610,8 @@ LZ_RESULT lz_net_update(hdr_type_t update_type, uint8_t *payload, uint32_t paylo
 	uint32_t previous_progress = 0;
 	do {
 		uint32_t received_packet;
+		// Bytes at the beginning of the packet which must not be written to the staging element
+		uint32_t skip = 0;
 
 		dbgprint(DBG_NW, "INFO: Receiving FW update chunk\n");
 		if (lzport_socket_receive(0, buf, sizeof(buf), TIMEOUT_RECEIVE_FW_MS, &received_packet) !=
@@ -477,9 +626,36 @@ LZ_RESULT lz_net_update(hdr_type_t update_type, uint8_t *payload, uint32_t paylo
 
 			memcpy((void *)&fw_update_response_hdr, (void *)buf, sizeof(lz_auth_hdr_t));
 
+			// The hub refuses the request if the installed image is up to date or the update
+			// must be requested again later
+			if (fw_update_response_hdr.content.type == CMD) {
+				dbgprint(DBG_INFO, "INFO: Hub has no %s update for the device\n",
+						 HDR_TYPE_STRING[update_type]);
+				result = LZ_NOT_FOUND;
+				goto exit;
+			}
+
 			total_size = fw_update_response_hdr.content.payload_size + sizeof(lz_auth_hdr_t);
 			pending = total_size;
 
+			// The server only sends the remainder if it has the same update. In this case the
+			// header is written by lz_resume_staging_element and the payload continues at offset
+			if (resume_offset != 0) {
+				result = lz_resume_staging_element(&fw_update_response_hdr);
+				if (result == LZ_SUCCESS) {
+					dbgprint(DBG_INFO, "INFO: Resuming download at offset %d\n", resume_offset);
+					skip = sizeof(lz_auth_hdr_t);
+					pending = total_size - sizeof(lz_auth_hdr_t) - resume_offset;
+					received_total = resume_offset;
+				} else if (result == LZ_NOT_FOUND) {
+					dbgprint(DBG_INFO, "INFO: Update changed, downloading it completely\n");
+				} else {
+					dbgprint(DBG_ERR, "ERROR: Failed to resume download\n");
+					goto exit;
+				}
+				result = LZ_ERROR;
+			}
+
 			// Print staging header info
 			dbgprint(DBG_INFO,
 					 "INFO: Received header: %s, total size %d payload size %d, "
@@ -491,25 +667,28 @@ LZ_RESULT lz_net_update(hdr_type_t update_type, uint8_t *payload, uint32_t paylo
 			dbgprint(DBG_INFO, "INFO: Receiving the update (this may take a while)\n");
 		}
 
-		// Set RTS to signal the ESP8266 to pause sending as data cannot be received while writing to flash
-		lzport_gpio_set_rts(true);
+		// Data cannot be received while writing to flash. The port buffers the next chunk in the
+		// meantime if possible, otherwise the ESP8266 is paused
+		lzport_socket_set_busy(true);
 
 		// Write data to flash
-		if (lz_flash_staging_element(buf, received_packet, total_size, pending) != LZ_SUCCESS) {
+		if ((received_packet > skip) &&
+			(lz_flash_staging_element(buf + skip, received_packet - skip, total_size, pending) !=
+			 LZ_SUCCESS)) {
+			lzport_socket_set_busy(false);
 			dbgprint(DBG_ERR, "ERROR: Failed to flash staging element\n");
 			result = LZ_ERROR;
 			goto exit;
 		}
 
-		// Reset RTS to signal the ESP8266 to continue sending
-		lzport_gpio_set_rts(false);
+		lzport_socket_set_busy(false);
 
 		received_total += received_packet;
-		pending -= received_packet;
+		pending -= received_packet - skip;
 
 		dbgprint(DBG_NW, "INFO: Received FW chunk (received: %d, pending: %d, total size: %d)\n",
 				 received_total, pending,
-				 fw_update_response_hdr.content.payload_size + sizeof(lz_auth_hdr_t));
+				 (int)(fw_update_response_hdr.content.payload_size + sizeof(lz_auth_hdr_t)));
 
 		// Indicate progress
 		uint32_t progress = (received_total * 100) / fw_update_response_hdr.content.payload_size;
@@ -520,12 +699,12 @@ LZ_RESULT lz_net_update(hdr_type_t update_type, uint8_t *payload, uint32_t paylo
 
 	} while (received_total < total_size);
 
-	dbgprint(DBG_NW, "INFO: Downloading firmware update successful. Closing socket\n");
+	dbgprint(DBG_NW, "INFO: Downloading firmware update successful\n");
 	result = LZ_SUCCESS;
 
 exit:
-	if (lzport_socket_close(0, TIMEOUT_TCP_MS) != LZ_SUCCESS) {
-		dbgprint(DBG_WARN, "WARN: Could not close socket\n");
+	if (!session_active || ((result != LZ_SUCCESS) && (result != LZ_NOT_FOUND))) {
+		lz_net_disconnect();
 	}
 
 	return result;
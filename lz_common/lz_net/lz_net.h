@@ -25,6 +25,17 @@
  */
 LZ_RESULT lz_net_init(void);
 
+/**
+ * Begin a session: the connection to the hub is kept open across requests until the session
+ * ends. If the hub closed the connection in the meantime, it is re-established transparently
+ */
+void lz_net_begin_session(void);
+
+/**
+ * End a session and close the connection to the hub
+ */
+void lz_net_end_session(void);
+
 LZ_RESULT lz_net_send_data(uint8_t *data, uint32_t data_size);
 
 /**
@@ -44,6 +55,18 @@ LZ_RESULT lz_net_refresh_boot_ticket(void);
  */
 LZ_RESULT lz_net_refresh_awdt(uint32_t requested_time_ms);
 
+/**
+ * Requests count deferral tickets with one round trip and passes the batch to the AWDT. The
+ * tickets in batch->chain must then be passed to lz_awdt_put_batch_ticket_nse in order, one
+ * per deferral period
+ * @param requested_time_ms the requested deferral time of each ticket (the backend might
+ * override this)
+ * @param count the requested number of tickets (the backend might issue fewer)
+ * @return LZ_SUCCESS on success, otherwise an error code
+ */
+LZ_RESULT lz_net_refresh_awdt_batch(uint32_t requested_time_ms, uint32_t count,
+									 lz_deferral_batch_t *batch);
+
 /**
  * Performs the Lazarus device reassociation protocol after a Lazarus Core update. The device
  * reassociates its new DeviceID through attesting to the server with dev_uuid, dev_auth
@@ -61,7 +84,8 @@ LZ_RESULT lz_net_reassociate_device(uint8_t *dev_uuid, uint8_t *dev_auth, uint8_
  *
  * @param update_type App, UpdateDownloader, UpdatePatcher or Lazarus Core Update, see
  * hdr_type_t
- * @return LZ_SUCCESS on success, otherwise an error code
+ * @return LZ_SUCCESS if an update was downloaded, LZ_NOT_FOUND if the hub has no update for the
+ * device, otherwise an error code
  */
 LZ_RESULT lz_net_fw_update(hdr_type_t update_type);
 
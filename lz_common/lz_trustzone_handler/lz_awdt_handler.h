@@ -23,4 +23,17 @@
 LZ_RESULT lz_awdt_get_nonce_nse(uint8_t *nonce);
 LZ_RESULT lz_awdt_put_ticket_nse(lz_auth_hdr_t *ticket, uint32_t time_ms);
 
+/**
+ * Verifies a batch of deferral tickets issued for the nonce of lz_awdt_get_nonce_nse and
+ * replaces the previous batch. The watchdog is not reloaded, the tickets of the batch must be
+ * passed to lz_awdt_put_batch_ticket_nse one at a time
+ */
+LZ_RESULT lz_awdt_put_ticket_batch_nse(lz_auth_hdr_t *batch_hdr, lz_deferral_batch_t *batch);
+
+/**
+ * Reloads the watchdog with the next ticket of the current batch
+ * @return LZ_SUCCESS, LZ_NOT_FOUND if the batch is used up, otherwise LZ_ERROR
+ */
+LZ_RESULT lz_awdt_put_batch_ticket_nse(uint8_t *ticket);
+
 #endif /* LZ_AWDT_H_ */
@@ -26,11 +26,17 @@
 #include "lz_common.h"
 #include "lz_awdt.h"
 #include "lz_core.h"
+#include "lz_sha256.h"
 
 #define MAX_STRING_LENGTH 0x400
 
 static uint8_t active_nonce[LEN_NONCE] = { 0 };
 
+// Current batch of deferral tickets. Only the last consumed element of the hash chain is kept
+static uint8_t batch_head[SHA256_DIGEST_LENGTH] = { 0 };
+static uint32_t batch_remaining = 0;
+static uint32_t batch_time_ms = 0;
+
 bool lz_awdt_last_reset_awdt(void)
 {
 	return lzport_last_reset_awdt();
@@ -108,3 +114,92 @@ __attribute__((cmse_nonsecure_entry)) LZ_RESULT lz_awdt_put_ticket_nse(lz_auth_h
 
 	return LZ_SUCCESS;
 }
+
+__attribute__((cmse_nonsecure_entry)) LZ_RESULT
+lz_awdt_put_ticket_batch_nse(lz_auth_hdr_t *batch_hdr, lz_deferral_batch_t *batch)
+{
+	lz_auth_hdr_t hdr_copy;
+	lz_deferral_batch_t batch_copy;
+	LZ_RESULT result = LZ_ERROR;
+
+	dbgprint(DBG_AWDT, "INFO: AWDT - Verifying deferral ticket batch\n");
+
+	/* Check whether the buffers are located in non-secure memory */
+	if ((cmse_check_address_range((void *)batch_hdr, sizeof(lz_auth_hdr_t),
+								  CMSE_NONSECURE | CMSE_MPU_READ) == NULL) ||
+		(cmse_check_address_range((void *)batch, sizeof(lz_deferral_batch_t),
+								  CMSE_NONSECURE | CMSE_MPU_READ) == NULL)) {
+		dbgprint(DBG_ERR, "ERROR: AWDT - Input buffer is not located in normal world!\n");
+		return LZ_ERROR;
+	}
+
+	// The header and the batch are checked, verified and used from secure memory, so that the
+	// normal world cannot change them in between
+	memcpy(&hdr_copy, batch_hdr, sizeof(hdr_copy));
+	memcpy(&batch_copy, batch, sizeof(batch_copy));
+
+	if ((hdr_copy.content.type != DEFERRAL_TICKET_BATCH) || (batch_copy.count == 0) ||
+		(batch_copy.count > LZ_MAX_DEFERRAL_BATCH) ||
+		(hdr_copy.content.payload_size != LZ_DEFERRAL_BATCH_SIZE(batch_copy.count))) {
+		dbgprint(DBG_ERR, "ERROR: AWDT - Invalid deferral ticket batch\n");
+		goto exit;
+	}
+
+	if (lz_core_verify_staging_elem_hdr(&hdr_copy, (uint8_t *)&batch_copy, active_nonce) !=
+		LZ_SUCCESS) {
+		dbgprint(DBG_ERR, "ERROR: AWDT - Failed to verify signature. Batch NOT ACCEPTED\n");
+		goto exit;
+	}
+
+	memcpy(batch_head, batch_copy.anchor, sizeof(batch_head));
+	batch_remaining = batch_copy.count;
+	batch_time_ms = batch_copy.time_ms;
+
+	dbgprint(DBG_AWDT, "INFO: AWDT - Accepted batch of %d tickets with %dms\n", batch_remaining,
+			 batch_time_ms);
+
+	result = LZ_SUCCESS;
+
+exit:
+	// Zero out nonce to avoid replay attacks
+	secure_zero_memory(active_nonce, LEN_NONCE);
+
+	return result;
+}
+
+__attribute__((cmse_nonsecure_entry)) LZ_RESULT lz_awdt_put_batch_ticket_nse(uint8_t *ticket)
+{
+	uint8_t ticket_copy[SHA256_DIGEST_LENGTH];
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+
+	/* Check whether the ticket is located in non-secure memory */
+	if (cmse_check_address_range((void *)ticket, sizeof(ticket_copy),
+								 CMSE_NONSECURE | CMSE_MPU_READ) == NULL) {
+		dbgprint(DBG_ERR, "ERROR: AWDT - Input buffer is not located in normal world!\n");
+		return LZ_ERROR;
+	}
+
+	if (batch_remaining == 0) {
+		dbgprint(DBG_AWDT, "INFO: AWDT - No tickets left in batch\n");
+		return LZ_NOT_FOUND;
+	}
+
+	memcpy(ticket_copy, ticket, sizeof(ticket_copy));
+
+	// The ticket is valid if it is the preimage of the previous one
+	if ((lz_sha256(digest, ticket_copy, sizeof(ticket_copy)) != 0) ||
+		(memcmp(digest, batch_head, sizeof(digest)) != 0)) {
+		dbgprint(DBG_ERR, "ERROR: AWDT - Invalid ticket of batch. AWDT NOT RELOADED\n");
+		return LZ_ERROR;
+	}
+
+	memcpy(batch_head, ticket_copy, sizeof(batch_head));
+	batch_remaining--;
+
+	lzport_wdt_reload(batch_time_ms / 1000);
+
+	dbgprint(DBG_AWDT, "INFO: AWDT - Reload Timer with ticket of batch: %dms, %d left\n",
+			 batch_time_ms, batch_remaining);
+
+	return LZ_SUCCESS;
+}
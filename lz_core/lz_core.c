@@ -42,13 +42,39 @@ __attribute__((section(".APP_CODE"))) volatile const uint8_t app_code[LZ_APP_COD
 
 static lz_core_boot_params_t *lz_core_boot_params = (lz_core_boot_params_t *)&lz_img_boot_params;
 
-static LZ_RESULT lz_get_staging_elem_content(hdr_type_t elem_type, uint8_t **content);
+// Parsed trust anchor public keys. Importing a key includes the check that the point is on the
+// curve, so they are parsed once and kept in secure RAM for the secure entry calls of the AWDT
+// and the update paths until the trust anchors change
+typedef struct {
+	bool valid;
+	lz_ecc_keypair key;
+} lz_core_cached_key_t;
+
+static lz_core_cached_key_t management_key_cache;
+static lz_core_cached_key_t code_auth_key_cache;
+
+// Layout of the trust anchors before LZ_CERT_STORE_VERSION 2: PEM encoded keys and certificates
+// and no version field. The certBag directly follows this header
+typedef struct {
+	uint32_t magic;
+	lz_ecc_pub_key_pem dev_pub_key;
+	lz_ecc_pub_key_pem code_auth_pub_key;
+	lz_ecc_pub_key_pem management_pub_key;
+	lz_img_cert_index_t certTable[2];
+	uint32_t cursor;
+} trust_anchors_info_v1_t;
+
 static LZ_RESULT lz_core_get_next_layer_addrs(boot_mode_t boot_mode,
 											  const lz_img_hdr_t **boot_image_hdr,
 											  const uint8_t **boot_image_code,
 											  const lz_img_meta_t **img_meta);
 static LZ_RESULT lz_core_derive_dev_auth(uint8_t *dev_auth, uint32_t dev_auth_length,
 										 lz_ecc_keypair *lz_dev_id);
+static lz_ecc_keypair *lz_core_get_cached_key(lz_core_cached_key_t *cache,
+											  const volatile lz_ecc_pub_key_raw *raw);
+static LZ_RESULT lz_core_migrate_trust_anchors(void);
+static LZ_RESULT lz_core_migrate_pub_key(const volatile lz_ecc_pub_key_pem *pem,
+										 lz_ecc_pub_key_raw *raw);
 
 boot_mode_t lz_core_run(void)
 {
@@ -110,6 +136,12 @@ boot_mode_t lz_core_run(void)
 			dbgprint(DBG_ERR, "ERROR: Failed to wipe static_symm\n");
 			lz_error_handler();
 		}
+
+		// Trust anchors provisioned by an older Lazarus Core are converted to the current layout
+		// before they are used, so that the device keeps its provisioning
+		if (lz_core_migrate_trust_anchors() != LZ_SUCCESS) {
+			dbgprint(DBG_ERR, "ERROR: Failed to migrate the trust anchors\n");
+		}
 	}
 
 	// Check whether we have a new Lazarus Core: either after an update, or because it runs for the
@@ -143,6 +175,17 @@ boot_mode_t lz_core_run(void)
 		dbgprint(DBG_INFO, "INFO: Device is provisioned\n");
 	}
 
+	// Parse the trust anchor keys once, all following verifications use the cached keys
+	if (lz_core_load_key_cache() != LZ_SUCCESS) {
+		dbgprint(DBG_ERR, "ERROR: Failed to parse the trust anchor public keys\n");
+		lz_error_handler();
+	}
+
+	// Verify all staging elements of the current boot cycle once. The boot plan is consulted for
+	// applying updates, the boot mode decision and the AWDT setup
+	lz_boot_plan_t boot_plan;
+	lz_core_create_boot_plan(&boot_plan);
+
 	// Check if there are staging elements on the staging area. This might be tickets of updates.
 	// If there are no elements, we need to boot into the update downloader to get a boot ticket
 	// from the hub in order to boot into the firmware. If there are elements present, we might
@@ -151,9 +194,9 @@ boot_mode_t lz_core_run(void)
 		boot_mode = LZ_UDOWNLOADER;
 	} else {
 		// Check for updates
-		if (lz_std_updates_pending() == LZ_SUCCESS) {
-			// Verify and apply updates
-			lz_apply_updates();
+		if (lz_std_updates_pending(&boot_plan) == LZ_SUCCESS) {
+			// Apply the verified updates
+			lz_apply_updates(&boot_plan);
 		}
 
 		if (lz_update_img_meta_data() != LZ_SUCCESS) {
@@ -161,9 +204,9 @@ boot_mode_t lz_core_run(void)
 			lz_error_handler();
 		}
 
-		if (lz_verified_core_update_pending() == LZ_SUCCESS) {
+		if (lz_verified_core_update_pending(&boot_plan) == LZ_SUCCESS) {
 			boot_mode = LZ_CPATCHER;
-		} else if (lz_has_valid_staging_element(BOOT_TICKET) == LZ_SUCCESS) {
+		} else if (lz_boot_plan_get_elem(&boot_plan, BOOT_TICKET) != NULL) {
 			boot_mode = APP;
 		} else {
 			boot_mode = LZ_UDOWNLOADER;
@@ -172,7 +215,7 @@ boot_mode_t lz_core_run(void)
 
 	// Determine deferral time based on deferral ticket in staging area
 	uint32_t deferral_time;
-	if (lz_get_deferral_time(&deferral_time) != LZ_SUCCESS) {
+	if (lz_get_deferral_time(&boot_plan, &deferral_time) != LZ_SUCCESS) {
 		dbgprint(DBG_WARN,
 				 "WARN: Could not find valid deferral ticket, using default value "
 				 "%ds.\n",
@@ -198,11 +241,11 @@ boot_mode_t lz_core_run(void)
 		}
 	}
 
-	lz_ecc_priv_key_pem pem;
-	lz_priv_key_to_pem(&lz_dev_id_keypair, &pem);
+	lz_ecc_priv_key_raw dev_id_priv;
+	lz_priv_key_to_raw(&lz_dev_id_keypair, &dev_id_priv);
 	uint8_t digest[SHA256_DIGEST_LENGTH];
-	if (lz_sha256_two_parts(digest, next_layer_digest, sizeof(next_layer_digest), &pem,
-							sizeof(pem)) < 0) {
+	if (lz_sha256_two_parts(digest, next_layer_digest, sizeof(next_layer_digest), &dev_id_priv,
+							sizeof(dev_id_priv)) < 0) {
 		dbgprint(DBG_ERR, "ERROR: Failed to derive digest from next layer and DeviceID\n");
 		return false;
 	}
@@ -218,7 +261,8 @@ boot_mode_t lz_core_run(void)
 
 	// Create the boot parameters for the next layer depending on the boot mode
 	if (lz_core_provide_params_ram(boot_mode, lz_core_updated, firmware_update_necessary,
-								   &lz_alias_id_keypair, &lz_dev_id_keypair) != LZ_SUCCESS) {
+								   boot_plan.delta_update_failed, &lz_alias_id_keypair,
+								   &lz_dev_id_keypair) != LZ_SUCCESS) {
 		dbgprint(DBG_ERR, "PANIC: Could not create boot parameters for next layer.\n");
 		lz_error_handler();
 	}
@@ -265,26 +309,34 @@ LZ_RESULT lz_core_derive_device_id(lz_ecc_keypair *device_id_keypair)
 }
 
 // Looks for a valid deferral ticket on the staging area.
-// On success, the function returns true and writes the deferral time to <deferral_time>
-LZ_RESULT lz_get_deferral_time(uint32_t *deferral_time)
+// On success, the function returns LZ_SUCCESS and writes the deferral time in seconds to
+// <deferral_time>
+LZ_RESULT lz_get_deferral_time(const lz_boot_plan_t *plan, uint32_t *deferral_time)
 {
-	LZ_RESULT result;
+	const lz_boot_plan_elem_t *elem;
+	uint32_t time_ms;
 
 	dbgprint(DBG_INFO, "INFO: Searching for deferral ticket on staging area\n");
 
-	if ((result = lz_has_valid_staging_element(DEFERRAL_TICKET)) != LZ_SUCCESS) {
-		goto exit;
+	if ((elem = lz_boot_plan_get_elem(plan, DEFERRAL_TICKET)) == NULL) {
+		return LZ_NOT_FOUND;
+	}
+
+	if (elem->hdr->content.payload_size != sizeof(time_ms)) {
+		dbgprint(DBG_ERR, "ERROR: Deferral ticket has invalid size\n");
+		return LZ_ERROR;
 	}
 
-	if ((result = lz_get_staging_elem_content(DEFERRAL_TICKET, (uint8_t **)&deferral_time)) !=
-		LZ_SUCCESS) {
-		goto exit;
+	// Like the tickets passed to the AWDT, deferral tickets contain the time in milliseconds
+	memcpy(&time_ms, ((uint8_t *)elem->hdr) + sizeof(lz_auth_hdr_t), sizeof(time_ms));
+	if (time_ms < 1000) {
+		dbgprint(DBG_ERR, "ERROR: Deferral time %dms too short\n", time_ms);
+		return LZ_ERROR;
 	}
 
-	result = LZ_SUCCESS;
+	*deferral_time = time_ms / 1000;
 
-exit:
-	return result;
+	return LZ_SUCCESS;
 }
 
 LZ_RESULT lz_core_get_next_layer_addrs(boot_mode_t boot_mode, const lz_img_hdr_t **boot_image_hdr,
@@ -454,19 +506,21 @@ LZ_RESULT lz_core_create_cert_store(boot_mode_t boot_mode, lz_ecc_keypair *alias
 	info.subject.org = "Lazarus";
 	info.subject.country = "DE";
 
-	lz_ecc_pub_key_pem alias_keypair_pem;
-	lz_pub_key_to_pem(alias_keypair, &alias_keypair_pem);
-	if (lz_set_serial_number_cert(&info, (unsigned char *)&alias_keypair_pem,
-								  sizeof(alias_keypair_pem)) != 0) {
+	lz_ecc_pub_key_raw alias_keypair_pub;
+	lz_pub_key_to_raw(alias_keypair, &alias_keypair_pub);
+	if (lz_set_serial_number_cert(&info, (unsigned char *)&alias_keypair_pub,
+								  sizeof(alias_keypair_pub)) != 0) {
 		dbgprint(DBG_ERR, "ERROR: lz_set_serial_number_cert failed.\n");
 		return LZ_ERROR;
 	}
 	// Create the cert store with all certificates
 	memset((void *)&lz_img_cert_store, 0x00, sizeof(lz_img_cert_store));
 
+	lz_img_cert_store.info.version = LZ_CERT_STORE_VERSION;
+
 	// Store DeviceID pubkey
 	// Write the public key to the cert_store
-	lz_pub_key_to_pem(device_id_keypair, (lz_ecc_pub_key_pem *)&lz_img_cert_store.info.dev_pub_key);
+	lz_pub_key_to_raw(device_id_keypair, (lz_ecc_pub_key_raw *)&lz_img_cert_store.info.dev_pub_key);
 
 	// Provide backend public key to upper layers
 	memcpy((void *)&lz_img_cert_store.info.management_pub_key,
@@ -521,16 +575,16 @@ LZ_RESULT lz_core_create_cert_store(boot_mode_t boot_mode, lz_ecc_keypair *alias
 
 	// Finally, load the volatile AliasID certificate
 	rem_length = sizeof(lz_img_cert_store.certBag) - lz_img_cert_store.info.cursor;
-	if (lz_write_cert_to_pem(
-			&info, alias_keypair, device_id_keypair,
-			(unsigned char *)&lz_img_cert_store.certBag[lz_img_cert_store.info.cursor],
-			rem_length) != 0) {
+	int cert_length = lz_write_cert_to_der(
+		&info, alias_keypair, device_id_keypair,
+		(unsigned char *)&lz_img_cert_store.certBag[lz_img_cert_store.info.cursor], rem_length);
+	if (cert_length <= 0 || (uint32_t)cert_length >= rem_length) {
 		dbgprint(
 			DBG_ERR,
-			"ERROR: lz_write_cert_to_pem failed. ImgCertStore overflow likely (INDEX_IMG_CERTSTORE_ALIASID).\n");
+			"ERROR: lz_write_cert_to_der failed. ImgCertStore overflow likely (INDEX_IMG_CERTSTORE_ALIASID).\n");
 		return LZ_ERROR;
 	}
-	rem_length = strlen((const char *)&lz_img_cert_store.certBag[lz_img_cert_store.info.cursor]);
+	rem_length = (uint32_t)cert_length;
 
 	lz_img_cert_store.info.certTable[INDEX_IMG_CERTSTORE_ALIASID].start =
 		lz_img_cert_store.info.cursor;
@@ -546,7 +600,7 @@ LZ_RESULT lz_core_create_cert_store(boot_mode_t boot_mode, lz_ecc_keypair *alias
 
 // This function provides all required boot parameters for the next layer as fixed structures at fixed locations in RAM.
 LZ_RESULT lz_core_provide_params_ram(boot_mode_t boot_mode, bool lz_core_updated,
-									 bool firmware_update_necessary,
+									 bool firmware_update_necessary, bool delta_update_failed,
 									 lz_ecc_keypair *lz_alias_id_keypair,
 									 lz_ecc_keypair *lz_dev_id_keypair)
 {
@@ -555,8 +609,8 @@ LZ_RESULT lz_core_provide_params_ram(boot_mode_t boot_mode, bool lz_core_updated
 	// which we still require until the end of this function.
 	lz_img_boot_params_info_t img_boot_params_info_cpy = { 0 };
 
-	lz_pub_key_to_pem(lz_alias_id_keypair, &img_boot_params_info_cpy.alias_id_keypair_pub);
-	lz_priv_key_to_pem(lz_alias_id_keypair, &img_boot_params_info_cpy.alias_id_keypair_priv);
+	lz_pub_key_to_raw(lz_alias_id_keypair, &img_boot_params_info_cpy.alias_id_keypair_pub);
+	lz_priv_key_to_raw(lz_alias_id_keypair, &img_boot_params_info_cpy.alias_id_keypair_priv);
 
 	// App and UD get next nonce for retrieving boot/deferral tickets, UM doesn't need it
 	// App currently also gets dev_uuid TODO check if that is OK or if another identifier must be
@@ -566,6 +620,10 @@ LZ_RESULT lz_core_provide_params_ram(boot_mode_t boot_mode, bool lz_core_updated
 			   LEN_UUID_V4_BIN);
 		memcpy(&img_boot_params_info_cpy.next_nonce, &(lz_core_boot_params->info.next_nonce),
 			   sizeof(img_boot_params_info_cpy.next_nonce));
+
+		// Both layers download updates and must then request the complete image instead of the
+		// delta which could not be applied
+		img_boot_params_info_cpy.delta_update_failed = delta_update_failed;
 	}
 
 	// The App should not be able to issue a Lazarus Core re-association so it does not get
@@ -630,6 +688,11 @@ LZ_RESULT lz_core_create_device_id_csr(bool first_boot, lz_ecc_keypair *device_i
 
 	dbgprint(DBG_INFO, "INFO: Generating new DeviceID certificate.\n");
 
+	// Trust anchors which could not be migrated to the current layout are created from scratch
+	if (lz_data_store.trust_anchors.info.version != LZ_CERT_STORE_VERSION) {
+		first_boot = true;
+	}
+
 	if (!first_boot) {
 		// Write the contents of the existing trust anchors structure to the copy
 		memcpy((void *)&ta_copy, (void *)&lz_data_store.trust_anchors, sizeof(ta_copy));
@@ -640,7 +703,8 @@ LZ_RESULT lz_core_create_device_id_csr(bool first_boot, lz_ecc_keypair *device_i
 	}
 
 	// Store new DeviceID public key
-	lz_pub_key_to_pem(device_id_keypair, &ta_copy.info.dev_pub_key);
+	ta_copy.info.version = LZ_CERT_STORE_VERSION;
+	lz_pub_key_to_raw(device_id_keypair, &ta_copy.info.dev_pub_key);
 	lz_x509_csr_info info;
 	info.subject.common_name = "DeviceID";
 	info.subject.country = "DE";
@@ -654,7 +718,7 @@ LZ_RESULT lz_core_create_device_id_csr(bool first_boot, lz_ecc_keypair *device_i
 
 	uint32_t length = 0;
 
-	// Produce a PEM-formatted output from the DER encoded certificate for the certBag
+	// Write the DER encoded CSR to the certBag
 	if (first_boot) {
 		// certBag must be empty, so we have the full space available
 		length = sizeof(ta_copy.certBag);
@@ -674,12 +738,13 @@ LZ_RESULT lz_core_create_device_id_csr(bool first_boot, lz_ecc_keypair *device_i
 		}
 	}
 
-	if (lz_write_csr_to_pem(&info, device_id_keypair, &ta_copy.certBag[ta_copy.info.cursor],
-							length) < 0) {
-		dbgprint(DBG_ERR, "ERROR: lz_write_csr_to_pem failed.\n");
+	int csr_length = lz_write_csr_to_der(&info, device_id_keypair,
+										 &ta_copy.certBag[ta_copy.info.cursor], length);
+	if (csr_length <= 0 || (uint32_t)csr_length >= length) {
+		dbgprint(DBG_ERR, "ERROR: lz_write_csr_to_der failed.\n");
 		return LZ_ERROR;
 	}
-	length = strlen((char *)&ta_copy.certBag[ta_copy.info.cursor]);
+	length = (uint32_t)csr_length;
 	ta_copy.info.certTable[INDEX_LZ_CERTSTORE_DEVICEID].start = ta_copy.info.cursor;
 	ta_copy.info.certTable[INDEX_LZ_CERTSTORE_DEVICEID].size = (uint16_t)length;
 	ta_copy.info.cursor += length;
@@ -696,10 +761,114 @@ LZ_RESULT lz_core_create_device_id_csr(bool first_boot, lz_ecc_keypair *device_i
 	return LZ_SUCCESS;
 }
 
+/**
+ * Converts trust anchors in the layout before LZ_CERT_STORE_VERSION 2 in place: the keys are
+ * stored raw and the certificates DER encoded, the magic value is kept
+ * @return LZ_SUCCESS if the trust anchors are in the current layout or not provisioned, otherwise
+ * LZ_ERROR
+ */
+static LZ_RESULT lz_core_migrate_trust_anchors(void)
+{
+	const volatile trust_anchors_info_v1_t *v1 =
+		(const volatile trust_anchors_info_v1_t *)&lz_data_store.trust_anchors;
+	const uint8_t *v1_cert_bag = ((const uint8_t *)&lz_data_store.trust_anchors) + sizeof(*v1);
+	const uint32_t v1_cert_bag_size = sizeof(lz_data_store.trust_anchors) - sizeof(*v1);
+	trust_anchors_t ta_copy;
+
+	// Unprovisioned trust anchors only contain a DeviceID CSR, which is created again
+	if ((lz_data_store.trust_anchors.info.magic != LZ_MAGIC) ||
+		(lz_data_store.trust_anchors.info.version == LZ_CERT_STORE_VERSION)) {
+		return LZ_SUCCESS;
+	}
+
+	// In the old layout, the version field overlaps with the PEM header of the DeviceID key
+	if (strncmp((const char *)v1->dev_pub_key.key, "-----BEGIN", strlen("-----BEGIN"))) {
+		dbgprint(DBG_ERR, "ERROR: Unknown trust anchors layout version %d\n",
+				 lz_data_store.trust_anchors.info.version);
+		return LZ_ERROR;
+	}
+
+	dbgprint(DBG_INFO, "INFO: Migrating trust anchors to layout version %d\n",
+			 LZ_CERT_STORE_VERSION);
+
+	memset(&ta_copy.info, 0x00, sizeof(ta_copy.info));
+	memset(ta_copy.certBag, 0xff, sizeof(ta_copy.certBag));
+	ta_copy.info.magic = LZ_MAGIC;
+	ta_copy.info.version = LZ_CERT_STORE_VERSION;
+
+	if ((lz_core_migrate_pub_key(&v1->dev_pub_key, &ta_copy.info.dev_pub_key) != LZ_SUCCESS) ||
+		(lz_core_migrate_pub_key(&v1->code_auth_pub_key, &ta_copy.info.code_auth_pub_key) !=
+		 LZ_SUCCESS) ||
+		(lz_core_migrate_pub_key(&v1->management_pub_key, &ta_copy.info.management_pub_key) !=
+		 LZ_SUCCESS)) {
+		return LZ_ERROR;
+	}
+
+	// Hub and DeviceID certificate
+	for (uint32_t i = 0; i < sizeof(v1->certTable) / sizeof(v1->certTable[0]); i++) {
+		uint32_t start = v1->certTable[i].start;
+		uint32_t size = v1->certTable[i].size;
+
+		if (size == 0) {
+			continue;
+		}
+		if ((start > v1_cert_bag_size) || (size > v1_cert_bag_size - start)) {
+			dbgprint(DBG_ERR, "ERROR: Invalid certificate table entry %d\n", i);
+			return LZ_ERROR;
+		}
+
+		int der_length = lz_pem_to_der(&v1_cert_bag[start], size,
+									   &ta_copy.certBag[ta_copy.info.cursor],
+									   sizeof(ta_copy.certBag) - ta_copy.info.cursor);
+		if (der_length <= 0) {
+			dbgprint(DBG_ERR, "ERROR: Failed to convert certificate %d to DER\n", i);
+			return LZ_ERROR;
+		}
+
+		ta_copy.info.certTable[i].start = ta_copy.info.cursor;
+		ta_copy.info.certTable[i].size = (uint16_t)der_length;
+		ta_copy.info.cursor += (uint32_t)der_length;
+	}
+
+	if (!(lzport_flash_write((uint32_t)&lz_data_store.trust_anchors, (uint8_t *)&ta_copy,
+							 sizeof(lz_data_store.trust_anchors)))) {
+		dbgprint(DBG_ERR, "ERROR: Failed to flash migrated trust anchors\n");
+		return LZ_ERROR;
+	}
+
+	dbgprint(DBG_INFO, "INFO: Successfully migrated trust anchors\n");
+
+	return LZ_SUCCESS;
+}
+
+static LZ_RESULT lz_core_migrate_pub_key(const volatile lz_ecc_pub_key_pem *pem,
+										 lz_ecc_pub_key_raw *raw)
+{
+	lz_ecc_pub_key_pem pem_copy;
+	lz_ecc_keypair key;
+	LZ_RESULT result = LZ_ERROR;
+
+	memcpy(&pem_copy, (const void *)pem, sizeof(pem_copy));
+	pem_copy.key[sizeof(pem_copy.key) - 1] = '\0';
+
+	if (lz_pem_to_pub_key(&key, &pem_copy) != 0) {
+		dbgprint(DBG_ERR, "ERROR: Failed to parse PEM public key of the trust anchors\n");
+		return LZ_ERROR;
+	}
+
+	if (lz_pub_key_to_raw(&key, raw) == 0) {
+		result = LZ_SUCCESS;
+	}
+
+	lz_free_keypair(&key);
+	return result;
+}
+
 LZ_RESULT lz_core_erase_lz_data_store(void)
 {
 	lz_data_store_t temp_store;
 	memset(&temp_store, 0xFF, sizeof(lz_data_store_t));
+	lz_core_invalidate_key_cache();
 	if (!lzport_flash_write((uint32_t)&lz_data_store, (uint8_t *)&temp_store,
 							sizeof(lz_data_store_t))) {
 		return LZ_ERROR;
@@ -714,7 +883,7 @@ LZ_RESULT lz_core_erase_staging_area(void)
 	uint8_t *p = (uint8_t *)&lz_staging_area;
 	for (int i = 0; i < LZ_STAGING_AREA_NUM_PAGES; i++) {
 		if (!lzport_flash_write((uint32_t)p, temp, 512)) {
-			dbgprint(DBG_ERR, "ERROR: Failed to erase staging area (page %d, addr %x)\n", i, p);
+			dbgprint(DBG_ERR, "ERROR: Failed to erase staging area (page %d, addr %p)\n", i, p);
 			return LZ_ERROR;
 		}
 		p += 512;
@@ -726,16 +895,16 @@ LZ_RESULT lz_core_erase_staging_area(void)
 // DeviceID may only change when Lazarus Core was updated
 bool lz_core_is_updated(lz_ecc_keypair *lz_dev_id_keypair)
 {
-	lz_ecc_keypair old_key;
-	if (lz_pem_to_pub_key(
-			&old_key, (lz_ecc_pub_key_pem *)&lz_data_store.trust_anchors.info.dev_pub_key) != 0) {
-		return 1;
+	lz_ecc_pub_key_raw dev_pub_key;
+	if (lz_data_store.trust_anchors.info.version != LZ_CERT_STORE_VERSION) {
+		return true;
+	}
+	if (lz_pub_key_to_raw(lz_dev_id_keypair, &dev_pub_key) != 0) {
+		return true;
 	}
-	int re = lz_compare_public_key(lz_keypair_to_public(&old_key),
-								   lz_keypair_to_public(lz_dev_id_keypair));
-	lz_free_keypair(&old_key);
 
-	return re;
+	return memcmp(&dev_pub_key, (void *)&lz_data_store.trust_anchors.info.dev_pub_key,
+				  sizeof(dev_pub_key)) != 0;
 }
 
 bool lz_core_is_initial_boot(void)
@@ -780,17 +949,12 @@ bool lz_core_boot_params_valid(void)
 bool lz_core_is_provisioning_complete(void)
 {
 	return ((lz_data_store.trust_anchors.info.magic == LZ_MAGIC) &&
+			(lz_data_store.trust_anchors.info.version == LZ_CERT_STORE_VERSION) &&
 			(lz_udownloader_hdr.hdr.content.magic == LZ_MAGIC) &&
 			(lz_cpatcher_hdr.hdr.content.magic == LZ_MAGIC) &&
 			(lz_core_hdr.hdr.content.magic == LZ_MAGIC));
 }
 
-LZ_RESULT lz_has_staging_elem_type(hdr_type_t elem_type)
-{
-	lz_auth_hdr_t *staging_hdr = NULL;
-	return lz_get_staging_hdr(elem_type, &staging_hdr, lz_core_boot_params->info.cur_nonce);
-}
-
 LZ_RESULT lz_core_verify_staging_elem_hdr_sig(const lz_auth_hdr_t *hdr, uint8_t *payload)
 {
 	uint8_t digest[SHA256_DIGEST_LENGTH];
@@ -807,37 +971,22 @@ LZ_RESULT lz_core_verify_staging_elem_hdr_sig(const lz_auth_hdr_t *hdr, uint8_t
 		return LZ_ERROR;
 	}
 
-	if (lz_ecdsa_verify_pub_pem(
-			(uint8_t *)&hdr->content, sizeof(hdr->content),
-			(lz_ecc_pub_key_pem *)&lz_data_store.trust_anchors.info.management_pub_key,
-			&hdr->signature) != 0) {
-		dbgprint(DBG_ERR, "ERROR: GEN - Failed to verify staging element header signature\n");
+	lz_ecc_keypair *management_key = lz_core_get_cached_key(
+		&management_key_cache, &lz_data_store.trust_anchors.info.management_pub_key);
+	if (!management_key) {
+		dbgprint(DBG_ERR, "ERROR: Failed to parse the management public key\n");
 		return LZ_ERROR;
 	}
 
-	dbgprint(DBG_INFO, "INFO: Success! Staging element's signature valid.\n");
-
-	return LZ_SUCCESS;
-}
-
-LZ_RESULT lz_verify_staging_header(const lz_auth_hdr_t *staging_element_hdr, uint8_t *payload)
-{
-	if (lz_core_verify_staging_elem_hdr(staging_element_hdr, payload,
-										lz_core_boot_params->info.cur_nonce) != LZ_SUCCESS) {
-		dbgprint(DBG_ERR, "ERROR: Staging element header verification failed.");
+	if (lz_ecdsa_verify((uint8_t *)&hdr->content, sizeof(hdr->content), management_key,
+						(lz_ecc_signature *)&hdr->signature) != 0) {
+		dbgprint(DBG_ERR, "ERROR: GEN - Failed to verify staging element header signature\n");
 		return LZ_ERROR;
 	}
 
-	if ((staging_element_hdr->content.type == LZ_CORE_UPDATE) ||
-		(staging_element_hdr->content.type == LZ_UDOWNLOADER_UPDATE) ||
-		(staging_element_hdr->content.type == LZ_CPATCHER_UPDATE) ||
-		(staging_element_hdr->content.type == APP_UPDATE) ||
-		(staging_element_hdr->content.type == DEVICE_ID_REASSOC_RES) ||
-		(staging_element_hdr->content.type == CONFIG_UPDATE)) {
-		return LZ_SUCCESS;
-	}
+	dbgprint(DBG_INFO, "INFO: Success! Staging element's signature valid.\n");
 
-	return LZ_ERROR;
+	return LZ_SUCCESS;
 }
 
 LZ_RESULT lz_core_verify_staging_elem_hdr(const lz_auth_hdr_t *hdr, uint8_t *payload,
@@ -902,8 +1051,28 @@ LZ_RESULT lz_core_verify_image(const lz_img_hdr_t *image_hdr, const uint8_t *ima
 		return LZ_ERROR;
 	}
 
+	if (lz_core_verify_image_digest(image_hdr, digest, image_meta) != LZ_SUCCESS) {
+		return LZ_ERROR;
+	}
+
+	// Write the digest to the out parameter in case a pointer was provided
+	if (image_digest_out) {
+		memcpy(image_digest_out, digest, SHA256_DIGEST_LENGTH);
+	}
+
+	return LZ_SUCCESS;
+}
+
+LZ_RESULT lz_core_verify_image_digest(const lz_img_hdr_t *image_hdr, const uint8_t *digest,
+									  const lz_img_meta_t *image_meta)
+{
+	if (image_hdr->hdr.content.magic != LZ_MAGIC) {
+		dbgprint(DBG_ERR, "ERROR: Image header invalid (MAGIC)\n");
+		return LZ_ERROR;
+	}
+
 	// Compare it with the digest stored in the header
-	if (memcmp(digest, image_hdr->hdr.content.digest, sizeof(digest)) != 0) {
+	if (memcmp(digest, image_hdr->hdr.content.digest, SHA256_DIGEST_LENGTH) != 0) {
 		dbgprint(DBG_ERR,
 				 "ERROR: Next layer digest mismatch. Layer %s, size %d, version %d, "
 				 "issue time %s\n",
@@ -914,10 +1083,15 @@ LZ_RESULT lz_core_verify_image(const lz_img_hdr_t *image_hdr, const uint8_t *ima
 		return LZ_ERROR;
 	}
 
-	if (lz_ecdsa_verify_pub_pem(
-			(uint8_t *)&image_hdr->hdr.content, sizeof(image_hdr->hdr.content),
-			(lz_ecc_pub_key_pem *)&lz_data_store.trust_anchors.info.code_auth_pub_key,
-			&image_hdr->hdr.signature) != 0) {
+	lz_ecc_keypair *code_auth_key = lz_core_get_cached_key(
+		&code_auth_key_cache, &lz_data_store.trust_anchors.info.code_auth_pub_key);
+	if (!code_auth_key) {
+		dbgprint(DBG_ERR, "ERROR: Failed to parse the code authentication public key\n");
+		return LZ_ERROR;
+	}
+
+	if (lz_ecdsa_verify((uint8_t *)&image_hdr->hdr.content, sizeof(image_hdr->hdr.content),
+						code_auth_key, (lz_ecc_signature *)&image_hdr->hdr.signature) != 0) {
 		dbgprint(DBG_ERR, "ERROR: Failed to verify image signature with code signing key\n");
 		return LZ_ERROR;
 	}
@@ -954,35 +1128,70 @@ LZ_RESULT lz_core_verify_image(const lz_img_hdr_t *image_hdr, const uint8_t *ima
 
 	dbgprint(DBG_INFO, "INFO: Image version and issue time check succeeded.\n");
 
-	// Write the digest to the out parameter in case a pointer was provided
-	if (image_digest_out) {
-		memcpy(image_digest_out, digest, SHA256_DIGEST_LENGTH);
-	}
-
 	return LZ_SUCCESS;
 }
 
-LZ_RESULT lz_has_valid_staging_element(hdr_type_t hdr_type)
+/**
+ * Creates the boot plan: every staging element of the current boot cycle is verified exactly once
+ * and the results are stored in the plan
+ * @param plan The boot plan to be created
+ */
+void lz_core_create_boot_plan(lz_boot_plan_t *plan)
 {
-	lz_auth_hdr_t *staging_hdr = NULL;
+	lz_auth_hdr_t *hdrs[LZ_STAGING_DIR_MAX_ENTRIES];
 
-	// Search for a header of the specified type
-	LZ_RESULT result =
-		lz_get_staging_hdr(hdr_type, &staging_hdr, lz_core_boot_params->info.cur_nonce);
+	plan->num_elems = lz_get_staging_hdrs(lz_core_boot_params->info.cur_nonce, hdrs,
+										  LZ_STAGING_DIR_MAX_ENTRIES);
+	plan->delta_update_failed = false;
 
-	// And verify it
-	if (result == LZ_SUCCESS) {
-		dbgprint(DBG_INFO, "INFO: Found requested staging element %s, verifying it...\n",
-				 HDR_TYPE_STRING[hdr_type]);
+	dbgprint(DBG_INFO, "INFO: Verifying %d staging elements of the current boot cycle\n",
+			 plan->num_elems);
 
-		if (lz_core_verify_staging_elem_hdr(staging_hdr,
-											(((uint8_t *)staging_hdr) + sizeof(lz_auth_hdr_t)),
-											lz_core_boot_params->info.cur_nonce) != LZ_SUCCESS) {
-			result = LZ_ERROR;
+	for (uint32_t i = 0; i < plan->num_elems; i++) {
+		plan->elems[i].hdr = hdrs[i];
+		lz_core_verify_boot_plan_elem(&plan->elems[i]);
+	}
+}
+
+/**
+ * Verifies a staging element of the boot plan with the current trust anchors and stores the
+ * results in the element
+ * @param elem The element of the boot plan
+ */
+void lz_core_verify_boot_plan_elem(lz_boot_plan_elem_t *elem)
+{
+	elem->hdr_result = lz_core_verify_staging_elem_hdr(
+		elem->hdr, ((uint8_t *)elem->hdr) + sizeof(lz_auth_hdr_t),
+		lz_core_boot_params->info.cur_nonce);
+	elem->img_result = LZ_SUCCESS;
+
+	// For image updates, the code signature of the image header must be verified as well
+	if ((elem->hdr_result == LZ_SUCCESS) && lz_staging_hdr_is_img_update(elem->hdr)) {
+		elem->img_result = lz_verify_img_hdr(elem->hdr);
+	}
+}
+
+/**
+ * Gets the first successfully verified staging element of the specified type from the boot plan
+ * @param plan The boot plan
+ * @param hdr_type The requested element type
+ * @return The element, or NULL if the boot plan contains no verified element of this type
+ */
+const lz_boot_plan_elem_t *lz_boot_plan_get_elem(const lz_boot_plan_t *plan, hdr_type_t hdr_type)
+{
+	for (uint32_t i = 0; i < plan->num_elems; i++) {
+		const lz_boot_plan_elem_t *elem = &plan->elems[i];
+
+		if ((elem->hdr->content.type == hdr_type) && (elem->hdr_result == LZ_SUCCESS) &&
+			(elem->img_result == LZ_SUCCESS)) {
+			return elem;
 		}
 	}
 
-	return result;
+	dbgprint(DBG_INFO, "INFO: No verified staging element %s in staging area\n",
+			 HDR_TYPE_STRING[hdr_type]);
+
+	return NULL;
 }
 
 void lz_get_curr_nonce(uint8_t *nonce)
@@ -990,43 +1199,39 @@ void lz_get_curr_nonce(uint8_t *nonce)
 	memcpy(nonce, lz_core_boot_params->info.cur_nonce, LEN_NONCE);
 }
 
-uint32_t lz_get_num_staging_elems(void)
+LZ_RESULT lz_core_load_key_cache(void)
 {
-	uint32_t staging_area_size = sizeof(lz_staging_area.content);
-	uint32_t cursor = 0;
-	uint8_t num_elements = 0;
-	lz_auth_hdr_t *hdr;
-
-	// Cursor holds the current position in the staging area
-	while (cursor < staging_area_size) {
-		hdr = (lz_auth_hdr_t *)(((uint32_t)&lz_staging_area.content) + cursor);
-
-		// Check whether header is sane
-		if (hdr->content.magic != LZ_MAGIC) {
-			dbgprint(DBG_INFO, "INFO: Staging area contains %d elements\n", num_elements,
-					 hdr->content.magic);
-			goto exit;
-		}
-
-		num_elements++;
-
-		// Move the cursor to the next header
-		cursor += (sizeof(lz_auth_hdr_t) + hdr->content.payload_size);
+	if (!lz_core_get_cached_key(&management_key_cache,
+								&lz_data_store.trust_anchors.info.management_pub_key)) {
+		return LZ_ERROR;
 	}
-
-exit:
-	return num_elements;
+	if (!lz_core_get_cached_key(&code_auth_key_cache,
+								&lz_data_store.trust_anchors.info.code_auth_pub_key)) {
+		return LZ_ERROR;
+	}
+	return LZ_SUCCESS;
 }
 
-static LZ_RESULT lz_get_staging_elem_content(hdr_type_t elem_type, uint8_t **content)
+void lz_core_invalidate_key_cache(void)
 {
-	lz_auth_hdr_t *hdr = NULL;
+	if (management_key_cache.valid) {
+		lz_free_keypair(&management_key_cache.key);
+		management_key_cache.valid = false;
+	}
+	if (code_auth_key_cache.valid) {
+		lz_free_keypair(&code_auth_key_cache.key);
+		code_auth_key_cache.valid = false;
+	}
+}
 
-	if (lz_get_staging_hdr(elem_type, &hdr, lz_core_boot_params->info.cur_nonce) == LZ_SUCCESS) {
-		*content = (((uint8_t *)hdr) + sizeof(lz_auth_hdr_t));
-		return LZ_SUCCESS;
-	} else {
-		*content = NULL;
-		return LZ_NOT_FOUND;
+static lz_ecc_keypair *lz_core_get_cached_key(lz_core_cached_key_t *cache,
+											  const volatile lz_ecc_pub_key_raw *raw)
+{
+	if (!cache->valid) {
+		if (lz_raw_to_pub_key(&cache->key, (const lz_ecc_pub_key_raw *)raw) != 0) {
+			return NULL;
+		}
+		cache->valid = true;
 	}
+	return &cache->key;
 }
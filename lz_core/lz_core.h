@@ -23,12 +23,37 @@
 #include "lz_ecc.h"
 #include "lz_ecdsa.h"
 
+/**
+ * Verification results of a staging element of the current boot cycle
+ */
+typedef struct {
+	lz_auth_hdr_t *hdr;
+	LZ_RESULT hdr_result; // Verification of nonce, digest and signature of the staging element
+	LZ_RESULT img_result; // Verification of the image header, LZ_SUCCESS if no image update
+} lz_boot_plan_elem_t;
+
+/**
+ * The boot plan contains all staging elements of the current boot cycle with their verification
+ * results. It is created once per boot, so that every staging element is verified only once
+ */
+typedef struct {
+	uint32_t num_elems;
+	lz_boot_plan_elem_t elems[LZ_STAGING_DIR_MAX_ENTRIES];
+	bool delta_update_failed; // A delta update could not be applied, set by lz_apply_updates
+} lz_boot_plan_t;
+
 boot_mode_t lz_core_run(void);
 
+void lz_core_create_boot_plan(lz_boot_plan_t *plan);
+
+void lz_core_verify_boot_plan_elem(lz_boot_plan_elem_t *elem);
+
+const lz_boot_plan_elem_t *lz_boot_plan_get_elem(const lz_boot_plan_t *plan, hdr_type_t hdr_type);
+
 LZ_RESULT lz_core_create_device_id_csr(bool first_boot, lz_ecc_keypair *lz_keypair);
 
 LZ_RESULT lz_core_provide_params_ram(boot_mode_t boot_mode, bool lz_core_updated,
-									 bool firmware_update_necessary,
+									 bool firmware_update_necessary, bool delta_update_failed,
 									 lz_ecc_keypair *lz_alias_id_keypair,
 									 lz_ecc_keypair *lz_dev_id_keypair);
 
@@ -36,13 +61,7 @@ LZ_RESULT lz_core_derive_device_id(lz_ecc_keypair *lz_keypair);
 
 bool lz_core_is_updated(lz_ecc_keypair *lz_pub);
 
-LZ_RESULT lz_get_deferral_time(uint32_t *deferral_time);
-
-LZ_RESULT lz_has_staging_elem_type(hdr_type_t elem_type);
-
-LZ_RESULT lz_verify_staging_header(const lz_auth_hdr_t *staging_element_hdr, uint8_t *payload);
-
-LZ_RESULT lz_has_valid_staging_element(hdr_type_t hdr_type);
+LZ_RESULT lz_get_deferral_time(const lz_boot_plan_t *plan, uint32_t *deferral_time);
 
 void lz_get_curr_nonce(uint8_t *nonce);
 
@@ -50,8 +69,6 @@ LZ_RESULT lz_core_verify_next_layer(boot_mode_t boot_mode, uint8_t *next_layer_d
 
 LZ_RESULT lz_core_store_static_symm(void);
 
-uint32_t lz_get_num_staging_elems(void);
-
 LZ_RESULT lz_core_erase_staging_area(void);
 
 LZ_RESULT lz_core_erase_lz_data_store(void);
@@ -75,6 +92,17 @@ LZ_RESULT lz_core_wipe_static_symm(void);
 LZ_RESULT lz_core_verify_image(const lz_img_hdr_t *image_hdr, const uint8_t *image_code,
 							   const lz_img_meta_t *image_meta, uint8_t *image_digest_out);
 
+/**
+ * Verify an image header regarding version number, issue time and signature and check that it
+ * matches the digest of the image code, which was computed by the caller
+ * @param image_hdr The header to be verified
+ * @param digest The digest of the image code
+ * @param image_meta The image meta data
+ * @return LZ_SUCCESS, if the image could be verified, LZ_ERROR otherwise
+ */
+LZ_RESULT lz_core_verify_image_digest(const lz_img_hdr_t *image_hdr, const uint8_t *digest,
+									  const lz_img_meta_t *image_meta);
+
 LZ_RESULT lz_core_verify_staging_elem_hdr_sig(const lz_auth_hdr_t *hdr, uint8_t *payload);
 
 LZ_RESULT lz_core_verify_staging_elem_hdr(const lz_auth_hdr_t *hdr, uint8_t *payload,
@@ -82,4 +110,12 @@ LZ_RESULT lz_core_verify_staging_elem_hdr(const lz_auth_hdr_t *hdr, uint8_t *pay
 
 LZ_RESULT lz_core_derive_alias_id_keypair(uint8_t *digest, lz_ecc_keypair *lz_alias_id_keypair);
 
+LZ_RESULT lz_core_load_key_cache(void);
+
+/**
+ * Drops the parsed trust anchor public keys. Must be called whenever the trust anchors are
+ * rewritten, the keys are parsed again on their next use
+ */
+void lz_core_invalidate_key_cache(void);
+
 #endif /* LZ_CORE_H_ */
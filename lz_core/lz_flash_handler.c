@@ -41,7 +41,7 @@ __attribute__((cmse_nonsecure_entry)) bool lz_flash_write_nse(void *dest, void *
 		return false;
 	}
 	if (cmse_check_address_range((void *)dest, size, CMSE_NONSECURE | CMSE_MPU_READ) == NULL) {
-		dbgprint(DBG_ERR, "ERROR: dest buffer is not located in normal world!\n", (uint32_t)dest,
+		dbgprint(DBG_ERR, "ERROR: dest buffer (0x%x-0x%x) is not located in normal world!\n", (uint32_t)dest,
 				 (uint32_t)dest + size);
 		return false;
 	}
@@ -58,6 +58,13 @@ __attribute__((cmse_nonsecure_entry)) bool lz_flash_write_nse(void *dest, void *
 		return false;
 	}
 
+	// Nothing to be written if the staging area already contains the data. This does not count
+	// towards the DoS protection, as the flash is not worn
+	if (lzport_flash_contains((uint32_t)dest, src, size)) {
+		dbgprint(DBG_VERB, "INFO: Staging area already contains the data, skipping write\n");
+		return true;
+	}
+
 	// DoS protection against flash wear-out.
 	if (lzport_throttle_timer_is_active()) {
 		dbgprint(DBG_ERR, "ERROR: DoS protection enabled. Flash writes are currently throttled!\n");
@@ -23,93 +23,110 @@
 #include "lzport_flash.h"
 #include "lzport_memory.h"
 #include "lzport_debug_output.h"
+#include "lz_sha256.h"
 #include "lz_core.h"
+#include "lz_update.h"
 
-static bool lz_staging_hdr_is_img_update(lz_auth_hdr_t *staging_elem_hdr);
+static bool lz_staging_hdr_is_std_update(lz_auth_hdr_t *staging_elem_hdr);
 static LZ_RESULT lz_apply_single_update(lz_auth_hdr_t *staging_elem_hdr);
-static LZ_RESULT lz_get_img_meta(lz_auth_hdr_t *staging_elem_hdr, const lz_img_meta_t **img_meta);
+static LZ_RESULT lz_get_img_meta(hdr_type_t type, const lz_img_meta_t **img_meta);
 static LZ_RESULT lz_apply_config_update(lz_auth_hdr_t *staging_elem_hdr);
 static LZ_RESULT lz_apply_certs_update(lz_auth_hdr_t *staging_elem_hdr);
 static LZ_RESULT lz_apply_img_update(lz_auth_hdr_t *staging_elem_hdr);
-static LZ_RESULT lz_verify_img_hdr(lz_auth_hdr_t *staging_elem_hdr);
+static LZ_RESULT lz_apply_compressed_img_update(lz_auth_hdr_t *staging_elem_hdr,
+												lz_compressed_hdr_t *compressed_hdr,
+												uint8_t *flash_image_start);
+static LZ_RESULT lz_apply_delta_update(lz_auth_hdr_t *staging_elem_hdr);
+static uint8_t *lz_get_delta_scratch(uint32_t size);
+static LZ_RESULT lz_apply_delta_ops(const uint8_t *ops, uint32_t ops_size, const uint8_t *base,
+									uint32_t base_size, uint8_t *target, uint32_t target_size,
+									uint8_t *digest);
+static LZ_RESULT lz_write_img_page(lz_sha256_ctx *ctx, uint8_t *dest, uint8_t *page,
+									 uint32_t size);
+static bool lz_get_compressed_hdr(lz_auth_hdr_t *staging_hdr, lz_compressed_hdr_t *compressed_hdr);
+static LZ_RESULT lz_decompress_img(const uint8_t *src, uint32_t src_size, uint8_t *target,
+								   uint32_t target_size, uint8_t *digest);
 
 /**
  * Standard updates are all updates except Lazarus Core Update
- * @return
+ * @param plan The boot plan with the verified staging elements
+ * @return LZ_SUCCESS if a verified standard update is pending, otherwise LZ_NOT_FOUND
  */
-LZ_RESULT lz_std_updates_pending(void)
+LZ_RESULT lz_std_updates_pending(const lz_boot_plan_t *plan)
 {
-	if ((lz_has_staging_elem_type(LZ_UDOWNLOADER_UPDATE) == LZ_SUCCESS) ||
-		(lz_has_staging_elem_type(LZ_CPATCHER_UPDATE) == LZ_SUCCESS) ||
-		(lz_has_staging_elem_type(APP_UPDATE) == LZ_SUCCESS) ||
-		(lz_has_staging_elem_type(DEVICE_ID_REASSOC_RES) == LZ_SUCCESS) ||
-		(lz_has_staging_elem_type(CONFIG_UPDATE) == LZ_SUCCESS)) {
-		return LZ_SUCCESS;
+	for (uint32_t i = 0; i < plan->num_elems; i++) {
+		if ((plan->elems[i].hdr_result == LZ_SUCCESS) &&
+			lz_staging_hdr_is_std_update(plan->elems[i].hdr)) {
+			return LZ_SUCCESS;
+		}
 	}
 
 	return LZ_NOT_FOUND;
 }
 
-LZ_RESULT lz_verified_core_update_pending(void)
+LZ_RESULT lz_verified_core_update_pending(const lz_boot_plan_t *plan)
 {
-	lz_auth_hdr_t *staging_hdr = NULL;
-
-	uint8_t nonce[LEN_NONCE];
-	lz_get_curr_nonce(nonce);
-
-	if (lz_get_staging_hdr(LZ_CORE_UPDATE, &staging_hdr, nonce) != LZ_SUCCESS) {
+	if (lz_boot_plan_get_elem(plan, LZ_CORE_UPDATE) == NULL) {
 		return LZ_NOT_FOUND;
 	}
 
-	if (lz_verify_staging_header(staging_hdr, (((uint8_t *)staging_hdr) + sizeof(lz_auth_hdr_t))) !=
-		LZ_SUCCESS) {
-		dbgprint(DBG_ERR, "ERROR: Update staging header verificytion failed\n");
-		return LZ_ERROR;
-	}
-
-	if (lz_verify_img_hdr(staging_hdr) != LZ_SUCCESS) {
-		dbgprint(DBG_ERR, "ERROR: Update image header verification failed\n");
-		return LZ_ERROR;
-	}
-
 	return LZ_SUCCESS;
 }
 
-LZ_RESULT lz_apply_updates(void)
+LZ_RESULT lz_apply_updates(lz_boot_plan_t *plan)
 {
-	lz_auth_hdr_t *staging_elem_hdr = (lz_auth_hdr_t *)&lz_staging_area.content;
 	uint32_t applied_updates = 0;
+	bool delta_update_failed = false;
 	LZ_RESULT result = LZ_ERROR;
 
-	do {
-		dbgprint(DBG_INFO, "INFO: Verifying staging element header at 0x%x\n", staging_elem_hdr);
-
-		// UM uses cur_nonce provided by Lazarus Core to verify staging elements
-		if (lz_verify_staging_header(staging_elem_hdr, (((uint8_t *)staging_elem_hdr) +
-														sizeof(lz_auth_hdr_t))) == LZ_SUCCESS) {
-			// For image updates, we must check their code signature based on their image header
-			if (lz_staging_hdr_is_img_update(staging_elem_hdr)) {
-				if (lz_verify_img_hdr(staging_elem_hdr) != LZ_SUCCESS) {
-					dbgprint(DBG_ERR, "ERROR: Failed to verify update image header\n");
-					result = LZ_ERROR;
-					goto exit;
-				}
-			}
+	for (uint32_t i = 0; i < plan->num_elems; i++) {
+		lz_boot_plan_elem_t *elem = &plan->elems[i];
+
+		// Only verified standard updates are applied here
+		if ((elem->hdr_result != LZ_SUCCESS) || !lz_staging_hdr_is_std_update(elem->hdr)) {
+			continue;
+		}
 
-			// For cert/config updates, we are ready to apply it
-			if (lz_apply_single_update(staging_elem_hdr) != LZ_SUCCESS) {
-				dbgprint(DBG_ERR, "ERROR: Abort, installation of an update failed.\n");
-				result = LZ_ERROR;
-				goto exit;
+		dbgprint(DBG_INFO, "INFO: Applying staging element at %p\n", elem->hdr);
+
+		// For image updates, the code signature of the image header must be valid as well
+		if (elem->img_result != LZ_SUCCESS) {
+			dbgprint(DBG_ERR, "ERROR: Failed to verify update image header\n");
+			result = LZ_ERROR;
+			goto exit;
+		}
+
+		if (lz_apply_single_update(elem->hdr) != LZ_SUCCESS) {
+			// A failed delta update leaves the installed image intact. The remaining updates
+			// are applied and the firmware downloads the complete image instead
+			if (elem->hdr->content.type == DELTA_UPDATE) {
+				dbgprint(DBG_WARN, "WARN: Delta update failed, the complete image is required\n");
+				delta_update_failed = true;
+				continue;
 			}
+			dbgprint(DBG_ERR, "ERROR: Abort, installation of an update failed.\n");
+			result = LZ_ERROR;
+			goto exit;
+		}
 
-			applied_updates++;
+		applied_updates++;
+
+		// The staging elements are verified with the trust anchors. If they were updated, the
+		// elements which were not handled yet must be verified again. The updates before the
+		// current element were already applied, the plan continues after it
+		if (elem->hdr->content.type == DEVICE_ID_REASSOC_RES) {
+			for (uint32_t j = 0; j < plan->num_elems; j++) {
+				if ((j > i) || !lz_staging_hdr_is_std_update(plan->elems[j].hdr)) {
+					lz_core_verify_boot_plan_elem(&plan->elems[j]);
+				}
+			}
 		}
-	} while (lz_get_next_staging_hdr(&staging_elem_hdr) == LZ_SUCCESS);
+	}
 
 	result = LZ_SUCCESS;
 
 exit:
+	plan->delta_update_failed = delta_update_failed;
 
 	dbgprint(DBG_INFO, "INFO: Applied %d updated\n", applied_updates);
 	return result;
@@ -186,17 +203,13 @@ LZ_RESULT lz_update_img_meta_data(void)
 	return LZ_SUCCESS;
 }
 
-/*****************************
- * Static Function Definitions
- *****************************/
-
 /**
  * Check whether a staging element header is an image update. Does not perform any verification
  * on the header
  * @param staging_elem_hdr The staging header to be checked
  * @return True, when the staging header is an image update, otherwise false
  */
-static bool lz_staging_hdr_is_img_update(lz_auth_hdr_t *staging_elem_hdr)
+bool lz_staging_hdr_is_img_update(lz_auth_hdr_t *staging_elem_hdr)
 {
 	return ((staging_elem_hdr->content.type == LZ_CORE_UPDATE) ||
 			(staging_elem_hdr->content.type == LZ_UDOWNLOADER_UPDATE) ||
@@ -204,6 +217,66 @@ static bool lz_staging_hdr_is_img_update(lz_auth_hdr_t *staging_elem_hdr)
 			(staging_elem_hdr->content.type == APP_UPDATE));
 }
 
+/**
+ * Verifies an update. Must be performed before the update is actually applied
+ * @param staging_elem_hdr
+ * @return LZ_SUCCESS on success, otherwise LZ_ERROR
+ */
+LZ_RESULT lz_verify_img_hdr(lz_auth_hdr_t *staging_hdr)
+{
+	// Layout: staging_elem_hdr | img_hdr | img_code
+	lz_img_hdr_t *img_hdr = (lz_img_hdr_t *)(((uint32_t)staging_hdr) + sizeof(lz_auth_hdr_t));
+	uint8_t *img_code = (uint8_t *)(((uint32_t)img_hdr) + sizeof(lz_img_hdr_t));
+	const lz_img_meta_t *img_meta;
+	lz_compressed_hdr_t compressed_hdr;
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+
+	if (lz_get_img_meta(staging_hdr->content.type, &img_meta) != LZ_SUCCESS) {
+		dbgprint(DBG_ERR, "ERROR: Could not get header and code information of update image.\n");
+		return LZ_ERROR;
+	}
+
+	if (!lz_get_compressed_hdr(staging_hdr, &compressed_hdr)) {
+		return lz_core_verify_image(img_hdr, img_code, img_meta, NULL);
+	}
+
+	// Lazarus Core updates are applied by the Core Patcher, which cannot decompress them
+	if ((staging_hdr->content.type == LZ_CORE_UPDATE) ||
+		!lz_check_img_size(staging_hdr->content.type,
+						   sizeof(lz_img_hdr_t) + img_hdr->hdr.content.size)) {
+		dbgprint(DBG_ERR, "ERROR: Invalid compressed update image.\n");
+		return LZ_ERROR;
+	}
+
+	// The digest refers to the uncompressed code, which is only hashed here
+	if (lz_decompress_img(img_code + sizeof(compressed_hdr), compressed_hdr.size, NULL,
+						  img_hdr->hdr.content.size, digest) != LZ_SUCCESS) {
+		return LZ_ERROR;
+	}
+
+	return lz_core_verify_image_digest(img_hdr, digest, img_meta);
+}
+
+/*****************************
+ * Static Function Definitions
+ *****************************/
+
+/**
+ * Check whether a staging element header is a standard update, i.e. an update that is applied by
+ * Lazarus Core. Does not perform any verification on the header
+ * @param staging_elem_hdr The staging header to be checked
+ * @return True, when the staging header is a standard update, otherwise false
+ */
+static bool lz_staging_hdr_is_std_update(lz_auth_hdr_t *staging_elem_hdr)
+{
+	return ((staging_elem_hdr->content.type == LZ_UDOWNLOADER_UPDATE) ||
+			(staging_elem_hdr->content.type == LZ_CPATCHER_UPDATE) ||
+			(staging_elem_hdr->content.type == APP_UPDATE) ||
+			(staging_elem_hdr->content.type == DEVICE_ID_REASSOC_RES) ||
+			(staging_elem_hdr->content.type == CONFIG_UPDATE) ||
+			(staging_elem_hdr->content.type == DELTA_UPDATE));
+}
+
 static LZ_RESULT lz_apply_single_update(lz_auth_hdr_t *staging_elem_hdr)
 {
 	if ((staging_elem_hdr->content.type == LZ_UDOWNLOADER_UPDATE) ||
@@ -214,6 +287,8 @@ static LZ_RESULT lz_apply_single_update(lz_auth_hdr_t *staging_elem_hdr)
 		return lz_apply_certs_update(staging_elem_hdr);
 	} else if (staging_elem_hdr->content.type == CONFIG_UPDATE) {
 		return lz_apply_config_update(staging_elem_hdr);
+	} else if (staging_elem_hdr->content.type == DELTA_UPDATE) {
+		return lz_apply_delta_update(staging_elem_hdr);
 	} else {
 		dbgprint(DBG_ERR, "ERROR: Element type not an update.\n");
 		return LZ_ERROR;
@@ -240,11 +315,17 @@ static LZ_RESULT lz_apply_certs_update(lz_auth_hdr_t *staging_elem_hdr)
 		return LZ_ERROR;
 	}
 
+	ta_update = (trust_anchors_t *)(((uint32_t)staging_elem_hdr) + sizeof(lz_auth_hdr_t));
+
+	if (ta_update->info.version != LZ_CERT_STORE_VERSION) {
+		dbgprint(DBG_ERR, "ERROR: Certs update has layout version %d, expected %d.\n",
+				 ta_update->info.version, LZ_CERT_STORE_VERSION);
+		return LZ_ERROR;
+	}
+
 	// Copy current trust anchors data structure to RAM, overwrite and flash back
 	memcpy((void *)&ta_copy, (void *)&lz_data_store.trust_anchors, sizeof(ta_copy));
 
-	ta_update = (trust_anchors_t *)(((uint32_t)staging_elem_hdr) + sizeof(lz_auth_hdr_t));
-
 	dbgprint(DBG_INFO, "INFO: Processing the contents of the TRUST_ANCHORS update...\n");
 
 	// Not allowed: DeviceID pubkey updates, because this key originates from the device
@@ -392,6 +473,9 @@ static LZ_RESULT lz_apply_certs_update(lz_auth_hdr_t *staging_elem_hdr)
 		}
 	}
 
+	// The cached keys are parsed from the old trust anchors, also if the write fails partially
+	lz_core_invalidate_key_cache();
+
 	if (!(lzport_flash_write((uint32_t)&lz_data_store.trust_anchors, (void *)&ta_copy,
 							 sizeof(lz_data_store.trust_anchors)))) {
 		dbgprint(DBG_ERR, "ERROR: Failed to flash certs update\n");
@@ -417,7 +501,7 @@ static LZ_RESULT lz_apply_config_update(lz_auth_hdr_t *staging_elem_hdr)
 		dbgprint(DBG_ERR,
 				 "ERROR: Config update size (%d) does not match size of CONFIG_DATA "
 				 "structure (%d).\n",
-				 staging_elem_hdr->content.payload_size, sizeof(cfg_copy));
+				 staging_elem_hdr->content.payload_size, (int)sizeof(cfg_copy));
 		return LZ_ERROR;
 	}
 
@@ -456,6 +540,7 @@ static LZ_RESULT lz_apply_img_update(lz_auth_hdr_t *staging_elem_hdr)
 {
 	uint8_t *flash_image_start;
 	uint8_t *staged_image_start;
+	lz_compressed_hdr_t compressed_hdr;
 
 	// Check whether the update fits into the image bounds
 	if (!lz_check_update_size(staging_elem_hdr)) {
@@ -464,17 +549,7 @@ static LZ_RESULT lz_apply_img_update(lz_auth_hdr_t *staging_elem_hdr)
 	}
 
 	// Get image address depending on the image type
-	switch (staging_elem_hdr->content.type) {
-	case LZ_UDOWNLOADER_UPDATE:
-		flash_image_start = (uint8_t *)&lz_udownloader_hdr;
-		break;
-	case LZ_CPATCHER_UPDATE:
-		flash_image_start = (uint8_t *)&lz_cpatcher_hdr;
-		break;
-	case APP_UPDATE:
-		flash_image_start = (uint8_t *)&lz_app_hdr;
-		break;
-	default:
+	if ((flash_image_start = (uint8_t *)lz_get_img_hdr(staging_elem_hdr->content.type)) == NULL) {
 		dbgprint(DBG_ERR, "ERROR: Cannot locate unknown update image type %s\n",
 				 HDR_TYPE_STRING[staging_elem_hdr->content.type]);
 		return LZ_ERROR;
@@ -483,6 +558,10 @@ static LZ_RESULT lz_apply_img_update(lz_auth_hdr_t *staging_elem_hdr)
 	// Determine the start address of the update
 	staged_image_start = (uint8_t *)(((uint32_t)staging_elem_hdr) + sizeof(lz_auth_hdr_t));
 
+	if (lz_get_compressed_hdr(staging_elem_hdr, &compressed_hdr)) {
+		return lz_apply_compressed_img_update(staging_elem_hdr, &compressed_hdr, flash_image_start);
+	}
+
 	// Finally, flash the staged update, assuming that it is contiguous and in its full length on staging area
 	dbgprint(DBG_INFO,
 			 "INFO: Flashing staged update from staging area (0x%x) to update area "
@@ -501,35 +580,425 @@ static LZ_RESULT lz_apply_img_update(lz_auth_hdr_t *staging_elem_hdr)
 }
 
 /**
- * Verifies an update. Must be performed before the update is actually applied
- * @param staging_elem_hdr
+ * Apply a compressed image update. The code is decompressed page by page directly into the image
+ * region, the image header is written last once the digest of the decompressed code matches
+ * @param staging_elem_hdr The staging element header of the update to be applied
+ * @param compressed_hdr The compression header of the update
+ * @param flash_image_start The start of the image region
  * @return LZ_SUCCESS on success, otherwise LZ_ERROR
  */
-static LZ_RESULT lz_verify_img_hdr(lz_auth_hdr_t *staging_hdr)
+static LZ_RESULT lz_apply_compressed_img_update(lz_auth_hdr_t *staging_elem_hdr,
+												lz_compressed_hdr_t *compressed_hdr,
+												uint8_t *flash_image_start)
 {
-	// Layout: staging_elem_hdr | img_hdr | img_code
-	lz_img_hdr_t *img_hdr = (lz_img_hdr_t *)(((uint32_t)staging_hdr) + sizeof(lz_auth_hdr_t));
-	uint8_t *img_code = (uint8_t *)(((uint32_t)img_hdr) + sizeof(lz_img_hdr_t));
+	lz_img_hdr_t *img_hdr = (lz_img_hdr_t *)(((uint32_t)staging_elem_hdr) + sizeof(lz_auth_hdr_t));
+	uint8_t *compressed_code = ((uint8_t *)img_hdr) + sizeof(lz_img_hdr_t) + sizeof(*compressed_hdr);
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+
+	if (!lz_check_img_size(staging_elem_hdr->content.type,
+						   sizeof(lz_img_hdr_t) + img_hdr->hdr.content.size)) {
+		dbgprint(DBG_ERR, "ERROR: Update image size exceeds bounds.\n");
+		return LZ_ERROR;
+	}
+
+	dbgprint(DBG_INFO,
+			 "INFO: Decompressing staged update from staging area (0x%x) to update area "
+			 "(0x%x)\n",
+			 (uint32_t)img_hdr, (uint32_t)flash_image_start);
+
+	if (lz_decompress_img(compressed_code, compressed_hdr->size,
+						  flash_image_start + sizeof(lz_img_hdr_t), img_hdr->hdr.content.size,
+						  digest) != LZ_SUCCESS) {
+		dbgprint(DBG_ERR, "ERROR: Decompressing the update failed.\n");
+		return LZ_ERROR;
+	}
+
+	// The update was verified before, this only detects a failure while decompressing
+	if (memcmp(digest, img_hdr->hdr.content.digest, sizeof(digest))) {
+		dbgprint(DBG_ERR, "ERROR: Digest of the decompressed update does not match.\n");
+		return LZ_ERROR;
+	}
+
+	if (!(lzport_flash_write((uint32_t)flash_image_start, (uint8_t *)img_hdr,
+							 sizeof(lz_img_hdr_t)))) {
+		dbgprint(DBG_ERR, "ERROR: Flashing the update header failed.\n");
+		return LZ_ERROR;
+	}
+
+	dbgprint(DBG_INFO, "INFO: Flashing update successful\n");
+
+	return LZ_SUCCESS;
+}
+
+/**
+ * Apply a delta update. The new image is reconstructed from the installed image and the delta in
+ * the free space at the end of the staging area. It is verified like a complete image update
+ * before it replaces the installed image, so that a failed delta leaves the installed image intact
+ * @param staging_elem_hdr The staging element header of the delta update to be applied
+ * @return LZ_SUCCESS on success, otherwise LZ_ERROR
+ */
+static LZ_RESULT lz_apply_delta_update(lz_auth_hdr_t *staging_elem_hdr)
+{
+	lz_delta_hdr_t delta_hdr;
+	volatile lz_img_hdr_t *installed_hdr;
 	const lz_img_meta_t *img_meta;
+	uint8_t *payload = ((uint8_t *)staging_elem_hdr) + sizeof(lz_auth_hdr_t);
+	uint8_t *target;
+	uint8_t digest[SHA256_DIGEST_LENGTH];
 
-	if (lz_get_img_meta(staging_hdr, &img_meta) != LZ_SUCCESS) {
-		dbgprint(DBG_ERR, "ERROR: Could not get header and code information of update image.\n");
+	if (staging_elem_hdr->content.payload_size < sizeof(delta_hdr)) {
+		dbgprint(DBG_ERR, "ERROR: Delta update too small.\n");
+		return LZ_ERROR;
+	}
+	memcpy(&delta_hdr, payload, sizeof(delta_hdr));
+
+	if ((delta_hdr.magic != LZ_MAGIC) ||
+		((installed_hdr = lz_get_img_hdr((hdr_type_t)delta_hdr.type)) == NULL) ||
+		(delta_hdr.target_size < sizeof(lz_img_hdr_t)) ||
+		!lz_check_img_size((hdr_type_t)delta_hdr.type, delta_hdr.target_size)) {
+		dbgprint(DBG_ERR, "ERROR: Invalid delta update header.\n");
+		return LZ_ERROR;
+	}
+
+	dbgprint(DBG_INFO, "INFO: Applying delta update for %s\n", HDR_TYPE_STRING[delta_hdr.type]);
+
+	// The delta can only be applied to the image it was created for
+	if (memcmp((void *)installed_hdr->hdr.content.digest, delta_hdr.base_digest,
+			   sizeof(delta_hdr.base_digest)) ||
+		!lz_check_img_size((hdr_type_t)delta_hdr.type,
+						   sizeof(lz_img_hdr_t) + installed_hdr->hdr.content.size)) {
+		dbgprint(DBG_ERR, "ERROR: Delta update does not match the installed image.\n");
+		return LZ_ERROR;
+	}
+
+	if ((target = lz_get_delta_scratch(delta_hdr.target_size)) == NULL) {
+		dbgprint(DBG_ERR, "ERROR: No space in staging area to apply the delta update.\n");
+		return LZ_ERROR;
+	}
+
+	if (lz_apply_delta_ops(payload + sizeof(delta_hdr),
+						   staging_elem_hdr->content.payload_size - sizeof(delta_hdr),
+						   ((uint8_t *)installed_hdr) + sizeof(lz_img_hdr_t),
+						   installed_hdr->hdr.content.size, target, delta_hdr.target_size,
+						   digest) != LZ_SUCCESS) {
+		return LZ_ERROR;
+	}
+
+	if (memcmp(digest, delta_hdr.target_digest, sizeof(digest))) {
+		dbgprint(DBG_ERR, "ERROR: Digest of the image created from the delta does not match.\n");
+		return LZ_ERROR;
+	}
+
+	// The reconstructed image must be signed by the code authority like any image update
+	if ((lz_get_img_meta((hdr_type_t)delta_hdr.type, &img_meta) != LZ_SUCCESS) ||
+		(lz_core_verify_image((lz_img_hdr_t *)target, target + sizeof(lz_img_hdr_t), img_meta,
+							  NULL) != LZ_SUCCESS)) {
+		dbgprint(DBG_ERR, "ERROR: Failed to verify the image created from the delta.\n");
+		return LZ_ERROR;
+	}
+
+	dbgprint(DBG_INFO, "INFO: Flashing image created from the delta (0x%x) to update area (0x%x)\n",
+			 (uint32_t)target, (uint32_t)installed_hdr);
+
+	if (!(lzport_flash_write((uint32_t)installed_hdr, target, delta_hdr.target_size))) {
+		dbgprint(DBG_ERR, "ERROR: Flashing the update failed.\n");
+		return LZ_ERROR;
+	}
+
+	dbgprint(DBG_INFO, "INFO: Flashing update successful\n");
+
+	return LZ_SUCCESS;
+}
+
+/**
+ * Returns page aligned space at the end of the staging area, which does not overlap with any
+ * staging element of the current boot cycle
+ * @param size The required size
+ * @return The start of the space, or NULL if there is not enough space
+ */
+static uint8_t *lz_get_delta_scratch(uint32_t size)
+{
+	lz_auth_hdr_t *hdrs[LZ_STAGING_DIR_MAX_ENTRIES];
+	uint8_t nonce[LEN_NONCE];
+	uint32_t staging_area_size = sizeof(lz_staging_area.content);
+	uint32_t used = 0;
+	uint32_t num_hdrs;
+	uint32_t scratch;
+
+	lz_get_curr_nonce(nonce);
+	num_hdrs = lz_get_staging_hdrs(nonce, hdrs, LZ_STAGING_DIR_MAX_ENTRIES);
+
+	for (uint32_t i = 0; i < num_hdrs; i++) {
+		uint32_t end = ((uint32_t)hdrs[i]) - ((uint32_t)&lz_staging_area.content) +
+					   sizeof(lz_auth_hdr_t) + hdrs[i]->content.payload_size;
+		if (end > used) {
+			used = end;
+		}
+	}
+
+	if (size > staging_area_size) {
+		return NULL;
+	}
+
+	scratch = (staging_area_size - size) & ~(FLASH_PAGE_SIZE - 1);
+	if (scratch < used) {
+		return NULL;
+	}
+
+	return ((uint8_t *)&lz_staging_area.content) + scratch;
+}
+
+/**
+ * Creates an image from the installed image and the operations of a delta update. Only one flash
+ * page of the new image is buffered in RAM, the new image is hashed while it is written
+ * @param ops The operations of the delta
+ * @param ops_size The size of the operations
+ * @param base The code of the installed image
+ * @param base_size The size of the code of the installed image
+ * @param target The address the new image is written to
+ * @param target_size The size of the new image
+ * @param digest Returns the digest of the new image
+ * @return LZ_SUCCESS on success, otherwise LZ_ERROR
+ */
+static LZ_RESULT lz_apply_delta_ops(const uint8_t *ops, uint32_t ops_size, const uint8_t *base,
+									uint32_t base_size, uint8_t *target, uint32_t target_size,
+									uint8_t *digest)
+{
+	uint8_t page[FLASH_PAGE_SIZE];
+	uint32_t fill = 0;
+	uint32_t written = 0;
+	uint32_t cursor = 0;
+	lz_sha256_ctx ctx;
+	lz_delta_op_t op;
+	const uint8_t *src;
+
+	if (lz_sha256_start(&ctx) != 0) {
+		dbgprint(DBG_ERR, "ERROR: Failed to start hashing of delta image\n");
+		return LZ_ERROR;
+	}
+
+	while (cursor < ops_size) {
+		if ((ops_size - cursor) < sizeof(op)) {
+			dbgprint(DBG_ERR, "ERROR: Truncated delta operation\n");
+			return LZ_ERROR;
+		}
+		memcpy(&op, ops + cursor, sizeof(op));
+		cursor += sizeof(op);
+
+		if (op.len > (target_size - written - fill)) {
+			dbgprint(DBG_ERR, "ERROR: Delta exceeds the image size\n");
+			return LZ_ERROR;
+		}
+
+		switch (op.op) {
+		case LZ_DELTA_OP_COPY:
+			if ((op.arg > base_size) || (op.len > (base_size - op.arg))) {
+				dbgprint(DBG_ERR, "ERROR: Delta copies outside of the installed image\n");
+				return LZ_ERROR;
+			}
+			src = base + op.arg;
+			break;
+		case LZ_DELTA_OP_DATA:
+			if (op.len > (ops_size - cursor)) {
+				dbgprint(DBG_ERR, "ERROR: Truncated delta data\n");
+				return LZ_ERROR;
+			}
+			src = ops + cursor;
+			cursor += op.len;
+			break;
+		case LZ_DELTA_OP_FILL:
+			src = NULL;
+			break;
+		default:
+			dbgprint(DBG_ERR, "ERROR: Unknown delta operation %d\n", op.op);
+			return LZ_ERROR;
+		}
+
+		// Append the bytes of the operation to the page buffer, writing every full page
+		for (uint32_t done = 0; done < op.len;) {
+			uint32_t n = op.len - done;
+			if (n > (FLASH_PAGE_SIZE - fill)) {
+				n = FLASH_PAGE_SIZE - fill;
+			}
+
+			if (src != NULL) {
+				memcpy(&page[fill], src + done, n);
+			} else {
+				memset(&page[fill], (uint8_t)op.arg, n);
+			}
+			fill += n;
+			done += n;
+
+			if (fill == FLASH_PAGE_SIZE) {
+				if (lz_write_img_page(&ctx, target + written, page, fill) != LZ_SUCCESS) {
+					return LZ_ERROR;
+				}
+				written += fill;
+				fill = 0;
+			}
+		}
+	}
+
+	if ((fill > 0) && (lz_write_img_page(&ctx, target + written, page, fill) != LZ_SUCCESS)) {
+		return LZ_ERROR;
+	}
+	written += fill;
+
+	if (written != target_size) {
+		dbgprint(DBG_ERR, "ERROR: Delta image size %d does not match %d\n", written, target_size);
+		return LZ_ERROR;
+	}
+
+	if (lz_sha256_finish(&ctx, digest) != 0) {
+		dbgprint(DBG_ERR, "ERROR: Failed to hash delta image\n");
+		return LZ_ERROR;
+	}
+
+	return LZ_SUCCESS;
+}
+
+/**
+ * Hashes a page of an image which is created from an update and writes it to flash
+ * @param ctx The hash context of the image
+ * @param dest The flash address the page is written to, or NULL if it is only hashed
+ * @param page The page buffer
+ * @param size The number of bytes in the page buffer
+ * @return LZ_SUCCESS on success, otherwise LZ_ERROR
+ */
+static LZ_RESULT lz_write_img_page(lz_sha256_ctx *ctx, uint8_t *dest, uint8_t *page,
+									 uint32_t size)
+{
+	if ((lz_sha256_update(ctx, page, size) != 0) ||
+		((dest != NULL) && !lzport_flash_write((uint32_t)dest, page, size))) {
+		dbgprint(DBG_ERR, "ERROR: Failed to write image page\n");
+		return LZ_ERROR;
+	}
+
+	return LZ_SUCCESS;
+}
+
+/**
+ * Checks whether the code of an image update is compressed
+ * @param staging_hdr The staging element header of the image update
+ * @param compressed_hdr Returns the compression header, if the code is compressed
+ * @return True, if the code is compressed, otherwise false
+ */
+static bool lz_get_compressed_hdr(lz_auth_hdr_t *staging_hdr, lz_compressed_hdr_t *compressed_hdr)
+{
+	uint8_t *payload = ((uint8_t *)staging_hdr) + sizeof(lz_auth_hdr_t);
+	uint32_t payload_size = staging_hdr->content.payload_size;
+
+	// An uncompressed update consists of exactly the image header and the code
+	if ((payload_size < sizeof(lz_img_hdr_t) + sizeof(*compressed_hdr)) ||
+		(payload_size == sizeof(lz_img_hdr_t) + ((lz_img_hdr_t *)payload)->hdr.content.size)) {
+		return false;
+	}
+
+	memcpy(compressed_hdr, payload + sizeof(lz_img_hdr_t), sizeof(*compressed_hdr));
+
+	return (compressed_hdr->magic == LZ_COMPRESSED_MAGIC) &&
+		   (compressed_hdr->size ==
+			payload_size - sizeof(lz_img_hdr_t) - sizeof(*compressed_hdr));
+}
+
+/**
+ * Decompresses the code of a compressed image update. The window of the compression is exactly
+ * one flash page, so the window buffer is also the page buffer: each time it is full, it holds
+ * the next page of the decompressed code
+ * @param src The compressed code
+ * @param src_size The size of the compressed code
+ * @param target The address the decompressed code is written to, or NULL if it is only hashed
+ * @param target_size The size of the decompressed code
+ * @param digest Returns the digest of the decompressed code
+ * @return LZ_SUCCESS on success, otherwise LZ_ERROR
+ */
+static LZ_RESULT lz_decompress_img(const uint8_t *src, uint32_t src_size, uint8_t *target,
+								   uint32_t target_size, uint8_t *digest)
+{
+	uint8_t window[LZ_COMPRESSION_WINDOW_SIZE];
+	uint32_t pos = 0;
+	uint32_t cursor = 0;
+	uint32_t flags = 0;
+	uint32_t len;
+	uint32_t dist;
+	lz_sha256_ctx ctx;
+
+	if (lz_sha256_start(&ctx) != 0) {
+		dbgprint(DBG_ERR, "ERROR: Failed to start hashing of decompressed image\n");
 		return LZ_ERROR;
 	}
 
-	return lz_core_verify_image(img_hdr, img_code, img_meta, NULL);
+	while (pos < target_size) {
+		// The upper bits mark how many items of the current group are left
+		flags >>= 1;
+		if ((flags & 0x100) == 0) {
+			if (cursor >= src_size) {
+				goto truncated;
+			}
+			flags = src[cursor++] | 0xFF00;
+		}
+
+		if (flags & 0x1) {
+			if ((src_size - cursor) < 2) {
+				goto truncated;
+			}
+			dist = (src[cursor] | ((src[cursor + 1] & 0x1) << 8)) + 1;
+			len = (src[cursor + 1] >> 1) + LZ_COMPRESSION_MIN_MATCH;
+			cursor += 2;
+
+			if ((dist > pos) || (len > (target_size - pos))) {
+				dbgprint(DBG_ERR, "ERROR: Invalid match in compressed image\n");
+				return LZ_ERROR;
+			}
+		} else {
+			if (cursor >= src_size) {
+				goto truncated;
+			}
+			dist = 0;
+			len = 1;
+		}
+
+		for (uint32_t i = 0; i < len; i++) {
+			window[pos % sizeof(window)] =
+				(dist == 0) ? src[cursor++] : window[(pos - dist) % sizeof(window)];
+			pos++;
+
+			if (((pos % sizeof(window)) == 0) &&
+				(lz_write_img_page(&ctx, target ? target + pos - sizeof(window) : NULL, window,
+								   sizeof(window)) != LZ_SUCCESS)) {
+				return LZ_ERROR;
+			}
+		}
+	}
+
+	if (((pos % sizeof(window)) != 0) &&
+		(lz_write_img_page(&ctx, target ? target + pos - (pos % sizeof(window)) : NULL, window,
+						   pos % sizeof(window)) != LZ_SUCCESS)) {
+		return LZ_ERROR;
+	}
+
+	if (lz_sha256_finish(&ctx, digest) != 0) {
+		dbgprint(DBG_ERR, "ERROR: Failed to hash decompressed image\n");
+		return LZ_ERROR;
+	}
+
+	return LZ_SUCCESS;
+
+truncated:
+	dbgprint(DBG_ERR, "ERROR: Compressed image is truncated\n");
+	return LZ_ERROR;
 }
 
 /**
  * Gets the address of the staged image's current meta data from Lazarus Data
- * @param staging_elem_hdr Used to determine the update type and corresponding meta data
+ * @param type The update type to determine the corresponding meta data
  * @param img_meta Pointer to retrieve the image's meta data
  * @return LZ_SUCCESS on success, otherwise LZ_ERROR
  */
-static LZ_RESULT lz_get_img_meta(lz_auth_hdr_t *staging_elem_hdr, const lz_img_meta_t **img_meta)
+static LZ_RESULT lz_get_img_meta(hdr_type_t type, const lz_img_meta_t **img_meta)
 {
 	// Meta data of image type to be verified is in Lazarus Data Store
-	switch (staging_elem_hdr->content.type) {
+	switch (type) {
 	case LZ_CORE_UPDATE:
 		if (img_meta != NULL)
 			*img_meta = (lz_img_meta_t *)&lz_data_store.config_data.img_info.rc_meta;
@@ -548,7 +1017,7 @@ static LZ_RESULT lz_get_img_meta(lz_auth_hdr_t *staging_elem_hdr, const lz_img_m
 		break;
 	default:
 		dbgprint(DBG_ERR, "ERROR: Cannot locate unknown image type %s meta data\n",
-				 HDR_TYPE_STRING[staging_elem_hdr->content.type]);
+				 HDR_TYPE_STRING[type]);
 		return LZ_ERROR;
 	}
 	return LZ_SUCCESS;
@@ -20,9 +20,13 @@
 #ifndef LZ_UPDATE_H_
 #define LZ_UPDATE_H_
 
-LZ_RESULT lz_apply_updates(void);
+#include "lz_core.h"
+
+LZ_RESULT lz_apply_updates(lz_boot_plan_t *plan);
 LZ_RESULT lz_update_img_meta_data(void);
-LZ_RESULT lz_std_updates_pending(void);
-LZ_RESULT lz_verified_core_update_pending(void);
+LZ_RESULT lz_std_updates_pending(const lz_boot_plan_t *plan);
+LZ_RESULT lz_verified_core_update_pending(const lz_boot_plan_t *plan);
+bool lz_staging_hdr_is_img_update(lz_auth_hdr_t *staging_elem_hdr);
+LZ_RESULT lz_verify_img_hdr(lz_auth_hdr_t *staging_hdr);
 
 #endif /* LZ_UPDATE_H_ */
@@ -30,14 +30,22 @@
 #include "lzport_gpio.h"
 #include "lz_common.h"
 #include "lz_net.h"
+#include "lz_awdt_handler.h"
 #include "lz_awdt.h"
 #include "lz_led.h"
+#include "net.h"
 
 #include "sensor.h"
 #include "benchmark.h"
 
 static TaskHandle_t task_awdt_handle = NULL;
 
+// Deferral tickets issued in advance, batch.chain[batch_next] is passed to the AWDT next
+static lz_deferral_batch_t batch = { 0 };
+static uint32_t batch_next = 0;
+
+static LZ_RESULT lz_awdt_defer(void);
+
 void lz_awdt_task(void *params)
 {
 	task_awdt_handle = xTaskGetCurrentTaskHandle();
@@ -56,13 +64,16 @@ void lz_awdt_task(void *params)
 		// Trigger flashing the blue LED to indicate that a deferral ticket is to be fetched
 		xTaskNotifyGive(get_led_task_handle());
 
+		// The ticket request and the sensor data share a connection to the hub
+		lz_net_begin_session();
+
 #if (RUN_IOT_SENSOR_DEMO == 1)
 		if ((multiple % DEFERRAL_TICKET_FETCHING_MULT) == 0) {
 #endif
 			dbgprint(DBG_INFO, "INFO: Fetching deferral ticket with a time of %ds..\n",
 					 DEFERRAL_TICKET_TIME_MS / 1000);
 
-			LZ_RESULT result = lz_net_refresh_awdt(DEFERRAL_TICKET_TIME_MS);
+			LZ_RESULT result = lz_awdt_defer();
 
 			if (result == LZ_SUCCESS) {
 				lzport_gpio_set_status_led(true, LED_ON);
@@ -75,6 +86,14 @@ void lz_awdt_task(void *params)
 		send_sensor_data();
 #endif
 
+		// Check for a firmware update after start-up and then periodically. Does not return if
+		// an update was downloaded
+		if ((multiple % UPDATE_CHECK_MULT) == 1) {
+			net_check_update();
+		}
+
+		lz_net_end_session();
+
 		dbgprint(DBG_INFO, "INFO: Waiting for %dms\n", DEFERRAL_TICKET_TASK_WAIT_MS);
 		vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(DEFERRAL_TICKET_TASK_WAIT_MS));
 
@@ -89,3 +108,25 @@ TaskHandle_t get_task_awdt_handle(void)
 {
 	return task_awdt_handle;
 }
+
+static LZ_RESULT lz_awdt_defer(void)
+{
+	// The hub is only contacted if all tickets of the current batch are used up
+	if (batch_next < batch.count) {
+		if (lz_awdt_put_batch_ticket_nse(batch.chain[batch_next++]) == LZ_SUCCESS) {
+			dbgprint(DBG_INFO, "INFO: Deferred AWDT with ticket %d of %d\n", batch_next,
+					 batch.count);
+			return LZ_SUCCESS;
+		}
+		dbgprint(DBG_WARN, "WARN: AWDT did not accept ticket, fetching new tickets\n");
+	}
+
+	batch_next = 0;
+	if (lz_net_refresh_awdt_batch(DEFERRAL_TICKET_TIME_MS, DEFERRAL_TICKET_BATCH_SIZE, &batch) !=
+		LZ_SUCCESS) {
+		batch.count = 0;
+		return LZ_ERROR;
+	}
+
+	return lz_awdt_put_batch_ticket_nse(batch.chain[batch_next++]);
+}
@@ -23,6 +23,10 @@
 #define DEFERRAL_TICKET_TIME_MS 60000
 #define DEFERRAL_TICKET_TASK_WAIT_MS 30000
 #define DEFERRAL_TICKET_FETCHING_MULT 10
+// The hub is asked for a firmware update every UPDATE_CHECK_MULT task periods (one hour)
+#define UPDATE_CHECK_MULT 120
+// Number of deferral tickets requested from the hub at once
+#define DEFERRAL_TICKET_BATCH_SIZE 10
 
 void lz_awdt_task(void *params);
 TaskHandle_t get_task_awdt_handle(void);
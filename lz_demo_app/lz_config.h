@@ -23,6 +23,10 @@
 // Signalize that FreeRTOS is available and can be used for certain functions
 #define FREERTOS_AVAILABLE 1
 
+// Receive the data from the ESP8266 via DMA instead of one interrupt per byte. Not yet verified
+// on hardware, enable together with ESP_USART_RX_BENCHMARK to compare both receive paths
+#define ESP_USART_RX_DMA 0
+
 // Do not edit! These are just the debug output levels
 #define DBG_NONE (0x0U)
 #define DBG_ERR (0x1U)
@@ -50,6 +50,8 @@ void net_task(void *params)
 			;
 	}
 
+	lz_net_begin_session();
+
 	// Send AliasID certificate
 	if (LZ_SUCCESS != lz_net_send_alias_id_cert()) {
 		dbgprint(DBG_WARN, "ERROR: WARN: Updating AliasID cert in backend not successful. Waiting "
@@ -64,23 +66,9 @@ void net_task(void *params)
 		dbgprint(DBG_WARN, "WARN: Could not retrieve a boot ticket from backend.\n");
 	}
 
-	lzport_gpio_set_status_led(LED_OK, LED_ON);
+	lz_net_end_session();
 
-	// TODO FW Update ONLY on request
-	// 	if (lz_net_fw_update(LZ_CORE_UPDATE) == LZ_SUCCESS)
-	// 	{
-	// 		if (lz_set_boot_mode_request(LZ_CPATCHER) != LZ_SUCCESS)
-	// 		{
-	// 			dbgprint(DBG_WARN, "WARN: Failed to set boot mode request\n");
-	// 		}
-	// 		dbgprint(DBG_INFO, "INFO: Rebooting to apply update\n");
-	// 		vTaskDelay(pdMS_TO_TICKS(100));
-	// 		NVIC_SystemReset();
-	// 	}
-	// 	else
-	// 	{
-	// 		dbgprint(DBG_INFO, "INFO: Failed to download update from hub\n");
-	// 	}
+	lzport_gpio_set_status_led(LED_OK, LED_ON);
 
 	// Notify AWDT task that network connection is established
 	xTaskNotifyGive(get_task_awdt_handle());
@@ -99,3 +87,34 @@ TaskHandle_t get_net_task_handle(void)
 {
 	return net_task_handle;
 }
+
+/**
+ * Asks the hub for an update of the App, which is sent as a delta if the hub has one for the
+ * installed image. If an update was downloaded, the device is reset so that Lazarus Core applies
+ * it. Must be called within a session
+ */
+void net_check_update(void)
+{
+	dbgprint(DBG_INFO, "INFO: Checking for a firmware update..\n");
+
+	LZ_RESULT result = lz_net_fw_update(APP_UPDATE);
+	if (result == LZ_NOT_FOUND) {
+		dbgprint(DBG_INFO, "INFO: Firmware is up to date\n");
+		return;
+	} else if (result != LZ_SUCCESS) {
+		dbgprint(DBG_WARN, "WARN: Failed to download update from hub\n");
+		return;
+	}
+
+	// Lazarus Core applies the update before it boots the App. The request also writes the
+	// staging area directory with the downloaded update
+	if (lz_set_boot_mode_request(APP) != LZ_SUCCESS) {
+		dbgprint(DBG_WARN, "WARN: Failed to set boot mode request\n");
+	}
+
+	lz_net_end_session();
+
+	dbgprint(DBG_INFO, "INFO: Rebooting to apply update\n");
+	vTaskDelay(pdMS_TO_TICKS(100));
+	NVIC_SystemReset();
+}
@@ -22,5 +22,6 @@
 
 void net_task(void *params);
 TaskHandle_t get_net_task_handle(void);
+void net_check_update(void);
 
 #endif /* NET_H_ */
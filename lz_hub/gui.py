@@ -25,13 +25,9 @@ def main():
     # Create temperature and humidity graphs for NUM_DEVICES
     fig_temp = [Figure(figsize=(7, 2), dpi=85) for i in range(NUM_DEVICES)]
     ax_temp = [fig_temp[i].add_subplot(111) for i in range(NUM_DEVICES)]
-    xs_temp = [[] for i in range(NUM_DEVICES)]
-    ys_temp = [[] for i in range(NUM_DEVICES)]
 
     fig_hum = [Figure(figsize=(7, 2), dpi=85) for i in range(NUM_DEVICES)]
     ax_hum = [fig_hum[i].add_subplot(111) for i in range(NUM_DEVICES)]
-    xs_hum = [[] for i in range(NUM_DEVICES)]
-    ys_hum = [[] for i in range(NUM_DEVICES)]
 
     window = tk.Tk()
 
@@ -82,7 +78,7 @@ def main():
             animation.FuncAnimation(
                 fig_temp[i],
                 gui_device_info.animate,
-                fargs=(ax_temp[i], xs_temp[i], ys_temp[i], uuids[i], gui_device_info.read_temp,
+                fargs=(ax_temp[i], uuids[i], gui_device_info.read_temp,
                 "Temp (deg C)"),
                 interval=4000))
 
@@ -90,8 +86,7 @@ def main():
             animation.FuncAnimation(
                 fig_hum[i],
                 gui_device_info.animate,
-                fargs=(ax_hum[i], xs_hum[i], ys_hum[i], uuids[i],
-                gui_device_info.read_hum,
+                fargs=(ax_hum[i], uuids[i], gui_device_info.read_hum,
                 "Humidity (%)"),
                 interval=4000))
 
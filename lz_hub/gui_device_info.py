@@ -5,6 +5,7 @@ from matplotlib.backends.backend_tkagg import (
 from matplotlib.figure import Figure
 import matplotlib.pyplot as plt
 import matplotlib.animation as animation
+import matplotlib.dates as mdates
 import numpy as np
 from random import random
 import datetime as dt
@@ -12,6 +13,10 @@ from lz_hub_device_certbag import device_certbag
 import lz_hub_db
 import time
 
+# The plots show the samples of the last PLOT_WINDOW_S, averaged to at most PLOT_MAX_POINTS
+PLOT_WINDOW_S   = 30 * 60
+PLOT_MAX_POINTS = 120
+
 def frm_create_basic_info(window, uuid):
 
     # Get stuff from database
@@ -59,59 +64,59 @@ def frm_create_device_cert(window, uuid):
     return frm_cert
 
 
-def read_temp(uuid):
-    updated = False
+def read_sensor_data(uuid):
+    """Returns the timestamps, indices, temperatures and humidities of the samples of a device
+    within the last PLOT_WINDOW_S"""
+    now = time.time()
     db = lz_hub_db.connect()
-    _, _, _, counter, temperature, _ = lz_hub_db.get_device_info(db, uuid)
+    rows = lz_hub_db.get_sensor_data(db, uuid, now - PLOT_WINDOW_S, now + 1, PLOT_MAX_POINTS)
     lz_hub_db.close(db)
-    if read_temp.counter.get(uuid) is None:
+    if not rows:
+        return [], [], [], []
+    return [list(column) for column in zip(*rows)]
+
+
+def is_updated(counters, uuid, func):
+    updated = False
+    counter = counters[-1] if counters else 0
+    if func.counter.get(uuid) is None:
         updated = True
-        read_temp.counter[uuid] = 0
-    if counter > read_temp.counter[uuid]:
+        func.counter[uuid] = 0
+    if counter > func.counter[uuid]:
         updated = True
-    read_temp.counter[uuid] = counter
-    return temperature, updated
+    func.counter[uuid] = counter
+    return updated
+
+
+def read_temp(uuid):
+    timestamps, counters, temperatures, _ = read_sensor_data(uuid)
+    return timestamps, temperatures, is_updated(counters, uuid, read_temp)
 read_temp.counter = {}
 
 
 def read_hum(uuid):
-    updated = False
-    db = lz_hub_db.connect()
-    _, _, _, counter, _, humidity = lz_hub_db.get_device_info(db, uuid)
-    lz_hub_db.close(db)
-    if read_hum.counter.get(uuid) is None:
-        updated = True
-        read_hum.counter[uuid] = 0
-    if counter > read_hum.counter[uuid]:
-        updated = True
-    read_hum.counter[uuid] = counter
-    return humidity, updated
+    timestamps, counters, _, humidities = read_sensor_data(uuid)
+    return timestamps, humidities, is_updated(counters, uuid, read_hum)
 read_hum.counter = {}
 
 
 
 # This function is called periodically from FuncAnimation
-def animate(i, ax, xs, ys, uuid, data_func, label):
-
-    # Read temperature (Celsius)
-    value, updated = data_func(uuid)
-
-    # Add x and y to lists
-    xs.append(dt.datetime.now().strftime('%M:%S'))
-    ys.append(value)
+def animate(i, ax, uuid, data_func, label):
 
-    # Limit x and y lists to 20 items
-    xs = xs[-10:]
-    ys = ys[-10:]
+    # Read the history of the last PLOT_WINDOW_S
+    timestamps, values, updated = data_func(uuid)
+    xs = [dt.datetime.fromtimestamp(timestamp) for timestamp in timestamps]
 
-    # Draw x and y lists
+    # Draw the history
     ax.clear()
     ax.set_ylabel(label)
+    ax.xaxis.set_major_formatter(mdates.DateFormatter('%H:%M'))
     if updated:
         fmt = 'bo-'
     else:
         fmt = 'r-'
-    ax.plot(xs, ys, fmt)
+    ax.plot(xs, values, fmt)
 
 
 def frm_create_plot(window, uuid, fig_temp, fig_hum):
@@ -202,12 +207,8 @@ def test():
     fig_hum = Figure(figsize=(7, 2), dpi=85)
 
     ax_temp = fig_temp.add_subplot(111)
-    xs_temp = []
-    ys_temp = []
 
     ax_hum = fig_hum.add_subplot(111)
-    xs_hum = []
-    ys_hum = []
 
     frm_device_info = frm_create_device_info(window, uuid, fig_temp, fig_hum)
     frm_device_info.pack()
@@ -215,14 +216,14 @@ def test():
     ani_temp = animation.FuncAnimation(
         fig_temp,
         animate,
-        fargs=(ax_temp, xs_temp, ys_temp, uuid, read_temp,
+        fargs=(ax_temp, uuid, read_temp,
         "Temp (deg C)"),
         interval=4000)
 
     ani_hum = animation.FuncAnimation(
         fig_hum,
         animate,
-        fargs=(ax_hum, xs_hum, ys_hum, uuid, read_hum,
+        fargs=(ax_hum, uuid, read_hum,
         "Humidity (%)"),
         interval=4000)
 
@@ -239,12 +240,8 @@ def test_frm_create_plot():
     fig_hum = Figure(figsize=(7, 2), dpi=85)
 
     ax_temp = fig_temp.add_subplot(111)
-    xs_temp = []
-    ys_temp = []
 
     ax_hum = fig_hum.add_subplot(111)
-    xs_hum = []
-    ys_hum = []
 
     frm_plot = frm_create_plot(window, uuid, fig_temp, fig_hum)
     frm_plot.pack()
@@ -252,14 +249,14 @@ def test_frm_create_plot():
     ani_temp = animation.FuncAnimation(
         fig_temp,
         animate,
-        fargs=(ax_temp, xs_temp, ys_temp, uuid, read_temp,
+        fargs=(ax_temp, uuid, read_temp,
         "Temp (deg C)"),
         interval=1000)
 
     ani_hum = animation.FuncAnimation(
         fig_hum,
         animate,
-        fargs=(ax_hum, xs_hum, ys_hum, uuid, read_hum,
+        fargs=(ax_hum, uuid, read_hum,
         "Humidity (%)"),
         interval=1000)
 
@@ -281,15 +278,15 @@ def test_frm_create_device_cert():
 def test_read_temp():
     uuid = b"9900ACFF-352A-4966-BE5B-DF79B5CF825E"
     for _ in range(10):
-        temp, updated = read_temp(uuid)
-        print(f"Temp = {temp}, updated = {updated}")
+        _, temps, updated = read_temp(uuid)
+        print(f"Temp = {temps[-1:]}, updated = {updated}")
         time.sleep(1)
 
 def test_read_hum():
     uuid = b"9900ACFF-352A-4966-BE5B-DF79B5CF825E"
     for _ in range(10):
-        hum, updated = read_hum(uuid)
-        print(f"Hum = {hum}, updated = {updated}")
+        _, hums, updated = read_hum(uuid)
+        print(f"Hum = {hums[-1:]}, updated = {updated}")
         time.sleep(1)
 
 # test_frm_create_device_cert()
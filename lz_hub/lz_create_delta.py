@@ -0,0 +1,165 @@
+# Copyright(c) 2021 Fraunhofer AISEC
+# Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the License); you may
+# not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an AS IS BASIS, WITHOUT
+# WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import sys
+import os
+import argparse
+import struct
+import hashlib
+from lz_hub_element_type import ELEMENT_TYPE
+from lz_hub_dev_update import DELTA_DIR, DELTA_HDR_FORMAT, IMG_HDR_FORMAT, get_delta_file_name
+
+HEADER_SIZE         = 0x800
+MAGIC               = 0x41495345
+
+# Delta operations, see lz_delta_op_t
+OP_COPY             = 0x1
+OP_DATA             = 0x2
+OP_FILL             = 0x3
+
+# Minimum length of a match in the installed image and of a run of equal bytes. Shorter matches
+# cost more than the literal data because of the operation header
+MIN_MATCH           = 32
+MIN_RUN             = 16
+
+def main():
+    print("")
+    print("Creating delta update..")
+
+    args = parse_arguments()
+
+    return create_delta_file(args.base_file, args.target_file, ELEMENT_TYPE[args.type], args.out_dir)
+
+def create_delta_file(base_file_name, target_file_name, element_type, out_dir):
+
+    # Read the signed binaries
+    try:
+        with open(base_file_name, "rb") as base_file:
+            base = base_file.read()
+        with open(target_file_name, "rb") as target_file:
+            target = target_file.read()
+    except Exception as e:
+        print("Error: failed to read signed binaries: %s" %str(e))
+        return 1
+
+    if len(base) < HEADER_SIZE or len(target) < HEADER_SIZE:
+        print("Error: binaries must be signed binaries created with lz_sign_binary.py")
+        return 1
+
+    # The installed image is identified by the code digest in its header. The delta is applied to
+    # the code of the installed image only
+    magic, _, _, _, base_size, _, base_digest = struct.unpack(IMG_HDR_FORMAT,
+        base[:struct.calcsize(IMG_HDR_FORMAT)])
+    if magic != MAGIC or base_size > len(base) - HEADER_SIZE:
+        print("Error: invalid header of installed image")
+        return 1
+    base_code = base[HEADER_SIZE:HEADER_SIZE + base_size]
+
+    ops = create_delta_ops(base_code, target)
+
+    delta = struct.pack(DELTA_HDR_FORMAT, MAGIC,
+                                          element_type,
+                                          len(target),
+                                          base_digest,
+                                          hashlib.sha256(target).digest(),
+                                          ) + ops
+
+    out_file = os.path.join(out_dir, os.path.basename(get_delta_file_name(element_type, base_digest)))
+
+    try:
+        os.makedirs(out_dir, exist_ok=True)
+        with open(out_file, "wb") as delta_file:
+            delta_file.write(delta)
+    except Exception as e:
+        print("Failed to write delta to file: %s" %str(e))
+        return 1
+
+    print("")
+    print("Type:            %s" %element_type.name)
+    print("Installed code:  %s" %base_digest.hex())
+    print("Image size:      %d (0x%x) bytes" %(len(target), len(target)))
+    print("Delta size:      %d (0x%x) bytes" %(len(delta), len(delta)))
+    print("---")
+    print("Successfully created delta %s" %out_file)
+
+    return 0
+
+
+def create_delta_ops(base, target):
+    """Greedily encodes target as copies of base, runs of equal bytes and literal data"""
+
+    # Index all windows of the installed code, the first occurence wins
+    index = {}
+    for i in range(len(base) - MIN_MATCH + 1):
+        index.setdefault(base[i:i + MIN_MATCH], i)
+
+    ops = bytearray()
+    literal = bytearray()
+
+    def flush_literal():
+        if len(literal) > 0:
+            ops.extend(struct.pack('III', OP_DATA, len(literal), 0) + literal)
+            del literal[:]
+
+    i = 0
+    while i < len(target):
+        run = 1
+        while i + run < len(target) and target[i + run] == target[i]:
+            run += 1
+        if run >= MIN_RUN:
+            flush_literal()
+            ops.extend(struct.pack('III', OP_FILL, run, target[i]))
+            i += run
+            continue
+
+        offset = index.get(target[i:i + MIN_MATCH])
+        if offset is not None:
+            length = MIN_MATCH
+            while (i + length < len(target) and offset + length < len(base) and
+                   target[i + length] == base[offset + length]):
+                length += 1
+            flush_literal()
+            ops.extend(struct.pack('III', OP_COPY, length, offset))
+            i += length
+            continue
+
+        literal.append(target[i])
+        i += 1
+
+    flush_literal()
+
+    return bytes(ops)
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("base_file", help="The signed binary installed on the devices")
+    parser.add_argument("target_file", help="The signed binary of the update")
+    parser.add_argument("type", choices=["UD_UPDATE", "CP_UPDATE", "APP_UPDATE"], help="The update type")
+    parser.add_argument("-o", "--out-dir", default=DELTA_DIR, help="The directory the hub loads deltas from")
+
+    args = parser.parse_args()
+
+    print("Specified installed binary: %s" %os.path.abspath(args.base_file))
+    print("Specified update binary: %s" %os.path.abspath(args.target_file))
+
+    return args
+
+
+if __name__ == "__main__":
+    ret = main()
+    sys.exit(ret)
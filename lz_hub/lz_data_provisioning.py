@@ -12,16 +12,18 @@ from dataclasses import astuple, dataclass
 
 
 MAGICVAL                            = (0x41495345)
-MAX_PUB_ECP_DER_BYTES               = 162
-MAX_PUB_ECP_PEM_BYTES               = 279
+PUB_ECP_RAW_BYTES                   = 65
+# Layout of the trust anchors: raw public keys and DER certificates (LZ_CERT_STORE_VERSION)
+TRUST_ANCHOR_VERSION                = 2
 
 # Dataclasses for trust anchors and config data (see lz_common.h for c structs)
 @dataclass
 class LzTrustAnchor:
     magic_trust_anchors: int
-    device_id_pub_key_pem: bytearray
-    code_auth_pub_key_pem: bytearray
-    hub_pub_key_pem: bytearray
+    version: int
+    device_id_pub_key: bytearray
+    code_auth_pub_key: bytearray
+    hub_pub_key: bytearray
     hub_cert_start: int
     hub_cert_size: int
     device_id_cert_start: int
@@ -30,7 +32,7 @@ class LzTrustAnchor:
     cert_bag: bytearray
 
 TRUST_ANCHOR_LENGTH = 4096
-TRUST_ANCHOR_FORMAT_WITHOUT_PADDING = f"I{(str(MAX_PUB_ECP_PEM_BYTES) + 's') * 3}HHHHI"
+TRUST_ANCHOR_FORMAT_WITHOUT_PADDING = f"II{(str(PUB_ECP_RAW_BYTES) + 's') * 3}HHHHI"
 TRUST_ANCHOR_FORMAT = f"{TRUST_ANCHOR_FORMAT_WITHOUT_PADDING}{TRUST_ANCHOR_LENGTH - struct.calcsize(TRUST_ANCHOR_FORMAT_WITHOUT_PADDING)}s"
 
 @dataclass
@@ -117,13 +119,16 @@ def issue_device_trust_anchors(project_path, hub_cert, hub_sk, code_auth_cert, c
     # ------------ Provision the trust anchors structures ------------
     # ----------------------------------------------------------------
 
-    trust_anchor.code_auth_pub_key_pem = osw.dump_publickey(code_auth_cert.get_pubkey())
+    if trust_anchor.version != TRUST_ANCHOR_VERSION:
+        print("Trust anchors have layout version %d, expected %d. Exit.." %(trust_anchor.version, TRUST_ANCHOR_VERSION))
+        return 0
+
+    trust_anchor.code_auth_pub_key = osw.dump_publickey_raw(code_auth_cert.get_pubkey())
 
     device_id_csr_raw = trust_anchor.cert_bag[trust_anchor.device_id_cert_start:trust_anchor.device_id_cert_start + trust_anchor.device_id_cert_size]
-    device_id_csr_string = device_id_csr_raw.decode('utf-8')
 
-    # Read the DeviceID CSR
-    device_id_csr = osw.load_csr_from_buffer(device_id_csr_string)
+    # Read the DER encoded DeviceID CSR
+    device_id_csr = osw.load_csr_from_buffer(bytes(device_id_csr_raw))
     if device_id_csr is None:
         print("Unable to load DeviceID CSR. Exit..")
         return 0
@@ -133,24 +138,30 @@ def issue_device_trust_anchors(project_path, hub_cert, hub_sk, code_auth_cert, c
     # Create a new, hub-signed DeviceID certificate with the extracted public DeviceID key
     device_id_cert_signed = osw.create_cert_from_csr(device_id_csr, hub_sk, hub_cert, True)
 
-    # Convert to raw format to store it in cert bag
-    device_id_cert_signed_raw = osw.dump_cert(device_id_cert_signed)
+    # Convert to DER format to store it in cert bag, the database stores it as PEM
+    device_id_cert_signed_raw = osw.dump_cert_der(device_id_cert_signed)
     device_id_cert_size = len(device_id_cert_signed_raw)
 
     # Create the certificate bag which contains the hub certificate and the DeviceID certificate and
     # fill the corresponding size and start variables
-    hub_cert_raw = osw.dump_cert(hub_cert)
+    hub_cert_raw = osw.dump_cert_der(hub_cert)
     hub_cert_size = len(hub_cert_raw)
-    print(f"Signed hub_cert: {device_id_cert_signed_raw}")
+    print(f"Signed DeviceID cert: {osw.dump_cert(device_id_cert_signed)}")
+
+    if hub_cert_size + device_id_cert_size > len(trust_anchor.cert_bag):
+        print("Certificates exceed the size of the certificate bag. Exit..")
+        return 0
 
     trust_anchor.hub_cert_start = 0
+    trust_anchor.hub_cert_size = hub_cert_size
     trust_anchor.device_id_cert_start = hub_cert_size
     trust_anchor.cursor = hub_cert_size + device_id_cert_size
 
-    trust_anchor.cert_bag = hub_cert_raw + device_id_cert_signed_raw + bytearray(4096 - (hub_cert_size + device_id_cert_size))
+    trust_anchor.device_id_cert_size = device_id_cert_size
+    trust_anchor.cert_bag = hub_cert_raw + device_id_cert_signed_raw
 
     # Store the hub public key
-    trust_anchor.hub_pub_key_pem = osw.dump_publickey(hub_cert.get_pubkey())
+    trust_anchor.hub_pub_key = osw.dump_publickey_raw(hub_cert.get_pubkey())
 
     # Set trust anchors magic val: TrusAnchors.info.magic = MAGICVAL to sign that device is now provisioned
     trust_anchor.magic_trust_anchors = MAGICVAL
@@ -169,7 +180,7 @@ def issue_device_trust_anchors(project_path, hub_cert, hub_sk, code_auth_cert, c
     # ------------- Store device in database -------------------------
     # ----------------------------------------------------------------
     db = lz_hub_db.connect()
-    if not lz_hub_db.insert_device(db, config_data.dev_uuid, "testdevice", device_id_cert_signed_raw, config_data.static_symm):
+    if not lz_hub_db.insert_device(db, config_data.dev_uuid, "testdevice", osw.dump_cert(device_id_cert_signed), config_data.static_symm):
         print("ERROR: Failed to store device in database. Exit..")
         return 0
     lz_hub_db.close(db)
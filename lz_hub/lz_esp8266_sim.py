@@ -0,0 +1,357 @@
+#!/usr/bin/env python3
+
+import os
+import sys
+import tty
+import time
+import random
+import select
+import socket
+import argparse
+
+# Emulates the subset of the ESP8266 AT firmware that lzport_net.c uses on a pseudo terminal, so
+# that the network stack can be run on the host (port/host, lz_host -n <pty>). TCP connections are
+# bridged to local sockets, e.g. to lz_hub.py. Latency, packet size and drop rate of the Wi-Fi link
+# can be configured to benchmark tickets and updates end-to-end
+
+# Values of AT+CIPSTATUS, see NW_STATUS_* in lzport_net.c
+STATUS_CONNECTED        = 2
+STATUS_TCP_TRANSMISSION = 3
+STATUS_DISCONNECTED     = 5
+
+# The ESP8266 AT firmware accepts at most 2048 bytes per AT+CIPSEND
+MAX_SEND_SIZE           = 2048
+# The ESP8266 forwards received TCP data in packets of at most one TCP segment
+DEFAULT_PACKET_SIZE     = 1460
+DEFAULT_BAUD_RATE       = 115200
+
+SIM_IP                  = "192.168.4.2"
+SIM_MAC                 = "5c:cf:7f:00:00:01"
+
+
+class link_stats:
+
+    def __init__(self, link):
+        self.link = link
+        self.start = time.monotonic()
+        self.tx_bytes = 0
+        self.rx_bytes = 0
+        self.rx_packets = 0
+
+    def print(self, reason):
+        duration = time.monotonic() - self.start
+        print("Link %d %s after %.3f s: sent %d bytes, received %d bytes in %d packets (%.1f KiB/s)"
+              %(self.link, reason, duration, self.tx_bytes, self.rx_bytes, self.rx_packets,
+                self.rx_bytes / 1024 / duration if duration > 0 else 0))
+
+
+class esp8266_sim:
+
+    def __init__(self, args):
+        self.args = args
+        self.echo = True
+        self.wifi_connected = False
+        self.ssid = None
+        self.baud_rate = args.baud
+        self.links = {}
+        self.stats = {}
+        self.cmd = bytearray()
+        self.send_link = None
+        self.send_len = 0
+        self.send_data = bytearray()
+        # Output to the device as a list of (time, data), delayed by the link latency
+        self.output = []
+        self.uart_busy_until = 0
+        self.total = link_stats(-1)
+        self.num_connections = 0
+        self.num_drops = 0
+
+        self.master, self.slave = os.openpty()
+        # The slave stays open, so that the simulator survives the restart of lz_host
+        tty.setraw(self.slave)
+        tty.setraw(self.master)
+        os.set_blocking(self.master, False)
+        self.device = os.ttyname(self.slave)
+
+    def run(self):
+        print("ESP8266 simulator listening on %s" %self.device)
+        print("Run: ./build/lz_host -n %s" %self.device)
+        sys.stdout.flush()
+
+        try:
+            while True:
+                self.poll()
+        except KeyboardInterrupt:
+            pass
+
+        for link in list(self.links):
+            self.close_link(link, "closed by simulator", notify=False)
+        print("")
+        print("Connections:     %d" %self.num_connections)
+        print("Dropped:         %d" %self.num_drops)
+        print("Sent:            %d bytes" %self.total.tx_bytes)
+        print("Received:        %d bytes in %d packets" %(self.total.rx_bytes,
+                                                           self.total.rx_packets))
+
+    def poll(self):
+        now = time.monotonic()
+        timeout = None
+        if len(self.output) > 0:
+            timeout = max(0, self.output[0][0] - now)
+
+        fds = [self.master] + list(self.links.values())
+        readable, _, _ = select.select(fds, [], [], timeout)
+
+        if self.master in readable:
+            try:
+                data = os.read(self.master, 4096)
+            except BlockingIOError:
+                data = b''
+            for b in data:
+                self.handle_byte(b)
+
+        for link, conn in list(self.links.items()):
+            if conn in readable:
+                self.handle_tcp(link, conn)
+
+        self.flush_output()
+
+    def write(self, data, delay=0):
+        """Queues data for the device. The transfer time over the UART is emulated as well"""
+        if isinstance(data, str):
+            data = data.encode('utf-8')
+        start = max(time.monotonic() + delay, self.uart_busy_until)
+        self.uart_busy_until = start + len(data) * 10 / self.baud_rate
+        self.output.append((self.uart_busy_until, data))
+        self.output.sort(key=lambda o: o[0])
+
+    def flush_output(self):
+        now = time.monotonic()
+        while len(self.output) > 0 and self.output[0][0] <= now:
+            _, data = self.output.pop(0)
+            while len(data) > 0:
+                try:
+                    n = os.write(self.master, data)
+                    data = data[n:]
+                except BlockingIOError:
+                    select.select([], [self.master], [])
+
+    def handle_byte(self, b):
+        # Data of AT+CIPSEND is not terminated and may contain line breaks
+        if self.send_link is not None:
+            self.send_data.append(b)
+            if len(self.send_data) == self.send_len:
+                self.handle_send_data()
+            return
+
+        self.cmd.append(b)
+        if self.cmd.endswith(b'\r\n'):
+            cmd = self.cmd[:-2].decode('utf-8', errors='replace')
+            self.cmd = bytearray()
+            if self.echo:
+                self.write(cmd + "\r\n")
+            if len(cmd) > 0:
+                self.handle_command(cmd)
+
+    def handle_command(self, cmd):
+        if self.args.verbose:
+            print("> %s" %cmd)
+
+        if cmd == "AT":
+            self.write("\r\nOK\r\n")
+        elif cmd == "ATE0":
+            self.echo = False
+            self.write("\r\nOK\r\n")
+        elif cmd == "ATE1":
+            self.echo = True
+            self.write("\r\nOK\r\n")
+        elif cmd.startswith("AT+UART_CUR=") or cmd.startswith("AT+UART_DEF="):
+            self.write("\r\nOK\r\n")
+            # The response is still sent with the previous baud rate
+            self.baud_rate = int(cmd.split('=')[1].split(',')[0])
+            print("Baud rate set to %d" %self.baud_rate)
+        elif cmd == "AT+CIPSTATUS":
+            if not self.wifi_connected:
+                status = STATUS_DISCONNECTED
+            elif len(self.links) > 0:
+                status = STATUS_TCP_TRANSMISSION
+            else:
+                status = STATUS_CONNECTED
+            self.write("STATUS:%d\r\n" %status)
+            for link in self.links:
+                self.write("+CIPSTATUS:%d,\"TCP\",\"%s\",%d,0,0\r\n"
+                           %((link,) + self.links[link].getpeername()[:2]))
+            self.write("\r\nOK\r\n")
+        elif cmd == "AT+CWJAP?":
+            if self.wifi_connected:
+                self.write("+CWJAP:\"%s\",\"00:00:00:00:00:00\",1,-50\r\n" %self.ssid)
+            else:
+                self.write("No AP\r\n")
+            self.write("\r\nOK\r\n")
+        elif cmd.startswith("AT+CWMODE"):
+            self.write("\r\nOK\r\n")
+        elif cmd == "AT+CWLAP":
+            self.write("+CWLAP:(3,\"%s\",-50,\"00:00:00:00:00:00\",1)\r\n"
+                       %(self.args.ssid if self.args.ssid else "lazarus"), self.args.latency)
+            self.write("\r\nOK\r\n")
+        elif cmd.startswith("AT+CWJAP"):
+            params = cmd.split('=', 1)[1].split(',')
+            ssid = params[0].strip('"')
+            if self.args.ssid and ssid != self.args.ssid:
+                self.write("+CWJAP:3\r\n\r\nFAIL\r\n", self.args.latency)
+                return
+            self.ssid = ssid
+            self.wifi_connected = True
+            self.write("WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n", self.args.latency)
+        elif cmd == "AT+CIFSR":
+            self.write("+CIFSR:STAIP,\"%s\"\r\n+CIFSR:STAMAC,\"%s\"\r\n\r\nOK\r\n"
+                       %(SIM_IP, SIM_MAC))
+        elif cmd.startswith("AT+CWAUTOCONN") or cmd.startswith("AT+CIPMUX"):
+            self.write("\r\nOK\r\n")
+        elif cmd.startswith("AT+CIPSTART="):
+            self.handle_cipstart(cmd)
+        elif cmd.startswith("AT+CIPSEND="):
+            params = cmd.split('=', 1)[1].split(',')
+            link, length = int(params[0]), int(params[1])
+            if link not in self.links or length <= 0 or length > MAX_SEND_SIZE:
+                self.write("link is not valid\r\n\r\nERROR\r\n")
+                return
+            self.send_link = link
+            self.send_len = length
+            self.send_data = bytearray()
+            self.write("\r\nOK\r\n> ")
+        elif cmd.startswith("AT+CIPCLOSE="):
+            link = int(cmd.split('=', 1)[1])
+            if link not in self.links:
+                self.write("UNLINK\r\n\r\nERROR\r\n")
+                return
+            self.close_link(link, "closed by device", notify=False)
+            self.write("%d,CLOSED\r\n\r\nOK\r\n" %link)
+        else:
+            print("Unsupported command: %s" %cmd)
+            self.write("\r\nERROR\r\n")
+
+    def handle_cipstart(self, cmd):
+        params = cmd.split('=', 1)[1].split(',')
+        link = int(params[0])
+        host = params[2].strip('"')
+        port = int(params[3])
+        if self.args.hub:
+            host, port = self.args.hub.rsplit(':', 1)
+            port = int(port)
+
+        if not self.wifi_connected:
+            self.write("no ip\r\n\r\nERROR\r\n")
+            return
+        if link in self.links:
+            self.write("ALREADY CONNECTED\r\n\r\nERROR\r\n")
+            return
+
+        try:
+            conn = socket.create_connection((host, port), timeout=5)
+            conn.setblocking(False)
+        except Exception as e:
+            print("Failed to connect to %s:%d - %s" %(host, port, str(e)))
+            self.write("\r\nERROR\r\n", self.args.latency)
+            self.write("%d,CLOSED\r\n" %link)
+            return
+
+        self.links[link] = conn
+        self.stats[link] = link_stats(link)
+        self.num_connections += 1
+        self.write("%d,CONNECT\r\n\r\nOK\r\n" %link, self.args.latency)
+
+    def handle_send_data(self):
+        link = self.send_link
+        data = bytes(self.send_data)
+        self.send_link = None
+        self.send_data = bytearray()
+
+        self.write("\r\nRecv %d bytes\r\n" %len(data))
+
+        conn = self.links.get(link)
+        if conn is None:
+            self.write("\r\nSEND FAIL\r\n")
+            return
+        try:
+            conn.setblocking(True)
+            conn.sendall(data)
+            conn.setblocking(False)
+        except Exception:
+            self.write("\r\nSEND FAIL\r\n", self.args.latency)
+            self.close_link(link, "failed to send")
+            return
+
+        self.stats[link].tx_bytes += len(data)
+        self.total.tx_bytes += len(data)
+        self.write("\r\nSEND OK\r\n", self.args.latency)
+
+    def handle_tcp(self, link, conn):
+        try:
+            data = conn.recv(self.args.packet_size)
+        except BlockingIOError:
+            return
+        except Exception:
+            data = b''
+
+        if len(data) == 0:
+            self.close_link(link, "closed by hub")
+            return
+
+        if random.random() < self.args.drop_rate:
+            self.num_drops += 1
+            self.close_link(link, "dropped")
+            return
+
+        self.stats[link].rx_bytes += len(data)
+        self.stats[link].rx_packets += 1
+        self.total.rx_bytes += len(data)
+        self.total.rx_packets += 1
+        self.write(b"\r\n+IPD,%d,%d:" %(link, len(data)) + data, self.args.latency)
+
+    def close_link(self, link, reason, notify=True):
+        conn = self.links.pop(link)
+        conn.close()
+        self.stats.pop(link).print(reason)
+        if notify:
+            self.write("%d,CLOSED\r\n" %link, self.args.latency)
+
+
+def main():
+    args = parse_arguments()
+
+    sim = esp8266_sim(args)
+    sim.run()
+
+    return 0
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description="Emulates an ESP8266 with AT firmware on a "
+        "pseudo terminal for host runs of the network stack (lz_host -n <pty>)")
+    parser.add_argument("--hub", metavar="HOST:PORT", help="Connect to this address instead of "
+        "the server configured on the device, e.g. 127.0.0.1:65433")
+    parser.add_argument("--ssid", help="Only accept this access point, any SSID is accepted if "
+        "not specified")
+    parser.add_argument("--latency", type=float, default=0, metavar="MS", help="Delay of "
+        "responses that involve the Wi-Fi link in milliseconds (default: 0)")
+    parser.add_argument("--packet-size", type=int, default=DEFAULT_PACKET_SIZE, metavar="BYTES",
+        help="Maximum size of +IPD packets (default: %d)" %DEFAULT_PACKET_SIZE)
+    parser.add_argument("--drop-rate", type=float, default=0, metavar="P", help="Probability "
+        "with which the connection is lost on each received packet (default: 0)")
+    parser.add_argument("--baud", type=int, default=DEFAULT_BAUD_RATE, help="Initial baud rate "
+        "of the emulated UART. AT+UART_CUR changes it (default: %d)" %DEFAULT_BAUD_RATE)
+    parser.add_argument("-v", "--verbose", action="store_true", help="Print the AT commands")
+
+    args = parser.parse_args()
+    args.latency = args.latency / 1000
+
+    if args.packet_size <= 0 or args.drop_rate < 0 or args.drop_rate > 1 or args.baud <= 0:
+        parser.error("invalid link parameters")
+
+    return args
+
+
+if __name__ == "__main__":
+    ret = main()
+    sys.exit(ret)
@@ -9,16 +9,32 @@ from OpenSSL import crypto
 import open_ssl_wrapper as osw
 import argparse
 import os
+import logging
+import time
+import threading
+import queue
+import selectors
+from concurrent.futures import ThreadPoolExecutor
 import wifi_credentials
-from lz_hub_device_certbag import device_certbag
+from lz_hub_device_certbag import device_certbag, alias_id_cache
 from lz_hub_certbag import hub_certbag
-from lz_hub_dev_update import get_update_file
+from lz_hub_dev_update import get_update_image, get_delta_image, get_compressed_update_image, \
+    get_code_digest, is_recovery_request
+from lz_hub_rollout import rollout_scheduler, get_rollout_image, ROLLOUT_DEFER
 from lz_hub_element_type import ELEMENT_TYPE
+from lz_data_provisioning import TRUST_ANCHOR_FORMAT, TRUST_ANCHOR_VERSION
 import lz_hub_db
 from ecdsa.util import sigencode_der, sigdecode_der
 import uuid as u
 
+log = logging.getLogger(__name__)
+
 MAX_DEFERRAL_TIME       = 1000*60*60
+# Maximum number of deferral tickets issued at once, see LZ_MAX_DEFERRAL_BATCH
+MAX_DEFERRAL_BATCH      = 16
+# Maximum total deferral time of all tickets of a batch. The device may use the tickets one after
+# another, so a batch must not defer the AWDT longer than a single ticket may
+MAX_DEFERRAL_BATCH_TIME = MAX_DEFERRAL_TIME
 
 TCP_CMD_REQ_BACKEND_PK  = 0x4
 TCP_CMD_ACK             = 0x3
@@ -37,14 +53,41 @@ LEN_PUB_KEY_PEM         = 279
 LEN_SIGNED_AREA = 76 + LEN_DEV_UUID
 LEN_SIGNATURE = 84
 LEN_HDR = LEN_SIGNED_AREA + LEN_SIGNATURE
+LEN_UPDATE_REQUEST = 8 + 32 + 32
 
 MAGICVAL                = (0x41495345)
 
+# Devices give up after TIMEOUT_TCP_MS (10 s). A connection that is idle for longer is closed and
+# a request that waited this long for a worker is dropped, as the device does not wait for it
+TCP_TIMEOUT_S           = 8
+TCP_BACKLOG             = 128
+TCP_RECV_SIZE           = 0x1000
+# Complete requests which may wait for a worker. If the workers fall further behind, no more
+# requests are read until they caught up
+MAX_QUEUED_REQUESTS_PER_WORKER = 4
+# Requests of the devices are small, larger packets are rejected before they are received
+MAX_REQUEST_PAYLOAD     = 0x4000
+# Payloads of at least this size are not copied into the packet, but sent after the header
+SEND_ZERO_COPY_MIN_SIZE = 0x1000
+# Downloads of rollouts with a bandwidth limit are sent in chunks of this size
+SEND_THROTTLE_CHUNK_SIZE = 0x1000
+# Interval in which old sensor samples are downsampled and deleted
+SENSOR_DATA_RETENTION_INTERVAL_S = 60 * 60
+
+# Chain-verified AliasID public keys of the devices
+alias_id_keys = alias_id_cache()
+
+# Rollouts of updates to the devices, which are controlled with lz_hub_rollout.py
+rollouts = rollout_scheduler()
+
 
 def main():
     global wifi_credentials_file_name
-    print("-------------------------- Backend server v0.1 -----------------------------")
-    cert_path, wifi_credentials_file_name = parse_arguments()
+    logging.basicConfig(level=logging.INFO, format="%(message)s")
+    log.info("-------------------------- Backend server v0.1 -----------------------------")
+    args = parse_arguments()
+    cert_path = args.cert_path
+    wifi_credentials_file_name = args.wifi_credentials_file
 
     # Load wifi-credentials from file.
     wifi_params = wifi_credentials.load(wifi_credentials_file_name)
@@ -55,40 +98,265 @@ def main():
     hub_cb = hub_certbag(cert_path)
 
     if not hub_cb.load():
-        print("ERROR: Could not load hub certificates. Exit..")
+        log.error("ERROR: Could not load hub certificates. Exit..")
+        return 0
+
+    # Create the tables once, before the workers access the database concurrently
+    db = lz_hub_db.connect()
+    if db is None:
+        return 0
+    lz_hub_db.close(db)
+
+    s = create_server_socket(wifi_params['ip'], wifi_params['port'])
+    if s is None:
         return 0
 
-    print("Waiting for connections..")
+    # The workers queue their writes, which are committed in batches by the writer thread
+    lz_hub_db.start_writer()
+    threading.Thread(target=run_sensor_data_retention, daemon=True).start()
+
+    log.info("Waiting for connections..")
+
+    with s:
+        serve(s, hub_cb, args.workers)
+
+
+def create_server_socket(ip, port):
+
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    try:
+        s.bind((ip, port))
+    except Exception as e:
+        log.error("ERROR: Failed to bind socket to %s:%s - %s" %(ip, port, str(e)))
+        s.close()
+        return None
+    s.listen(TCP_BACKLOG)
 
-    # Establish connection
+    return s
+
+
+def run_sensor_data_retention():
     while True:
-        with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
-            s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
-            try:
-                s.bind((wifi_params['ip'], wifi_params['port']))
-            except Exception as e:
-                print("ERROR: Failed to bind socket to %s:%s - %s" %(wifi_params['ip'],
-                    wifi_params['port'], str(e)))
-                break
-            s.listen()
-            conn, addr = s.accept()
-            with conn:
-                print('Connected by', addr)
-                while True:
-                    # Receive data
+        deleted = lz_hub_db.store_sensor_data_retention()
+        if deleted:
+            log.info("INFO: Downsampled %d sensor samples" %deleted)
+        time.sleep(SENSOR_DATA_RETENTION_INTERVAL_S)
+
+
+class hub_connection:
+    """A connection of a device. Its requests are received by serve() and handled by a worker"""
+
+    def __init__(self, conn, addr):
+        self.conn = conn
+        self.addr = addr
+        self.buf = bytearray()
+        self.last_active = time.monotonic()
+
+    def next_request(self):
+        """Removes the next complete request from the receive buffer. Returns None if it has not
+        been received completely yet"""
+
+        if len(self.buf) < 8:
+            return None
+        size = packet_size(self.buf[:8])
+        if len(self.buf) < size:
+            return None
+
+        request = bytes(self.buf[:size])
+        del self.buf[:size]
+
+        return request
+
+
+def serve(s, hub_cb, workers):
+    """Accepts connections and receives their requests with a selector. Request handling is
+    dominated by the signature operations, so only complete requests are handed to a pool of
+    worker threads. A session which waits for its next request does not occupy a worker"""
+
+    sel = selectors.DefaultSelector()
+    # The workers hand the connections back through the queue and wake up the selector
+    done = queue.Queue()
+    wakeup_r, wakeup_w = socket.socketpair()
+    wakeup_r.setblocking(False)
+    wakeup_w.setblocking(False)
+    s.setblocking(False)
+    sel.register(s, selectors.EVENT_READ)
+    sel.register(wakeup_r, selectors.EVENT_READ)
+
+    max_queued = workers * MAX_QUEUED_REQUESTS_PER_WORKER
+    queued = 0
+    last_idle_check = time.monotonic()
+
+    def close(c):
+        if c.conn.fileno() != -1 and c.conn in sel.get_map():
+            sel.unregister(c.conn)
+        c.conn.close()
+
+    def dispatch(c):
+        """Hands the next complete request of the connection to the workers or waits for it"""
+        nonlocal queued
+        try:
+            request = c.next_request()
+        except ValueError as e:
+            log.error("HUB: ERROR - %s" %str(e))
+            close(c)
+            return
+        if request is None:
+            if c.conn not in sel.get_map():
+                sel.register(c.conn, selectors.EVENT_READ, c)
+            return
+        if c.conn in sel.get_map():
+            sel.unregister(c.conn)
+        queued += 1
+        executor.submit(handle_connection, c, request, hub_cb, done, wakeup_w)
+
+    def resume(c, keep):
+        nonlocal queued
+        queued -= 1
+        if not keep:
+            close(c)
+            return
+        c.conn.setblocking(False)
+        c.last_active = time.monotonic()
+        dispatch(c)
+
+    with ThreadPoolExecutor(max_workers=workers) as executor:
+        while s.fileno() != -1:
+            # The requests wait in the socket buffers and the accept backlog instead
+            if queued >= max_queued:
+                try:
+                    resume(*done.get(timeout=1))
+                except queue.Empty:
+                    pass
+                continue
+
+            for key, _ in sel.select(timeout=1):
+                if key.fileobj is s:
                     try:
-                        data = conn.recv(1024)
-                    except Exception as e:
-                        print("HUB: ERROR - %s" %str(e))
-                        break
+                        conn, addr = s.accept()
+                    except BlockingIOError:
+                        continue
+                    except OSError as e:
+                        log.error("HUB: ERROR - %s" %str(e))
+                        continue
+                    log.info("Connected by %s" %str(addr))
+                    conn.setblocking(False)
+                    sel.register(conn, selectors.EVENT_READ, hub_connection(conn, addr))
+                elif key.fileobj is wakeup_r:
+                    try:
+                        wakeup_r.recv(TCP_RECV_SIZE)
+                    except BlockingIOError:
+                        pass
+                    while not done.empty():
+                        resume(*done.get())
+                else:
+                    c = key.data
+                    try:
+                        data = c.conn.recv(TCP_RECV_SIZE)
+                    except BlockingIOError:
+                        continue
+                    except OSError as e:
+                        log.error("HUB: ERROR - %s" %str(e))
+                        close(c)
+                        continue
                     if not data:
-                        break
+                        close(c)
+                        continue
+                    c.buf += data
+                    c.last_active = time.monotonic()
+                    dispatch(c)
+
+            # Sessions which are idle for longer than the devices wait are closed
+            now = time.monotonic()
+            if now - last_idle_check >= 1:
+                last_idle_check = now
+                for key in list(sel.get_map().values()):
+                    if isinstance(key.data, hub_connection) and \
+                            now - key.data.last_active > TCP_TIMEOUT_S:
+                        close(key.data)
+
+        for key in list(sel.get_map().values()):
+            if isinstance(key.data, hub_connection):
+                close(key.data)
+
+    sel.close()
+    wakeup_r.close()
+    wakeup_w.close()
+
+
+def handle_connection(c, request, hub_cb, done, wakeup):
+    """Handles a complete request of a connection in a worker and hands the connection back to
+    serve(). A request which waited longer than the device for a worker is dropped"""
+
+    keep = False
+    try:
+        if time.monotonic() - c.last_active > TCP_TIMEOUT_S:
+            log.warning("WARN: Dropping request of %s, which waited too long for a worker"
+                %str(c.addr))
+        else:
+            c.conn.settimeout(TCP_TIMEOUT_S)
+            handle_request(c.conn, request, hub_cb)
+            keep = True
+
+            log.info("Packet evaluated. Waiting for new data..")
+            log.info("----------------------------------------")
+            log.info("")
+    except Exception as e:
+        log.error("HUB: ERROR - failed to handle request from %s: %s" %(c.addr, str(e)))
+    finally:
+        done.put((c, keep))
+        try:
+            wakeup.send(b"\0")
+        except BlockingIOError:
+            # The selector is woken up already
+            pass
+
+
+def packet_size(data):
+    """Returns the size of a packet including its header from the first 8 bytes of the packet"""
+
+    element_type, payload_size = struct.unpack('II', data)
+    if payload_size > MAX_REQUEST_PAYLOAD:
+        raise ValueError("payload size %d of packet type %d exceeds maximum" %(payload_size, element_type))
+
+    # An AliasID update or a CMD is unauthenticated and has a shorter header
+    if element_type == ELEMENT_TYPE.ALIAS_ID or element_type == ELEMENT_TYPE.CMD:
+        len_hdr = 8 + LEN_DEV_UUID
+    else:
+        len_hdr = LEN_HDR
+
+    return len_hdr + payload_size
+
+
+def recv_packet(conn):
+    """Receives exactly one packet. Packets are framed by their header, which contains the payload
+    size. Returns None if the connection was closed before a new packet"""
 
-                    handle_request(conn, data, hub_cb)
+    data = recv_exact(conn, 8)
+    if data is None:
+        return None
+
+    remainder = recv_exact(conn, packet_size(data) - len(data))
+    if remainder is None:
+        raise ConnectionError("connection closed within packet")
+
+    return data + remainder
+
+
+def recv_exact(conn, size):
+    """Receives exactly size bytes. Returns None if the connection was closed"""
+
+    buf = bytearray(size)
+    view = memoryview(buf)
+    received = 0
+    while received < size:
+        n = conn.recv_into(view[received:])
+        if n == 0:
+            return None
+        received += n
 
-                    print("Packet evaluated. Waiting for new data..")
-                    print("----------------------------------------")
-                    print("")
+    return bytes(buf)
 
 
 def handle_request(conn, data, hub_cb):
@@ -96,9 +364,9 @@ def handle_request(conn, data, hub_cb):
     # Pre-unpack the element-type to see if it is an authenticated or unauthenticated packet
     try:
         element_type = struct.unpack('I', data[:4])[0]
-        print("Received packet type %s, length = %d" %(ELEMENT_TYPE(element_type), len(data)))
+        log.info("Received packet type %s, length = %d" %(ELEMENT_TYPE(element_type), len(data)))
     except Exception as e:
-        print("Invalid packet type: %s. Abort" %str(e))
+        log.error("Invalid packet type: %s. Abort" %str(e))
         return
 
     # DeviceID re-association is a special case
@@ -114,32 +382,32 @@ def handle_request(conn, data, hub_cb):
 
 def handle_unauthenticated_reqest(conn, data, hub_cb):
 
-    print("Processing UNAUTHENTICATED packet..")
+    log.info("Processing UNAUTHENTICATED packet..")
     len_hdr = 8+LEN_DEV_UUID
     try:
         element_type, payload_size, uuid = struct.unpack("II16s", data[:len_hdr])
         payload = struct.unpack("%ds" %payload_size, data[len_hdr:])[0]
     except Exception as e:
-        print("Error unpacking data: %s" %str(e))
+        log.error("Error unpacking data: %s" %str(e))
         conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
         return
 
     if element_type == ELEMENT_TYPE.ALIAS_ID:
-        print(str(u.UUID(bytes=uuid)))
+        log.info(str(u.UUID(bytes=uuid)))
         handle_alias_id_cert_update(conn, uuid, payload, hub_cb)
     elif element_type == ELEMENT_TYPE.CMD:
         handle_cmd(conn, uuid, payload)
     else:
-        print("unknown command")
+        log.info("unknown command")
 
     return
 
 
 def handle_cmd(conn, uuid,  payload):
-    print("Received Command")
+    log.info("Received Command")
 
     if payload == TCP_CMD_REQ_BACKEND_PK:
-        print("TCP_CMD TCP_CMD_REQ_BACKEND_PK")
+        log.info("TCP_CMD TCP_CMD_REQ_BACKEND_PK")
         # TODO
         # The key format requests 0x4 as the first byte
         # first_byte = 0x4
@@ -147,18 +415,18 @@ def handle_cmd(conn, uuid,  payload):
 
         # TODO send back key in correct authenticated format
     if payload == TCP_CMD_ACK:
-        print("TCP_CMD_ACK")
+        log.info("TCP_CMD_ACK")
     elif payload == TCP_CMD_NAK:
-        print("TCP_CMD_NAK")
+        log.info("TCP_CMD_NAK")
     elif payload == TCP_CMD_TEST:
-        print("TCP_CMD_TEST")
+        log.info("TCP_CMD_TEST")
     else:
-        print("TCP_CMD_UNKNOWN")
+        log.info("TCP_CMD_UNKNOWN")
 
 
 def handle_authenticated_reqest(conn, data, hub_cb):
 
-    print("Processing AUTHENTICATED packet..")
+    log.info("Processing AUTHENTICATED packet..")
 
     try:
         signed_area, signature = struct.unpack("%ds%ds" %(LEN_SIGNED_AREA, LEN_SIGNATURE), data[:LEN_HDR])
@@ -167,40 +435,45 @@ def handle_authenticated_reqest(conn, data, hub_cb):
         element_type, payload_size, uuid, magic, nonce, digest = struct.unpack("II16sI32s32s", signed_area)
         payload = struct.unpack("%ds" %payload_size, data[LEN_HDR:])[0]
     except Exception as e:
-        print("Error unpacking data: %s" %str(e))
+        log.error("Error unpacking data: %s" %str(e))
         return
 
-    # Load certificates from database
-    device_cb = device_certbag(uuid)
-    trusted_certs = [hub_cb.hub_cert, device_cb.device_id_cert]
-    if not osw.verify_cert(trusted_certs, device_cb.alias_id_cert):
-        print("ERROR: Certificate chain could not be verified")
+    # Get the AliasID public key, the certificate chain is only verified once per AliasID
+    alias_id_pk_ecdsa = alias_id_keys.get_verifying_key(uuid, hub_cb.hub_cert)
+    if alias_id_pk_ecdsa is None:
+        log.error("ERROR: No verified AliasID public key for UUID %s" %str(u.UUID(bytes=uuid)))
         conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
         return
 
     try:
-        print("Verifying request with AliasID public key..")
-        alias_id_pk_ecdsa = ecdsa.VerifyingKey.from_pem(osw.dump_publickey(device_cb.alias_id_cert.get_pubkey()))
+        log.info("Verifying request with AliasID public key..")
         ret = alias_id_pk_ecdsa.verify(signature, signed_area, hashfunc=hashlib.sha256, sigdecode=sigdecode_der)
         if ret == True:
-            print("Good signature!")
+            log.info("Good signature!")
         else:
-            print("ERROR: Bad signature. Drop packet")
+            log.error("ERROR: Bad signature. Drop packet")
             conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
             return
     except Exception as e:
-        print("ERROR: Could not verify signature: %s. Drop packet" %(str(e)))
+        log.error("ERROR: Could not verify signature: %s. Drop packet" %(str(e)))
         conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
         return
 
     # Verify payload
     calculated_digest = hashlib.sha256(payload).digest()
     if calculated_digest != digest:
-        print(f"ERROR: digest mismatch - {calculated_digest} vs. {digest}")
+        log.error(f"ERROR: digest mismatch - {calculated_digest} vs. {digest}")
         conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
         return
 
-    print("Digest verification successful")
+    log.info("Digest verification successful")
+
+    # Offset from which on the payload is sent, if the device continues an interrupted download
+    offset = 0
+    # Digest of the payload, if it is known already
+    payload_digest = None
+    # Rollout the sent update belongs to
+    rollout = None
 
     # Handle request according to type
     if ((element_type == ELEMENT_TYPE.APP_UPDATE) or
@@ -208,12 +481,55 @@ def handle_authenticated_reqest(conn, data, hub_cb):
         (element_type == ELEMENT_TYPE.CP_UPDATE) or
         (element_type == ELEMENT_TYPE.LZ_CORE_UPDATE)):
 
-        payload = get_update_file(element_type)
-        if payload is None:
-            print("ERROR: Failed to retrieve firmware update file on hub")
+        request = payload
+
+        # During a rollout, devices receive the update when their wave started and a download
+        # slot is free, and otherwise must try again later
+        rollout = rollouts.admit(uuid, element_type, request)
+        if rollout == ROLLOUT_DEFER:
+            log.info("INFO: Deferring update of UUID %s because of rollout"
+                %str(u.UUID(bytes=uuid)))
             conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
             return
 
+        if rollout is not None:
+            update = get_rollout_image(rollout)
+        else:
+            update = get_update_image(element_type)
+        if update is None:
+            log.error("ERROR: Failed to retrieve firmware update file on hub")
+            if rollout is not None:
+                rollouts.finish(rollout, uuid, 0, False)
+            conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
+            return
+
+        # Devices with an intact image check for updates regularly. They receive nothing if they
+        # already run the update
+        if is_installed(request, update):
+            log.info("INFO: UUID %s already runs the update" %str(u.UUID(bytes=uuid)))
+            if rollout is not None:
+                rollouts.finish(rollout, uuid, 0, True)
+            conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
+            return
+        image = update
+
+        # Send only a delta against the installed image, if the device accepts one
+        delta = get_update_delta(request, element_type, update)
+        if delta is not None:
+            element_type = ELEMENT_TYPE.DELTA_UPDATE
+            image = delta
+        elif element_type != ELEMENT_TYPE.LZ_CORE_UPDATE:
+            # Otherwise send the compressed update, if there is one. The Core Patcher cannot
+            # decompress Lazarus Core updates
+            compressed = get_compressed_update_image(update)
+            if compressed is not None:
+                image = compressed
+
+        # The images are cached with their digests, only the header is signed per request
+        offset = get_resume_offset(request, image)
+        payload = image.data
+        payload_digest = image.digest
+
     elif element_type == ELEMENT_TYPE.BOOT_TICKET:
 
         payload = struct.pack("I", magic)
@@ -223,11 +539,21 @@ def handle_authenticated_reqest(conn, data, hub_cb):
         time_ms = get_deferral_time(struct.unpack("I", payload)[0])
         payload = struct.pack("I", time_ms)
 
+    elif element_type == ELEMENT_TYPE.DEFERRAL_TICKET_BATCH:
+
+        try:
+            time_ms, count = struct.unpack("II", payload)
+        except Exception as e:
+            log.error("ERROR: Failed to unpack ticket batch request - %s" %str(e))
+            conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
+            return
+        payload = get_deferral_batch(get_deferral_time(time_ms), count)
+
     elif element_type == ELEMENT_TYPE.CONFIG_UPDATE:
 
         payload = get_nw_config()
         if payload is None:
-            print("ERROR: Failed to retrieve firmware update file on hub")
+            log.error("ERROR: Failed to retrieve firmware update file on hub")
             conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
             return
 
@@ -236,38 +562,84 @@ def handle_authenticated_reqest(conn, data, hub_cb):
         try:
             index, temp, humidity = struct.unpack("Iff", payload)
         except Exception as e:
-            print("ERROR: Failed to unpack sensor data - %s" %str(e))
+            log.error("ERROR: Failed to unpack sensor data - %s" %str(e))
             conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
             return
-        print("INFO: UUID = %s" %str(u.UUID(bytes=uuid)))
-        print("INFO: INDEX %d = TEMP: %f°C, HUMIDITY: %fpct" %(index, temp, humidity))
-        db = lz_hub_db.connect()
-        lz_hub_db.update_data(db, uuid, 1, index, temp, humidity)
-        lz_hub_db.close(db)
-
-        payload = payload = struct.pack("I", TCP_CMD_ACK)
+        log.info("INFO: UUID = %s" %str(u.UUID(bytes=uuid)))
+        log.info("INFO: INDEX %d = TEMP: %f°C, HUMIDITY: %fpct" %(index, temp, humidity))
+        # Samples are refused if the database cannot keep up
+        if lz_hub_db.store_sensor_data(uuid, time.time(), index, temp, humidity):
+            payload = struct.pack("I", TCP_CMD_ACK)
+        else:
+            payload = struct.pack("I", TCP_CMD_NAK)
 
     else:
-        print("ERROR: Received unknown packet: %d" %element_type)
-        print("Full packet: ")
-        print(data)
-        print("Abort")
+        log.error("ERROR: Received unknown packet: %d" %element_type)
+        log.info("Full packet: ")
+        log.info(data)
+        log.info("Abort")
         conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
         return
 
-    send_element(conn, magic, nonce, element_type, uuid, payload, hub_cb)
+    if rollout is None:
+        send_element(conn, magic, nonce, element_type, uuid, payload, hub_cb, offset,
+            payload_digest)
+        return
+
+    ret = send_element(conn, magic, nonce, element_type, uuid, payload, hub_cb, offset,
+        payload_digest, lambda size: rollouts.throttle(rollout, size))
+    rollouts.finish(rollout, uuid, len(payload) - offset if ret else 0, ret)
+
+
+def get_resume_offset(request, update):
+    """Returns the offset from which on the update must be sent. If a download was interrupted,
+    the device requests only the remainder, which is possible if the update did not change"""
+
+    if len(request) != LEN_UPDATE_REQUEST:
+        return 0
+
+    _, offset, digest, _ = struct.unpack("II32s32s", request)
+    if offset == 0 or offset >= len(update.data) or digest != update.digest:
+        return 0
+
+    log.info("Continuing interrupted download at offset %d" %offset)
+    return offset
+
+
+def is_installed(request, update):
+    """Checks whether the device sent the code digest of the update as its installed image"""
+
+    if is_recovery_request(request):
+        return False
+
+    _, _, _, base_digest = struct.unpack("II32s32s", request)
+    return base_digest == get_code_digest(update)
+
+
+def get_update_delta(request, element_type, update):
+    """Returns a delta which creates the update from the image installed on the device, or None
+    if the device requires the complete update or no matching delta exists"""
+
+    if len(request) != LEN_UPDATE_REQUEST:
+        return None
+
+    _, _, _, base_digest = struct.unpack("II32s32s", request)
+    if base_digest == bytes(32):
+        return None
+
+    return get_delta_image(element_type, base_digest, update)
 
 
 def handle_device_id_reassociation(conn, data, hub_cb):
 
-    print("Processing AUTHENTICATED packet..")
+    log.info("Processing AUTHENTICATED packet..")
 
     try:
         signed_area, signature = struct.unpack("%ds%ds" %(LEN_SIGNED_AREA, LEN_SIGNATURE), data[:LEN_HDR])
         element_type, payload_size, uuid, magic, nonce, digest = struct.unpack("II16sI32s32s", signed_area)
         payload = struct.unpack("%ds" %payload_size, data[LEN_HDR:])[0]
     except Exception as e:
-        print("Error unpacking data: %s" %str(e))
+        log.error("Error unpacking data: %s" %str(e))
         return
 
     # DO NOT verify the signature here, as we have a new DeviceID which must first be
@@ -276,11 +648,11 @@ def handle_device_id_reassociation(conn, data, hub_cb):
     # Verify payload
     calculated_digest = hashlib.sha256(payload).digest()
     if calculated_digest != digest:
-        print("ERROR digest mismatch")
+        log.error("ERROR digest mismatch")
         conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
         return
 
-    print("Digest verification successful")
+    log.info("Digest verification successful")
 
     # payload = enc(dev_uuid | dev_auth | DeviceID CSR)^hub_pub
     payload_decrypted = ecdh_decrypt(payload, hub_cb.hub_sk)
@@ -295,41 +667,42 @@ def handle_device_id_reassociation(conn, data, hub_cb):
 
     device_cb = device_certbag(uuid)
     if not device_cb.reassociate_device_id_cert(csr_buffer, dev_auth, hub_cb.hub_cert, hub_cb.hub_sk):
-        print("ERROR: Unable to update and reassociate DeviceID certificate.")
-        print("Cert: %s" %csr_buffer)
+        log.error("ERROR: Unable to update and reassociate DeviceID certificate.")
+        log.info("Cert: %s" %csr_buffer)
         conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
         return
 
+    # The AliasID certificate was issued by the old DeviceID
+    alias_id_keys.invalidate(uuid)
+
     # NOW the signature of the packet can be verified with the new device ID
     # TODO implement this
 
-    # Send back the trust anchors structure
-    device_id_cert = osw.dump_cert(device_cb.device_id_cert)
+    # Send back the trust anchors structure. Zeroed keys are not updated by the device
+    device_id_cert = osw.dump_cert_der(device_cb.device_id_cert)
     if device_id_cert is None:
-        print("ERROR: Could not convert certificate to raw format")
+        log.error("ERROR: Could not convert certificate to raw format")
         return
 
     magic = MAGICVAL
-    flags = 0
-    # device_id_pub_key = bytearray(LEN_PUB_KEY)
-    # code_auth_pub_key = bytearray(LEN_PUB_KEY)
-    # hub_pub_key = bytearray(LEN_PUB_KEY)
+    device_id_pub_key = bytes()
+    code_auth_pub_key = bytes()
+    hub_pub_key = bytes()
     hub_cert_start = 0
     hub_cert_size = 0
     device_id_cert_start = 0
     device_id_cert_size = len(device_id_cert)
     cursor = hub_cert_start + hub_cert_size + device_id_cert_size
-    cert_bag = device_id_cert + bytearray(4076 - device_id_cert_size)
+    cert_bag = device_id_cert
 
     try:
         payload = struct.pack(
-            # 'II76s76s76sHHHHI3848s',  # (TRUST_ANCHORS = 4096 Bytes)
-            'IIHHHHI4076s',  # (TRUST_ANCHORS = 4096 Bytes)
+            TRUST_ANCHOR_FORMAT,  # (TRUST_ANCHORS = 4096 Bytes)
             magic,
-            flags,
-            # device_id_pub_key,
-            # code_auth_pub_key,
-            # hub_pub_key,
+            TRUST_ANCHOR_VERSION,
+            device_id_pub_key,
+            code_auth_pub_key,
+            hub_pub_key,
             hub_cert_start,
             hub_cert_size,
             device_id_cert_start,
@@ -337,7 +710,7 @@ def handle_device_id_reassociation(conn, data, hub_cb):
             cursor,
             cert_bag)
     except Exception as e:
-        print("Unable to pack trust anchors to raw-data: %s. Exit.." %str(e))
+        log.error("Unable to pack trust anchors to raw-data: %s. Exit.." %str(e))
         return 0
 
     send_element(conn, MAGICVAL, nonce, ELEMENT_TYPE.DEVICE_ID_REASSOC_RES, uuid, payload, hub_cb)
@@ -345,15 +718,35 @@ def handle_device_id_reassociation(conn, data, hub_cb):
 
 def get_deferral_time(time_ms):
 
-    print("Requested time ms: %dms" %time_ms)
+    log.info("Requested time ms: %dms" %time_ms)
     if time_ms > MAX_DEFERRAL_TIME:
         time_ms = MAX_DEFERRAL_TIME
-        print("Requested deferral time violating server policies. Reducing deferral time to "
+        log.info("Requested deferral time violating server policies. Reducing deferral time to "
             "%dms" %MAX_DEFERRAL_TIME)
 
     return time_ms
 
 
+def get_deferral_batch(time_ms, count):
+    """Issues count deferral tickets as a hash chain, see lz_deferral_batch_t. The count is
+    reduced so that the tickets together defer the AWDT for at most MAX_DEFERRAL_BATCH_TIME"""
+
+    max_count = max(1, min(MAX_DEFERRAL_BATCH, MAX_DEFERRAL_BATCH_TIME // max(time_ms, 1)))
+    if count < 1 or count > max_count:
+        count = max(1, min(count, max_count))
+        log.info("Requested number of deferral tickets violating server policies. Reducing to %d"
+            %count)
+
+    # The last ticket is random, each ticket before is the hash of its successor
+    chain = [os.urandom(32)]
+    for _ in range(count):
+        chain.insert(0, hashlib.sha256(chain[0]).digest())
+
+    log.info("Issuing %d deferral tickets with %dms" %(count, time_ms))
+
+    return struct.pack("II", time_ms, count) + b''.join(chain)
+
+
 def get_nw_config():
 
     params = wifi_credentials.load(wifi_credentials_file_name)
@@ -388,17 +781,21 @@ def get_nw_config():
             server_port,
             padding)
     except Exception as e:
-        print("Unable to pack network data configuration: %s. Exit.." %str(e))
+        log.error("Unable to pack network data configuration: %s. Exit.." %str(e))
         return None
 
     return config_data
 
 
-def send_element(conn, magic, nonce, element_type, uuid, payload, hub_cb):
+def send_element(conn, magic, nonce, element_type, uuid, payload, hub_cb, offset=0, digest=None,
+    throttle=None):
+    """Sends the payload with a signed header. throttle(size) is called before each chunk of a
+    large payload is sent. Returns True if the element was sent"""
 
-    # Calculate digest and size of payload
+    # Calculate digest and size of payload, unless the digest is known already
     payload_size = len(payload)
-    digest = hashlib.sha256(payload).digest()
+    if digest is None:
+        digest = hashlib.sha256(payload).digest()
 
     # Create element header
     try:
@@ -410,15 +807,15 @@ def send_element(conn, magic, nonce, element_type, uuid, payload, hub_cb):
                                                 digest,
                                                 )
     except Exception as e:
-        print("ERROR: failed to create header: %s" %str(e))
-        return
+        log.error("ERROR: failed to create header: %s" %str(e))
+        return False
 
     # Append signature to header
-    hdr_sig = hub_cb.hub_sk_ecdsa.sign(hdr_data, hashfunc=hashlib.sha256, sigencode=sigencode_der)
+    hdr_sig = hub_cb.sign(hdr_data)
     if len(hdr_sig) > LEN_SIGNATURE:
-        print(f"ERROR: signature too long ({len(hdr_sig)} > {LEN_SIGNATURE})")
-        return
-    print(f"Length of the signature: {len(hdr_sig)}")
+        log.error(f"ERROR: signature too long ({len(hdr_sig)} > {LEN_SIGNATURE})")
+        return False
+    log.info(f"Length of the signature: {len(hdr_sig)}")
     # We now need to make the signature to a byte block of length 84
     hdr_sig = hdr_sig + (b"\x00" * (LEN_SIGNATURE - len(hdr_sig) - 4)) + int.to_bytes(len(hdr_sig), 4, "little")
 
@@ -426,27 +823,46 @@ def send_element(conn, magic, nonce, element_type, uuid, payload, hub_cb):
 
     print_tcp_element_info(payload_size, nonce, element_type, digest, hdr_sig)
 
-    data = hdr_data + hdr_sig + payload
-
-    print("Sending %s (total %d bytes, payload %d bytes)"
-        %(ELEMENT_TYPE(element_type), len(data), len(payload)))
+    # The header always covers the complete payload, but only the payload from offset on is sent.
+    # Large payloads are sent from a view, so that updates are not copied for every device. Small
+    # payloads are sent with the header, to not delay them in a separate segment
+    hdr = hdr_data + hdr_sig
+    data = memoryview(payload)[offset:]
+    if len(data) < SEND_ZERO_COPY_MIN_SIZE:
+        hdr = hdr + data
+        data = None
+
+    log.info("Sending %s (total %d bytes, payload %d bytes from offset %d)"
+        %(ELEMENT_TYPE(element_type), len(hdr) + (len(data) if data else 0), len(payload), offset))
     try:
-        conn.sendall(data)
+        conn.sendall(hdr)
+        if data and throttle is None:
+            conn.sendall(data)
+        elif data:
+            for chunk_offset in range(0, len(data), SEND_THROTTLE_CHUNK_SIZE):
+                chunk = data[chunk_offset:chunk_offset + SEND_THROTTLE_CHUNK_SIZE]
+                throttle(len(chunk))
+                conn.sendall(chunk)
     except Exception as e:
-        print("ERROR: failed to send data: %s" %str(e))
-        return
+        log.error("ERROR: failed to send data: %s" %str(e))
+        return False
+
+    return True
 
 
 def handle_alias_id_cert_update(conn, uuid, cert_buffer, hub_cb):
 
-    print("INFO: Updating AliasID for UUID %s" %str(u.UUID(bytes=uuid)))
+    log.info("INFO: Updating AliasID for UUID %s" %str(u.UUID(bytes=uuid)))
     device_cb = device_certbag(uuid)
     if not device_cb.update_alias_id_cert(cert_buffer, hub_cb.hub_cert):
-        print("ERROR: Unable to update AliasID certificate.")
+        log.error("ERROR: Unable to update AliasID certificate.")
         conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_NAK))
         return
 
-    print("Send back Response ACK..")
+    # Devices send their AliasID certificate after every boot, keep the cached key if it is unchanged
+    alias_id_keys.invalidate(uuid, device_cb.alias_id_cert)
+
+    log.info("Send back Response ACK..")
     conn.sendall(struct.pack('II16sI', ELEMENT_TYPE.CMD, 4, uuid, TCP_CMD_ACK))
 
 
@@ -460,11 +876,11 @@ def ecdh_decrypt(payload, hub_cb):
 
 def print_tcp_element_info(payload_size, nonce, element_type, digest, signature):
 
-    print("Payload size:    %d (0x%x) bytes" %(payload_size, payload_size))
-    print("Nonce:           %s" %("".join("{:02x}".format(x) for x in nonce)))
-    print("Type:            %s" %ELEMENT_TYPE(element_type)) # TODO readable
-    print("Digest:          %s" %("".join("{:02x}".format(x) for x in digest)))
-    print("Signature:       %s" %("".join("{:02x}".format(x) for x in signature)))
+    log.info("Payload size:    %d (0x%x) bytes" %(payload_size, payload_size))
+    log.info("Nonce:           %s" %("".join("{:02x}".format(x) for x in nonce)))
+    log.info("Type:            %s" %ELEMENT_TYPE(element_type)) # TODO readable
+    log.info("Digest:          %s" %("".join("{:02x}".format(x) for x in digest)))
+    log.info("Signature:       %s" %("".join("{:02x}".format(x) for x in signature)))
 
 
 def parse_arguments():
@@ -479,13 +895,14 @@ def parse_arguments():
         'ip="192.168.0.1"\n'
         'pwd= "mypassword123"\n'
         'port=   "65433"\n')
+    parser.add_argument("-w", "--workers", type=int, default=32, help="The number of requests "
+        "which are handled concurrently")
     args = parser.parse_args()
-    cert_path = args.cert_path.rstrip("/")
-    wifi_credentials_file_name = args.wifi_credentials_file
-    print("Loading certs from %s"  %os.path.abspath(cert_path))
-    print("Loading wifi-credentials file %s" %os.path.abspath(wifi_credentials_file_name))
+    args.cert_path = args.cert_path.rstrip("/")
+    log.info("Loading certs from %s"  %os.path.abspath(args.cert_path))
+    log.info("Loading wifi-credentials file %s" %os.path.abspath(args.wifi_credentials_file))
 
-    return cert_path, wifi_credentials_file_name
+    return args
 
 
 ### main ###
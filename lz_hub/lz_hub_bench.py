@@ -0,0 +1,281 @@
+#!/usr/bin/env python3
+
+import sys
+import os
+import argparse
+import logging
+import socket
+import struct
+import hashlib
+import tempfile
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
+import ecdsa
+from ecdsa.util import sigencode_der, sigdecode_der
+from OpenSSL import crypto
+from cryptography.hazmat.primitives import hashes
+from cryptography.hazmat.primitives.asymmetric import ec
+
+import open_ssl_wrapper as osw
+import lz_hub
+import lz_hub_db
+from lz_hub_certbag import hub_certbag
+from lz_hub_element_type import ELEMENT_TYPE
+
+
+def main():
+    print("")
+
+    # The hub reports every request at level INFO, which would dominate the measurements.
+    # Warnings and errors are still printed
+    logging.basicConfig(level=logging.WARNING, format="%(message)s")
+
+    args = parse_arguments()
+
+    if args.command == "db":
+        return run_db_benchmark(args.rows, args.workers)
+
+    hub_cb = hub_certbag(args.cert_path)
+    if not hub_cb.load():
+        print("ERROR: Could not load hub certificates. Exit..")
+        return 1
+
+    if args.command == "signing":
+        return run_signing_benchmark(hub_cb, args.tickets)
+
+    return run_benchmark(hub_cb, args.devices, args.requests, args.workers)
+
+
+def run_benchmark(hub_cb, num_devices, num_requests, workers):
+    """Runs the hub on localhost and emulates devices which concurrently request deferral
+    tickets. The emulated devices are registered in a temporary database"""
+
+    db_dir = tempfile.TemporaryDirectory()
+    lz_hub_db.LZ_HUB_DB_PATH = os.path.join(db_dir.name, "lz_hub_benchmark.db")
+
+    print("Creating %d emulated devices.." %num_devices)
+    devices = [create_device(hub_cb, i) for i in range(num_devices)]
+    if None in devices:
+        print("ERROR: Failed to create emulated devices")
+        return 1
+
+    s = lz_hub.create_server_socket("127.0.0.1", 0)
+    if s is None:
+        return 1
+    port = s.getsockname()[1]
+    lz_hub_db.start_writer()
+    threading.Thread(target=lz_hub.serve, args=(s, hub_cb, workers), daemon=True).start()
+
+    print("Requesting %d deferral tickets per device with %d workers.." %(num_requests, workers))
+    latencies = []
+    failures = []
+
+    def run_device(device):
+        for _ in range(num_requests):
+            start = time.perf_counter()
+            if request_ticket(port, device):
+                latencies.append(time.perf_counter() - start)
+            else:
+                failures.append(device)
+
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=num_devices) as executor:
+        list(executor.map(run_device, devices))
+    duration = time.perf_counter() - start
+
+    s.close()
+    lz_hub_db.stop_writer()
+    db_dir.cleanup()
+
+    if len(latencies) == 0:
+        print("ERROR: No deferral ticket was received")
+        return 1
+
+    latencies.sort()
+    print("")
+    print("Tickets:         %d (%d failed)" %(len(latencies), len(failures)))
+    print("Duration:        %.2f s" %duration)
+    print("Throughput:      %.1f tickets/s" %(len(latencies) / duration))
+    print("Latency p50:     %.1f ms" %(latencies[len(latencies) // 2] * 1000))
+    print("Latency p99:     %.1f ms" %(latencies[min(len(latencies) - 1, (len(latencies) * 99) // 100)] * 1000))
+    print("Latency max:     %.1f ms" %(latencies[-1] * 1000))
+
+    return 0
+
+
+def run_signing_benchmark(hub_cb, num_tickets):
+    """Compares the signing of ticket headers with the pure python implementation and with
+    OpenSSL, one by one and as a batch"""
+
+    hdrs = [struct.pack('II16sI32s32s', ELEMENT_TYPE.DEFERRAL_TICKET, 4,
+        os.urandom(lz_hub.LEN_DEV_UUID), lz_hub.MAGICVAL, os.urandom(32), os.urandom(32))
+        for _ in range(num_tickets)]
+
+    signers = [
+        ("python-ecdsa", lambda: [hub_cb.hub_sk_ecdsa.sign(hdr, hashfunc=hashlib.sha256,
+            sigencode=sigencode_der) for hdr in hdrs]),
+        ("OpenSSL", lambda: [hub_cb.sign(hdr) for hdr in hdrs]),
+        ("OpenSSL batch", lambda: hub_cb.sign_batch(hdrs)),
+    ]
+
+    # The devices verify the signatures, they must be valid regardless of the signer
+    hub_pk_ecdsa = hub_cb.hub_sk_ecdsa.get_verifying_key()
+
+    print("")
+    for name, sign in signers:
+        start = time.perf_counter()
+        sigs = sign()
+        duration = time.perf_counter() - start
+        valid = all(hub_pk_ecdsa.verify(sig, hdr, hashfunc=hashlib.sha256, sigdecode=sigdecode_der)
+            for sig, hdr in zip(sigs[:10], hdrs))
+        print("%-16s %8.1f tickets/s %8.1f us/ticket%s" %(name, num_tickets / duration,
+            duration * 1000000 / num_tickets, "" if valid else "  INVALID SIGNATURES"))
+
+    return 0
+
+
+def run_db_benchmark(num_rows, workers):
+    """Stores sensor samples of emulated devices from concurrent workers, once with a connection
+    and a transaction per sample as the hub used to and once through the writer"""
+
+    db_dir = tempfile.TemporaryDirectory()
+    lz_hub_db.LZ_HUB_DB_PATH = os.path.join(db_dir.name, "lz_hub_benchmark.db")
+
+    uuids = [os.urandom(lz_hub.LEN_DEV_UUID) for _ in range(100)]
+    db = lz_hub_db.connect()
+    for uuid in uuids:
+        lz_hub_db.insert_device(db, uuid, "benchmark", b"", bytes(32))
+    lz_hub_db.close(db)
+    samples = [(uuids[i % len(uuids)], i, i, 20.0, 50.0) for i in range(num_rows)]
+
+    def store_connect(sample):
+        db = lz_hub_db.connect()
+        lz_hub_db.insert_sensor_data(db, [sample])
+        lz_hub_db.close(db)
+
+    def store_writer(sample):
+        lz_hub_db.store_sensor_data(*sample)
+
+    print("")
+    for name, store in [("connect per sample", store_connect), ("writer", store_writer)]:
+        if store == store_writer:
+            lz_hub_db.start_writer()
+        start = time.perf_counter()
+        with ThreadPoolExecutor(max_workers=workers) as executor:
+            list(executor.map(store, samples))
+        lz_hub_db.stop_writer()
+        duration = time.perf_counter() - start
+        print("%-20s %10.1f rows/s" %(name, num_rows / duration))
+
+    db_dir.cleanup()
+
+    return 0
+
+
+def create_device(hub_cb, index):
+    """Creates the DeviceID and AliasID of an emulated device and registers the device"""
+
+    uuid = os.urandom(lz_hub.LEN_DEV_UUID)
+    device_id_sk = ecdsa.SigningKey.generate(curve=ecdsa.NIST256p, hashfunc=hashlib.sha256)
+    alias_id_sk = ecdsa.SigningKey.generate(curve=ecdsa.NIST256p, hashfunc=hashlib.sha256)
+    device_id_key = osw.load_privatekey_from_buffer(device_id_sk.to_pem())
+    alias_id_key = osw.load_privatekey_from_buffer(alias_id_sk.to_pem())
+    if device_id_key is None or alias_id_key is None:
+        return None
+
+    device_id_cert = osw.create_cert_from_csr(create_csr("DeviceID %d" %index, device_id_key),
+        hub_cb.hub_sk, hub_cb.hub_cert, True)
+    alias_id_cert = osw.create_cert_from_csr(create_csr("AliasID %d" %index, alias_id_key),
+        device_id_key, device_id_cert, False)
+
+    db = lz_hub_db.connect()
+    if db is None:
+        return None
+    ret = lz_hub_db.insert_device(db, uuid, "benchmark %d" %index, osw.dump_cert(device_id_cert),
+        bytes(32))
+    lz_hub_db.update_alias_id_cert(db, uuid, osw.dump_cert(alias_id_cert))
+    lz_hub_db.close(db)
+    if not ret:
+        return None
+
+    # The emulated devices sign with OpenSSL, so that they do not compete with the hub for the CPU
+    return (uuid, alias_id_key.to_cryptography_key(), osw.dump_cert_der(alias_id_cert))
+
+
+def create_csr(common_name, key):
+
+    csr = crypto.X509Req()
+    csr.get_subject().CN = common_name
+    csr.set_pubkey(key)
+    csr.sign(key, 'sha256')
+
+    return csr
+
+
+def create_request(device, element_type, payload):
+    """Creates a request of an emulated device, signed with its AliasID key like lz_auth_hdr_t"""
+
+    uuid, alias_id_key, _ = device
+    signed_area = struct.pack("II16sI32s32s", element_type,
+                                              len(payload),
+                                              uuid,
+                                              lz_hub.MAGICVAL,
+                                              os.urandom(32),
+                                              hashlib.sha256(payload).digest(),
+                                              )
+    sig = alias_id_key.sign(signed_area, ec.ECDSA(hashes.SHA256()))
+    sig = sig + (b"\x00" * (lz_hub.LEN_SIGNATURE - len(sig) - 4)) + int.to_bytes(len(sig), 4, "little")
+
+    return signed_area + sig + payload
+
+
+def request_ticket(port, device):
+    """Requests a deferral ticket like a device. Returns True if the ticket was received"""
+
+    request = create_request(device, ELEMENT_TYPE.DEFERRAL_TICKET,
+        struct.pack("I", lz_hub.MAX_DEFERRAL_TIME))
+
+    try:
+        with socket.create_connection(("127.0.0.1", port), timeout=lz_hub.TCP_TIMEOUT_S) as conn:
+            conn.sendall(request)
+            response = lz_hub.recv_packet(conn)
+    except Exception:
+        return False
+
+    return response is not None and struct.unpack('I', response[:4])[0] == ELEMENT_TYPE.DEFERRAL_TICKET
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description="Benchmarks the hub, its signing and its "
+        "database on localhost")
+    parser.add_argument("cert_path", help="The path where the hub certificates are located")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    tickets = subparsers.add_parser("tickets", help="Benchmark the hub with emulated devices "
+        "requesting deferral tickets")
+    tickets.add_argument("devices", type=int, help="The number of emulated devices")
+    tickets.add_argument("-r", "--requests", type=int, default=20, help="The number of deferral "
+        "tickets each emulated device requests")
+    tickets.add_argument("-w", "--workers", type=int, default=32, help="The number of workers of "
+        "the hub")
+
+    signing = subparsers.add_parser("signing", help="Compare the signing of ticket headers with "
+        "python-ecdsa and OpenSSL")
+    signing.add_argument("tickets", type=int, help="The number of ticket headers")
+
+    db = subparsers.add_parser("db", help="Compare storing sensor samples with a connection per "
+        "sample and the writer")
+    db.add_argument("rows", type=int, help="The number of sensor samples")
+    db.add_argument("-w", "--workers", type=int, default=32, help="The number of concurrent "
+        "workers")
+
+    args = parser.parse_args()
+    args.cert_path = args.cert_path.rstrip("/")
+
+    return args
+
+
+if __name__ == "__main__":
+    ret = main()
+    sys.exit(ret)
@@ -5,6 +5,8 @@ import struct
 import hashlib
 import OpenSSL
 import open_ssl_wrapper as osw
+from cryptography.hazmat.primitives import hashes
+from cryptography.hazmat.primitives.asymmetric import ec
 
 count = 0
 
@@ -14,6 +16,7 @@ class hub_certbag:
         self.hub_cert = None
         self.hub_sk = None
         self.hub_sk_ecdsa = None
+        self.hub_sk_native = None
 
     def load(self):
         self.hub_cert = osw.load_cert(self.cert_path + "/hub_cert.pem")
@@ -23,11 +26,25 @@ class hub_certbag:
         if self.hub_sk is not None:
             tmp = OpenSSL.crypto.dump_privatekey(OpenSSL.crypto.FILETYPE_ASN1, self.hub_sk)
             self.hub_sk_ecdsa = ecdsa.SigningKey.from_der(tmp, hashfunc=hashlib.sha256)
+            # OpenSSL signs with precomputed tables for the fixed base point of the curve, which is
+            # orders of magnitude faster than the pure python implementation
+            self.hub_sk_native = self.hub_sk.to_cryptography_key()
         else:
             return False
         return True
 
 
+    def sign(self, data):
+        """Signs data with the hub key. Returns the DER encoded signature"""
+        return self.hub_sk_native.sign(data, ec.ECDSA(hashes.SHA256()))
+
+
+    def sign_batch(self, data_list):
+        """Signs all elements of data_list with the hub key. Returns the DER encoded signatures"""
+        algorithm = ec.ECDSA(hashes.SHA256())
+        return [self.hub_sk_native.sign(data, algorithm) for data in data_list]
+
+
     def print_pub_key(self, cert):
         tmp = ecdsa.VerifyingKey.from_pem(osw.dump_publickey(cert.get_pubkey()))
         pubkey = struct.pack('B64s', 0x4, ecdsa.VerifyingKey.to_string(tmp))
@@ -1,10 +1,33 @@
 import sqlite3
 import os
+import time
+import queue
+import threading
 from sqlite3.dbapi2 import Connection
 
 LZ_HUB_DB_PATH          = './lz_hubs.db'
 TEST_CERTS_PATH         = './unit_test/test_certs/'
 
+# Raw sensor samples are kept for SENSOR_DATA_RETENTION_S, older samples are averaged into buckets
+# of SENSOR_DATA_DOWNSAMPLE_S, which are kept for SENSOR_DATA_DOWNSAMPLED_RETENTION_S
+SENSOR_DATA_RETENTION_S             = 7 * 24 * 3600
+SENSOR_DATA_DOWNSAMPLE_S            = 15 * 60
+SENSOR_DATA_DOWNSAMPLED_RETENTION_S = 365 * 24 * 3600
+
+# The writer commits the queued writes at most every WRITE_INTERVAL_S or after WRITE_MAX_BATCH writes
+WRITE_INTERVAL_S        = 0.05
+WRITE_MAX_BATCH         = 1000
+# Writes which do not fit into the queue are refused, so that a stalled database does not grow the
+# memory of the hub. Waiting writers give up after WRITE_TIMEOUT_S
+WRITE_MAX_QUEUE         = 100000
+WRITE_TIMEOUT_S         = 30
+# Transactions which fail because another connection holds the database lock are retried
+WRITE_BUSY_RETRIES      = 5
+WRITE_BUSY_BACKOFF_S    = 0.1
+
+SQL_UPDATE_ALIAS_ID_CERT    = "UPDATE devices SET alias_id_cert=? WHERE uuid=?"
+SQL_UPDATE_DEVICE_ID_CERT   = "UPDATE devices SET device_id_cert=? WHERE uuid=?"
+
 CREATE_STATEMENTS = {
     'devices': 'CREATE TABLE "devices" ('
         '`uuid`	BLOB, '
@@ -28,8 +51,52 @@ CREATE_STATEMENTS = {
         '`uuid`	TEXT, '
         '`static_symm`	BLOB '
     ')',
+    'sensor_data': 'CREATE TABLE "sensor_data" ('
+        '`uuid`	BLOB, '
+        '`timestamp`	REAL, '
+        '`data_index`	INTEGER, '
+        '`temperature`	REAL, '
+        '`humidity`	REAL '
+    ')',
+    'sensor_data_downsampled': 'CREATE TABLE "sensor_data_downsampled" ('
+        '`uuid`	BLOB, '
+        '`timestamp`	REAL, '
+        '`samples`	INTEGER, '
+        '`data_index`	INTEGER, '
+        '`temperature`	REAL, '
+        '`humidity`	REAL, '
+        'PRIMARY KEY(`uuid`, `timestamp`)'
+    ')',
+    'rollouts': 'CREATE TABLE "rollouts" ('
+        '`id`	INTEGER PRIMARY KEY AUTOINCREMENT, '
+        '`element_type`	INTEGER, '
+        '`file_name`	TEXT, '
+        '`digest`	BLOB, '
+        '`waves`	TEXT, '
+        '`current_wave`	INTEGER, '
+        '`wave_started`	REAL, '
+        '`wave_duration_s`	INTEGER, '
+        '`max_concurrent`	INTEGER, '
+        '`max_rate`	INTEGER, '
+        '`max_failure_rate`	REAL, '
+        '`state`	TEXT '
+    ')',
+    'rollout_devices': 'CREATE TABLE "rollout_devices" ('
+        '`rollout_id`	INTEGER, '
+        '`uuid`	BLOB, '
+        '`wave`	INTEGER, '
+        '`state`	TEXT, '
+        '`bytes_sent`	INTEGER, '
+        '`updated`	REAL, '
+        'PRIMARY KEY(`rollout_id`, `uuid`)'
+    ')',
 }
 
+INDEX_STATEMENTS = [
+    'CREATE INDEX IF NOT EXISTS "sensor_data_uuid_timestamp" ON "sensor_data" (`uuid`, `timestamp`)',
+    'CREATE INDEX IF NOT EXISTS "sensor_data_timestamp" ON "sensor_data" (`timestamp`)',
+]
+
 def check_if_tables_exist(db: Connection):
     cursor = db.cursor()
     for (table_name, statement) in CREATE_STATEMENTS.items():
@@ -41,11 +108,18 @@ def check_if_tables_exist(db: Connection):
             cursor.execute(statement)
             db.commit()
             print(f"Added table {table_name} to database.")
+    for statement in INDEX_STATEMENTS:
+        cursor.execute(statement)
+    db.commit()
 
 
 def connect():
     try:
         db = sqlite3.connect(LZ_HUB_DB_PATH)
+        # The hub appends sensor samples while the GUI reads them, in WAL mode readers do not
+        # block the writer. NORMAL only syncs at checkpoints, which is sufficient in WAL mode
+        db.execute("PRAGMA journal_mode=WAL")
+        db.execute("PRAGMA synchronous=NORMAL")
         check_if_tables_exist(db)
         return db
     except sqlite3.Error as e:
@@ -60,6 +134,21 @@ def close(db):
         print("ERROR: Could not close lazarus database connect: Connection was not open")
 
 
+thread_connections = threading.local()
+
+def get_connection():
+    """Returns a connection of the calling thread, which stays open for the lifetime of the thread
+    and must not be closed. The hub workers use it instead of opening a connection per request"""
+    db = getattr(thread_connections, "db", None)
+    if db is None or thread_connections.path != LZ_HUB_DB_PATH:
+        db = connect()
+        if db is None:
+            return None
+        thread_connections.db = db
+        thread_connections.path = LZ_HUB_DB_PATH
+    return db
+
+
 def insert_device(db, uuid, name, device_id_cert, static_symm):
 
     # Check if device in devices table exists
@@ -139,28 +228,45 @@ def insert_device(db, uuid, name, device_id_cert, static_symm):
     return True
 
 
+def delete_devices(db, uuids):
+    """Deletes devices and their sensor data and rollout states in one transaction, e.g. the
+    emulated devices of the load generator"""
+    data = [(uuid, ) for uuid in uuids]
+    try:
+        with db:
+            for table in ["devices", "static_symms", "sensor_data", "sensor_data_downsampled",
+                "rollout_devices"]:
+                db.executemany("DELETE FROM %s WHERE uuid=?" %table, data)
+    except sqlite3.Error as e:
+        print("ERROR: Failed to delete devices from lazarus db: %s" %(e.args))
+        return False
+    return True
+
+
 def update_alias_id_cert(db, uuid, alias_id_cert):
     try:
         cursor = db.cursor()
-        sql = """UPDATE devices SET alias_id_cert=? WHERE uuid=?"""
+        sql = SQL_UPDATE_ALIAS_ID_CERT
         data = (alias_id_cert, uuid)
         cursor.execute(sql, data)
         db.commit()
     except sqlite3.Error as e:
         print("ERROR: Failed to insert data into lazarus db: %s" %(e.args))
-        return
+        return False
+    return True
 
 
 def update_device_id_cert(db, uuid, device_id_cert):
     try:
         cursor = db.cursor()
-        sql = """UPDATE devices SET device_id_cert=? WHERE uuid=?"""
+        sql = SQL_UPDATE_DEVICE_ID_CERT
         data = (device_id_cert, uuid)
         cursor.execute(sql, data)
         db.commit()
     except sqlite3.Error as e:
         print("ERROR: Failed to insert data into lazarus db: %s" %(e.args))
-        return
+        return False
+    return True
 
 
 def update_awdt_period(db, uuid, awdt_period_s):
@@ -176,15 +282,96 @@ def update_awdt_period(db, uuid, awdt_period_s):
 
 
 def update_data(db, uuid, status, index, temperature, humidity):
+    insert_sensor_data(db, [(uuid, time.time(), index, temperature, humidity)], status)
+
+
+def insert_sensor_data(db, samples, status=1):
+    """Appends samples (uuid, timestamp, index, temperature, humidity) to the sensor data time
+    series and stores the latest sample of each device in the devices table in one transaction"""
+    try:
+        with db:
+            execute_sensor_data(db, samples, status)
+    except sqlite3.Error as e:
+        print("ERROR: Failed to insert data into lazarus db: %s" %(e.args))
+        return False
+    return True
+
+
+def execute_sensor_data(db, samples, status=1):
+    latest = {}
+    for sample in samples:
+        if sample[0] not in latest or sample[1] >= latest[sample[0]][1]:
+            latest[sample[0]] = sample
+    sql = """INSERT INTO sensor_data (uuid, timestamp, data_index, temperature, humidity)
+        VALUES (?, ?, ?, ?, ?)"""
+    db.executemany(sql, samples)
+    sql = """UPDATE devices SET status=?, data_index=?, temperature=?, humidity=? WHERE uuid=?"""
+    data = [(status, index, temperature, humidity, uuid)
+        for (uuid, _, index, temperature, humidity) in latest.values()]
+    db.executemany(sql, data)
+
+
+def get_sensor_data(db, uuid, start, end, max_points=None):
+    """Returns the samples (timestamp, index, temperature, humidity) of a device with
+    start <= timestamp < end ordered by time. Samples older than SENSOR_DATA_RETENTION_S are only
+    available downsampled. If max_points is given, the samples are averaged into at most
+    max_points buckets of equal duration"""
+    samples = """SELECT timestamp, data_index, temperature, humidity, 1 AS samples FROM sensor_data
+            WHERE uuid=:uuid AND timestamp>=:start AND timestamp<:end
+        UNION ALL
+        SELECT timestamp, data_index, temperature, humidity, samples FROM sensor_data_downsampled
+            WHERE uuid=:uuid AND timestamp>=:start AND timestamp<:end"""
+    data = {"uuid": uuid, "start": start, "end": end}
+    if max_points:
+        sql = """SELECT MIN(timestamp), MAX(data_index), SUM(temperature * samples) / SUM(samples),
+            SUM(humidity * samples) / SUM(samples) FROM (%s)
+            GROUP BY CAST((timestamp - :start) / :bucket AS INTEGER) ORDER BY 1""" %samples
+        data["bucket"] = max((end - start) / max_points, 1e-3)
+    else:
+        sql = """SELECT timestamp, data_index, temperature, humidity FROM (%s)
+            ORDER BY timestamp""" %samples
     try:
         cursor = db.cursor()
-        sql = """UPDATE devices SET status=?, data_index=?, temperature=?, humidity=? WHERE uuid=?"""
-        data = (status, index, temperature, humidity, uuid)
         cursor.execute(sql, data)
-        db.commit()
+        rows = cursor.fetchall()
     except sqlite3.Error as e:
-        print("ERROR: Failed to insert data into lazarus db: %s" %(e.args))
-        return
+        print("ERROR: Failed to retrieve data from lazarus db: %s" %(e.args))
+        return None
+    return rows
+
+
+def apply_sensor_data_retention(db, now=None):
+    """Averages raw samples older than SENSOR_DATA_RETENTION_S into buckets of
+    SENSOR_DATA_DOWNSAMPLE_S and deletes downsampled samples older than
+    SENSOR_DATA_DOWNSAMPLED_RETENTION_S. Returns the number of deleted raw samples"""
+    if now is None:
+        now = time.time()
+    # Only complete buckets are downsampled, buckets with late samples are merged
+    cutoff = ((now - SENSOR_DATA_RETENTION_S) // SENSOR_DATA_DOWNSAMPLE_S) * SENSOR_DATA_DOWNSAMPLE_S
+    try:
+        with db:
+            sql = """INSERT INTO sensor_data_downsampled
+                    (uuid, timestamp, samples, data_index, temperature, humidity)
+                SELECT uuid, CAST(timestamp / :bucket AS INTEGER) * :bucket, COUNT(*),
+                    MAX(data_index), AVG(temperature), AVG(humidity)
+                FROM sensor_data WHERE timestamp<:cutoff
+                GROUP BY uuid, CAST(timestamp / :bucket AS INTEGER)
+                ON CONFLICT(uuid, timestamp) DO UPDATE SET
+                    temperature=(temperature * samples + excluded.temperature * excluded.samples)
+                        / (samples + excluded.samples),
+                    humidity=(humidity * samples + excluded.humidity * excluded.samples)
+                        / (samples + excluded.samples),
+                    data_index=MAX(data_index, excluded.data_index),
+                    samples=samples + excluded.samples"""
+            db.execute(sql, {"bucket": SENSOR_DATA_DOWNSAMPLE_S, "cutoff": cutoff})
+            cursor = db.execute("DELETE FROM sensor_data WHERE timestamp<?", (cutoff, ))
+            deleted = cursor.rowcount
+            db.execute("DELETE FROM sensor_data_downsampled WHERE timestamp<?",
+                (now - SENSOR_DATA_DOWNSAMPLED_RETENTION_S, ))
+    except sqlite3.Error as e:
+        print("ERROR: Failed to apply sensor data retention in lazarus db: %s" %(e.args))
+        return None
+    return deleted
 
 
 def get_device_info(db, uuid):
@@ -257,6 +444,342 @@ def get_static_symm(db, uuid):
     return static_symm
 
 
+ROLLOUT_COLUMNS = ("id, element_type, file_name, digest, waves, current_wave, wave_started, "
+    "wave_duration_s, max_concurrent, max_rate, max_failure_rate, state")
+
+def insert_rollout(db, element_type, file_name, digest, waves, wave_duration_s, max_concurrent,
+        max_rate, max_failure_rate, devices):
+    """Creates a running rollout, devices is a list of (uuid, wave). Returns the rollout ID"""
+    try:
+        with db:
+            sql = """INSERT INTO rollouts (element_type, file_name, digest, waves, current_wave,
+                wave_started, wave_duration_s, max_concurrent, max_rate, max_failure_rate, state)
+                VALUES (?, ?, ?, ?, 0, ?, ?, ?, ?, ?, 'running')"""
+            data = (element_type, file_name, digest, waves, time.time(), wave_duration_s,
+                max_concurrent, max_rate, max_failure_rate)
+            rollout_id = db.execute(sql, data).lastrowid
+            sql = """INSERT INTO rollout_devices (rollout_id, uuid, wave, state, bytes_sent, updated)
+                VALUES (?, ?, ?, 'pending', 0, ?)"""
+            db.executemany(sql, [(rollout_id, uuid, wave, time.time()) for (uuid, wave) in devices])
+    except sqlite3.Error as e:
+        print("ERROR: Failed to insert rollout into lazarus db: %s" %(e.args))
+        return None
+    return rollout_id
+
+
+def get_rollout(db, rollout_id):
+    try:
+        cursor = db.cursor()
+        sql = "SELECT %s FROM rollouts WHERE id=?" %ROLLOUT_COLUMNS
+        cursor.execute(sql, (rollout_id, ))
+        row = cursor.fetchone()
+    except sqlite3.Error as e:
+        print("ERROR: Failed to retrieve rollout from lazarus db: %s" %(e.args))
+        return None
+    return row
+
+
+def get_active_rollout(db, element_type):
+    """Returns the latest rollout of an element type which was not aborted"""
+    try:
+        cursor = db.cursor()
+        sql = """SELECT %s FROM rollouts WHERE element_type=? AND state!='aborted'
+            ORDER BY id DESC LIMIT 1""" %ROLLOUT_COLUMNS
+        cursor.execute(sql, (element_type, ))
+        row = cursor.fetchone()
+    except sqlite3.Error as e:
+        print("ERROR: Failed to retrieve rollout from lazarus db: %s" %(e.args))
+        return None
+    return row
+
+
+def get_rollouts(db):
+    try:
+        cursor = db.cursor()
+        sql = "SELECT %s FROM rollouts ORDER BY id" %ROLLOUT_COLUMNS
+        cursor.execute(sql)
+        rows = cursor.fetchall()
+    except sqlite3.Error as e:
+        print("ERROR: Failed to retrieve rollouts from lazarus db: %s" %(e.args))
+        return None
+    return rows
+
+
+def update_rollout_state(db, rollout_id, state):
+    try:
+        with db:
+            db.execute("UPDATE rollouts SET state=? WHERE id=?", (state, rollout_id))
+    except sqlite3.Error as e:
+        print("ERROR: Failed to update rollout in lazarus db: %s" %(e.args))
+        return False
+    return True
+
+
+def update_rollout_wave(db, rollout_id, current_wave):
+    try:
+        with db:
+            sql = "UPDATE rollouts SET current_wave=?, wave_started=? WHERE id=?"
+            db.execute(sql, (current_wave, time.time(), rollout_id))
+    except sqlite3.Error as e:
+        print("ERROR: Failed to update rollout in lazarus db: %s" %(e.args))
+        return False
+    return True
+
+
+def get_rollout_device(db, rollout_id, uuid):
+    """Returns (wave, state, bytes_sent) of a device in a rollout"""
+    try:
+        cursor = db.cursor()
+        sql = "SELECT wave, state, bytes_sent FROM rollout_devices WHERE rollout_id=? AND uuid=?"
+        cursor.execute(sql, (rollout_id, uuid))
+        row = cursor.fetchone()
+    except sqlite3.Error as e:
+        print("ERROR: Failed to retrieve rollout device from lazarus db: %s" %(e.args))
+        return None
+    return row
+
+
+def update_rollout_device(db, rollout_id, uuid, wave, state, bytes_sent):
+    try:
+        with db:
+            sql = """INSERT INTO rollout_devices (rollout_id, uuid, wave, state, bytes_sent, updated)
+                VALUES (?, ?, ?, ?, ?, ?)
+                ON CONFLICT(rollout_id, uuid) DO UPDATE SET state=excluded.state,
+                    bytes_sent=excluded.bytes_sent, updated=excluded.updated"""
+            db.execute(sql, (rollout_id, uuid, wave, state, bytes_sent, time.time()))
+    except sqlite3.Error as e:
+        print("ERROR: Failed to update rollout device in lazarus db: %s" %(e.args))
+        return False
+    return True
+
+
+def get_rollout_progress(db, rollout_id):
+    """Returns the number of devices (wave, state, count) of a rollout"""
+    try:
+        cursor = db.cursor()
+        sql = """SELECT wave, state, COUNT(*) FROM rollout_devices WHERE rollout_id=?
+            GROUP BY wave, state ORDER BY wave, state"""
+        cursor.execute(sql, (rollout_id, ))
+        rows = cursor.fetchall()
+    except sqlite3.Error as e:
+        print("ERROR: Failed to retrieve rollout progress from lazarus db: %s" %(e.args))
+        return None
+    return rows
+
+
+class db_writer:
+    """Owns a connection which stays open and commits the queued writes of the hub workers in one
+    transaction every WRITE_INTERVAL_S. Sensor data is written asynchronously, certificate
+    updates wait for their transaction, as the certificates are read again right afterwards.
+    If the writer stops, all waiting and later writes fail instead of blocking the workers"""
+
+    def __init__(self, interval_s=WRITE_INTERVAL_S, max_batch=WRITE_MAX_BATCH,
+            max_queue=WRITE_MAX_QUEUE):
+        self.interval_s = interval_s
+        self.max_batch = max_batch
+        self.queue = queue.Queue(max_queue)
+        self.thread = None
+        self.running = False
+
+
+    def start(self):
+        self.running = True
+        self.thread = threading.Thread(target=self.__run, daemon=True)
+        self.thread.start()
+
+
+    def stop(self):
+        if self.running:
+            self.queue.put(None)
+        self.thread.join()
+
+
+    def insert_sensor_data(self, uuid, timestamp, index, temperature, humidity):
+        if not self.running:
+            return False
+        try:
+            self.queue.put_nowait(("sensor_data", (uuid, timestamp, index, temperature, humidity),
+                None))
+        except queue.Full:
+            print("WARN: Database write queue full, dropping sensor data")
+            return False
+        return True
+
+
+    def update_alias_id_cert(self, uuid, alias_id_cert):
+        return self.__write(SQL_UPDATE_ALIAS_ID_CERT, (alias_id_cert, uuid))
+
+
+    def update_device_id_cert(self, uuid, device_id_cert):
+        return self.__write(SQL_UPDATE_DEVICE_ID_CERT, (device_id_cert, uuid))
+
+
+    def call(self, function):
+        """Runs function(db) on the connection of the writer after the queued writes, so that it
+        does not compete with the writer for the database lock. Waits as long as the writer runs.
+        Returns the result of function or None"""
+        return self.__write(function, None, None)
+
+
+    def flush(self):
+        """Waits until all writes queued so far are committed"""
+        return self.__write(None, None)
+
+
+    def __write(self, sql, data, timeout_s=WRITE_TIMEOUT_S):
+        done = [threading.Event(), None if callable(sql) else False]
+        start = time.monotonic()
+        if not self.running:
+            return done[1]
+        try:
+            self.queue.put((sql, data, done), timeout=WRITE_TIMEOUT_S)
+        except queue.Full:
+            print("ERROR: Database write queue full")
+            return done[1]
+        # The writer fails the queued writes when it stops, writes queued afterwards are failed
+        # here
+        while not done[0].wait(1):
+            if not self.thread.is_alive():
+                print("ERROR: Database writer stopped")
+                return None if callable(sql) else False
+            if timeout_s is not None and time.monotonic() - start >= timeout_s:
+                print("ERROR: Database write not committed in time")
+                return False
+        return done[1]
+
+
+    def __run(self):
+        db = None
+        try:
+            db = connect()
+            if db is None:
+                return
+            stop = False
+            while not stop:
+                writes = [self.queue.get()]
+                deadline = time.monotonic() + self.interval_s
+                while len(writes) < self.max_batch:
+                    try:
+                        writes.append(self.queue.get(timeout=max(deadline - time.monotonic(), 0)))
+                    except queue.Empty:
+                        break
+                if None in writes:
+                    writes = [write for write in writes if write is not None]
+                    stop = True
+                self.__commit(db, [write for write in writes if not callable(write[0])])
+                for write in writes:
+                    if callable(write[0]):
+                        self.__call(db, write)
+        except Exception as e:
+            print("ERROR: Database writer stopped - %s" %str(e))
+        finally:
+            self.running = False
+            # Fail the writes which can no longer be committed
+            while True:
+                try:
+                    write = self.queue.get_nowait()
+                except queue.Empty:
+                    break
+                if write is not None and write[2] is not None:
+                    write[2][0].set()
+            if db is not None:
+                close(db)
+
+
+    def __commit(self, db, writes):
+        samples = [data for (sql, data, _) in writes if sql == "sensor_data"]
+        ret = run_transaction(db, lambda: self.__execute(db, samples, writes), len(writes))
+        for (_, _, done) in writes:
+            if done is not None:
+                done[1] = ret
+                done[0].set()
+
+
+    def __execute(self, db, samples, writes):
+        if samples:
+            execute_sensor_data(db, samples)
+        # Statements with the same SQL are prepared only once per connection
+        for (sql, data, _) in writes:
+            if sql is not None and sql != "sensor_data":
+                db.execute(sql, data)
+        return True
+
+
+    def __call(self, db, write):
+        function, _, done = write
+        try:
+            done[1] = function(db)
+        except Exception as e:
+            print("ERROR: Database writer call failed - %s" %str(e))
+            done[1] = None
+        done[0].set()
+
+
+def is_busy(e):
+    """Checks whether an error was caused by another connection holding the database lock"""
+    return isinstance(e, sqlite3.OperationalError) and ("locked" in str(e) or "busy" in str(e))
+
+
+def run_transaction(db, function, num_writes):
+    """Runs function in a transaction, which is retried if the database is busy. Returns False if
+    the transaction failed"""
+    for attempt in range(WRITE_BUSY_RETRIES + 1):
+        try:
+            with db:
+                return bool(function())
+        except Exception as e:
+            if is_busy(e) and attempt < WRITE_BUSY_RETRIES:
+                print("WARN: Database busy, retrying %d writes" %num_writes)
+                time.sleep(WRITE_BUSY_BACKOFF_S * (attempt + 1))
+                continue
+            print("ERROR: Failed to commit %d writes to lazarus db: %s" %(num_writes, str(e)))
+            return False
+    return False
+
+
+writer = None
+
+def start_writer():
+    """Starts the writer, through which the store_* functions write from now on"""
+    global writer
+    writer = db_writer()
+    writer.start()
+    return writer
+
+
+def stop_writer():
+    global writer
+    if writer is not None:
+        writer.stop()
+        writer = None
+
+
+def store_sensor_data(uuid, timestamp, index, temperature, humidity):
+    if writer is not None:
+        return writer.insert_sensor_data(uuid, timestamp, index, temperature, humidity)
+    return insert_sensor_data(get_connection(), [(uuid, timestamp, index, temperature, humidity)])
+
+
+def store_sensor_data_retention():
+    """Applies the sensor data retention. The writer runs it between its transactions, as a
+    concurrent transaction of this size would exceed the busy timeout of the writer"""
+    if writer is not None:
+        return writer.call(apply_sensor_data_retention)
+    return apply_sensor_data_retention(get_connection())
+
+
+def store_alias_id_cert(uuid, alias_id_cert):
+    if writer is not None:
+        return writer.update_alias_id_cert(uuid, alias_id_cert)
+    return update_alias_id_cert(get_connection(), uuid, alias_id_cert)
+
+
+def store_device_id_cert(uuid, device_id_cert):
+    if writer is not None:
+        return writer.update_device_id_cert(uuid, device_id_cert)
+    return update_device_id_cert(get_connection(), uuid, device_id_cert)
+
+
 def set_hub_certs(db, hub_cert, hub_sk, code_auth_cert, code_auth_sk):
     raise NotImplementedError
 
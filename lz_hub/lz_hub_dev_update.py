@@ -1,5 +1,9 @@
 from lz_hub_element_type import ELEMENT_TYPE
 import os
+import struct
+import hashlib
+import threading
+from collections import OrderedDict
 
 FW_FILE = "../lz_demo_app/build/lz_demo_app_signed.bin"
 UD_FILE = "../lz_udownloader/build/lz_udownloader_signed.bin"
@@ -11,18 +15,163 @@ UD_FILE_UNSIGNED = "../lz_udownloader/build/lz_udownloader.bin"
 LZ_FILE_UNSIGNED = "../lz_core/build/lz_core.bin"
 CP_FILE_UNSIGNED = "../lz_cpatcher/build/lz_cpatcher.bin"
 
-def get_update_file(element_type):
+HEADER_SIZE = 0x800
+# The image header at the start of a signed binary, the code digest is its last field
+IMG_HDR_FORMAT = "2I32sIIq32s"
+# Update request of a device: magic, offset and digest of an interrupted download and the code
+# digest of the installed image, which is zero if the image could not be verified
+UPDATE_REQUEST_FORMAT = "II32s32s"
+
+# Deltas created with lz_create_delta.py, named <type>_<digest of installed code>.delta
+DELTA_DIR = "./deltas"
+DELTA_HDR_FORMAT = "III32s32s"
+
+class update_image:
+    """The contents of an update, delta or compressed binary and the digest the hub signs"""
+
+    def __init__(self, file_name, data):
+        self.file_name = file_name
+        self.data = data
+        self.digest = hashlib.sha256(data).digest()
+
+
+# file name -> ((mtime, size), update_image), least recently used first. Every update request of
+# a rollout sends the same binaries, they are only read and hashed again if the files change.
+# Entries of files which changed or were removed are dropped, and the least recently used images
+# are evicted once the cached images exceed IMAGE_CACHE_MAX_SIZE
+IMAGE_CACHE_MAX_SIZE = 64 * 1024 * 1024
+image_cache = OrderedDict()
+image_cache_size = 0
+image_cache_lock = threading.Lock()
+
+
+def load_image(file_name):
+    """Returns the cached image of a file. Raises OSError if the file cannot be read"""
+    try:
+        stat = os.stat(file_name)
+    except OSError:
+        with image_cache_lock:
+            evict_image(file_name)
+        raise
+    version = (stat.st_mtime_ns, stat.st_size)
+    with image_cache_lock:
+        entry = image_cache.get(file_name)
+        if entry is not None and entry[0] == version:
+            image_cache.move_to_end(file_name)
+            return entry[1]
+        evict_image(file_name)
+
+    with open(file_name, "rb") as f:
+        image = update_image(file_name, f.read())
+
+    # Do not cache a file which was modified while it was read
+    stat = os.stat(file_name)
+    if (stat.st_mtime_ns, stat.st_size) == version:
+        with image_cache_lock:
+            cache_image(file_name, version, image)
+
+    return image
+
+
+def cache_image(file_name, version, image):
+    """Must be called with image_cache_lock held"""
+    global image_cache_size
+    evict_image(file_name)
+    if len(image.data) > IMAGE_CACHE_MAX_SIZE:
+        return
+    image_cache[file_name] = (version, image)
+    image_cache_size += len(image.data)
+    while image_cache_size > IMAGE_CACHE_MAX_SIZE:
+        evict_image(next(iter(image_cache)))
+
+
+def evict_image(file_name):
+    """Must be called with image_cache_lock held"""
+    global image_cache_size
+    entry = image_cache.pop(file_name, None)
+    if entry is not None:
+        image_cache_size -= len(entry[1].data)
+
+
+def get_update_image(element_type):
     fw_file_name = get_fw_file_name(element_type)
 
     # Read firmware binary
     try:
-        with open(fw_file_name, "rb") as fw_file:
-            fw = fw_file.read()
+        return load_image(fw_file_name)
     except Exception as e:
         print("ERR: could not read update - %s" %e)
         return None
 
-    return fw
+
+def get_compressed_update_image(update):
+    # Compressed binaries are created next to the signed binaries with lz_sign_binary.py -z
+    compressed_file_name = os.path.splitext(update.file_name)[0] + "_compressed.bin"
+
+    # Read compressed binary, it is fine if there is none
+    try:
+        compressed = load_image(compressed_file_name)
+    except Exception:
+        return None
+
+    # The header contains the digest of the code, the compressed binary must belong to the update
+    if compressed.data[:HEADER_SIZE] != update.data[:HEADER_SIZE]:
+        print("WARN: compressed binary %s does not belong to the current update" %compressed_file_name)
+        return None
+
+    print("Using compressed binary %s (%d bytes, update %d bytes)" %(compressed_file_name,
+        len(compressed.data), len(update.data)))
+    return compressed
+
+
+def get_delta_image(element_type, base_digest, update):
+    delta_file_name = get_delta_file_name(element_type, base_digest)
+
+    # Read delta, it is fine if there is none for the installed image
+    try:
+        delta = load_image(delta_file_name)
+    except Exception:
+        return None
+
+    # The delta must create the current update, otherwise it is outdated
+    try:
+        _, _, _, _, target_digest = struct.unpack(DELTA_HDR_FORMAT,
+            delta.data[:struct.calcsize(DELTA_HDR_FORMAT)])
+    except Exception as e:
+        print("ERR: invalid delta %s - %s" %(delta_file_name, e))
+        return None
+
+    if target_digest != update.digest:
+        print("WARN: delta %s does not create the current update" %delta_file_name)
+        return None
+
+    print("Using delta %s (%d bytes, update %d bytes)" %(delta_file_name, len(delta.data),
+        len(update.data)))
+    return delta
+
+
+def is_recovery_request(request):
+    """Devices whose installed image could not be verified do not send its digest"""
+
+    if len(request) != struct.calcsize(UPDATE_REQUEST_FORMAT):
+        return True
+
+    _, _, _, base_digest = struct.unpack(UPDATE_REQUEST_FORMAT, request)
+    return base_digest == bytes(32)
+
+
+def get_code_digest(update):
+    """Returns the code digest of the image header of a signed binary, which the device sends as
+    the digest of its installed image"""
+    try:
+        return struct.unpack(IMG_HDR_FORMAT, update.data[:struct.calcsize(IMG_HDR_FORMAT)])[-1]
+    except Exception:
+        return None
+
+
+def get_delta_file_name(element_type, base_digest):
+
+    return os.path.join(DELTA_DIR, "%s_%s.delta" %(ELEMENT_TYPE(element_type).name, base_digest.hex()))
 
 
 def get_update_file_unsigned(element_type):
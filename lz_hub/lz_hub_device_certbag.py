@@ -16,6 +16,7 @@ import base64
 import binascii
 import wifi_credentials
 import time
+import threading
 
 import lz_hub_db
 from lz_hub_element_type import ELEMENT_TYPE
@@ -34,13 +35,12 @@ class device_certbag:
         self.device_id_public_pem = None
         self.alias_id_cert = None
 
-        db = lz_hub_db.connect()
+        db = lz_hub_db.get_connection()
         if db is None:
             print("Error: Failed to connect to lazarus database")
             return
 
         device_id_cert_buf, alias_id_cert_buf = lz_hub_db.get_device_certs(db, self.uuid)
-        lz_hub_db.close(db)
         if device_id_cert_buf is None:
             print("ERROR: Failed to retrieve DeviceID certificate for UUID %s" %str(u.UUID(bytes=uuid)))
             return
@@ -69,12 +69,8 @@ class device_certbag:
         print("INFO: Verification of certificate chain successful")
 
         print("INFO: Storing AliasID certificate..")
-        try:
-            db = lz_hub_db.connect()
-            lz_hub_db.update_alias_id_cert(db, self.uuid, alias_id_buf)
-            lz_hub_db.close(db)
-        except Exception as e:
-            print("ERROR: could not store AliasID certificate: %s" %str(e))
+        if not lz_hub_db.store_alias_id_cert(self.uuid, alias_id_buf):
+            print("ERROR: could not store AliasID certificate")
             return False
 
         self.alias_id_cert = alias_id_cert
@@ -120,9 +116,9 @@ class device_certbag:
         device_id_cert_buf = osw.dump_cert(self.device_id_cert)
 
         # Store the DeviceID certificate to be able to verify AliasID signed tickets
-        db = lz_hub_db.connect()
-        lz_hub_db.update_device_id_cert(db, self.uuid, device_id_cert_buf)
-        lz_hub_db.close(db)
+        if not lz_hub_db.store_device_id_cert(self.uuid, device_id_cert_buf):
+            print("ERROR: could not store DeviceID certificate")
+            return False
 
         # Update device_id public key
         self.device_id_public = self.device_id_cert.get_pubkey()
@@ -139,9 +135,7 @@ class device_certbag:
 
         print("INFO: Calculating dev_auth..")
         # Read stored static_symm
-        db = lz_hub_db.connect()
-        static_symm = lz_hub_db.get_static_symm(db, self.uuid)
-        lz_hub_db.close(db)
+        static_symm = lz_hub_db.get_static_symm(lz_hub_db.get_connection(), self.uuid)
         if static_symm is None:
             print("ERROR: Could not retrieve static_symm")
             return None
@@ -169,6 +163,61 @@ class device_certbag:
 
 
 
+class alias_id_cache:
+    """Caches the chain-verified AliasID public keys of the devices, so that an authenticated
+    request only requires the verification of its signature. The AliasID of a device only changes
+    when the device boots, the cache must be invalidated whenever the certificates change"""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        # uuid -> (AliasID certificate fingerprint, ecdsa.VerifyingKey)
+        self.keys = {}
+        # uuid -> number of invalidations, to discard keys loaded before an invalidation
+        self.generations = {}
+
+
+    def get_verifying_key(self, uuid, hub_cert):
+        with self.lock:
+            entry = self.keys.get(uuid)
+            generation = self.generations.get(uuid, 0)
+        if entry is not None:
+            return entry[1]
+
+        # Load and verify the certificate chain without holding the lock
+        device_cb = device_certbag(uuid)
+        if device_cb.device_id_cert is None or device_cb.alias_id_cert is None:
+            return None
+        trusted_certs = [hub_cert, device_cb.device_id_cert]
+        if not osw.verify_cert(trusted_certs, device_cb.alias_id_cert):
+            print("ERROR: Certificate chain could not be verified")
+            return None
+
+        try:
+            key = ecdsa.VerifyingKey.from_pem(osw.dump_publickey(device_cb.alias_id_cert.get_pubkey()))
+        except Exception as e:
+            print("ERROR: Could not load AliasID public key: %s" %str(e))
+            return None
+
+        with self.lock:
+            if self.generations.get(uuid, 0) == generation:
+                self.keys[uuid] = (device_cb.alias_id_cert.digest("sha256"), key)
+
+        return key
+
+
+    def invalidate(self, uuid, alias_id_cert=None):
+        """Drops the cached key of a device, unless the given new AliasID certificate is the one
+        which is cached already"""
+
+        with self.lock:
+            entry = self.keys.get(uuid)
+            if (entry is not None and alias_id_cert is not None and
+                entry[0] == alias_id_cert.digest("sha256")):
+                return
+            self.keys.pop(uuid, None)
+            self.generations[uuid] = self.generations.get(uuid, 0) + 1
+
+
 def hmac_sha256(message, key):
     return hmac.new(key, message, hashlib.sha256).digest()
 
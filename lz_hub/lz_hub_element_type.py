@@ -12,4 +12,6 @@ class ELEMENT_TYPE(IntEnum):
     BOOT_TICKET             = 0x8
     DEFERRAL_TICKET         = 0x9
     CMD                     = 0xA
-    SENSOR_DATA             = 0xB
\ No newline at end of file
+    SENSOR_DATA             = 0xB
+    DELTA_UPDATE            = 0xC
+    DEFERRAL_TICKET_BATCH   = 0xD
\ No newline at end of file
@@ -0,0 +1,359 @@
+import sys
+import os
+import argparse
+import logging
+import socket
+import struct
+import hashlib
+import itertools
+import random
+import tempfile
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
+from cryptography.hazmat.primitives import hashes
+from cryptography.hazmat.primitives.asymmetric import ec
+
+import lz_hub
+import lz_hub_bench
+import lz_hub_db
+from lz_hub_certbag import hub_certbag
+from lz_hub_element_type import ELEMENT_TYPE
+
+# Requests per second of each emulated device
+DEFAULT_RATES           = "alias_id=0.01,boot_ticket=0.01,deferral_ticket=0.1,sensor_data=0.1,update=0"
+
+# Request types and the element types of their responses
+REQUEST_TYPES = {
+    "alias_id":         (ELEMENT_TYPE.ALIAS_ID, [ELEMENT_TYPE.CMD]),
+    "boot_ticket":      (ELEMENT_TYPE.BOOT_TICKET, [ELEMENT_TYPE.BOOT_TICKET]),
+    "deferral_ticket":  (ELEMENT_TYPE.DEFERRAL_TICKET, [ELEMENT_TYPE.DEFERRAL_TICKET]),
+    "sensor_data":      (ELEMENT_TYPE.SENSOR_DATA, [ELEMENT_TYPE.SENSOR_DATA]),
+    "update":           (ELEMENT_TYPE.APP_UPDATE, [ELEMENT_TYPE.APP_UPDATE, ELEMENT_TYPE.DELTA_UPDATE]),
+}
+
+
+def main():
+    print("")
+
+    # The hub reports every request at level INFO. Warnings and errors are still printed
+    logging.basicConfig(level=logging.WARNING, format="%(message)s")
+
+    args = parse_arguments()
+    rates = parse_rates(args.rates)
+    if rates is None:
+        return 1
+
+    hub_cb = hub_certbag(args.cert_path)
+    if not hub_cb.load():
+        print("ERROR: Could not load hub certificates. Exit..")
+        return 1
+
+    # Without a hub address, a hub is started in this process with a temporary database
+    db_dir = None
+    if args.hub is None:
+        db_dir = tempfile.TemporaryDirectory()
+        lz_hub_db.LZ_HUB_DB_PATH = os.path.join(db_dir.name, "lz_hub_loadgen.db")
+    else:
+        # The emulated devices are registered in the database of the running hub and removed
+        # from it when the load generator is done
+        lz_hub_db.LZ_HUB_DB_PATH = args.db
+
+    print("Creating %d emulated devices.." %args.devices)
+    devices = [lz_hub_bench.create_device(hub_cb, i) for i in range(args.devices)]
+    if args.hub is None:
+        lz_hub_db.start_writer()
+        s = lz_hub.create_server_socket("127.0.0.1", 0)
+        address = s.getsockname()
+        threading.Thread(target=lz_hub.serve, args=(s, hub_cb, args.workers), daemon=True).start()
+    else:
+        host, port = args.hub.rsplit(":", 1)
+        address = (host, int(port))
+
+    try:
+        if None in devices:
+            print("ERROR: Failed to create emulated devices")
+            return 1
+
+        print("Sending requests to %s:%d for %d s with %d %s.." %(address[0], address[1],
+            args.duration, args.connections, "sessions" if args.session else "connections"))
+        hub_pub_key = hub_cb.hub_cert.get_pubkey().to_cryptography_key()
+        stats, duration = run_load(address, devices, rates, args.duration, args.connections,
+            args.session, hub_pub_key)
+    finally:
+        if args.hub is None:
+            s.close()
+            lz_hub_db.stop_writer()
+            db_dir.cleanup()
+        else:
+            remove_devices(devices)
+
+    error_rate = print_stats(stats, duration)
+    if error_rate > args.max_error_rate:
+        print("ERROR: Error rate %.2f%% exceeds %.2f%%" %(error_rate * 100, args.max_error_rate * 100))
+        return 1
+
+    return 0
+
+
+class load_stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        # request type -> ([latencies], ok, nak, errors)
+        self.results = {name: ([], [0], [0], [0]) for name in REQUEST_TYPES}
+        # error -> count
+        self.errors = {}
+
+
+    def add(self, name, latency, result):
+        latencies, ok, nak, errors = self.results[name]
+        with self.lock:
+            if result == "ok":
+                latencies.append(latency)
+                ok[0] += 1
+            elif result == "nak":
+                nak[0] += 1
+            else:
+                errors[0] += 1
+                error = "%s: %s" %(name, result)
+                self.errors[error] = self.errors.get(error, 0) + 1
+
+
+def run_load(address, devices, rates, duration, connections, session, hub_pub_key):
+    """Sends the requests of the devices at the given rates. Each request type of each device is
+    a Poisson process. Latencies are measured from the time a request was due, so that they
+    include the time requests wait if the connections cannot keep up. With session, each of the
+    connections is kept open and reused for the following requests, otherwise a connection is
+    opened per request"""
+
+    events = []
+    for (name, rate) in rates.items():
+        total_rate = rate * len(devices)
+        t = random.expovariate(total_rate) if total_rate > 0 else duration
+        while t < duration:
+            events.append((t, name, random.choice(devices)))
+            t += random.expovariate(total_rate)
+    events.sort(key=lambda event: event[0])
+
+    stats = load_stats()
+    sensor_index = itertools.count()
+    sessions = threading.local()
+    session_conns = []
+    session_lock = threading.Lock()
+
+    def exchange(conn, request):
+        conn.sendall(request)
+        return recv_response(conn)
+
+    def exchange_session(request):
+        conn = getattr(sessions, "conn", None)
+        if conn is None:
+            conn = socket.create_connection(address, timeout=lz_hub.TCP_TIMEOUT_S)
+            sessions.conn = conn
+            with session_lock:
+                session_conns.append(conn)
+        try:
+            return exchange(conn, request)
+        except Exception:
+            # The state of the connection is unknown, the next request opens a new one
+            sessions.conn = None
+            conn.close()
+            raise
+
+    def send(name, device, due):
+        try:
+            request = create_request(name, device, next(sensor_index))
+            if session:
+                response = exchange_session(request)
+            else:
+                with socket.create_connection(address, timeout=lz_hub.TCP_TIMEOUT_S) as conn:
+                    response = exchange(conn, request)
+            result = check_response(name, response, hub_pub_key)
+        except Exception as e:
+            result = "%s %s" %(type(e).__name__, str(e))
+        stats.add(name, time.perf_counter() - due, result)
+
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=connections) as executor:
+        for (t, name, device) in events:
+            delay = start + t - time.perf_counter()
+            if delay > 0:
+                time.sleep(delay)
+            executor.submit(send, name, device, start + t)
+    duration = time.perf_counter() - start
+
+    for conn in session_conns:
+        conn.close()
+
+    return stats, duration
+
+
+def remove_devices(devices):
+    """Removes the emulated devices and their data from the database of the running hub"""
+
+    db = lz_hub_db.connect()
+    if db is None:
+        print("ERROR: Failed to remove the emulated devices from %s" %lz_hub_db.LZ_HUB_DB_PATH)
+        return
+    uuids = [device[0] for device in devices if device is not None]
+    if lz_hub_db.delete_devices(db, uuids):
+        print("Removed %d emulated devices from %s" %(len(uuids), lz_hub_db.LZ_HUB_DB_PATH))
+    lz_hub_db.close(db)
+
+
+def create_request(name, device, index):
+    uuid, _, alias_id_cert = device
+    element_type = REQUEST_TYPES[name][0]
+
+    if element_type == ELEMENT_TYPE.ALIAS_ID:
+        return struct.pack("II16s", element_type, len(alias_id_cert), uuid) + alias_id_cert
+    elif element_type == ELEMENT_TYPE.BOOT_TICKET:
+        payload = struct.pack("I", 0)
+    elif element_type == ELEMENT_TYPE.DEFERRAL_TICKET:
+        payload = struct.pack("I", lz_hub.MAX_DEFERRAL_TIME)
+    elif element_type == ELEMENT_TYPE.SENSOR_DATA:
+        payload = struct.pack("Iff", index, random.uniform(15, 30), random.uniform(20, 80))
+    else:
+        # A device which cannot verify its image requests the complete update
+        payload = struct.pack("II32s32s", lz_hub.MAGICVAL, 0, bytes(32), bytes(32))
+
+    return lz_hub_bench.create_request(device, element_type, payload)
+
+
+def recv_response(conn):
+    """Receives a response of the hub. In contrast to requests, responses can be updates larger
+    than MAX_REQUEST_PAYLOAD"""
+
+    data = lz_hub.recv_exact(conn, 8)
+    if data is None:
+        raise ConnectionError("connection closed")
+
+    element_type, payload_size = struct.unpack("II", data)
+    if element_type == ELEMENT_TYPE.CMD:
+        len_hdr = 8 + lz_hub.LEN_DEV_UUID
+    else:
+        len_hdr = lz_hub.LEN_HDR
+
+    remainder = lz_hub.recv_exact(conn, len_hdr - len(data) + payload_size)
+    if remainder is None:
+        raise ConnectionError("connection closed within response")
+
+    return data + remainder
+
+
+def check_response(name, response, hub_pub_key):
+    """Checks a response like a device. Returns "ok", "nak" or the error"""
+
+    element_type = struct.unpack("I", response[:4])[0]
+    if element_type == ELEMENT_TYPE.CMD:
+        ack = struct.unpack("I", response[-4:])[0] == lz_hub.TCP_CMD_ACK
+        if REQUEST_TYPES[name][0] == ELEMENT_TYPE.ALIAS_ID and ack:
+            return "ok"
+        # Update requests are refused during rollouts, the device requests the update again later
+        if REQUEST_TYPES[name][0] == ELEMENT_TYPE.APP_UPDATE and not ack:
+            return "nak"
+        return "rejected"
+
+    if element_type not in REQUEST_TYPES[name][1]:
+        return "unexpected response %d" %element_type
+
+    # The header is signed by the hub and contains the digest of the payload
+    signed_area = response[:lz_hub.LEN_SIGNED_AREA]
+    signature = response[lz_hub.LEN_SIGNED_AREA:lz_hub.LEN_HDR]
+    signature = signature[:int.from_bytes(signature[-4:], "little")]
+    hub_pub_key.verify(signature, signed_area, ec.ECDSA(hashes.SHA256()))
+    digest = struct.unpack("II16sI32s32s", signed_area)[5]
+    if digest != hashlib.sha256(response[lz_hub.LEN_HDR:]).digest():
+        return "digest mismatch"
+
+    # Sensor data is acknowledged in the payload
+    if (element_type == ELEMENT_TYPE.SENSOR_DATA and
+        struct.unpack("I", response[lz_hub.LEN_HDR:])[0] != lz_hub.TCP_CMD_ACK):
+        return "nak"
+
+    return "ok"
+
+
+def print_stats(stats, duration):
+    """Prints the results per request type. Returns the error rate"""
+
+    print("")
+    print("%-16s %8s %8s %6s %7s %9s %9s %9s %9s %9s" %("Request", "Sent", "OK", "NAK", "Errors",
+        "OK/s", "p50 ms", "p90 ms", "p99 ms", "max ms"))
+
+    total_sent = 0
+    total_errors = 0
+    for (name, (latencies, ok, nak, errors)) in stats.results.items():
+        sent = ok[0] + nak[0] + errors[0]
+        if sent == 0:
+            continue
+        total_sent += sent
+        total_errors += errors[0]
+        latencies.sort()
+        percentiles = [latencies[min(len(latencies) - 1, (len(latencies) * p) // 100)] * 1000
+            if latencies else 0 for p in (50, 90, 99)]
+        print("%-16s %8d %8d %6d %7d %9.1f %9.1f %9.1f %9.1f %9.1f" %(name, sent, ok[0], nak[0],
+            errors[0], ok[0] / duration, *percentiles, latencies[-1] * 1000 if latencies else 0))
+
+    error_rate = total_errors / total_sent if total_sent else 0
+    print("")
+    for (error, count) in sorted(stats.errors.items(), key=lambda item: -item[1])[:10]:
+        print("%8d x %s" %(count, error))
+    if stats.errors:
+        print("")
+    print("Duration:        %.2f s" %duration)
+    print("Throughput:      %.1f requests/s" %(total_sent / duration))
+    print("Error rate:      %.2f%%" %(error_rate * 100))
+
+    return error_rate
+
+
+def parse_rates(rates_arg):
+    rates = {}
+    try:
+        for entry in rates_arg.split(","):
+            name, rate = entry.split("=")
+            if name not in REQUEST_TYPES:
+                raise ValueError("unknown request type %s" %name)
+            rates[name] = float(rate)
+    except ValueError as e:
+        print("ERROR: Invalid rates: %s" %str(e))
+        return None
+    return rates
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description="Emulates devices which send requests to the hub "
+        "and reports the throughput and latencies of the hub")
+    parser.add_argument("cert_path", help="The path where the hub certificates are located. The "
+        "emulated devices are issued DeviceID certificates with the hub key")
+    parser.add_argument("--hub", metavar="HOST:PORT", help="The address of a running hub. "
+        "Without it, a hub is started in this process")
+    parser.add_argument("--db", help="The database of the running hub, in which the emulated "
+        "devices are registered and from which they are removed afterwards. Required with --hub")
+    parser.add_argument("-n", "--devices", type=int, default=100, help="The number of emulated "
+        "devices")
+    parser.add_argument("-d", "--duration", type=int, default=30, metavar="SECONDS",
+        help="The time in which requests are sent")
+    parser.add_argument("-r", "--rates", default=DEFAULT_RATES, help="Requests per second of each "
+        "device for each request type (%s)" %", ".join(REQUEST_TYPES))
+    parser.add_argument("-c", "--connections", type=int, default=64, help="The maximum number of "
+        "concurrent connections to the hub")
+    parser.add_argument("-s", "--session", action="store_true", help="Keep the connections open "
+        "and send the following requests over them, instead of a connection per request")
+    parser.add_argument("-w", "--workers", type=int, default=32, help="The number of workers of "
+        "the hub started in this process")
+    parser.add_argument("--max-error-rate", type=float, default=0.01, help="The error rate above "
+        "which the exit code indicates a failure")
+    args = parser.parse_args()
+    args.cert_path = args.cert_path.rstrip("/")
+    # The emulated devices must not end up in the database of the hub by accident
+    if args.hub is not None and args.db is None:
+        parser.error("--db is required with --hub")
+
+    return args
+
+
+if __name__ == "__main__":
+    ret = main()
+    sys.exit(ret)
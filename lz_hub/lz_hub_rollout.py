@@ -0,0 +1,391 @@
+import sys
+import os
+import argparse
+import hashlib
+import math
+import struct
+import tempfile
+import threading
+import time
+import uuid as u
+
+import lz_hub_db
+from lz_hub_element_type import ELEMENT_TYPE
+from lz_hub_dev_update import load_image, is_recovery_request, IMG_HDR_FORMAT, \
+    UPDATE_REQUEST_FORMAT
+
+# The hub reads rollouts from the database, so that they can be controlled while it is running.
+# Changes apply after at most ROLLOUT_REFRESH_S
+ROLLOUT_REFRESH_S       = 1
+
+# Cumulative percentages of the devices which are updated in each wave
+DEFAULT_WAVES           = "1,10,50,100"
+DEFAULT_WAVE_DURATION_S = 60 * 60
+DEFAULT_MAX_CONCURRENT  = 8
+DEFAULT_MAX_FAILURE_RATE = 0.1
+# The failure rate is only evaluated after this number of downloads finished
+MIN_FINISHED_DOWNLOADS  = 5
+
+# Returned by rollout_scheduler.admit if the device must request the update again later
+ROLLOUT_DEFER           = "defer"
+
+
+def main():
+    print("")
+
+    args = parse_arguments()
+
+    if args.command == "test":
+        return test()
+
+    db = lz_hub_db.connect()
+    if db is None:
+        return 1
+
+    if args.command == "start":
+        ret = start_rollout(db, args)
+    elif args.command == "status":
+        ret = print_rollouts(db, args.id)
+    elif args.command == "advance":
+        ret = advance_rollout(db, args.id)
+    else:
+        states = {"pause": "paused", "resume": "running", "abort": "aborted"}
+        ret = set_rollout_state(db, args.id, states[args.command])
+
+    lz_hub_db.close(db)
+    return ret
+
+
+class rollout:
+    def __init__(self, row):
+        (self.id, self.element_type, self.file_name, self.digest, waves, self.current_wave,
+            self.wave_started, self.wave_duration_s, self.max_concurrent, self.max_rate,
+            self.max_failure_rate, self.state) = row
+        self.waves = [int(wave) for wave in waves.split(",")]
+
+
+class rollout_scheduler:
+    """Decides which devices receive the update of a rollout. Devices are updated in waves, at most
+    max_concurrent devices download at the same time and the downloads share max_rate bytes/s,
+    so that the rollout does not starve the ticket requests of the other devices"""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.refresh_lock = threading.Lock()
+        # element type -> (time of the next refresh, rollout or None)
+        self.rollouts = {}
+        # rollout ID -> {uuid: wave} of the devices which are currently downloading
+        self.downloads = {}
+        # rollout ID -> time at which the downloads may send the next chunk
+        self.next_send = {}
+
+
+    def get_rollout(self, element_type):
+        with self.refresh_lock:
+            entry = self.rollouts.get(element_type)
+            if entry is not None and entry[0] > time.monotonic():
+                return entry[1]
+
+            r = None
+            db = lz_hub_db.get_connection()
+            row = lz_hub_db.get_active_rollout(db, element_type) if db is not None else None
+            if row is not None:
+                r = rollout(row)
+                if r.state == "running":
+                    self.__update_waves(db, r)
+            self.rollouts[element_type] = (time.monotonic() + ROLLOUT_REFRESH_S, r)
+            return r
+
+
+    def admit(self, uuid, element_type, request):
+        """Returns the rollout whose update the device receives for its update request, None if the
+        device receives the signed binary of lz_hub_dev_update or ROLLOUT_DEFER. Devices with an
+        intact image ask for updates regularly and are deferred until the rollout admits them.
+        Devices which must recover their firmware are never deferred, they receive the signed
+        binary if the rollout does not admit them"""
+
+        r = self.get_rollout(element_type)
+        if r is None:
+            return None
+        # The update of a completed rollout is the current update
+        if r.state == "completed":
+            return r
+        fallback = None if is_recovery_request(request) else ROLLOUT_DEFER
+        if r.state != "running":
+            return fallback
+
+        # Devices registered after the rollout was started are updated in the last wave
+        db = lz_hub_db.get_connection()
+        device = lz_hub_db.get_rollout_device(db, r.id, uuid)
+        wave = device[0] if device is not None else len(r.waves) - 1
+        if wave > r.current_wave:
+            return fallback
+
+        with self.lock:
+            downloads = self.downloads.setdefault(r.id, {})
+            if uuid not in downloads and len(downloads) >= r.max_concurrent:
+                return fallback
+            downloads[uuid] = wave
+
+        lz_hub_db.update_rollout_device(db, r.id, uuid, wave, "downloading", 0)
+        print("INFO: Rollout %d: %s downloading (wave %d)" %(r.id, str(u.UUID(bytes=uuid)), wave))
+        return r
+
+
+    def finish(self, r, uuid, bytes_sent, success):
+        with self.lock:
+            wave = self.downloads.get(r.id, {}).pop(uuid, len(r.waves) - 1)
+
+        state = "downloaded" if success else "failed"
+        lz_hub_db.update_rollout_device(lz_hub_db.get_connection(), r.id, uuid, wave, state,
+            bytes_sent)
+        print("INFO: Rollout %d: %s %s" %(r.id, str(u.UUID(bytes=uuid)), state))
+
+
+    def throttle(self, r, size):
+        """Blocks until size bytes of a download may be sent within max_rate of the rollout"""
+        if not r.max_rate:
+            return
+        with self.lock:
+            now = time.monotonic()
+            start = max(self.next_send.get(r.id, now), now)
+            self.next_send[r.id] = start + size / r.max_rate
+        if start > now:
+            time.sleep(start - now)
+
+
+    def __update_waves(self, db, r):
+        progress = lz_hub_db.get_rollout_progress(db, r.id)
+        if progress is None:
+            return
+
+        # Stop the rollout if too many downloads of the started waves failed
+        finished = sum(count for (wave, state, count) in progress
+            if wave <= r.current_wave and state in ("downloaded", "failed"))
+        failed = sum(count for (wave, state, count) in progress
+            if wave <= r.current_wave and state == "failed")
+        if finished >= MIN_FINISHED_DOWNLOADS and failed / finished > r.max_failure_rate:
+            print("WARN: Rollout %d: %d of %d downloads failed, pausing rollout" %(r.id, failed,
+                finished))
+            lz_hub_db.update_rollout_state(db, r.id, "paused")
+            r.state = "paused"
+            return
+
+        if all(state == "downloaded" for (_, state, _) in progress):
+            print("INFO: Rollout %d completed" %r.id)
+            lz_hub_db.update_rollout_state(db, r.id, "completed")
+            r.state = "completed"
+            return
+
+        if (r.current_wave < len(r.waves) - 1 and
+            time.time() - r.wave_started >= r.wave_duration_s):
+            r.current_wave += 1
+            print("INFO: Rollout %d: starting wave %d" %(r.id, r.current_wave))
+            lz_hub_db.update_rollout_wave(db, r.id, r.current_wave)
+
+
+def get_rollout_image(r):
+    """Returns the update of a rollout, if the binary was not modified since the rollout started"""
+    try:
+        image = load_image(r.file_name)
+    except Exception as e:
+        print("ERROR: Rollout %d: could not read update - %s" %(r.id, e))
+        return None
+
+    if image.digest != r.digest:
+        print("ERROR: Rollout %d: %s was modified since the rollout started" %(r.id, r.file_name))
+        return None
+
+    return image
+
+
+def assign_waves(uuids, waves, seed):
+    """Assigns the devices to waves. The order of the devices depends on the seed, so that the
+    first waves of different rollouts contain different devices"""
+    uuids = sorted(uuids, key=lambda uuid: hashlib.sha256(seed + uuid).digest())
+    devices = []
+    for (index, uuid) in enumerate(uuids):
+        wave = next(i for (i, percent) in enumerate(waves)
+            if index < math.ceil(len(uuids) * percent / 100))
+        devices.append((uuid, wave))
+    return devices
+
+
+def start_rollout(db, args):
+    element_type = ELEMENT_TYPE[args.type]
+    row = lz_hub_db.get_active_rollout(db, element_type)
+    if row is not None and rollout(row).state in ("running", "paused"):
+        print("ERROR: There already is an active rollout for %s" %args.type)
+        return 1
+
+    try:
+        waves = [int(wave) for wave in args.waves.split(",")]
+    except ValueError:
+        print("ERROR: Waves must be comma separated percentages")
+        return 1
+    if not waves or waves != sorted(waves) or waves[-1] != 100:
+        print("ERROR: Waves must be ascending percentages ending with 100")
+        return 1
+
+    try:
+        image = load_image(args.file)
+    except Exception as e:
+        print("ERROR: could not read update - %s" %e)
+        return 1
+
+    uuids = lz_hub_db.get_uuids(db)
+    if uuids is None:
+        return 1
+    devices = assign_waves(uuids, waves, image.digest)
+
+    rollout_id = lz_hub_db.insert_rollout(db, element_type, os.path.abspath(args.file),
+        image.digest, ",".join(str(wave) for wave in waves), args.wave_duration,
+        args.max_concurrent, args.max_rate, args.max_failure_rate, devices)
+    if rollout_id is None:
+        return 1
+
+    print("Started rollout %d of %s to %d devices in %d waves" %(rollout_id, args.file,
+        len(devices), len(waves)))
+    return 0
+
+
+def set_rollout_state(db, rollout_id, state):
+    row = lz_hub_db.get_rollout(db, rollout_id)
+    if row is None:
+        print("ERROR: Rollout %d does not exist" %rollout_id)
+        return 1
+    if rollout(row).state not in ("running", "paused"):
+        print("ERROR: Rollout %d is %s" %(rollout_id, rollout(row).state))
+        return 1
+    if not lz_hub_db.update_rollout_state(db, rollout_id, state):
+        return 1
+    print("Rollout %d is %s" %(rollout_id, state))
+    return 0
+
+
+def advance_rollout(db, rollout_id):
+    row = lz_hub_db.get_rollout(db, rollout_id)
+    if row is None:
+        print("ERROR: Rollout %d does not exist" %rollout_id)
+        return 1
+    r = rollout(row)
+    if r.current_wave >= len(r.waves) - 1:
+        print("ERROR: Rollout %d is in its last wave" %rollout_id)
+        return 1
+    if not lz_hub_db.update_rollout_wave(db, rollout_id, r.current_wave + 1):
+        return 1
+    print("Rollout %d: starting wave %d" %(rollout_id, r.current_wave + 1))
+    return 0
+
+
+def print_rollouts(db, rollout_id):
+    rows = lz_hub_db.get_rollouts(db)
+    if rows is None:
+        return 1
+
+    for row in rows:
+        r = rollout(row)
+        if rollout_id is not None and r.id != rollout_id:
+            continue
+        print("Rollout %d: %s %s, %s, wave %d of %d, max %d concurrent, max %s bytes/s"
+            %(r.id, ELEMENT_TYPE(r.element_type).name, r.file_name, r.state, r.current_wave + 1,
+            len(r.waves), r.max_concurrent, r.max_rate if r.max_rate else "unlimited"))
+        for (wave, state, count) in lz_hub_db.get_rollout_progress(db, r.id) or []:
+            print("    wave %d: %5d %s" %(wave, count, state))
+
+    return 0
+
+
+############################
+########## TEST ############
+############################
+
+def test():
+    """Drives the scheduler with the update requests the Update Downloader and the App send: the
+    digest of the installed image if it is intact, zero if it must be recovered"""
+
+    magic = 0x41495345
+    installed = hashlib.sha256(b"installed").digest()
+    update_request = struct.pack(UPDATE_REQUEST_FORMAT, magic, 0, bytes(32), installed)
+    recovery_request = struct.pack(UPDATE_REQUEST_FORMAT, magic, 0, bytes(32), bytes(32))
+
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        lz_hub_db.LZ_HUB_DB_PATH = os.path.join(tmp_dir, "lz_hub_rollout_test.db")
+        file_name = os.path.join(tmp_dir, "update_signed.bin")
+        with open(file_name, "wb") as f:
+            f.write(struct.pack(IMG_HDR_FORMAT, magic, 0, bytes(32), 4, 0, 0,
+                hashlib.sha256(b"code").digest()) + b"code")
+        image = load_image(file_name)
+
+        db = lz_hub_db.get_connection()
+        uuids = [bytes([i]) * 16 for i in range(4)]
+        waves = [int(wave) for wave in DEFAULT_WAVES.split(",")]
+        # Device 0 and 1 are updated in the first wave, 2 and 3 in the last one
+        devices = [(uuids[0], 0), (uuids[1], 0), (uuids[2], 3), (uuids[3], 3)]
+        rollout_id = lz_hub_db.insert_rollout(db, ELEMENT_TYPE.APP_UPDATE, file_name, image.digest,
+            DEFAULT_WAVES, DEFAULT_WAVE_DURATION_S, 1, 0, DEFAULT_MAX_FAILURE_RATE, devices)
+
+        scheduler = rollout_scheduler()
+        results = [
+            ("first wave", scheduler.admit(uuids[0], ELEMENT_TYPE.APP_UPDATE, update_request)),
+            ("no download slot", scheduler.admit(uuids[1], ELEMENT_TYPE.APP_UPDATE,
+                update_request)),
+            ("later wave", scheduler.admit(uuids[2], ELEMENT_TYPE.APP_UPDATE, update_request)),
+            ("later wave recovery", scheduler.admit(uuids[3], ELEMENT_TYPE.APP_UPDATE,
+                recovery_request)),
+        ]
+        expected = [rollout_id, ROLLOUT_DEFER, ROLLOUT_DEFER, None]
+
+        scheduler.finish(results[0][1], uuids[0], len(image.data), True)
+        results.append(("after download", scheduler.admit(uuids[1], ELEMENT_TYPE.APP_UPDATE,
+            update_request)))
+        expected.append(rollout_id)
+
+        lz_hub_db.close(db)
+        lz_hub_db.thread_connections.db = None
+
+    failed = 0
+    for ((name, result), exp) in zip(results, expected):
+        result = result.id if isinstance(result, rollout) else result
+        if result != exp:
+            print("FAILED: %s: %s, expected %s" %(name, result, exp))
+            failed += 1
+        else:
+            print("OK: %s: %s" %(name, result))
+
+    return 1 if failed else 0
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description="Controls the rollouts of the hub")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    start = subparsers.add_parser("start", help="Start a rollout to all registered devices")
+    start.add_argument("type", choices=["UD_UPDATE", "CP_UPDATE", "APP_UPDATE"], help="The update type")
+    start.add_argument("file", help="The signed binary of the update")
+    start.add_argument("--waves", default=DEFAULT_WAVES, help="Cumulative percentages of the "
+        "devices updated in each wave")
+    start.add_argument("--wave-duration", type=int, default=DEFAULT_WAVE_DURATION_S,
+        metavar="SECONDS", help="The time after which the next wave starts")
+    start.add_argument("--max-concurrent", type=int, default=DEFAULT_MAX_CONCURRENT,
+        help="The maximum number of concurrent downloads")
+    start.add_argument("--max-rate", type=int, default=0, metavar="BYTES",
+        help="The maximum bytes/s of all downloads, 0 for unlimited")
+    start.add_argument("--max-failure-rate", type=float, default=DEFAULT_MAX_FAILURE_RATE,
+        help="The share of failed downloads at which the rollout is paused")
+
+    status = subparsers.add_parser("status", help="Print the progress of the rollouts")
+    status.add_argument("id", type=int, nargs="?", help="The rollout")
+
+    for command in ["pause", "resume", "abort", "advance"]:
+        subparser = subparsers.add_parser(command, help="%s a rollout" %command.capitalize())
+        subparser.add_argument("id", type=int, help="The rollout")
+
+    subparsers.add_parser("test", help="Test the scheduler with a temporary database")
+
+    return parser.parse_args()
+
+
+if __name__ == "__main__":
+    ret = main()
+    sys.exit(ret)
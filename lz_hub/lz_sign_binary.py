@@ -13,6 +13,13 @@ from ecdsa.util import sigencode_der
 HEADER_SIZE         = 0x800
 LEN_SIGNATURE = 84
 
+# Compressed images, see lz_compressed_hdr_t. The window is one flash page, so that the device
+# decompresses into a single page buffer
+COMPRESSED_MAGIC    = 0x315A4C43
+WINDOW_SIZE         = 0x200
+MIN_MATCH           = 3
+MAX_MATCH           = MIN_MATCH + 0x7F
+
 def main():
     print("")
     print("Creating signed code file..")
@@ -45,9 +52,9 @@ def main():
     code_auth_sk_ecdsa = ecdsa.SigningKey.from_der(code_auth_sk_tmp, hashfunc=hashlib.sha256)
 
     # Create signed code files
-    return create_signed_code_file(args.in_file, args.buildno_file, code_auth_sk_ecdsa, args.out_file, args.c, args.e)
+    return create_signed_code_file(args.in_file, args.buildno_file, code_auth_sk_ecdsa, args.out_file, args.c, args.e, args.z)
 
-def create_signed_code_file(code_file_name, build_file_name, code_auth_sk_ecdsa, out_file, is_core, is_erased):
+def create_signed_code_file(code_file_name, build_file_name, code_auth_sk_ecdsa, out_file, is_core, is_erased, is_compressed=False):
 
     # Check if build number file exists, if not, create it
     if not os.path.isfile(build_file_name):
@@ -153,9 +160,87 @@ def create_signed_code_file(code_file_name, build_file_name, code_auth_sk_ecdsa,
     print("---")
     print("Successfully created signed code file %s" %os.path.basename(out_file))
 
+    # The compressed binary is only used for updates, the signed binary is still required for
+    # provisioning. The header is the same, the digest refers to the uncompressed code
+    if is_compressed and not is_core:
+        compressed_code = compress(code_file_content)
+        if len(compressed_code) + 8 >= len(code_file_content):
+            print("Code is not compressible, no compressed code file created")
+            return 0
+
+        compressed_file = get_compressed_file_name(out_file)
+        try:
+            with open(compressed_file, "wb") as out_compressed_file:
+                out_compressed_file.write(hdr + struct.pack('II', COMPRESSED_MAGIC, len(compressed_code)) + compressed_code)
+        except Exception as e:
+            print("Failed to write compressed binary to file: %s" %str(e))
+            return 1
+
+        print("Compressed size: %d (0x%x) bytes" %(len(compressed_code), len(compressed_code)))
+        print("Successfully created compressed code file %s" %os.path.basename(compressed_file))
+
     return 0
 
 
+def get_compressed_file_name(file_name):
+
+    return os.path.splitext(file_name)[0] + "_compressed.bin"
+
+
+def compress(data):
+    """LZSS compression with a window of one flash page. A control byte precedes each group of
+    eight items, a set bit (LSB first) marks a match, a clear bit a literal byte. A match is
+    encoded in 16 bits little endian: distance - 1 in bits 0-8, length - MIN_MATCH in bits 9-15"""
+
+    # Positions of all 3 byte prefixes in the window, the most recent last
+    index = {}
+    out = bytearray()
+    ctrl_pos = 0
+    items = 8
+
+    i = 0
+    while i < len(data):
+        if items == 8:
+            ctrl_pos = len(out)
+            out.append(0)
+            items = 0
+
+        best_len = 0
+        best_dist = 0
+        for pos in reversed(index.get(data[i:i + MIN_MATCH], [])):
+            if i - pos > WINDOW_SIZE:
+                break
+            length = 0
+            while (length < MAX_MATCH and i + length < len(data) and
+                   data[pos + length] == data[i + length]):
+                length += 1
+            if length > best_len:
+                best_len = length
+                best_dist = i - pos
+                if length == MAX_MATCH:
+                    break
+
+        if best_len >= MIN_MATCH:
+            token = (best_dist - 1) | ((best_len - MIN_MATCH) << 9)
+            out[ctrl_pos] |= 1 << items
+            out.extend(struct.pack('<H', token))
+            step = best_len
+        else:
+            out.append(data[i])
+            step = 1
+
+        for j in range(i, i + step):
+            positions = index.setdefault(data[j:j + MIN_MATCH], [])
+            positions.append(j)
+            # Older positions are out of the window anyway
+            if len(positions) > WINDOW_SIZE:
+                del positions[:len(positions) - WINDOW_SIZE]
+        i += step
+        items += 1
+
+    return bytes(out)
+
+
 def parse_arguments():
     parser = argparse.ArgumentParser()
     parser.add_argument("in_file", help="The binary file to be signed")
@@ -164,6 +249,7 @@ def parse_arguments():
     parser.add_argument("cert_path", help="The path where the backend and the code authentification certificates are located")
     parser.add_argument("-c", action='store_true', help="flag to indicate that binary is lazarus core")
     parser.add_argument("-e", action='store_true', help="flag to indicate that flash was erased and datastore needs to be included")
+    parser.add_argument("-z", action='store_true', help="flag to additionally create a compressed binary for updates (not for lazarus core)")
 
     args = parser.parse_args()
     args.cert_path = args.cert_path.rstrip("/")
@@ -1,10 +1,17 @@
 from OpenSSL import crypto
+from cryptography.hazmat.primitives import serialization
 import sys
 
 def dump_publickey(key):
     return crypto.dump_publickey(crypto.FILETYPE_PEM, key)
 
 
+def dump_publickey_raw(key):
+    """Returns the public key as uncompressed SEC1 point (0x04 | X | Y)"""
+    return key.to_cryptography_key().public_bytes(serialization.Encoding.X962,
+        serialization.PublicFormat.UncompressedPoint)
+
+
 def dump_privatekey(key):
     return crypto.dump_privatekey(crypto.FILETYPE_PEM, key)
 
@@ -18,6 +25,22 @@ def dump_cert(cert):
     return buffer
 
 
+def dump_cert_der(cert):
+    try:
+        buffer = crypto.dump_certificate(crypto.FILETYPE_ASN1, cert)
+    except Exception as e:
+        print("ERROR: Could not dump certificate - %s" %str(e))
+        return None
+    return buffer
+
+
+def get_filetype(buf):
+    """Devices store certificates and CSRs DER encoded, files and the database contain PEM"""
+    if isinstance(buf, str) or bytes(buf).lstrip().startswith(b'-----BEGIN'):
+        return crypto.FILETYPE_PEM
+    return crypto.FILETYPE_ASN1
+
+
 def load_privatekey_from_buffer(buf):
     try:
         key = crypto.load_privatekey(crypto.FILETYPE_PEM, buf)
@@ -49,7 +72,7 @@ def load_privatekey(name):
 
 def load_cert_from_buffer(buf):
     try:
-        cert = crypto.load_certificate(crypto.FILETYPE_PEM, buf)
+        cert = crypto.load_certificate(get_filetype(buf), buf)
     except Exception as e:
         print("Error loading certificate: %s"
               % (str(e)))
@@ -151,7 +174,7 @@ def create_cert_from_csr(csr, ca_sk, ca_cert, isCA):
 
 def load_csr_from_buffer(buf):
     try:
-        csr = crypto.load_certificate_request(crypto.FILETYPE_PEM, buf)
+        csr = crypto.load_certificate_request(get_filetype(buf), buf)
     except Exception as e:
         print("Error: Unable to load CSR from buffer: %s" %str(e))
         return None
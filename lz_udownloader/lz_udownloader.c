@@ -26,6 +26,8 @@
 
 void lz_udownloader_run(void)
 {
+	LZ_RESULT result;
+
 	// Check whether we have valid boot parameters provided by Lazarus Core
 	if (lz_has_valid_boot_params() != LZ_SUCCESS) {
 		dbgprint(DBG_ERR, "ERROR: Corrupted boot parameters.\n");
@@ -56,20 +58,24 @@ void lz_udownloader_run(void)
 		}
 	}
 
+	// The requests to the hub share a connection
+	lz_net_begin_session();
+
 	if (lz_net_send_alias_id_cert() != LZ_SUCCESS) {
 		dbgprint(DBG_WARN, "WARN: Updating AliasID cert in backend not successful\n");
 	}
 
-	// Check if a firmware update is necessary. This is signaled by Lazarus Core if the firmware
-	// could not be verified
-	if (lz_firmware_update_necessary()) {
-		if (lz_net_fw_update(APP_UPDATE) == LZ_SUCCESS) {
-			if (lz_set_boot_mode_request(APP_UPDATE) != LZ_SUCCESS) {
-				dbgprint(DBG_WARN, "WARN: Failed to set boot mode request\n");
-			}
-		} else {
-			dbgprint(DBG_WARN, "WARN: Failed to download update from hub\n");
+	// Check for a firmware update. If Lazarus Core could not verify the firmware, the complete
+	// image is requested. Otherwise, the hub only sends an update if the firmware is outdated
+	result = lz_net_fw_update(APP_UPDATE);
+	if (result == LZ_SUCCESS) {
+		if (lz_set_boot_mode_request(APP) != LZ_SUCCESS) {
+			dbgprint(DBG_WARN, "WARN: Failed to set boot mode request\n");
 		}
+	} else if (result == LZ_NOT_FOUND) {
+		dbgprint(DBG_INFO, "INFO: Firmware is up to date\n");
+	} else {
+		dbgprint(DBG_WARN, "WARN: Failed to download update from hub\n");
 	}
 
 	// Get a new boot ticket, as the Update Downloader will trigger a reset when it is finished.
@@ -81,28 +87,30 @@ void lz_udownloader_run(void)
 			dbgprint(DBG_WARN, "WARN: Failed to set boot mode request to APP\n");
 		}
 	}
+
+	lz_net_end_session();
 }
 
 void lz_print_cert_store(void)
 {
 	dbgprint(DBG_INFO, "INFO: Printing certificate store\n");
 
-	dbgprint(DBG_INFO, "INFO: DeviceID pubkey:\n%s\n", &lz_img_cert_store.info.dev_pub_key.key);
+	dbgprint_data((uint8_t *)&lz_img_cert_store.info.dev_pub_key,
+				  sizeof(lz_img_cert_store.info.dev_pub_key), "DeviceID pubkey");
 
-	dbgprint(DBG_INFO, "INFO: CodeAuthority pubkey:\n%s\n",
-			 &lz_img_cert_store.info.code_auth_pub_key.key);
+	dbgprint_data((uint8_t *)&lz_img_cert_store.info.code_auth_pub_key,
+				  sizeof(lz_img_cert_store.info.code_auth_pub_key), "CodeAuthority pubkey");
 
-	dbgprint(DBG_INFO, "INFO: Hub Public Key:\n%s\n",
-			 &lz_img_cert_store.info.management_pub_key.key);
+	dbgprint_data((uint8_t *)&lz_img_cert_store.info.management_pub_key,
+				  sizeof(lz_img_cert_store.info.management_pub_key), "Hub Public Key");
 
-	dbgprint(DBG_INFO, "INFO: Certificate bag certificates:\n");
+	dbgprint(DBG_INFO, "INFO: Certificate bag certificates (DER):\n");
 	for (uint32_t n = 0; n < NUM_CERTS; n++) {
 		if (lz_img_cert_store.info.certTable[n].size > 0) {
-			// We have a 0 byte between the PEM certificates in the certBag
-			dbgprint(DBG_INFO, "%s",
-					 (char *)&lz_img_cert_store.certBag[lz_img_cert_store.info.certTable[n].start]);
+			dbgprint_data(
+				(uint8_t *)&lz_img_cert_store.certBag[lz_img_cert_store.info.certTable[n].start],
+				lz_img_cert_store.info.certTable[n].size, "Certificate");
 		}
-		dbgprint(DBG_INFO, "\n");
 	}
 }
 
@@ -116,10 +124,8 @@ LZ_RESULT lz_reassociate_device(void)
 		dbgprint(DBG_ERR, "ERROR: Failed to read DeviceID CSR from certbag: Size is 0\n");
 	}
 
-	// There is a 0 byte between the PEM certificates in the certBag
-	dbgprint(DBG_INFO, "DeviceID CSR:\n%s\n",
-			 (char *)&lz_img_cert_store
-				 .certBag[lz_img_cert_store.info.certTable[INDEX_IMG_CERTSTORE_DEVICEID].start]);
+	dbgprint(DBG_INFO, "INFO: DeviceID CSR (DER, %d bytes)\n",
+			 lz_img_cert_store.info.certTable[INDEX_IMG_CERTSTORE_DEVICEID].size);
 
 	return lz_net_reassociate_device(
 		(uint8_t *)lz_img_boot_params.info.dev_uuid, (uint8_t *)lz_img_boot_params.info.dev_auth,
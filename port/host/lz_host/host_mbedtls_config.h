@@ -0,0 +1,38 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_MBEDTLS_CONFIG_H
+#define HOST_MBEDTLS_CONFIG_H
+
+/*
+ * The host build uses the default mbed TLS configuration without any hardware acceleration.
+ * Crypto timings measured on the host are therefore not representative for the CASPER and
+ * HASHCRYPT accelerated LPC55S69 builds.
+ */
+#include "mbedtls/config.h"
+
+/* The Lazarus sources rely on the standard headers the LPC55S69 configuration pulls in through
+ * the SDK headers */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#endif /* HOST_MBEDTLS_CONFIG_H */
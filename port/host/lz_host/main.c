@@ -0,0 +1,278 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "lz_config.h"
+#include "lz_common.h"
+#include "lzport_flash.h"
+#include "lzport_memory.h"
+#include "lzport_debug_output.h"
+#include "lzport_rng.h"
+#include "lzport_throttle_timer.h"
+#include "lzport_wdt.h"
+#include "lzport_usart.h"
+#include "dicepp.h"
+#include "lz_core.h"
+#include "lz_net.h"
+
+/*
+ * Host (Linux) executable which runs DICEpp and Lazarus Core on an emulated flash. Each run of
+ * the executable corresponds to one reset of the device. The flash file keeps its contents
+ * across runs, so consecutive runs behave like consecutive boots.
+ *
+ * Usage: lz_host [-f flash_file] [-l addr:file]... [-w timeout_s] [-n pty [-t count] [-u type]]
+ *   -f  File backing the emulated flash (default: lz_host_flash.bin)
+ *   -l  Flash the contents of <file> to <addr> before booting, e.g. a signed image to its header
+ *       address or a staging element to the staging area. Can be specified multiple times
+ *   -w  Arm the emulated watchdog before booting, so that a blocking boot terminates
+ *   -n  After booting, connect to the hub through the ESP8266 simulator (lz_esp8266_sim.py)
+ *       listening on <pty>
+ *   -t  Request <count> boot tickets from the hub (default: 1)
+ *   -u  Download an update of <type> (APP_UPDATE, UD_UPDATE or CP_UPDATE) to the staging area
+ */
+
+static const char *boot_mode_str[] = { "APP", "LZ_UDOWNLOADER", "LZ_CPATCHER" };
+
+static const struct {
+	const char *name;
+	hdr_type_t type;
+} update_types[] = {
+	{ "APP_UPDATE", APP_UPDATE },
+	{ "UD_UPDATE", LZ_UDOWNLOADER_UPDATE },
+	{ "CP_UPDATE", LZ_CPATCHER_UPDATE },
+};
+
+static void lz_host_usage(const char *name)
+{
+	fprintf(stderr,
+			"Usage: %s [-f flash_file] [-l addr:file]... [-w timeout_s] [-n pty [-t count] "
+			"[-u type]]\n",
+			name);
+}
+
+static double lz_host_elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static bool lz_host_load_file(const char *arg)
+{
+	bool result = false;
+	char *end = NULL;
+	uint8_t *buf = NULL;
+	FILE *f = NULL;
+	long size;
+
+	uint32_t addr = strtoul(arg, &end, 0);
+	if (end == arg || *end != ':') {
+		dbgprint(DBG_ERR, "ERROR: Invalid load argument %s. Expected addr:file\n", arg);
+		goto exit;
+	}
+
+	f = fopen(end + 1, "rb");
+	if (!f) {
+		dbgprint(DBG_ERR, "ERROR: Failed to open %s\n", end + 1);
+		goto exit;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	buf = malloc(size);
+	if (!buf || fread(buf, 1, size, f) != (size_t)size) {
+		dbgprint(DBG_ERR, "ERROR: Failed to read %s\n", end + 1);
+		goto exit;
+	}
+
+	dbgprint(DBG_INFO, "INFO: Flashing %s (%ld bytes) to 0x%x\n", end + 1, size, addr);
+	if (!lzport_flash_write(addr, buf, size)) {
+		dbgprint(DBG_ERR, "ERROR: Failed to flash %s\n", end + 1);
+		goto exit;
+	}
+
+	result = true;
+
+exit:
+	free(buf);
+	if (f) {
+		fclose(f);
+	}
+	return result;
+}
+
+static bool lz_host_parse_update_type(const char *arg, hdr_type_t *type)
+{
+	for (uint32_t i = 0; i < sizeof(update_types) / sizeof(update_types[0]); i++) {
+		if (strcmp(arg, update_types[i].name) == 0) {
+			*type = update_types[i].type;
+			return true;
+		}
+	}
+	dbgprint(DBG_ERR, "ERROR: Invalid update type %s\n", arg);
+	return false;
+}
+
+/*
+ * Runs the requests of the network stack against the hub, as Lazarus Core and the update
+ * downloader do on the device, and reports the time each of them took
+ */
+static bool lz_host_run_network(uint32_t num_tickets, bool update, hdr_type_t update_type)
+{
+	struct timespec start;
+	bool result = false;
+	double ms;
+
+	lzport_usart_init_esp();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (lz_net_init() != LZ_SUCCESS) {
+		dbgprint(DBG_ERR, "ERROR: Failed to initialize network\n");
+		return false;
+	}
+	dbgprint(DBG_INFO, "INFO: Network initialized after %.3f ms\n", lz_host_elapsed_ms(&start));
+
+	// All requests share one connection to the hub
+	lz_net_begin_session();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (uint32_t i = 0; i < num_tickets; i++) {
+		if (lz_net_refresh_boot_ticket() != LZ_SUCCESS) {
+			dbgprint(DBG_ERR, "ERROR: Boot ticket request %d failed\n", i);
+			goto exit;
+		}
+	}
+	if (num_tickets) {
+		ms = lz_host_elapsed_ms(&start);
+		dbgprint(DBG_INFO, "INFO: %d boot tickets in %.3f ms (%.3f ms per ticket)\n",
+				 num_tickets, ms, ms / num_tickets);
+	}
+
+	if (update) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		LZ_RESULT update_result = lz_net_fw_update(update_type);
+		if (update_result == LZ_NOT_FOUND) {
+			dbgprint(DBG_INFO, "INFO: Hub has no update for the installed image\n");
+		} else if (update_result != LZ_SUCCESS) {
+			dbgprint(DBG_ERR, "ERROR: Update failed\n");
+			goto exit;
+		} else {
+			ms = lz_host_elapsed_ms(&start);
+			dbgprint(DBG_INFO, "INFO: Update downloaded in %.3f ms\n", ms);
+		}
+	}
+
+	result = true;
+
+exit:
+	lz_net_end_session();
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec start;
+	uint32_t wdt_timeout_s = 0;
+	const char *esp_device = NULL;
+	uint32_t num_tickets = 1;
+	hdr_type_t update_type = APP_UPDATE;
+	bool update = false;
+	int opt;
+
+	// The emulated watchdog terminates the process without flushing stdout
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	// Flash must be initialized before images can be loaded, so only the flash file is parsed
+	// in the first pass
+	while ((opt = getopt(argc, argv, "f:l:w:n:t:u:")) != -1) {
+		switch (opt) {
+		case 'f':
+			lzport_flash_set_file(optarg);
+			break;
+		case 'l':
+			break;
+		case 'w':
+			wdt_timeout_s = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			esp_device = optarg;
+			break;
+		case 't':
+			num_tickets = strtoul(optarg, NULL, 0);
+			break;
+		case 'u':
+			if (!lz_host_parse_update_type(optarg, &update_type)) {
+				return EXIT_FAILURE;
+			}
+			update = true;
+			break;
+		default:
+			lz_host_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	lzport_init_debug();
+	if (!lzport_flash_init()) {
+		dbgprint(DBG_ERR, "Failed to initialize flash\n");
+		return EXIT_FAILURE;
+	}
+
+	optind = 1;
+	while ((opt = getopt(argc, argv, "f:l:w:n:t:u:")) != -1) {
+		if (opt == 'l' && !lz_host_load_file(optarg)) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (wdt_timeout_s) {
+		lzport_wdt_init(wdt_timeout_s);
+	}
+
+	lzport_throttle_timer_init();
+	lzport_rng_init();
+
+	// DICEpp and Lazarus Core hand over their parameters via the same SRAM region, as on the
+	// device (see linker_script_lz_host.ld)
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	dicepp_run();
+	dbgprint(DBG_INFO, "INFO: DICEpp finished after %.3f ms\n", lz_host_elapsed_ms(&start));
+
+	lz_print_img_info("Lazarus Core", &lz_core_hdr);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	boot_mode_t boot_mode = lz_core_run();
+	dbgprint(DBG_INFO, "INFO: Lazarus Core finished after %.3f ms\n", lz_host_elapsed_ms(&start));
+
+	dbgprint(DBG_INFO, "INFO: Lazarus Core would now boot %s\n", boot_mode_str[boot_mode]);
+
+	if (esp_device) {
+		lzport_usart_set_device(esp_device);
+		if (!lz_host_run_network(num_tickets, update, update_type)) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
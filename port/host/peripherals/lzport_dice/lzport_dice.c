@@ -0,0 +1,46 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+#include "lzport_debug_output.h"
+#include "lzport_memory.h"
+#include "lzport_dice.h"
+#include "lz_common.h"
+
+/**
+ * The host has no DICE hardware. The CDI is a fixed value, so the identities derived from it are
+ * stable across boots of the same flash file. Never use this port for anything but testing.
+ */
+static const uint8_t host_cdi[SHA256_DIGEST_LENGTH] = {
+	0x4c, 0x5a, 0x2d, 0x48, 0x4f, 0x53, 0x54, 0x2d, 0x43, 0x44, 0x49, 0x2d, 0x4e, 0x4f, 0x54, 0x2d,
+	0x53, 0x45, 0x43, 0x52, 0x45, 0x54, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09
+};
+
+void lzport_read_cdi(uint8_t *data, uint32_t len)
+{
+	if (len != SHA256_DIGEST_LENGTH) {
+		dbgprint(DBG_ERR, "ERROR: specified CDI length (%d) is invalid (must be %d)", len,
+				 SHA256_DIGEST_LENGTH);
+		lz_error_handler();
+	}
+
+	memcpy(data, host_cdi, SHA256_DIGEST_LENGTH);
+}
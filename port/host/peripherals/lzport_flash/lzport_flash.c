@@ -0,0 +1,347 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lz_error.h"
+#include "lz_common.h"
+#include "lzport_flash.h"
+#include "lzport_memory.h"
+#include "lzport_rng.h"
+#include "lzport_debug_output.h"
+
+/*
+ * The flash is emulated by a file which is mapped to the same addresses as on the LPC55S69. The
+ * secure part of the flash (DICEpp, Lazarus Core, Core Patcher) is only accessed through its
+ * secure alias 0x1xxxxxxx, the non-secure part (UD, App, data store, staging area) through its
+ * non-secure alias. Both windows map the same file, so the file offset is always the physical
+ * flash address. The host linker script places the flash sections at these addresses.
+ */
+
+#define SECURE_BIT_MASK 0x10000000
+#define min(x, y) ((x) < (y) ? (x) : (y))
+
+static const char *flash_file = LZPORT_FLASH_DEFAULT_FILE;
+static int flash_fd = -1;
+
+static bool lzport_flash_program_page(uint32_t start, uint8_t *buf);
+static bool lzport_flash_page_is_erased(const uint8_t *page);
+static bool lzport_flash_map_window(uint32_t addr, uint32_t offset, uint32_t size);
+
+void lzport_flash_set_file(const char *path)
+{
+	flash_file = path;
+}
+
+bool lzport_flash_init(void)
+{
+	struct stat st;
+	uint8_t erased[FLASH_PAGE_SIZE];
+
+	dbgprint(DBG_VERB, "Initializing emulated flash %s...\n", flash_file);
+
+	flash_fd = open(flash_file, O_RDWR | O_CREAT, 0644);
+	if (flash_fd < 0) {
+		dbgprint(DBG_ERR, "ERROR: Failed to open flash file %s\n", flash_file);
+		return false;
+	}
+
+	if (fstat(flash_fd, &st) != 0) {
+		dbgprint(DBG_ERR, "ERROR: Failed to stat flash file %s\n", flash_file);
+		goto fail;
+	}
+
+	// A new (or truncated) flash file is filled up with erased pages
+	memset(erased, 0xFF, sizeof(erased));
+	for (uint32_t offset = (uint32_t)st.st_size, len = 0; offset < FLASH_SIZE; offset += len) {
+		len = min(FLASH_SIZE - offset, FLASH_PAGE_SIZE - (offset % FLASH_PAGE_SIZE));
+		if (pwrite(flash_fd, erased, len, offset) != (ssize_t)len) {
+			dbgprint(DBG_ERR, "ERROR: Failed to initialize flash file %s\n", flash_file);
+			goto fail;
+		}
+	}
+
+	if (!lzport_flash_map_window(FLASH_BASE_ADDR | SECURE_BIT_MASK, FLASH_BASE_ADDR,
+								 LZ_FLASH_NS_START) ||
+		!lzport_flash_map_window(LZ_FLASH_NS_START, LZ_FLASH_NS_START,
+								 FLASH_SIZE - LZ_FLASH_NS_START)) {
+		goto fail;
+	}
+
+	return true;
+
+fail:
+	close(flash_fd);
+	flash_fd = -1;
+	return false;
+}
+
+bool lzport_flash_write(uint32_t start, uint8_t *buf, uint32_t size)
+{
+	uint8_t tmp[FLASH_PAGE_SIZE];
+	// The start of the flash to be written
+	uint32_t flash_start = start & ~SECURE_BIT_MASK;
+	// The cursor where to flash is set to the page start
+	uint32_t cursor_flash = flash_start - (flash_start % FLASH_PAGE_SIZE);
+	// Size of the flash between page start and the actual address to be written
+	uint32_t size_before = (flash_start % FLASH_PAGE_SIZE);
+	// If the block to be flashed does not exceed a single page, there is no
+	// part of the last page to be flashed
+	uint32_t size_last_page = ((flash_start + size) < (cursor_flash + FLASH_PAGE_SIZE)) ?
+								  0 :
+								  ((flash_start + size) % FLASH_PAGE_SIZE);
+	uint32_t cursor_buf = 0;
+	bool result = false;
+
+	dbgprint(DBG_VERB, "INFO: Flashing %d bytes to address 0x%X\n", size, flash_start);
+
+	// Start address is not page aligned, or is aligned but smaller than one page:
+	// we have to read the first page
+	if (((flash_start % FLASH_PAGE_SIZE) != 0) || size < FLASH_PAGE_SIZE) {
+		// Read flash page
+		if (!lzport_flash_read(cursor_flash, tmp, FLASH_PAGE_SIZE)) {
+			goto exit;
+		}
+
+		// Append own data to the first flash page
+		memcpy(&tmp[size_before], buf, min(size, FLASH_PAGE_SIZE - size_before));
+
+		// Flash first page
+		if (!lzport_flash_program_page(cursor_flash, tmp)) {
+			goto exit;
+		}
+
+		// Set cursor to next page
+		cursor_flash += FLASH_PAGE_SIZE;
+		cursor_buf = FLASH_PAGE_SIZE - size_before;
+	}
+
+	// Flash while there is still at lest one full page left
+	while ((cursor_flash + FLASH_PAGE_SIZE) <= (flash_start + size)) {
+		if (!lzport_flash_program_page(cursor_flash, &buf[cursor_buf])) {
+			goto exit;
+		}
+
+		cursor_flash += FLASH_PAGE_SIZE;
+		cursor_buf += FLASH_PAGE_SIZE;
+	}
+
+	// If size is not aligned and there was more than one page to flash,
+	// read the last page, insert the data and write it back
+	if (size_last_page != 0) {
+		if (!lzport_flash_read(cursor_flash, tmp, FLASH_PAGE_SIZE)) {
+			goto exit;
+		}
+
+		memcpy(tmp, &buf[cursor_buf], size_last_page);
+
+		if (!lzport_flash_program_page(cursor_flash, tmp)) {
+			goto exit;
+		}
+	}
+
+	result = true;
+
+exit:
+	return result;
+}
+
+bool lzport_flash_erase_page(uint32_t start)
+{
+	uint8_t erased[FLASH_PAGE_SIZE];
+
+	dbgprint(DBG_VERB, "INFO: Erasing flash...\n");
+
+	if (flash_fd < 0) {
+		dbgprint(DBG_ERR, "ERROR: Flash is not properly initialized\n");
+		return false;
+	}
+
+	// Parameter check: Page-alignment and within flash bounds
+	if (!((start < (FLASH_BASE_ADDR + FLASH_SIZE)) && (start % FLASH_PAGE_SIZE) == 0)) {
+		dbgprint(DBG_ERR,
+				 "ERROR: Failed to erase page: address 0x%x outside of flash memory "
+				 "range or not pagewise aligned\n",
+				 start);
+		return false;
+	}
+
+	memset(erased, 0xFF, sizeof(erased));
+	if (pwrite(flash_fd, erased, sizeof(erased), start) != sizeof(erased)) {
+		dbgprint(DBG_ERR, "ERROR: Failed to erase page 0x%x\n", start);
+		return false;
+	}
+
+	return true;
+}
+
+bool lzport_flash_erase(uint32_t start, uint32_t size)
+{
+	uint32_t start_internal = start;
+	for (uint32_t i = 0; i < size / FLASH_PAGE_SIZE; i++) {
+		if (!lzport_flash_erase_page(start_internal)) {
+			return false;
+		}
+		start_internal += FLASH_PAGE_SIZE;
+	}
+	return true;
+}
+
+bool lzport_flash_read(uint32_t addr, uint8_t *buffer, uint32_t size)
+{
+	uint32_t flash_addr = addr & ~SECURE_BIT_MASK;
+
+	dbgprint(DBG_VERB, "INFO: FLASH - Reading from flash\n");
+
+	if (flash_addr >= (FLASH_BASE_ADDR + FLASH_SIZE)) {
+		dbgprint(DBG_ERR,
+				 "ERROR: Failed to read flash: address range 0x%x-0x%x is outside of "
+				 "flash memory region\n",
+				 addr, addr + size);
+		return false;
+	}
+
+	if (pread(flash_fd, buffer, size, flash_addr) != (ssize_t)size) {
+		dbgprint(DBG_ERR, "ERROR: Failed to read flash at 0x%x\n", addr);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * The host has no protected flash region with a factory UUID. A random version 4 UUID is
+ * generated instead, which is stored in the DICEpp data store on the first boot anyway
+ */
+int lzport_retrieve_uuid(uint8_t uuid[LEN_UUID_V4_BIN])
+{
+	if (lzport_rng_get_random_data(uuid, LEN_UUID_V4_BIN) != LZ_SUCCESS) {
+		dbgprint(DBG_ERR, "ERROR: Failed to generate UUID\n");
+		return LZ_ERROR;
+	}
+
+	// Version 4, variant RFC4122
+	uuid[6] = (uuid[6] & 0x0F) | 0x40;
+	uuid[8] = (uuid[8] & 0x3F) | 0x80;
+
+	return LZ_SUCCESS;
+}
+
+bool lzport_flash_contains(uint32_t start, const uint8_t *buf, uint32_t size)
+{
+	uint32_t flash_start = start & ~SECURE_BIT_MASK;
+
+	if ((flash_start >= (FLASH_BASE_ADDR + FLASH_SIZE)) ||
+		(size > (FLASH_BASE_ADDR + FLASH_SIZE) - flash_start)) {
+		return false;
+	}
+
+	// The emulated flash has no ECC, erased pages can be read as well
+	return memcmp((void *)(uintptr_t)start, buf, size) == 0;
+}
+
+/* ############################### Private function definitions #################################*/
+
+/**
+ * Emulates the LPC55S69 page programming: Pages that already contain the data are skipped. Other
+ * pages are erased if necessary, then programmed and verified. Like the real flash controller,
+ * programming a page that is not erased fails
+ */
+static bool lzport_flash_program_page(uint32_t start, uint8_t *buf)
+{
+	uint8_t page[FLASH_PAGE_SIZE];
+	uint32_t flash_start = start & ~SECURE_BIT_MASK;
+
+	// Parameter check: Page-alignment and within flash bounds
+	if (!((flash_start < (FLASH_BASE_ADDR + FLASH_SIZE)) && (flash_start % FLASH_PAGE_SIZE) == 0)) {
+		dbgprint(DBG_ERR,
+				 "ERROR: Failed to flash page. Address 0x%x outside of flash memory range"
+				 "\n",
+				 start);
+		return false;
+	}
+
+	if (!lzport_flash_read(flash_start, page, FLASH_PAGE_SIZE)) {
+		return false;
+	}
+
+	if (memcmp(page, buf, FLASH_PAGE_SIZE) == 0) {
+		dbgprint(DBG_VERB, "INFO: Page 0x%X unchanged, skipping it\n", flash_start);
+		return true;
+	}
+
+	if (!lzport_flash_page_is_erased(page)) {
+		if (!lzport_flash_erase_page(flash_start)) {
+			return false;
+		}
+
+		if (!lzport_flash_read(flash_start, page, FLASH_PAGE_SIZE)) {
+			return false;
+		}
+		if (!lzport_flash_page_is_erased(page)) {
+			dbgprint(DBG_ERR, "ERROR: Programming page 0x%x which is not erased\n", flash_start);
+			return false;
+		}
+	}
+
+	if (pwrite(flash_fd, buf, FLASH_PAGE_SIZE, flash_start) != FLASH_PAGE_SIZE) {
+		dbgprint(DBG_ERR, "ERROR: Failed to program page 0x%x\n", flash_start);
+		return false;
+	}
+
+	if (!lzport_flash_read(flash_start, page, FLASH_PAGE_SIZE) ||
+		memcmp(page, buf, FLASH_PAGE_SIZE) != 0) {
+		dbgprint(DBG_ERR, "ERROR: Verifying page 0x%x failed\n", flash_start);
+		return false;
+	}
+
+	return true;
+}
+
+static bool lzport_flash_page_is_erased(const uint8_t *page)
+{
+	for (uint32_t i = 0; i < FLASH_PAGE_SIZE; i++) {
+		if (page[i] != 0xFF) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Maps <size> bytes of the flash file starting at <offset> to the fixed address <addr>, replacing
+ * the placeholder sections the linker created there
+ */
+static bool lzport_flash_map_window(uint32_t addr, uint32_t offset, uint32_t size)
+{
+	void *p = mmap((void *)(uintptr_t)addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+				   flash_fd, offset);
+	if (p == MAP_FAILED) {
+		dbgprint(DBG_ERR, "ERROR: Failed to map flash window 0x%x-0x%x\n", addr, addr + size);
+		return false;
+	}
+	return true;
+}
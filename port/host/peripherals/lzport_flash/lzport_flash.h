@@ -0,0 +1,56 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLASH_API_H_
+#define FLASH_API_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Secure flash start address */
+#define FLASH_BASE_ADDR 0x00000000
+/** Flash size is 640kB = 0xA0000, the last 20 pages are reserved */
+#define FLASH_SIZE 0x9D800
+
+/** File which backs the emulated flash if lzport_flash_set_file() was not called */
+#define LZPORT_FLASH_DEFAULT_FILE "lz_host_flash.bin"
+
+/**
+ * Sets the file backing the emulated flash. Must be called before lzport_flash_init(). The file
+ * holds the physical flash contents, i.e. offset 0 corresponds to flash address 0x0
+ */
+void lzport_flash_set_file(const char *path);
+
+bool lzport_flash_init(void);
+bool lzport_flash_erase_page(uint32_t start);
+bool lzport_flash_erase(uint32_t start, uint32_t size);
+bool lzport_flash_write(uint32_t start, uint8_t *buf, uint32_t size);
+bool lzport_flash_read(uint32_t addr, uint8_t *buffer, uint32_t size);
+/**
+ * Checks whether the flash already contains the data, without reading erased pages through the
+ * bus, which causes an ECC fault on the LPC55S69
+ */
+bool lzport_flash_contains(uint32_t start, const uint8_t *buf, uint32_t size);
+/**
+ * Returns the 128-bit RFC4122 compliant Universally Unique Identifier (UUID)
+ * of the device
+ */
+int lzport_retrieve_uuid(uint8_t uuid[LEN_UUID_V4_BIN]);
+
+#endif /* FLASH_API_H_ */
@@ -0,0 +1,36 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lzport_gpio.h"
+
+/*
+ * The host has no GPIOs. The RTS line to pause the ESP8266 is not required, as the simulator
+ * blocks when the pseudo terminal is full
+ */
+
+void lzport_gpio_set_rts(bool status)
+{
+	(void)status;
+}
+
+void lzport_gpio_toggle_trace(void)
+{
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include "lzport_debug_output.h"
+#include "lzport_power.h"
+
+static bool rng_ring_oscillator_powered_down = false;
+
+void lzport_power_enter_sleep(void)
+{
+	dbgprint(DBG_VERB, "INFO: Sleep mode is not emulated on the host\n");
+}
+
+void lzport_power_init_rng_ring_oscillator(void)
+{
+	rng_ring_oscillator_powered_down = false;
+}
+
+void lzport_power_deinit_rng_ring_oscillator(void)
+{
+	rng_ring_oscillator_powered_down = true;
+}
+
+// Mirrors the LPC55S69 semantics which return the power-down bit of the ring oscillator
+bool lzport_power_is_ring_oscillator_enabled(void)
+{
+	return rng_ring_oscillator_powered_down;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/random.h>
+#include "lz_config.h"
+#include "lzport_debug_output.h"
+#include "lzport_rng.h"
+
+/**
+ * Initializes the random number generator. The host uses the kernel's CSPRNG, so there is
+ * nothing to initialize
+ */
+void lzport_rng_init(void)
+{
+	dbgprint(DBG_VERB, "INFO: RNG initialization successful\n");
+}
+
+/**
+ * Deinitializes the random number generator
+ */
+void lzport_rng_deinit(void)
+{
+	dbgprint(DBG_VERB, "INFO: RNG de-initialization successful\n");
+}
+
+/**
+ * Gets random data from the kernel's random number generator
+ *
+ * @param data buffer to be filled with random data
+ * @param size size of the buffer
+ */
+LZ_RESULT lzport_rng_get_random_data(void *data, size_t size)
+{
+	uint8_t *p = (uint8_t *)data;
+
+	while (size > 0) {
+		ssize_t len = getrandom(p, size, 0);
+		if (len < 0) {
+			dbgprint(DBG_ERR, "ERROR: Generating random data failed\n");
+			return LZ_ERROR;
+		}
+		p += len;
+		size -= len;
+	}
+
+	return LZ_SUCCESS;
+}
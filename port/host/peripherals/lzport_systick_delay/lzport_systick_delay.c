@@ -0,0 +1,47 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include "lzport_systick_delay.h"
+
+/*
+ * The millisecond tick is derived from the monotonic clock of the host
+ */
+
+uint32_t lzport_get_tick_ms(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+void lzport_delay(uint32_t time_ms)
+{
+	struct timespec t = { .tv_sec = time_ms / 1000, .tv_nsec = (time_ms % 1000) * 1000000 };
+	nanosleep(&t, NULL);
+}
+
+void lzport_init_systick_1khz(void)
+{
+}
+
+void lzport_deinit_systick(void)
+{
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdint.h"
+#include <stdbool.h>
+#include <time.h>
+
+static struct timespec throttle_end;
+
+static bool lzport_throttle_timer_is_before(const struct timespec *a, const struct timespec *b)
+{
+	return (a->tv_sec < b->tv_sec) || ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec));
+}
+
+void lzport_throttle_timer_init()
+{
+	throttle_end.tv_sec = 0;
+	throttle_end.tv_nsec = 0;
+}
+
+/**
+ * The throttling timer is active for timeout_s seconds.
+ *
+ * To start a new counting, call this function again
+ * with the appropriate timeout.
+ */
+void lzport_throttle_timer_start(uint32_t timeout_s)
+{
+	clock_gettime(CLOCK_MONOTONIC, &throttle_end);
+	throttle_end.tv_sec += timeout_s;
+}
+
+bool lzport_throttle_timer_is_active()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return lzport_throttle_timer_is_before(&now, &throttle_end);
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LZPORT_HOST_ARM_CMSE_H_
+#define LZPORT_HOST_ARM_CMSE_H_
+
+/*
+ * Replacement for the compiler's arm_cmse.h. There is no TrustZone on the host, so the
+ * non-secure entry points become plain function calls and every address range is accepted.
+ */
+
+#include <stddef.h>
+
+#define CMSE_MPU_READWRITE 1
+#define CMSE_AU_NONSECURE 2
+#define CMSE_MPU_NONSECURE 16
+#define CMSE_NONSECURE 18
+#define CMSE_MPU_READ 8
+
+/* Expands __attribute__((cmse_nonsecure_entry)) to an empty attribute list */
+#define cmse_nonsecure_entry
+#define cmse_nonsecure_call
+
+#define cmse_check_address_range(p, s, flags) ((void)(s), (void)(flags), (void *)(p))
+
+#endif /* LZPORT_HOST_ARM_CMSE_H_ */
@@ -0,0 +1,145 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "lz_config.h"
+#include "lzport_debug_output.h"
+#include "lzport_usart.h"
+
+/*
+ * The ESP8266 USART is emulated with the pseudo terminal of an ESP8266 simulator. The data is
+ * written through net_fd as on the device. Instead of an interrupt, the rx fifo is filled when
+ * it is polled by the network driver
+ */
+
+// Time to wait for data if the rx fifo is polled while empty, similar to a tick on the device
+#define ESP_USART_POLL_MS 1
+
+FILE *net_fd = NULL;
+volatile lzport_usart_fifo_t lzport_usart_tx_fifo_esp;
+volatile lzport_usart_fifo_t lzport_usart_rx_fifo_esp;
+
+static const char *esp_device = NULL;
+static int esp_fd = -1;
+
+static void lzport_usart_poll_esp(void);
+
+void lzport_usart_set_device(const char *path)
+{
+	esp_device = path;
+}
+
+void lzport_usart_init_esp(void)
+{
+	struct termios tio;
+
+	lzport_usart_buffer_init(&lzport_usart_tx_fifo_esp);
+	lzport_usart_buffer_init(&lzport_usart_rx_fifo_esp);
+
+	if (esp_device == NULL) {
+		dbgprint(DBG_ERR, "ERROR: No ESP8266 simulator device specified\n");
+		exit(EXIT_FAILURE);
+	}
+
+	esp_fd = open(esp_device, O_RDWR | O_NOCTTY);
+	if (esp_fd < 0) {
+		dbgprint(DBG_ERR, "ERROR: Failed to open ESP8266 simulator %s\n", esp_device);
+		exit(EXIT_FAILURE);
+	}
+
+	// The simulator speaks the raw AT protocol, line breaks must not be translated
+	if (tcgetattr(esp_fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(esp_fd, TCSANOW, &tio);
+	}
+
+	net_fd = fdopen(esp_fd, "w");
+	if (net_fd == NULL) {
+		dbgprint(DBG_ERR, "ERROR: Failed to open ESP8266 simulator %s\n", esp_device);
+		exit(EXIT_FAILURE);
+	}
+}
+
+void lzport_usart_set_baud_rate_esp(uint32_t baud_rate)
+{
+	// A pseudo terminal has no baud rate, the simulator emulates the transfer time
+	dbgprint(DBG_NW, "INFO: ESP USART baud rate %d\n", baud_rate);
+}
+
+void lzport_usart_buffer_init(volatile lzport_usart_fifo_t *buffer)
+{
+	buffer->size = USART_BUFF_SIZE + 1;
+	buffer->start = 0;
+	buffer->end = 0;
+}
+
+int lzport_usart_buffer_is_full(volatile lzport_usart_fifo_t *buffer)
+{
+	return (buffer->end + 1) % buffer->size == buffer->start;
+}
+
+int lzport_usart_buffer_is_empty(volatile lzport_usart_fifo_t *buffer)
+{
+	if ((buffer == &lzport_usart_rx_fifo_esp) && (buffer->end == buffer->start)) {
+		lzport_usart_poll_esp();
+	}
+	return buffer->end == buffer->start;
+}
+
+void lzport_usart_buffer_write(volatile lzport_usart_fifo_t *buffer, uint8_t elem)
+{
+	buffer->elems[buffer->end] = elem;
+	buffer->end = (buffer->end + 1) % buffer->size;
+
+	// if buffer is full
+	if (buffer->end == buffer->start) {
+		buffer->start = (buffer->start + 1) % buffer->size;
+	}
+}
+
+void lzport_usart_buffer_read(volatile lzport_usart_fifo_t *buffer, uint8_t *elem)
+{
+	*elem = buffer->elems[buffer->start];
+	buffer->start = (buffer->start + 1) % buffer->size;
+}
+
+static void lzport_usart_poll_esp(void)
+{
+	struct pollfd pfd = { .fd = esp_fd, .events = POLLIN };
+	uint8_t buf[USART_BUFF_SIZE];
+
+	if ((esp_fd < 0) || (poll(&pfd, 1, ESP_USART_POLL_MS) <= 0)) {
+		return;
+	}
+
+	// The fifo is empty, so it can take a full buffer
+	ssize_t len = read(esp_fd, buf, sizeof(buf));
+	if (len <= 0) {
+		dbgprint(DBG_ERR, "ERROR: ESP8266 simulator closed the connection\n");
+		exit(EXIT_FAILURE);
+	}
+	for (ssize_t i = 0; i < len; i++) {
+		lzport_usart_buffer_write(&lzport_usart_rx_fifo_esp, buf[i]);
+	}
+}
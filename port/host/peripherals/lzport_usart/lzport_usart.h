@@ -0,0 +1,66 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LZ_USART_H
+#define LZ_USART_H
+
+#include <stdint.h>
+#include "lz_config.h"
+#include "lz_error.h"
+
+/** The ESP8266 is emulated by a simulator on a pseudo terminal, see lz_hub/lz_esp8266_sim.py */
+#define ESP_USART_BAUD_RATE 115200U
+#ifndef ESP_USART_BAUD_RATE_HIGH
+#define ESP_USART_BAUD_RATE_HIGH ESP_USART_BAUD_RATE
+#endif
+#define ESP_USART_RX_DMA 0
+#ifndef ESP_USART_RX_BENCHMARK
+#define ESP_USART_RX_BENCHMARK 0
+#endif
+#define ESP_USART_RX_BENCHMARK_BYTES 0x10000
+#define USART_BUFF_SIZE 2000
+
+/**
+ * @brief 	USART circular buffer structure
+ */
+typedef struct {
+	uint16_t size;
+	uint16_t start;
+	uint16_t end;
+	uint8_t elems[USART_BUFF_SIZE + 1];
+} lzport_usart_fifo_t;
+
+extern volatile lzport_usart_fifo_t lzport_usart_tx_fifo_esp;
+extern volatile lzport_usart_fifo_t lzport_usart_rx_fifo_esp;
+
+/**
+ * Sets the pseudo terminal of the ESP8266 simulator. Must be called before lzport_usart_init_esp()
+ */
+void lzport_usart_set_device(const char *path);
+
+void lzport_usart_init_esp(void);
+void lzport_usart_set_baud_rate_esp(uint32_t baud_rate);
+
+void lzport_usart_buffer_init(volatile lzport_usart_fifo_t *buffer);
+void lzport_usart_buffer_write(volatile lzport_usart_fifo_t *buffer, uint8_t elem);
+void lzport_usart_buffer_read(volatile lzport_usart_fifo_t *buffer, uint8_t *elem);
+int lzport_usart_buffer_is_full(volatile lzport_usart_fifo_t *buffer);
+int lzport_usart_buffer_is_empty(volatile lzport_usart_fifo_t *buffer);
+
+#endif /* LZ_USART_H */
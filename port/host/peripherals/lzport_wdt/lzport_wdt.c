@@ -0,0 +1,76 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include "lz_config.h"
+#include "lzport_debug_output.h"
+#include "lzport_wdt.h"
+
+/*
+ * The watchdog is emulated with SIGALRM. If it is not reloaded in time, the process terminates
+ * with LZPORT_WDT_EXIT_CODE, which is the host equivalent of a watchdog reset.
+ */
+
+static void lzport_wdt_expired(int sig)
+{
+	(void)sig;
+	static const char msg[] = "INFO: Watchdog expired. Resetting device..\n";
+	if (write(STDOUT_FILENO, msg, sizeof(msg) - 1) < 0) {
+		// Nothing we can do here
+	}
+	_exit(LZPORT_WDT_EXIT_CODE);
+}
+
+/**
+ * Checks whether a watchdog reset was the cause of the last device reset. The host process
+ * always starts from a power-on reset.
+ * @returns false
+ */
+bool lzport_last_reset_awdt(void)
+{
+	return false;
+}
+
+/**
+ * Initializes the watchdog with the specified timeout.
+ * @param timeout_s The timeout in seconds
+ */
+void lzport_wdt_init(uint32_t timeout_s)
+{
+	dbgprint(DBG_AWDT, "INFO: Initializing Watchdog Timer..\n");
+
+	signal(SIGALRM, lzport_wdt_expired);
+	alarm(timeout_s);
+
+	dbgprint(DBG_AWDT, "INFO: WDT Successfully initialized\n");
+}
+
+/**
+ * Reloads the watchdog with the specified timeout.
+ * @param timeout_s The timeout in seconds
+ */
+void lzport_wdt_reload(uint32_t timeout_s)
+{
+	alarm(timeout_s);
+
+	dbgprint(DBG_AWDT, "INFO: WDT successfully reloaded!\n");
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef lzport_LPC55S69_lzport_WDT_lzport_WDT_H_
+#define lzport_LPC55S69_lzport_WDT_lzport_WDT_H_
+
+/** Exit code of the host process if the emulated watchdog expired */
+#define LZPORT_WDT_EXIT_CODE 3
+
+bool lzport_last_reset_awdt(void);
+void lzport_wdt_init(uint32_t timeout_s);
+void lzport_wdt_reload(uint32_t timeout_s);
+
+#endif /* lzport_LPC55S69_lzport_WDT_lzport_WDT_H_ */
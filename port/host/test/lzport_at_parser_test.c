@@ -0,0 +1,284 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "lzport_at_parser.h"
+
+#define MAX_EVENTS 16
+#define TRANSCRIPT(s) s, sizeof(s) - 1
+#define PAYLOAD_BUF_SIZE 16
+
+/**
+ * @brief	A transcript of the ESP8266 as recorded on the USART, and what the parser must
+ * 			recognize in it. The information lines are separated by '|'
+ */
+typedef struct {
+	const char *name;
+	const char *data;
+	uint32_t len;
+	lzport_at_event_t events[MAX_EVENTS];
+	const char *lines;
+	const char *payload;
+	uint32_t payload_len;
+	// Payload bytes which do not fit into the two buffers of PAYLOAD_BUF_SIZE
+	uint32_t discarded;
+	uint32_t link;
+} transcript_t;
+
+static const transcript_t transcripts[] = {
+	{ "AT+CIPSTATUS",
+	  TRANSCRIPT("STATUS:3\r\n+CIPSTATUS:0,\"TCP\",\"192.168.0.10\",65433,51234,0\r\n\r\nOK\r\n"),
+	  { LZPORT_AT_LINE, LZPORT_AT_LINE, LZPORT_AT_OK },
+	  "STATUS:3|+CIPSTATUS:0,\"TCP\",\"192.168.0.10\",65433,51234,0",
+	  TRANSCRIPT(""),
+	  0,
+	  0 },
+	{ "AT+CWJAP_CUR",
+	  TRANSCRIPT("WIFI DISCONNECT\r\nWIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n"),
+	  { LZPORT_AT_WIFI_DISCONNECT, LZPORT_AT_WIFI_CONNECTED, LZPORT_AT_WIFI_GOT_IP,
+		LZPORT_AT_OK },
+	  "",
+	  TRANSCRIPT(""),
+	  0,
+	  0 },
+	{ "AT+CIFSR",
+	  TRANSCRIPT("+CIFSR:STAIP,\"192.168.0.42\"\r\n+CIFSR:STAMAC,\"5c:cf:7f:0a:1b:2c\"\r\n"
+				 "\r\nOK\r\n"),
+	  { LZPORT_AT_LINE, LZPORT_AT_LINE, LZPORT_AT_OK },
+	  "+CIFSR:STAIP,\"192.168.0.42\"|+CIFSR:STAMAC,\"5c:cf:7f:0a:1b:2c\"",
+	  TRANSCRIPT(""),
+	  0,
+	  0 },
+	{ "AT+CIPSTART",
+	  TRANSCRIPT("1,CONNECT\r\n\r\nOK\r\n"),
+	  { LZPORT_AT_CONNECT, LZPORT_AT_OK },
+	  "",
+	  TRANSCRIPT(""),
+	  0,
+	  1 },
+	{ "AT+CIPSTART already connected",
+	  TRANSCRIPT("ALREADY CONNECTED\r\n\r\nERROR\r\n"),
+	  { LZPORT_AT_ALREADY_CONNECTED, LZPORT_AT_ERROR },
+	  "",
+	  TRANSCRIPT(""),
+	  0,
+	  0 },
+	{ "AT+CIPSEND",
+	  TRANSCRIPT("\r\nOK\r\n> \r\nRecv 12 bytes\r\n\r\nSEND OK\r\n"),
+	  { LZPORT_AT_OK, LZPORT_AT_SEND_READY, LZPORT_AT_LINE, LZPORT_AT_SEND_OK },
+	  "Recv 12 bytes",
+	  TRANSCRIPT(""),
+	  0,
+	  0 },
+	{ "AT+CIPSEND busy",
+	  TRANSCRIPT("busy s...\r\n\r\nRecv 12 bytes\r\n\r\nSEND FAIL\r\n"),
+	  { LZPORT_AT_BUSY, LZPORT_AT_LINE, LZPORT_AT_SEND_FAIL },
+	  "Recv 12 bytes",
+	  TRANSCRIPT(""),
+	  0,
+	  0 },
+	// The payload contains responses and a header, which must not be parsed. It is scattered
+	// over both buffers
+	{ "+IPD multiple connections",
+	  TRANSCRIPT("\r\n+IPD,0,16:OK\r\n+IPD,1,3:x\r\n\r\n+IPD,0,5:hello0,CLOSED\r\n"),
+	  { LZPORT_AT_IPD, LZPORT_AT_IPD_DONE, LZPORT_AT_IPD, LZPORT_AT_IPD_DONE,
+		LZPORT_AT_CLOSED },
+	  "",
+	  TRANSCRIPT("OK\r\n+IPD,1,3:x\r\nhello"),
+	  0,
+	  0 },
+	{ "+IPD single connection",
+	  TRANSCRIPT("\r\n+IPD,4:\0\xff\r\n\r\nCLOSED\r\n"),
+	  { LZPORT_AT_IPD, LZPORT_AT_IPD_DONE, LZPORT_AT_CLOSED },
+	  "",
+	  TRANSCRIPT("\0\xff\r\n"),
+	  0,
+	  0 },
+	{ "+IPD larger than the buffers",
+	  TRANSCRIPT("+IPD,2,40:0123456789abcdef0123456789ABCDEFdiscard\r\nOK\r\n"),
+	  { LZPORT_AT_IPD, LZPORT_AT_IPD_DONE, LZPORT_AT_OK },
+	  "",
+	  TRANSCRIPT("0123456789abcdef0123456789ABCDEF"),
+	  8,
+	  2 },
+	{ "+IPD malformed header",
+	  TRANSCRIPT("+IPD,x:\r\nOK\r\n"),
+	  { LZPORT_AT_LINE, LZPORT_AT_OK },
+	  "+IPD,x:",
+	  TRANSCRIPT(""),
+	  0,
+	  0 },
+};
+
+static uint32_t num_failed = 0;
+
+static void fail(const transcript_t *t, uint32_t chunk_size, bool direct, const char *msg)
+{
+	printf("FAIL: %s (reads of %u bytes%s): %s\n", t->name, chunk_size,
+		   direct ? ", payload read directly" : "", msg);
+	num_failed++;
+}
+
+/**
+ * Feeds the transcript to the parser in reads of chunk_size bytes like esp8266_next_event. If
+ * direct is set, payload bytes are read into the buffers of the parser without passing them
+ * through lzport_at_parser_feed whenever no parsed bytes are pending
+ */
+static void run_transcript(const transcript_t *t, uint32_t chunk_size, bool direct)
+{
+	lzport_at_parser_t parser;
+	uint8_t payload[2 * PAYLOAD_BUF_SIZE] = { 0 };
+	lzport_iovec_t iov[2] = { { &payload[0], PAYLOAD_BUF_SIZE },
+							  { &payload[PAYLOAD_BUF_SIZE], PAYLOAD_BUF_SIZE } };
+	lzport_at_event_t events[MAX_EVENTS] = { LZPORT_AT_NONE };
+	uint32_t num_events = 0;
+	char lines[2 * LZPORT_AT_MAX_LINE] = { 0 };
+	uint32_t discarded = 0;
+	uint32_t pos = 0;
+	uint32_t chunk_pos = 0;
+	uint32_t chunk_len = 0;
+
+	lzport_at_parser_init(&parser);
+	lzport_at_parser_set_data(&parser, iov, 2);
+
+	while ((pos < t->len) || (chunk_pos < chunk_len)) {
+		lzport_at_event_t event;
+		uint8_t *dest;
+		uint32_t len = lzport_at_parser_data_dest(&parser, &dest);
+
+		if (direct && (chunk_pos == chunk_len) && (len > 0)) {
+			len = (len < chunk_size) ? len : chunk_size;
+			len = (len < t->len - pos) ? len : t->len - pos;
+			memcpy(dest, &t->data[pos], len);
+			pos += len;
+			event = lzport_at_parser_data_written(&parser, len);
+		} else {
+			if (chunk_pos == chunk_len) {
+				chunk_pos = pos;
+				chunk_len = (chunk_size < t->len - pos) ? pos + chunk_size : t->len;
+				pos = chunk_len;
+			}
+			uint32_t consumed;
+			event = lzport_at_parser_feed(&parser, (const uint8_t *)&t->data[chunk_pos],
+										  chunk_len - chunk_pos, &consumed);
+			chunk_pos += consumed;
+		}
+
+		if (event == LZPORT_AT_NONE) {
+			continue;
+		}
+		if (num_events == MAX_EVENTS) {
+			fail(t, chunk_size, direct, "too many events");
+			return;
+		}
+		events[num_events++] = event;
+		if ((event == LZPORT_AT_LINE) || (event == LZPORT_AT_LINE_TOO_LONG)) {
+			if ((strlen(lines) + parser.line_len + 2) > sizeof(lines)) {
+				fail(t, chunk_size, direct, "too many lines");
+				return;
+			}
+			if (lines[0] != '\0') {
+				strcat(lines, "|");
+			}
+			strcat(lines, parser.line);
+		} else if (event == LZPORT_AT_IPD_DONE) {
+			discarded += parser.ipd_discarded;
+		}
+	}
+
+	if (memcmp(events, t->events, sizeof(events)) != 0) {
+		char msg[128];
+		int n = snprintf(msg, sizeof(msg), "events");
+		for (uint32_t i = 0; (i < num_events) && (n < (int)sizeof(msg)); i++) {
+			n += snprintf(&msg[n], sizeof(msg) - n, " %d", events[i]);
+		}
+		fail(t, chunk_size, direct, msg);
+	}
+	if (strcmp(lines, t->lines) != 0) {
+		fail(t, chunk_size, direct, "lines");
+	}
+	if ((memcmp(payload, t->payload, t->payload_len) != 0) ||
+		((t->payload_len < sizeof(payload)) && (payload[t->payload_len] != 0))) {
+		fail(t, chunk_size, direct, "payload");
+	}
+	if (discarded != t->discarded) {
+		fail(t, chunk_size, direct, "discarded");
+	}
+	if (parser.link != t->link) {
+		fail(t, chunk_size, direct, "link");
+	}
+	if (parser.state != LZPORT_AT_STATE_LINE) {
+		fail(t, chunk_size, direct, "state");
+	}
+}
+
+/**
+ * Lines longer than the line buffer, e.g. of AT+CWLAP with long SSIDs or of a garbled UART, are
+ * reported with their beginning and must not affect the following lines. The line is also longer
+ * than the response buffer of lzport_net
+ */
+static void run_long_line(uint32_t chunk_size, bool direct)
+{
+	static char data[1500 + 32];
+	static char line[LZPORT_AT_MAX_LINE + 1];
+	const char *prefix = "+CWLAP:(3,\"";
+
+	strcpy(data, prefix);
+	memset(&data[strlen(prefix)], 'a', 1500);
+	strcpy(&data[strlen(prefix) + 1500], "\")\r\n\r\nOK\r\n");
+	memcpy(line, data, LZPORT_AT_MAX_LINE);
+
+	transcript_t t = { .name = "Line longer than the response buffer",
+					   .data = data,
+					   .len = strlen(data),
+					   .events = { LZPORT_AT_LINE_TOO_LONG, LZPORT_AT_OK },
+					   .lines = line,
+					   .payload = "" };
+	run_transcript(&t, chunk_size, direct);
+}
+
+int main(void)
+{
+	static const uint32_t chunk_sizes[] = { 1, 2, 3, 4, 5, 7, 11, 13, 16, 64, 1024 };
+
+	// Reads of one byte split the data at every position. The other sizes cover reads which
+	// contain the end of one line, header or payload and the beginning of the next
+	for (uint32_t i = 0; i < sizeof(transcripts) / sizeof(transcripts[0]); i++) {
+		for (uint32_t j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); j++) {
+			run_transcript(&transcripts[i], chunk_sizes[j], false);
+			run_transcript(&transcripts[i], chunk_sizes[j], true);
+		}
+	}
+	for (uint32_t j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); j++) {
+		run_long_line(chunk_sizes[j], false);
+		run_long_line(chunk_sizes[j], true);
+	}
+
+	if (num_failed > 0) {
+		printf("ERROR: %u checks failed\n", num_failed);
+		return 1;
+	}
+	printf("INFO: All AT parser tests passed\n");
+
+	return 0;
+}
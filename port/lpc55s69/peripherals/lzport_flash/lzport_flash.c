@@ -174,14 +174,28 @@ bool lzport_flash_program_page(uint32_t start, uint8_t *buf)
 		goto Cleanup;
 	}
 
-	// Erase the required area. We have NAND flash, so erasing writes 1's in order to make writes possible
-	if (!lzport_flash_erase_page(flash_start)) {
+	// Skip the page if it already contains the data. The comparison is done by the flash
+	// controller, as reading a page that is erased would cause an ECC fault
+	uint32_t status = FLASH_VerifyProgram(&g_flash_config, flash_start, FLASH_PAGE_SIZE, buf,
+										  &failedAddr, &failedData);
+	if (kStatus_Success == status) {
+		dbgprint(DBG_VERB, "INFO: Page 0x%X unchanged, skipping it\n", flash_start);
+		result = true;
 		goto Cleanup;
 	}
 
+	// Erase the required area if it is not erased yet. We have NAND flash, so erasing writes 1's
+	// in order to make writes possible. Because of the ECC, a programmed page cannot be
+	// programmed again without erasing it, even if the new data would only clear bits
+	if (kStatus_Success != FLASH_VerifyErase(&g_flash_config, flash_start, FLASH_PAGE_SIZE)) {
+		if (!lzport_flash_erase_page(flash_start)) {
+			goto Cleanup;
+		}
+	}
+
 	// Flash the buffer and verify
 	dbgprint(DBG_VERB, "INFO: Programming flash..\n");
-	uint32_t status = FLASH_Program(&g_flash_config, flash_start, buf, FLASH_PAGE_SIZE);
+	status = FLASH_Program(&g_flash_config, flash_start, buf, FLASH_PAGE_SIZE);
 	verify_status(status);
 	if (kStatus_Success != status) {
 		goto Cleanup;
@@ -272,6 +286,40 @@ bool lzport_flash_read(uint32_t addr, uint8_t *buffer, uint32_t size)
 	return true;
 }
 
+bool lzport_flash_contains(uint32_t start, const uint8_t *buf, uint32_t size)
+{
+	uint32_t flash_start = start & ~SECURE_BIT_MASK;
+	uint32_t cursor = 0;
+	uint32_t page;
+	uint32_t len;
+
+	if ((flash_start >= (FLASH_BASE_ADDR + FLASH_SIZE)) ||
+		(size > (FLASH_BASE_ADDR + FLASH_SIZE) - flash_start)) {
+		return false;
+	}
+
+	while (cursor < size) {
+		page = (flash_start + cursor) - ((flash_start + cursor) % FLASH_PAGE_SIZE);
+		len = min(size - cursor, page + FLASH_PAGE_SIZE - (flash_start + cursor));
+
+		// Erased pages are checked by the flash controller, they contain the data if it is erased
+		// as well. Programmed pages can be read through the bus
+		if (kStatus_Success == FLASH_VerifyErase(&g_flash_config, page, FLASH_PAGE_SIZE)) {
+			for (uint32_t i = 0; i < len; i++) {
+				if (buf[cursor + i] != 0xFF) {
+					return false;
+				}
+			}
+		} else if (memcmp((void *)(start + cursor), &buf[cursor], len) != 0) {
+			return false;
+		}
+
+		cursor += len;
+	}
+
+	return true;
+}
+
 int lzport_retrieve_uuid(uint8_t uuid[LEN_UUID_V4_BIN])
 {
 	if (FFR_Init(&g_flash_config) != kStatus_Success) {
@@ -34,6 +34,11 @@ bool lzport_flash_erase_page(uint32_t start);
 bool lzport_flash_erase(uint32_t start, uint32_t size);
 bool lzport_flash_write(uint32_t start, uint8_t *buf, uint32_t size);
 bool lzport_flash_read(uint32_t addr, uint8_t *buffer, uint32_t size);
+/**
+ * Checks whether the flash already contains the data, without reading erased pages through the
+ * bus, which causes an ECC fault on the LPC55S69
+ */
+bool lzport_flash_contains(uint32_t start, const uint8_t *buf, uint32_t size);
 /**
  * Returns the 128-bit RFC4122 compliant Universally Unique Identifier (UUID)
  * of the device
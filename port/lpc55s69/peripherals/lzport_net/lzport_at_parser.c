@@ -0,0 +1,240 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "lzport_at_parser.h"
+
+static lzport_at_event_t parse_line(lzport_at_parser_t *parser);
+static lzport_at_event_t parse_ipd_header(lzport_at_parser_t *parser);
+static const char *parse_uint(const char *s, uint32_t *value);
+
+void lzport_at_parser_init(lzport_at_parser_t *parser)
+{
+	memset(parser, 0x00, sizeof(lzport_at_parser_t));
+}
+
+void lzport_at_parser_set_data(lzport_at_parser_t *parser, const lzport_iovec_t *iov,
+							   uint32_t iovcnt)
+{
+	parser->iov = iov;
+	parser->iovcnt = iovcnt;
+	parser->iov_index = 0;
+	parser->iov_offset = 0;
+}
+
+lzport_at_event_t lzport_at_parser_feed(lzport_at_parser_t *parser, const uint8_t *data,
+										uint32_t len, uint32_t *consumed)
+{
+	lzport_at_event_t event = LZPORT_AT_NONE;
+
+	*consumed = 0;
+
+	while ((*consumed < len) && (event == LZPORT_AT_NONE)) {
+		if (parser->state == LZPORT_AT_STATE_DATA) {
+			uint8_t *dest;
+			uint32_t n = lzport_at_parser_data_dest(parser, &dest);
+			if (n > 0) {
+				n = (n < len - *consumed) ? n : len - *consumed;
+				memcpy(dest, &data[*consumed], n);
+				event = lzport_at_parser_data_written(parser, n);
+			} else {
+				// The payload does not fit into the buffers and is discarded
+				n = (parser->ipd_pending < len - *consumed) ? parser->ipd_pending :
+															  len - *consumed;
+				parser->ipd_discarded += n;
+				event = lzport_at_parser_data_written(parser, n);
+			}
+			*consumed += n;
+			continue;
+		}
+
+		char c = (char)data[*consumed];
+		*consumed += 1;
+
+		// The last line remains available to the caller until the next line begins
+		if (parser->line_done) {
+			parser->line_len = 0;
+			parser->line[0] = '\0';
+			parser->line_done = false;
+			parser->line_truncated = false;
+		}
+
+		if (c == '\r') {
+			continue;
+		} else if (c == '\n') {
+			event = parse_line(parser);
+			parser->line_done = true;
+		} else if ((c == '>') && (parser->line_len == 0)) {
+			event = LZPORT_AT_SEND_READY;
+		} else {
+			if (parser->line_len < LZPORT_AT_MAX_LINE) {
+				parser->line[parser->line_len++] = c;
+			} else {
+				parser->line_truncated = true;
+			}
+			parser->line[parser->line_len] = '\0';
+			// The payload of +IPD is not terminated by a line break, the header ends with ':'
+			if ((c == ':') && (strncmp(parser->line, "+IPD,", 5) == 0)) {
+				event = parse_ipd_header(parser);
+				parser->line_done = true;
+			}
+		}
+	}
+
+	return event;
+}
+
+uint32_t lzport_at_parser_data_dest(lzport_at_parser_t *parser, uint8_t **dest)
+{
+	if (parser->state != LZPORT_AT_STATE_DATA) {
+		return 0;
+	}
+
+	while ((parser->iov_index < parser->iovcnt) &&
+		   (parser->iov_offset == parser->iov[parser->iov_index].len)) {
+		parser->iov_index++;
+		parser->iov_offset = 0;
+	}
+	if (parser->iov_index >= parser->iovcnt) {
+		return 0;
+	}
+
+	const lzport_iovec_t *iov = &parser->iov[parser->iov_index];
+	uint32_t len = iov->len - parser->iov_offset;
+	*dest = (uint8_t *)iov->base + parser->iov_offset;
+
+	return (len < parser->ipd_pending) ? len : parser->ipd_pending;
+}
+
+lzport_at_event_t lzport_at_parser_data_written(lzport_at_parser_t *parser, uint32_t len)
+{
+	if (parser->iov_index < parser->iovcnt) {
+		parser->iov_offset += len;
+	}
+	parser->ipd_pending -= len;
+
+	if (parser->ipd_pending == 0) {
+		parser->state = LZPORT_AT_STATE_LINE;
+		return LZPORT_AT_IPD_DONE;
+	}
+
+	return LZPORT_AT_NONE;
+}
+
+static lzport_at_event_t parse_line(lzport_at_parser_t *parser)
+{
+	// Trailing spaces, e.g. of the '> ' prompt, are not part of the response
+	while ((parser->line_len > 0) && (parser->line[parser->line_len - 1] == ' ')) {
+		parser->line_len--;
+	}
+	parser->line[parser->line_len] = '\0';
+
+	if (parser->line_truncated) {
+		return LZPORT_AT_LINE_TOO_LONG;
+	}
+	if (parser->line_len == 0) {
+		return LZPORT_AT_NONE;
+	}
+
+	const char *line = parser->line;
+	if (strcmp(line, "OK") == 0) {
+		return LZPORT_AT_OK;
+	} else if (strcmp(line, "ERROR") == 0) {
+		return LZPORT_AT_ERROR;
+	} else if (strcmp(line, "FAIL") == 0) {
+		return LZPORT_AT_FAIL;
+	} else if (strcmp(line, "SEND OK") == 0) {
+		return LZPORT_AT_SEND_OK;
+	} else if (strcmp(line, "SEND FAIL") == 0) {
+		return LZPORT_AT_SEND_FAIL;
+	} else if ((strcmp(line, "busy p...") == 0) || (strcmp(line, "busy s...") == 0)) {
+		return LZPORT_AT_BUSY;
+	} else if (strcmp(line, "ALREADY CONNECTED") == 0) {
+		return LZPORT_AT_ALREADY_CONNECTED;
+	} else if (strcmp(line, "WIFI CONNECTED") == 0) {
+		return LZPORT_AT_WIFI_CONNECTED;
+	} else if (strcmp(line, "WIFI GOT IP") == 0) {
+		return LZPORT_AT_WIFI_GOT_IP;
+	} else if (strcmp(line, "WIFI DISCONNECT") == 0) {
+		return LZPORT_AT_WIFI_DISCONNECT;
+	} else if (strcmp(line, "CLOSED") == 0) {
+		parser->link = 0;
+		return LZPORT_AT_CLOSED;
+	}
+
+	// <link>,CONNECT and <link>,CLOSED in multiple connection mode
+	uint32_t link;
+	const char *s = parse_uint(line, &link);
+	if ((s != NULL) && (strcmp(s, ",CONNECT") == 0)) {
+		parser->link = link;
+		return LZPORT_AT_CONNECT;
+	} else if ((s != NULL) && (strcmp(s, ",CLOSED") == 0)) {
+		parser->link = link;
+		return LZPORT_AT_CLOSED;
+	}
+
+	return LZPORT_AT_LINE;
+}
+
+/**
+ * Parses +IPD,<link>,<len>: in multiple connection mode or +IPD,<len>: in single connection mode
+ */
+static lzport_at_event_t parse_ipd_header(lzport_at_parser_t *parser)
+{
+	uint32_t first, second;
+	const char *s = parse_uint(&parser->line[5], &first);
+
+	if ((s != NULL) && (*s == ':')) {
+		parser->link = 0;
+		parser->ipd_len = first;
+	} else if ((s != NULL) && (*s == ',') && ((s = parse_uint(s + 1, &second)) != NULL) &&
+			   (*s == ':')) {
+		parser->link = first;
+		parser->ipd_len = second;
+	} else {
+		return LZPORT_AT_LINE;
+	}
+
+	parser->ipd_pending = parser->ipd_len;
+	parser->ipd_discarded = 0;
+	if (parser->ipd_len == 0) {
+		return LZPORT_AT_IPD_DONE;
+	}
+	parser->state = LZPORT_AT_STATE_DATA;
+
+	return LZPORT_AT_IPD;
+}
+
+static const char *parse_uint(const char *s, uint32_t *value)
+{
+	if ((*s < '0') || (*s > '9')) {
+		return NULL;
+	}
+
+	*value = 0;
+	while ((*s >= '0') && (*s <= '9')) {
+		*value = *value * 10 + (uint32_t)(*s - '0');
+		s++;
+	}
+
+	return s;
+}
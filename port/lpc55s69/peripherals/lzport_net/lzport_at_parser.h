@@ -0,0 +1,130 @@
+/*
+ * Copyright(c) 2021 Fraunhofer AISEC
+ * Fraunhofer-Gesellschaft zur Foerderung der angewandten Forschung e.V.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LZPORT_AT_PARSER_H_
+#define LZPORT_AT_PARSER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lzport_net.h"
+
+// Lines which are longer are truncated and reported as LZPORT_AT_LINE_TOO_LONG, the parser
+// continues with the next line
+#define LZPORT_AT_MAX_LINE 128
+
+/**
+ * @brief	Events recognized by the parser. Each event is returned once when its last byte
+ * 			was parsed
+ */
+typedef enum {
+	LZPORT_AT_NONE = 0,
+	LZPORT_AT_OK,
+	LZPORT_AT_ERROR,
+	LZPORT_AT_FAIL,
+	LZPORT_AT_BUSY,
+	LZPORT_AT_ALREADY_CONNECTED,
+	// The '>' prompt of AT+CIPSEND, the data can be sent now
+	LZPORT_AT_SEND_READY,
+	LZPORT_AT_SEND_OK,
+	LZPORT_AT_SEND_FAIL,
+	// The header +IPD,<link>,<len>: was parsed, the payload follows
+	LZPORT_AT_IPD,
+	// The payload of the last +IPD was received completely
+	LZPORT_AT_IPD_DONE,
+	// Unsolicited events, <link>,CONNECT and <link>,CLOSED set the link of the parser
+	LZPORT_AT_CONNECT,
+	LZPORT_AT_CLOSED,
+	LZPORT_AT_WIFI_CONNECTED,
+	LZPORT_AT_WIFI_GOT_IP,
+	LZPORT_AT_WIFI_DISCONNECT,
+	// Any other non-empty line, e.g. STATUS:2 or +CIFSR:STAIP,"...", it is available in line
+	LZPORT_AT_LINE,
+	// A line longer than LZPORT_AT_MAX_LINE, its beginning is available in line
+	LZPORT_AT_LINE_TOO_LONG,
+} lzport_at_event_t;
+
+typedef enum {
+	LZPORT_AT_STATE_LINE = 0,
+	LZPORT_AT_STATE_DATA,
+} lzport_at_state_t;
+
+/**
+ * @brief	State of the parser. The parser does not depend on the hardware, it can be fed with
+ * 			recorded ESP8266 transcripts on the host
+ */
+typedef struct {
+	lzport_at_state_t state;
+	char line[LZPORT_AT_MAX_LINE + 1];
+	uint32_t line_len;
+	bool line_done;
+	bool line_truncated;
+	// Link of the last +IPD, CONNECT or CLOSED
+	uint32_t link;
+	// Payload length of the last +IPD and the number of bytes still to be received
+	uint32_t ipd_len;
+	uint32_t ipd_pending;
+	// Number of payload bytes which did not fit into the buffers and were discarded
+	uint32_t ipd_discarded;
+	// Buffers the payload of +IPD is written to
+	const lzport_iovec_t *iov;
+	uint32_t iovcnt;
+	uint32_t iov_index;
+	uint32_t iov_offset;
+} lzport_at_parser_t;
+
+void lzport_at_parser_init(lzport_at_parser_t *parser);
+
+/**
+ * Sets the buffers the payload of the following +IPD packets is scattered over. Without buffers,
+ * the payload is discarded
+ */
+void lzport_at_parser_set_data(lzport_at_parser_t *parser, const lzport_iovec_t *iov,
+							   uint32_t iovcnt);
+
+/**
+ * Parses the data until an event is recognized or all data was consumed
+ *
+ * @param parser The parser state
+ * @param data The received data
+ * @param len The length of the data
+ * @param consumed The number of bytes that were parsed
+ * @return The recognized event or LZPORT_AT_NONE if more data is required
+ */
+lzport_at_event_t lzport_at_parser_feed(lzport_at_parser_t *parser, const uint8_t *data,
+										uint32_t len, uint32_t *consumed);
+
+/**
+ * Returns the location the next payload bytes of an +IPD packet belong to, so that they can be
+ * received there directly without passing them through lzport_at_parser_feed
+ *
+ * @param parser The parser state
+ * @param dest Returns the location
+ * @return The number of bytes that can be written to dest, 0 if no payload is expected or it
+ * cannot be stored
+ */
+uint32_t lzport_at_parser_data_dest(lzport_at_parser_t *parser, uint8_t **dest);
+
+/**
+ * Signals that len payload bytes were written to the location from lzport_at_parser_data_dest
+ *
+ * @return LZPORT_AT_IPD_DONE if the payload is complete, otherwise LZPORT_AT_NONE
+ */
+lzport_at_event_t lzport_at_parser_data_written(lzport_at_parser_t *parser, uint32_t len);
+
+#endif /* LZPORT_AT_PARSER_H_ */
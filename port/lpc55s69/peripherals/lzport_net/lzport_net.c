@@ -18,6 +18,8 @@
  */
 
 #include "stdint.h"
+#include "inttypes.h"
+#include "stdbool.h"
 #include "string.h"
 #include "stdio.h"
 
@@ -25,6 +27,7 @@
 #include "lz_error.h"
 #include "lzport_debug_output.h"
 #include "lzport_usart.h"
+#include "lzport_gpio.h"
 #if (1 == FREERTOS_AVAILABLE)
 #include "FreeRTOS.h"
 #include "task.h"
@@ -34,11 +37,14 @@
 #endif
 
 #include "lzport_net.h"
+#include "lzport_at_parser.h"
 
 #define ESP8266_STD_TIMEOUT_MS 2000
 #define TIMEOUT_TCP_MS 10000
 #define ESP8266_EXT_TIMEOUT_MS 25000
 #define ESP8266_RCV_QUEUE_SIZE 8096
+// TCP keep-alive interval of sockets, so that a lost connection of a session is detected
+#define ESP8266_TCP_KEEP_ALIVE_S 10
 
 #define NW_STATUS_CONNECTED 2
 #define NW_STATUS_TCP_TRANSMISSION 3
@@ -49,51 +55,81 @@
 #define LEN_MAC 6
 
 extern FILE *net_fd;
-static char rxbuf[8096] = { 0 };
+// The information lines of the last response, e.g. STATUS:2
+static char rxbuf[1024] = { 0 };
+
+// Received bytes are parsed incrementally, the bytes of the last read which were not yet parsed
+// remain in rx_chunk
+static lzport_at_parser_t at_parser;
+static uint8_t rx_chunk[64];
+static uint32_t rx_chunk_pos = 0;
+static uint32_t rx_chunk_len = 0;
 
 #if (1 == FREERTOS_AVAILABLE)
 static QueueHandle_t esp8266_rcv_queue;
 #endif
 
-const char *response_ok = "OK\r\n";
-const char *response_sendok = "SEND OK\r\n";
-const char *response_err = "ERROR\r\n";
-const char *response_already_connected = "ALREADY CONNECTED\r\n\r\nERROR\r\n";
-const char *response_busy_p = "busy p...\r\n";
-const char *response_busy_s = "busy s...\r\n";
-const char *response_send_ready = ">";
-const char *response_recv_ready = ":";
-const char *response_closed = "CLOSED\r\n";
+static uint32_t esp8266_baud_rate = ESP_USART_BAUD_RATE;
+
+#if (1 == ESP_USART_RX_BENCHMARK)
+static uint32_t rx_benchmark_bytes = 0;
+static uint32_t rx_benchmark_ms = 0;
+static uint32_t ipd_start_ms = 0;
+#endif
 
 static LZ_RESULT esp8266_connect_to_ap(char *ssid, char *pwd);
 static LZ_RESULT esp8266_get_network_info(uint8_t *ip, uint32_t iplen, uint8_t *mac,
 										  uint32_t maclen);
-static LZ_RESULT esp8266_receive(char *buf, uint32_t buf_size, const char *terminator,
-								 uint32_t timeout_ms);
-static LZ_RESULT esp8266_receive_data(char *buf, uint32_t buf_size, uint32_t timeout_ms);
+static LZ_RESULT esp8266_read(uint8_t *buf, uint32_t len, uint32_t timeout_ms,
+							  uint32_t *len_read);
+static LZ_RESULT esp8266_next_event(lzport_at_event_t *event, uint32_t timeout_ms);
+static LZ_RESULT esp8266_receive(lzport_at_event_t expected, uint32_t timeout_ms);
 static void update_remaining_time(uint32_t *remaining_time, uint32_t elapsed_time);
+static LZ_RESULT esp8266_set_baud_rate(uint32_t baud_rate);
+#if (1 == ESP_USART_RX_BENCHMARK)
+static void esp8266_rx_benchmark(uint32_t len, uint32_t elapsed_ms);
+#endif
 
 LZ_RESULT lzport_net_init(uint8_t *ip, uint8_t *mac, char *ssid, char *pwd)
 {
 	LZ_RESULT result = LZ_ERROR;
 
+	lzport_at_parser_init(&at_parser);
+	rx_chunk_pos = 0;
+	rx_chunk_len = 0;
+
 	fprintf(net_fd, "ATE0\r\n");
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
+	if (esp8266_receive(LZPORT_AT_OK, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
+#if (ESP_USART_BAUD_RATE_HIGH != ESP_USART_BAUD_RATE)
+		// The ESP8266 keeps the baud rate of a previous initialization until it is reset
+		esp8266_baud_rate = (esp8266_baud_rate == ESP_USART_BAUD_RATE) ?
+								ESP_USART_BAUD_RATE_HIGH :
+								ESP_USART_BAUD_RATE;
+		lzport_usart_set_baud_rate_esp(esp8266_baud_rate);
+		dbgprint(DBG_WARN, "WARN: ESP does not respond, retrying with %d baud\n",
+				 esp8266_baud_rate);
+#endif
 		dbgprint(DBG_ERR, "ERROR: ESP does not respond to ATE0 command\n");
 		return result;
 	}
 
+	if ((esp8266_baud_rate != ESP_USART_BAUD_RATE_HIGH) &&
+		(esp8266_set_baud_rate(ESP_USART_BAUD_RATE_HIGH) != LZ_SUCCESS)) {
+		dbgprint(DBG_ERR, "ERROR: Failed to set ESP baud rate to %d\n", ESP_USART_BAUD_RATE_HIGH);
+		return result;
+	}
+
 	fprintf(net_fd, "AT+CIPSTATUS\r\n");
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
+	if (esp8266_receive(LZPORT_AT_OK, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
 		return result;
 	}
 
 	uint32_t status;
-	sscanf(rxbuf, "STATUS:%lu\r\n", &status);
+	sscanf(rxbuf, "STATUS:%" SCNu32 "\r\n", &status);
 
 	if (status != NW_STATUS_DISCONNECTED) {
 		fprintf(net_fd, "AT+CWJAP?\r\n");
-		if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, ESP8266_STD_TIMEOUT_MS) !=
+		if (esp8266_receive(LZPORT_AT_OK, ESP8266_STD_TIMEOUT_MS) !=
 			LZ_SUCCESS) {
 			return result;
 		}
@@ -120,12 +156,12 @@ LZ_RESULT lzport_net_init(uint8_t *ip, uint8_t *mac, char *ssid, char *pwd)
 	}
 
 	fprintf(net_fd, "AT+CWAUTOCONN=1\r\n");
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
+	if (esp8266_receive(LZPORT_AT_OK, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
 		return result;
 	}
 
 	fprintf(net_fd, "AT+CIPMUX=1\r\n");
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
+	if (esp8266_receive(LZPORT_AT_OK, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
 		return result;
 	}
 
@@ -147,10 +183,10 @@ LZ_RESULT lzport_socket_open(uint32_t handle, const char *host_name, uint32_t de
 		update_remaining_time(&remaining_time_ms, lzport_get_tick_ms() - curr_time_ms);
 		curr_time_ms = lzport_get_tick_ms();
 
-		fprintf(net_fd, "AT+CIPSTART=%ld,\"%s\",\"%s\",%ld\r\n", handle, "TCP", host_name,
-				dest_port);
+		fprintf(net_fd, "AT+CIPSTART=%" PRIu32 ",\"%s\",\"%s\",%" PRIu32 ",%d\r\n", handle,
+				"TCP", host_name, dest_port, ESP8266_TCP_KEEP_ALIVE_S);
 
-		result = esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, remaining_time_ms);
+		result = esp8266_receive(LZPORT_AT_OK, remaining_time_ms);
 
 		if (result == LZ_SUCCESS) {
 			return LZ_SUCCESS;
@@ -165,17 +201,13 @@ LZ_RESULT lzport_socket_open(uint32_t handle, const char *host_name, uint32_t de
 			return LZ_SUCCESS;
 		} else if (result == LZ_ERROR_WIFI_BUSY) {
 			dbgprint(DBG_WARN, "WARN: Failed to open socket, ESP busy. Wait until finished..\n");
-			if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, remaining_time_ms) !=
+			if (esp8266_receive(LZPORT_AT_OK, remaining_time_ms) !=
 				LZ_SUCCESS) {
 				dbgprint(DBG_WARN, "WARN: ESP did not finish until timeout\n");
 			}
 		} else if (result == LZ_ERROR_WIFI) {
-			if (esp8266_receive(rxbuf, sizeof(rxbuf), response_closed, remaining_time_ms) ==
-				LZ_SUCCESS) {
+			if (esp8266_receive(LZPORT_AT_CLOSED, remaining_time_ms) == LZ_SUCCESS) {
 				dbgprint(DBG_WARN, "WARN: Failed to open socket. ESP returned %s\n", rxbuf);
-
-				uint32_t status;
-				sscanf(rxbuf, "STATUS:%lu\r\n", &status);
 			} else {
 				dbgprint(DBG_WARN, "WARN: Failed to open socket. ESP returned %s\n", rxbuf);
 			}
@@ -191,8 +223,8 @@ LZ_RESULT lzport_socket_open(uint32_t handle, const char *host_name, uint32_t de
 
 LZ_RESULT lzport_socket_close(uint32_t handle, uint32_t timeout_ms)
 {
-	fprintf(net_fd, "AT+CIPCLOSE=%ld\r\n", handle);
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, timeout_ms) != LZ_SUCCESS) {
+	fprintf(net_fd, "AT+CIPCLOSE=%" PRIu32 "\r\n", handle);
+	if (esp8266_receive(LZPORT_AT_OK, timeout_ms) != LZ_SUCCESS) {
 		return LZ_ERROR;
 	}
 
@@ -200,16 +232,29 @@ LZ_RESULT lzport_socket_close(uint32_t handle, uint32_t timeout_ms)
 }
 
 LZ_RESULT lzport_socket_send(uint32_t handle, uint8_t *data, uint32_t len, uint32_t timeout_ms)
+{
+	lzport_iovec_t iov = { .base = data, .len = len };
+
+	return lzport_socket_sendv(handle, &iov, 1, timeout_ms);
+}
+
+LZ_RESULT lzport_socket_sendv(uint32_t handle, const lzport_iovec_t *iov, uint32_t iovcnt,
+							  uint32_t timeout_ms)
 {
 	uint32_t curr_time_ms = lzport_get_tick_ms();
 	uint32_t remaining_time_ms = timeout_ms;
+	uint32_t len = 0;
+
+	for (uint32_t i = 0; i < iovcnt; i++) {
+		len += iov[i].len;
+	}
 
 	dbgprint(DBG_NW, "esp8266_socket_send\n");
 
-	dbgprint(DBG_NW, "AT+CIPSEND=%ld,%ld\n", handle, len);
-	fprintf(net_fd, "AT+CIPSEND=%ld,%ld\r\n", handle, len);
+	dbgprint(DBG_NW, "AT+CIPSEND=%" PRIu32 ",%" PRIu32 "\n", handle, len);
+	fprintf(net_fd, "AT+CIPSEND=%" PRIu32 ",%" PRIu32 "\r\n", handle, len);
 
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, remaining_time_ms) != LZ_SUCCESS) {
+	if (esp8266_receive(LZPORT_AT_OK, remaining_time_ms) != LZ_SUCCESS) {
 		return LZ_ERROR;
 	}
 
@@ -218,14 +263,18 @@ LZ_RESULT lzport_socket_send(uint32_t handle, uint8_t *data, uint32_t len, uint3
 
 	dbgprint(DBG_NW, "esp8266_socket_send: Waiting for ESP to be ready for transmission\n");
 
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_send_ready, remaining_time_ms) !=
+	if (esp8266_receive(LZPORT_AT_SEND_READY, remaining_time_ms) !=
 		LZ_SUCCESS) {
 		return LZ_ERROR;
 	}
 
 	dbgprint(DBG_NW, "\nesp8266_socket_send: Starting to send %d bytes\n", len);
 
-	uint32_t sent = fwrite(data, 1, len, net_fd);
+	// The buffers are streamed from their original location
+	uint32_t sent = 0;
+	for (uint32_t i = 0; i < iovcnt; i++) {
+		sent += fwrite(iov[i].base, 1, iov[i].len, net_fd);
+	}
 	fflush(net_fd);
 	if (len != sent) {
 		dbgprint(DBG_NW,
@@ -237,7 +286,7 @@ LZ_RESULT lzport_socket_send(uint32_t handle, uint8_t *data, uint32_t len, uint3
 	update_remaining_time(&remaining_time_ms, lzport_get_tick_ms() - curr_time_ms);
 	curr_time_ms = lzport_get_tick_ms();
 
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_sendok, remaining_time_ms) != LZ_SUCCESS) {
+	if (esp8266_receive(LZPORT_AT_SEND_OK, remaining_time_ms) != LZ_SUCCESS) {
 		dbgprint(DBG_WARN, "esp8266_socket_send error: timeout waiting for 'SEND OK'\n");
 		return LZ_ERROR;
 	}
@@ -250,28 +299,39 @@ LZ_RESULT lzport_socket_send(uint32_t handle, uint8_t *data, uint32_t len, uint3
 LZ_RESULT lzport_socket_receive(uint32_t handle, uint8_t *data, uint32_t len_exp,
 								uint32_t timeout_ms, uint32_t *len_rec)
 {
-	uint32_t curr_time_ms = lzport_get_tick_ms();
-	uint32_t remaining_time_ms = timeout_ms;
-	uint32_t handle_recv;
+	lzport_iovec_t iov = { .base = data, .len = len_exp };
 
-	dbgprint(DBG_NW, "INFO: ESP8266 - Receiving packet header\n");
+	return lzport_socket_receivev(handle, &iov, 1, timeout_ms, len_rec);
+}
 
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_recv_ready, remaining_time_ms) !=
-		LZ_SUCCESS) {
-		dbgprint(DBG_NW, "ERROR: ESP8266 - Failed to receive header from ESP8266\n");
-		return LZ_ERROR;
+LZ_RESULT lzport_socket_receivev(uint32_t handle, const lzport_iovec_t *iov, uint32_t iovcnt,
+								 uint32_t timeout_ms, uint32_t *len_rec)
+{
+	uint32_t len_exp = 0;
+
+	for (uint32_t i = 0; i < iovcnt; i++) {
+		len_exp += iov[i].len;
 	}
 
-	dbgprint(DBG_NW, "INFO: ESP8266 - received start sequence: %s\n", rxbuf);
+	dbgprint(DBG_NW, "INFO: ESP8266 - Receiving packet\n");
+
+	// The parser scatters the payload over the buffers in order, the last ones may remain empty
+	lzport_at_parser_set_data(&at_parser, iov, iovcnt);
+	LZ_RESULT result = esp8266_receive(LZPORT_AT_IPD_DONE, timeout_ms);
+	lzport_at_parser_set_data(&at_parser, NULL, 0);
+	if (result != LZ_SUCCESS) {
+		dbgprint(DBG_NW, "ERROR: ESP8266 - Failed to receive data from ESP8266\n");
+		return LZ_ERROR;
+	}
 
-	uint32_t ret = sscanf((char *)&rxbuf[2], "+IPD,%ld,%ld:", &handle_recv, len_rec);
+	*len_rec = at_parser.ipd_len;
 
-	if ((ret != 2) || (handle_recv != handle)) {
-		dbgprint(DBG_ERR, "WARN: ESP8266 - Failed to parse start sequence\n");
+	if (at_parser.link != handle) {
+		dbgprint(DBG_ERR, "WARN: ESP8266 - Received packet for link %d\n", at_parser.link);
 		return LZ_ERROR;
 	}
 
-	if (len_exp < *len_rec) {
+	if (at_parser.ipd_discarded > 0) {
 		dbgprint(DBG_ERR, "WARN: ESP8266 - Receive buffer too small. Expected = %d, +IPD = %d\n",
 				 len_exp, *len_rec);
 		return LZ_ERROR;
@@ -284,15 +344,9 @@ LZ_RESULT lzport_socket_receive(uint32_t handle, uint8_t *data, uint32_t len_exp
 				 *len_rec, len_exp);
 	}
 
-	update_remaining_time(&remaining_time_ms, lzport_get_tick_ms() - curr_time_ms);
-	curr_time_ms = lzport_get_tick_ms();
-
-	dbgprint(DBG_NW, "INFO: ESP8266 - Receiving %d bytes\n", *len_rec);
-
-	if (esp8266_receive_data((char *)data, *len_rec, remaining_time_ms) != LZ_SUCCESS) {
-		dbgprint(DBG_NW, "ERROR: ESP8266 - Failed to receive data from\n");
-		return LZ_ERROR;
-	}
+#if (1 == ESP_USART_RX_BENCHMARK)
+	esp8266_rx_benchmark(*len_rec, lzport_get_tick_ms() - ipd_start_ms);
+#endif
 
 	dbgprint(DBG_NW, "INFO: ESP8266 successfully received data from socket\n");
 
@@ -320,184 +374,231 @@ LZ_RESULT lzport_esp8266_queue_send(char ch, uint32_t *higher_prio_task_woken)
 
 #endif
 
-#if (1 == FREERTOS_AVAILABLE)
+#if (1 == ESP_USART_RX_DMA)
 
-static LZ_RESULT esp8266_receive(char *buf, uint32_t buf_size, const char *terminator,
-								 uint32_t timeout_ms)
+static LZ_RESULT esp8266_read(uint8_t *buf, uint32_t len, uint32_t timeout_ms, uint32_t *len_read)
 {
-	uint32_t remaining_timeout = pdMS_TO_TICKS(timeout_ms);
-	uint32_t curr_time = xTaskGetTickCount();
-	uint32_t received_len = 0;
-
-	memset(buf, 0x00, buf_size);
-
-	if (buf_size < strlen(terminator) + 1) {
-		return LZ_ERROR;
-	}
-
-	dbgprint(DBG_NW, "INFO: esp8266_receive receiving data\n");
-
-	char ch;
-	while (xQueueReceive(esp8266_rcv_queue, &ch, (TickType_t)remaining_timeout) == pdPASS) {
-		buf[received_len] = ch;
-		received_len = received_len + 1;
+	uint32_t deadline = lzport_get_tick_ms() + timeout_ms;
 
-		uint32_t elapsed_time = (xTaskGetTickCount() - curr_time);
-		if (remaining_timeout > elapsed_time) {
-			remaining_timeout -= elapsed_time;
-		} else {
-			remaining_timeout = 0;
+	// All bytes received so far are copied from the ring buffer in one block
+	do {
+		if (lzport_usart_rx_dma_read(buf, len, len_read) != LZ_SUCCESS) {
+			return LZ_ERROR;
 		}
-		curr_time = xTaskGetTickCount();
-
-		if ((received_len >= strlen(terminator)) && strstr(buf, terminator)) {
+		if (*len_read > 0) {
 			return LZ_SUCCESS;
-		} else if ((received_len >= strlen(response_already_connected)) &&
-				   strstr(buf, response_already_connected)) {
-			dbgprint(DBG_WARN, "WARN: ESP responded with already connected\n");
-			return LZ_ERROR_WIFI_ALREADY_CONNECTED;
-		} else if ((received_len >= strlen(response_err)) && strstr(buf, response_err)) {
-			dbgprint(DBG_WARN, "WARN: ESP responded with ERROR\n");
-			return LZ_ERROR_WIFI;
-		} else if (((received_len >= strlen(response_busy_p)) && strstr(buf, response_busy_p)) ||
-				   ((received_len >= strlen(response_busy_s)) && strstr(buf, response_busy_s))) {
-			dbgprint(DBG_WARN, "WARN: ESP responded with BUSY\n");
-			return LZ_ERROR_WIFI_BUSY;
 		}
-
-		if (received_len >= buf_size) {
-			dbgprint(DBG_WARN, "\nERROR: ESP8266 Buffer full while waiting for terminator\n");
-			return LZ_ERROR;
-		}
-	}
-
-	dbgprint(DBG_WARN, "WARN: Timeout waiting for ESP8266 response\n");
+#if (1 == FREERTOS_AVAILABLE)
+		vTaskDelay(1);
+#endif
+	} while (deadline >= lzport_get_tick_ms());
 
 	return LZ_TIMEOUT;
 }
 
-static LZ_RESULT esp8266_receive_data(char *buf, uint32_t buf_size, uint32_t timeout_ms)
+#elif (1 == FREERTOS_AVAILABLE)
+
+static LZ_RESULT esp8266_read(uint8_t *buf, uint32_t len, uint32_t timeout_ms, uint32_t *len_read)
 {
-	uint32_t remaining_timeout = pdMS_TO_TICKS(timeout_ms);
-	uint32_t curr_time = xTaskGetTickCount();
-	uint32_t received_len = 0;
+	*len_read = 0;
 
-	memset(buf, 0x00, buf_size);
+	// Wait for the first byte, the following bytes are only taken if they are already queued
+	if (xQueueReceive(esp8266_rcv_queue, &buf[0], pdMS_TO_TICKS(timeout_ms)) != pdPASS) {
+		return LZ_TIMEOUT;
+	}
+	*len_read = 1;
+	while ((*len_read < len) && (xQueueReceive(esp8266_rcv_queue, &buf[*len_read], 0) == pdPASS)) {
+		*len_read += 1;
+	}
+
+	return LZ_SUCCESS;
+}
 
-	dbgprint(DBG_NW, "INFO: In esp8266_receive_data\n");
+#else
 
-	char ch;
-	while (xQueueReceive(esp8266_rcv_queue, &ch, (TickType_t)remaining_timeout) == pdPASS) {
-		buf[received_len] = ch;
-		received_len = received_len + 1;
+static LZ_RESULT esp8266_read(uint8_t *buf, uint32_t len, uint32_t timeout_ms, uint32_t *len_read)
+{
+	uint32_t deadline = lzport_get_tick_ms() + timeout_ms;
 
-		uint32_t elapsed_time = (xTaskGetTickCount() - curr_time);
-		if (remaining_timeout > elapsed_time) {
-			remaining_timeout -= elapsed_time;
-		} else {
-			remaining_timeout = 0;
-		}
-		curr_time = xTaskGetTickCount();
+	*len_read = 0;
 
-		if (received_len == buf_size) {
-			return LZ_SUCCESS;
+	while (lzport_usart_buffer_is_empty(&lzport_usart_rx_fifo_esp)) {
+		if (deadline < lzport_get_tick_ms()) {
+			return LZ_TIMEOUT;
 		}
 	}
+	while ((*len_read < len) && !lzport_usart_buffer_is_empty(&lzport_usart_rx_fifo_esp)) {
+		lzport_usart_buffer_read(&lzport_usart_rx_fifo_esp, &buf[*len_read]);
+		*len_read += 1;
+	}
 
-	dbgprint(DBG_WARN, "WARN: Timeout waiting for ESP8266 response\n");
-
-	return LZ_ERROR;
+	return LZ_SUCCESS;
 }
 
-#else
+#endif
 
-static LZ_RESULT esp8266_receive(char *buf, uint32_t buf_size, const char *terminator,
-								 uint32_t timeout_ms)
+/**
+ * Returns the next event of the ESP8266. Received bytes which were not parsed yet remain in
+ * rx_chunk for the next call. Payload bytes of +IPD are received directly into the buffers of
+ * the parser if no parsed bytes are pending
+ */
+static LZ_RESULT esp8266_next_event(lzport_at_event_t *event, uint32_t timeout_ms)
 {
-	uint32_t deadline = lzport_get_tick_ms() + timeout_ms;
-	uint32_t received_len = 0;
-
-	memset(buf, 0x00, buf_size);
+	uint32_t curr_time_ms = lzport_get_tick_ms();
+	uint32_t remaining_time_ms = timeout_ms;
+	LZ_RESULT result;
 
-	if (buf_size < strlen(terminator) + 1) {
-		return LZ_ERROR;
-	}
+	*event = LZPORT_AT_NONE;
 
-	dbgprint(DBG_NW, "ESP8266: ");
+	while (*event == LZPORT_AT_NONE) {
+		uint8_t *dest;
+		uint32_t len = lzport_at_parser_data_dest(&at_parser, &dest);
+		uint32_t len_read;
 
-	while (deadline >= lzport_get_tick_ms()) {
-		if (!lzport_usart_buffer_is_empty(&lzport_usart_rx_fifo_esp)) {
-			uint8_t c;
-			lzport_usart_buffer_read(&lzport_usart_rx_fifo_esp, &c);
-			dbgprint(DBG_NW, "%c", c);
-			buf[received_len] = (char)c;
-			received_len++;
+		if ((rx_chunk_pos == rx_chunk_len) && (len > 0)) {
+			result = esp8266_read(dest, len, remaining_time_ms, &len_read);
+			if (result != LZ_SUCCESS) {
+				return result;
+			}
+			*event = lzport_at_parser_data_written(&at_parser, len_read);
+		} else {
+			if (rx_chunk_pos == rx_chunk_len) {
+				result = esp8266_read(rx_chunk, sizeof(rx_chunk), remaining_time_ms, &len_read);
+				if (result != LZ_SUCCESS) {
+					return result;
+				}
+				rx_chunk_pos = 0;
+				rx_chunk_len = len_read;
+			}
+			uint32_t consumed;
+			*event = lzport_at_parser_feed(&at_parser, &rx_chunk[rx_chunk_pos],
+										   rx_chunk_len - rx_chunk_pos, &consumed);
+			rx_chunk_pos += consumed;
 		}
 
-		if ((received_len >= strlen(terminator)) && strstr(buf, terminator)) {
-			return LZ_SUCCESS;
-		} else if ((received_len >= strlen(response_already_connected)) &&
-				   strstr(buf, response_already_connected)) {
-			dbgprint(DBG_WARN, "WARN: ESP responded with already connected\n");
-			return LZ_ERROR_WIFI_ALREADY_CONNECTED;
-		} else if ((received_len >= strlen(response_err)) && strstr(buf, response_err)) {
-			dbgprint(DBG_WARN, "WARN: ESP responded with ERROR\n");
-			return LZ_ERROR_WIFI;
-		} else if (((received_len >= strlen(response_busy_p)) && strstr(buf, response_busy_p)) ||
-				   ((received_len >= strlen(response_busy_s)) && strstr(buf, response_busy_s))) {
-			dbgprint(DBG_WARN, "WARN: ESP responded with BUSY\n");
-			return LZ_ERROR_WIFI_BUSY;
-		}
-		if (received_len >= buf_size) {
-			dbgprint(DBG_WARN, "WARN: specified receive buffer full\n");
-			return LZ_ERROR;
+		update_remaining_time(&remaining_time_ms, lzport_get_tick_ms() - curr_time_ms);
+		curr_time_ms = lzport_get_tick_ms();
+		if ((*event == LZPORT_AT_NONE) && (remaining_time_ms == 0)) {
+			return LZ_TIMEOUT;
 		}
 	}
 
-	dbgprint(DBG_WARN, "WARN: Timeout waiting for ESP8266 response\n");
-
-	return LZ_ERROR;
+	return LZ_SUCCESS;
 }
 
-static LZ_RESULT esp8266_receive_data(char *buf, uint32_t buf_size, uint32_t timeout_ms)
+/**
+ * Receives the response of the ESP8266 until the expected event occurs. The information lines of
+ * the response are collected in rxbuf, separated by line breaks. If a line did not fit, the
+ * response is still received completely, but LZ_ERROR is returned
+ */
+static LZ_RESULT esp8266_receive(lzport_at_event_t expected, uint32_t timeout_ms)
 {
-	uint32_t deadline = lzport_get_tick_ms() + timeout_ms;
-	uint32_t received_len = 0;
+	uint32_t curr_time_ms = lzport_get_tick_ms();
+	uint32_t remaining_time_ms = timeout_ms;
+	uint32_t response_len = 0;
+	bool already_connected = false;
+	bool truncated = false;
+	lzport_at_event_t event;
 
-	memset(buf, 0x00, buf_size);
+	rxbuf[0] = '\0';
+
+	dbgprint(DBG_NW, "INFO: esp8266_receive receiving data\n");
 
-	dbgprint(DBG_NW, "ESP8266: ");
+	while (esp8266_next_event(&event, remaining_time_ms) == LZ_SUCCESS) {
+		update_remaining_time(&remaining_time_ms, lzport_get_tick_ms() - curr_time_ms);
+		curr_time_ms = lzport_get_tick_ms();
 
-	while (deadline >= lzport_get_tick_ms()) {
-		if (!lzport_usart_buffer_is_empty(&lzport_usart_rx_fifo_esp)) {
-			lzport_usart_buffer_read(&lzport_usart_rx_fifo_esp, (uint8_t *)&buf[received_len]);
-			dbgprint(DBG_NW, "%c", buf[received_len]);
-			received_len++;
+		if (event == expected) {
+			// The response was consumed completely, but information lines are missing
+			return truncated ? LZ_ERROR : LZ_SUCCESS;
 		}
 
-		if (received_len == buf_size) {
-			return LZ_SUCCESS;
+		switch (event) {
+		case LZPORT_AT_LINE:
+			dbgprint(DBG_NW, "ESP8266: %s\n", at_parser.line);
+			if (response_len + at_parser.line_len + 2 < sizeof(rxbuf)) {
+				memcpy(&rxbuf[response_len], at_parser.line, at_parser.line_len);
+				memcpy(&rxbuf[response_len + at_parser.line_len], "\r\n", 3);
+				response_len += at_parser.line_len + 2;
+			} else {
+				dbgprint(DBG_WARN, "WARN: ESP8266 - Response too long, dropped line %s\n",
+						 at_parser.line);
+				truncated = true;
+			}
+			break;
+		case LZPORT_AT_LINE_TOO_LONG:
+			dbgprint(DBG_WARN, "WARN: ESP8266 - Line longer than %d bytes: %s..\n",
+					 LZPORT_AT_MAX_LINE, at_parser.line);
+			truncated = true;
+			break;
+		case LZPORT_AT_ALREADY_CONNECTED:
+			// The ESP8266 terminates this response with ERROR
+			already_connected = true;
+			break;
+		case LZPORT_AT_ERROR:
+		case LZPORT_AT_FAIL:
+		case LZPORT_AT_SEND_FAIL:
+			if (already_connected) {
+				dbgprint(DBG_WARN, "WARN: ESP responded with already connected\n");
+				return LZ_ERROR_WIFI_ALREADY_CONNECTED;
+			}
+			dbgprint(DBG_WARN, "WARN: ESP responded with ERROR\n");
+			return LZ_ERROR_WIFI;
+		case LZPORT_AT_BUSY:
+			dbgprint(DBG_WARN, "WARN: ESP responded with BUSY\n");
+			return LZ_ERROR_WIFI_BUSY;
+		case LZPORT_AT_IPD:
+			dbgprint(DBG_NW, "INFO: ESP8266 - Receiving %d bytes\n", at_parser.ipd_len);
+#if (1 == ESP_USART_RX_BENCHMARK)
+			ipd_start_ms = lzport_get_tick_ms();
+#endif
+			break;
+		case LZPORT_AT_IPD_DONE:
+			dbgprint(DBG_WARN, "WARN: ESP8266 - Discarded unexpected packet of %d bytes\n",
+					 at_parser.ipd_len);
+			break;
+		case LZPORT_AT_CLOSED:
+		case LZPORT_AT_WIFI_DISCONNECT:
+			// No data is received anymore, but the response to a command can still follow
+			dbgprint(DBG_NW, "INFO: ESP8266 - Connection closed\n");
+			if (expected == LZPORT_AT_IPD_DONE) {
+				dbgprint(DBG_WARN, "WARN: ESP8266 - Connection closed while receiving\n");
+				return LZ_ERROR;
+			}
+			break;
+		default:
+			dbgprint(DBG_NW, "INFO: ESP8266 - Unsolicited event %d\n", event);
+			break;
 		}
 	}
 
 	dbgprint(DBG_WARN, "WARN: Timeout waiting for ESP8266 response\n");
 
-	return LZ_ERROR;
+	return LZ_TIMEOUT;
 }
 
+void lzport_socket_set_busy(bool busy)
+{
+#if (1 == ESP_USART_RX_DMA)
+	// The DMA continues to receive into the ring buffer while the caller is busy. RTS is
+	// asserted by its ISR if the ring buffer fills up
+	(void)busy;
+#else
+	lzport_gpio_set_rts(busy);
 #endif
+}
 
 static LZ_RESULT esp8266_connect_to_ap(char *ssid, char *pwd)
 {
 	dbgprint(DBG_NW, "AT+CWMODE_DEF=1\n");
 	fprintf(net_fd, "AT+CWMODE_DEF=1\r\n");
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
+	if (esp8266_receive(LZPORT_AT_OK, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
 		return LZ_ERROR;
 	}
 
 	dbgprint(DBG_NW, "AT+CWLAP\n");
 	fprintf(net_fd, "AT+CWLAP\r\n");
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, ESP8266_EXT_TIMEOUT_MS) != LZ_SUCCESS) {
+	if (esp8266_receive(LZPORT_AT_OK, ESP8266_EXT_TIMEOUT_MS) != LZ_SUCCESS) {
 		return LZ_ERROR;
 	}
 
@@ -507,7 +608,7 @@ static LZ_RESULT esp8266_connect_to_ap(char *ssid, char *pwd)
 
 	dbgprint(DBG_NW, "AT+CWJAP_DEF=\"%s\",\"%s\"\n", ssid, (pwd == NULL) ? "" : pwd);
 	fprintf(net_fd, "AT+CWJAP_DEF=\"%s\",\"%s\"\r\n", ssid, (pwd == NULL) ? "" : pwd);
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, ESP8266_EXT_TIMEOUT_MS) != LZ_SUCCESS) {
+	if (esp8266_receive(LZPORT_AT_OK, ESP8266_EXT_TIMEOUT_MS) != LZ_SUCCESS) {
 		return LZ_ERROR;
 	}
 
@@ -523,15 +624,16 @@ static LZ_RESULT esp8266_get_network_info(uint8_t *ip, uint32_t iplen, uint8_t *
 	}
 
 	fprintf(net_fd, "AT+CIFSR\r\n");
-	if (esp8266_receive(rxbuf, sizeof(rxbuf), response_ok, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
+	if (esp8266_receive(LZPORT_AT_OK, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
 		return LZ_ERROR;
 	}
 
 	uint32_t iptmp[LEN_IP] = { 0 };
 	uint32_t mactmp[LEN_MAC] = { 0 };
 	if (sscanf(rxbuf,
-			   "+CIFSR:STAIP,\"%lu.%lu.%lu.%lu\"\r\n+CIFSR:STAMAC,"
-			   "\"%lx:%lx:%lx:%lx:%lx:%lx:\"\r\n",
+			   "+CIFSR:STAIP,\"%" SCNu32 ".%" SCNu32 ".%" SCNu32 ".%" SCNu32 "\"\r\n"
+			   "+CIFSR:STAMAC,\"%" SCNx32 ":%" SCNx32 ":%" SCNx32 ":%" SCNx32 ":%" SCNx32
+			   ":%" SCNx32 ":\"\r\n",
 			   &iptmp[0], &iptmp[1], &iptmp[2], &iptmp[3], &mactmp[0], &mactmp[1], &mactmp[2],
 			   &mactmp[3], &mactmp[4], &mactmp[5]) != 10) {
 		dbgprint(DBG_WARN, "WARN: Failed to parse IP and MAC address\n");
@@ -548,6 +650,60 @@ static LZ_RESULT esp8266_get_network_info(uint8_t *ip, uint32_t iplen, uint8_t *
 	return LZ_SUCCESS;
 }
 
+static LZ_RESULT esp8266_set_baud_rate(uint32_t baud_rate)
+{
+	// Flow control is kept as configured with AT+UART_DEF
+	fprintf(net_fd, "AT+UART_CUR=%" PRIu32 ",8,1,0,3\r\n", baud_rate);
+	if (esp8266_receive(LZPORT_AT_OK, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
+		return LZ_ERROR;
+	}
+
+	// The ESP8266 sends the response with the previous baud rate and switches afterwards
+	lzport_usart_set_baud_rate_esp(baud_rate);
+	esp8266_baud_rate = baud_rate;
+
+	fprintf(net_fd, "AT\r\n");
+	if (esp8266_receive(LZPORT_AT_OK, ESP8266_STD_TIMEOUT_MS) != LZ_SUCCESS) {
+		return LZ_ERROR;
+	}
+
+	dbgprint(DBG_INFO, "INFO: ESP8266 baud rate set to %d\n", baud_rate);
+
+	return LZ_SUCCESS;
+}
+
+#if (1 == ESP_USART_RX_BENCHMARK)
+static void esp8266_rx_benchmark(uint32_t len, uint32_t elapsed_ms)
+{
+	rx_benchmark_bytes += len;
+	rx_benchmark_ms += elapsed_ms;
+
+	if (rx_benchmark_bytes < ESP_USART_RX_BENCHMARK_BYTES) {
+		return;
+	}
+
+	// The time covers the data of the packets only, so that the throughput can be compared
+	// with the raw data rate of the baud rate
+	dbgprint(DBG_INFO,
+			 "INFO: ESP8266 received %d bytes in %d ms: %d bytes/s at %d baud (%d bytes/s raw), "
+			 "%s receive path\n",
+			 rx_benchmark_bytes, rx_benchmark_ms,
+			 (rx_benchmark_ms > 0) ? (rx_benchmark_bytes * 1000) / rx_benchmark_ms : 0,
+			 esp8266_baud_rate, esp8266_baud_rate / 10,
+#if (1 == ESP_USART_RX_DMA)
+			 "DMA"
+#elif (1 == FREERTOS_AVAILABLE)
+			 "queue"
+#else
+			 "fifo"
+#endif
+	);
+
+	rx_benchmark_bytes = 0;
+	rx_benchmark_ms = 0;
+}
+#endif
+
 static void update_remaining_time(uint32_t *remaining_time, uint32_t elapsed_time)
 {
 	if (*remaining_time > elapsed_time) {
@@ -20,8 +20,18 @@
 #ifndef LZPORT_NET_H_
 #define LZPORT_NET_H_
 
+#include "stdbool.h"
 #include "lz_error.h"
 
+/**
+ * Buffer of a scatter-gather socket operation. Headers and payloads can be sent from and received
+ * to their original location without copying them into a contiguous buffer
+ */
+typedef struct {
+	void *base;
+	uint32_t len;
+} lzport_iovec_t;
+
 LZ_RESULT lzport_net_init(uint8_t *ip, uint8_t *mac, char *ssid, char *pwd);
 
 LZ_RESULT lzport_socket_close(uint32_t handle, uint32_t timeout_ms);
@@ -31,6 +41,27 @@ LZ_RESULT lzport_socket_send(uint32_t handle, uint8_t *data, uint32_t len, uint3
 LZ_RESULT lzport_socket_receive(uint32_t handle, uint8_t *data, uint32_t len_exp,
 								uint32_t timeout_ms, uint32_t *len_rec);
 
+/**
+ * Sends the buffers as a single packet
+ */
+LZ_RESULT lzport_socket_sendv(uint32_t handle, const lzport_iovec_t *iov, uint32_t iovcnt,
+							  uint32_t timeout_ms);
+
+/**
+ * Receives a packet and scatters it over the buffers in order. len_rec returns the size of
+ * the packet, which must not exceed the total size of the buffers
+ */
+LZ_RESULT lzport_socket_receivev(uint32_t handle, const lzport_iovec_t *iov, uint32_t iovcnt,
+								 uint32_t timeout_ms, uint32_t *len_rec);
+
+/**
+ * Must be called before and after the caller is busy without receiving, e.g. while writing to
+ * flash. If the received data is buffered in the background, the ESP8266 continues sending and
+ * is only paused via RTS once the buffer fills up. Otherwise, it is paused until the caller is
+ * done
+ */
+void lzport_socket_set_busy(bool busy);
+
 #if (1 == FREERTOS_AVAILABLE)
 LZ_RESULT lzport_esp8266_init_queue(void);
 LZ_RESULT lzport_esp8266_queue_send(char ch, uint32_t *higher_prio_task_woken);
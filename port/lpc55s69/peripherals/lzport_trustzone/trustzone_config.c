@@ -76,6 +76,9 @@ void init_trustzone(void)
 	// Configure USART2 for ESP communication as non-secure
 	NVIC_SetTargetState(FLEXCOMM2_IRQn);
 
+	// Configure DMA0 IRQ for the DMA receive path of USART2 as non-secure
+	NVIC_SetTargetState(DMA0_IRQn);
+
 	// Configure WWDT IRQ for AWDT as secure
 	NVIC_ClearTargetState(WDT_BOD_IRQn);
 
@@ -18,10 +18,14 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "fsl_usart.h"
+#include "fsl_reset.h"
 
 #include "lz_config.h"
+#include "lz_error.h"
 #include "lzport_usart.h"
+#include "lzport_gpio.h"
 #include "lzport_debug_output.h"
 
 #if (1 == FREERTOS_AVAILABLE)
@@ -34,12 +38,41 @@ volatile FILE *net_fd = NULL;
 volatile lzport_usart_fifo_t lzport_usart_tx_fifo_esp;
 volatile lzport_usart_fifo_t lzport_usart_rx_fifo_esp;
 
+#if (1 == ESP_USART_RX_DMA)
+/**
+ * @brief	DMA transfer descriptor as read by the DMA controller. The addresses point to the last
+ * 			byte of the transfer
+ */
+typedef struct {
+	uint32_t xfercfg;
+	volatile const void *src_end;
+	void *dst_end;
+	void *next;
+} esp_rx_dma_desc_t;
+
+// The channel descriptor table only requires entries up to the used channel
+static esp_rx_dma_desc_t esp_rx_dma_table[ESP_USART_RX_DMA_CHANNEL + 1]
+	__attribute__((aligned(512)));
+static esp_rx_dma_desc_t esp_rx_dma_desc[ESP_USART_RX_DMA_BLOCKS] __attribute__((aligned(16)));
+static uint8_t esp_rx_dma_buf[ESP_USART_RX_DMA_BUF_SIZE];
+// Positions are counted in bytes since initialization and wrap with the ring buffer size
+static volatile uint32_t esp_rx_dma_blocks_done = 0;
+static volatile uint32_t esp_rx_dma_read_pos = 0;
+// Set by the ISR if it paused the ESP8266 because the ring buffer reached the watermark
+static volatile bool esp_rx_dma_rts = false;
+
+static void esp_usart_rx_dma_init(void);
+static uint32_t esp_usart_rx_dma_write_pos(void);
+#endif
+
 void lzport_usart_init_esp(void)
 {
 	usart_config_t config;
 
 	lzport_usart_buffer_init(&lzport_usart_tx_fifo_esp);
-#if (1 == FREERTOS_AVAILABLE)
+#if (1 == ESP_USART_RX_DMA)
+	// The ring buffer is set up after the USART
+#elif (1 == FREERTOS_AVAILABLE)
 	if (lzport_esp8266_init_queue() != LZ_SUCCESS) {
 		dbgprint(DBG_ERR, "ERROR: Failed to initialize ESP queue\n");
 		for (;;)
@@ -59,11 +92,166 @@ void lzport_usart_init_esp(void)
 
 	net_fd = fopen("wifi", "wb");
 
+#if (1 == ESP_USART_RX_DMA)
+	esp_usart_rx_dma_init();
+	USART_EnableInterrupts(ESP_USART, kUSART_RxErrorInterruptEnable);
+#else
 	USART_EnableInterrupts(ESP_USART,
 						   kUSART_RxLevelInterruptEnable | kUSART_RxErrorInterruptEnable);
+#endif
 	EnableIRQ(ESP_USART_IRQn);
 }
 
+void lzport_usart_set_baud_rate_esp(uint32_t baud_rate)
+{
+	if (USART_SetBaudRate(ESP_USART, baud_rate, ESP_USART_CLK_FREQ) != kStatus_Success) {
+		dbgprint(DBG_ERR, "ERROR: Failed to set ESP USART baud rate %d\n", baud_rate);
+	}
+}
+
+#if (1 == ESP_USART_RX_DMA)
+
+LZ_RESULT lzport_usart_rx_dma_read(uint8_t *buf, uint32_t len, uint32_t *len_read)
+{
+	uint32_t available = esp_usart_rx_dma_write_pos() - esp_rx_dma_read_pos;
+
+	*len_read = 0;
+
+	if (available > ESP_USART_RX_DMA_BUF_SIZE) {
+		dbgprint(DBG_ERR, "ERROR: ESP USART DMA ring buffer overflow, lost %d bytes\n",
+				 available - ESP_USART_RX_DMA_BUF_SIZE);
+		esp_rx_dma_read_pos += available;
+		return LZ_ERROR;
+	}
+
+	if (len > available) {
+		len = available;
+	}
+
+	// Copy in up to two chunks, as the data might wrap around the end of the ring buffer
+	while (*len_read < len) {
+		uint32_t offset = esp_rx_dma_read_pos % ESP_USART_RX_DMA_BUF_SIZE;
+		uint32_t chunk = ESP_USART_RX_DMA_BUF_SIZE - offset;
+		if (chunk > len - *len_read) {
+			chunk = len - *len_read;
+		}
+		memcpy(buf + *len_read, &esp_rx_dma_buf[offset], chunk);
+		*len_read += chunk;
+		esp_rx_dma_read_pos += chunk;
+	}
+
+	// The ESP8266 continues sending once the ring buffer has room for a few more blocks. The
+	// flag is checked with interrupts disabled, so that the ISR cannot set RTS in between
+	if (esp_rx_dma_rts && (ESP_USART_RX_DMA_BUF_SIZE - (available - len) >=
+						   ESP_USART_RX_DMA_RTS_RESUME)) {
+		uint32_t primask = DisableGlobalIRQ();
+		esp_rx_dma_rts = false;
+		lzport_gpio_set_rts(false);
+		EnableGlobalIRQ(primask);
+	}
+
+	return LZ_SUCCESS;
+}
+
+static void esp_usart_rx_dma_init(void)
+{
+	uint32_t mask = 1UL << ESP_USART_RX_DMA_CHANNEL;
+
+	// Each descriptor receives one block and raises interrupt A when the block is full. The
+	// descriptors are linked to a circle and reloaded by the DMA, so that it never stops
+	uint32_t xfercfg =
+		DMA_CHANNEL_XFERCFG_CFGVALID(1) | DMA_CHANNEL_XFERCFG_RELOAD(1) |
+		DMA_CHANNEL_XFERCFG_SWTRIG(1) | DMA_CHANNEL_XFERCFG_SETINTA(1) |
+		DMA_CHANNEL_XFERCFG_WIDTH(0) | DMA_CHANNEL_XFERCFG_SRCINC(0) |
+		DMA_CHANNEL_XFERCFG_DSTINC(1) |
+		DMA_CHANNEL_XFERCFG_XFERCOUNT(ESP_USART_RX_DMA_BLOCK_SIZE - 1);
+	for (uint32_t i = 0; i < ESP_USART_RX_DMA_BLOCKS; i++) {
+		esp_rx_dma_desc[i].xfercfg = xfercfg;
+		esp_rx_dma_desc[i].src_end = &ESP_USART->FIFORD;
+		esp_rx_dma_desc[i].dst_end =
+			&esp_rx_dma_buf[(i + 1) * ESP_USART_RX_DMA_BLOCK_SIZE - 1];
+		esp_rx_dma_desc[i].next = &esp_rx_dma_desc[(i + 1) % ESP_USART_RX_DMA_BLOCKS];
+	}
+	esp_rx_dma_table[ESP_USART_RX_DMA_CHANNEL] = esp_rx_dma_desc[0];
+
+	CLOCK_EnableClock(kCLOCK_Dma0);
+	RESET_PeripheralReset(kDMA0_RST_SHIFT_RSTn);
+
+	ESP_USART_DMA->SRAMBASE = (uint32_t)esp_rx_dma_table;
+	ESP_USART_DMA->CTRL = DMA_CTRL_ENABLE(1);
+	ESP_USART_DMA->CHANNEL[ESP_USART_RX_DMA_CHANNEL].CFG = DMA_CHANNEL_CFG_PERIPHREQEN(1);
+	ESP_USART_DMA->COMMON[0].ENABLESET = mask;
+	ESP_USART_DMA->COMMON[0].INTENSET = mask;
+
+	USART_EnableRxDMA(ESP_USART, true);
+
+	// Writing the configuration of the first descriptor with SWTRIG starts the transfer, the
+	// trigger is kept for the reloaded descriptors as CLRTRIG is not set
+	ESP_USART_DMA->CHANNEL[ESP_USART_RX_DMA_CHANNEL].XFERCFG = xfercfg;
+
+	EnableIRQ(ESP_USART_DMA_IRQn);
+}
+
+void ESP_USART_DMA_IRQHandler(void)
+{
+	uint32_t mask = 1UL << ESP_USART_RX_DMA_CHANNEL;
+
+	if (ESP_USART_DMA->COMMON[0].ERRINT & mask) {
+		dbgprint(DBG_ERR, "ERROR: ESP USART DMA. Looping forever\n");
+		for (;;)
+			;
+	}
+
+	if (ESP_USART_DMA->COMMON[0].INTA & mask) {
+		ESP_USART_DMA->COMMON[0].INTA = mask;
+		esp_rx_dma_blocks_done = esp_rx_dma_blocks_done + 1;
+
+		// The reader might be busy, e.g. writing to flash. Pause the ESP8266 before the DMA
+		// overwrites unread data
+		uint32_t available =
+			esp_rx_dma_blocks_done * ESP_USART_RX_DMA_BLOCK_SIZE - esp_rx_dma_read_pos;
+		if (!esp_rx_dma_rts && (available >= ESP_USART_RX_DMA_BUF_SIZE -
+												  ESP_USART_RX_DMA_RTS_WATERMARK)) {
+			esp_rx_dma_rts = true;
+			lzport_gpio_set_rts(true);
+		}
+	}
+}
+
+/**
+ * The LPC55S69 USART has no idle line interrupt. Instead, the position of the DMA within the
+ * current block is derived from its remaining transfer count, so that data is available as soon
+ * as it was received and not only when a block is full
+ */
+static uint32_t esp_usart_rx_dma_write_pos(void)
+{
+	uint32_t mask = 1UL << ESP_USART_RX_DMA_CHANNEL;
+	uint32_t pending, remaining, blocks;
+
+	uint32_t primask = DisableGlobalIRQ();
+	do {
+		// A block completion which was not yet handled by the ISR is counted here. If the block
+		// completes while reading the transfer count, the count is read again
+		pending = ESP_USART_DMA->COMMON[0].INTA & mask;
+		// XFERCOUNT is the number of remaining transfers minus one and 0x3FF if the block is
+		// full, which is then counted as the beginning of the next block
+		remaining = ((ESP_USART_DMA->CHANNEL[ESP_USART_RX_DMA_CHANNEL].XFERCFG &
+					  DMA_CHANNEL_XFERCFG_XFERCOUNT_MASK) >>
+					 DMA_CHANNEL_XFERCFG_XFERCOUNT_SHIFT) +
+					1;
+		blocks = esp_rx_dma_blocks_done;
+	} while (pending != (ESP_USART_DMA->COMMON[0].INTA & mask));
+	EnableGlobalIRQ(primask);
+
+	if (pending) {
+		blocks++;
+	}
+
+	return blocks * ESP_USART_RX_DMA_BLOCK_SIZE + (ESP_USART_RX_DMA_BLOCK_SIZE - remaining);
+}
+
+#endif
+
 void lzport_usart_buffer_init(volatile lzport_usart_fifo_t *buffer)
 {
 	buffer->size = USART_BUFF_SIZE + 1;
@@ -100,7 +288,13 @@ void lzport_usart_buffer_read(volatile lzport_usart_fifo_t *buffer, uint8_t *ele
 
 void ESP_USART_IRQHandler(void)
 {
-	if ((kUSART_RxFifoNotEmptyFlag)&USART_GetStatusFlags(ESP_USART)) {
+	uint32_t status = USART_GetStatusFlags(ESP_USART);
+#if (1 == ESP_USART_RX_DMA)
+	// Received bytes are transferred by the DMA, only errors and transmission are handled here
+	status &= ~kUSART_RxFifoNotEmptyFlag;
+#endif
+
+	if (kUSART_RxFifoNotEmptyFlag & status) {
 		uint8_t byte = USART_ReadByte(ESP_USART);
 
 #if (1 == FREERTOS_AVAILABLE)
@@ -112,11 +306,11 @@ void ESP_USART_IRQHandler(void)
 #else
 		lzport_usart_buffer_write(&lzport_usart_rx_fifo_esp, byte);
 #endif
-	} else if (kUSART_RxError & USART_GetStatusFlags(ESP_USART)) {
+	} else if (kUSART_RxError & status) {
 		dbgprint(DBG_ERR, "ERROR: ESP USART. Looping forever\n");
 		for (;;)
 			;
-	} else if (kUSART_TxFifoNotFullFlag & USART_GetStatusFlags(ESP_USART)) {
+	} else if (kUSART_TxFifoNotFullFlag & status) {
 		if (!lzport_usart_buffer_is_empty(&lzport_usart_tx_fifo_esp)) {
 			uint8_t ch;
 			lzport_usart_buffer_read(&lzport_usart_tx_fifo_esp, &ch);
@@ -20,6 +20,9 @@
 #ifndef LZ_USART_H
 #define LZ_USART_H
 
+#include "lz_config.h"
+#include "lz_error.h"
+
 #define ESP_USART USART2
 #define ESP_USART_CLK_SRC kCLOCK_Flexcomm2
 // TODO CLOCK_GetFreq(kCLOCK_Flexcomm2) is not available, as it unnecessarily accesses
@@ -31,6 +34,39 @@
 #define ESP_USART_BAUD_RATE 115200U
 #define USART_BUFF_SIZE 2000
 
+// Baud rate the ESP8266 is switched to after it responded at ESP_USART_BAUD_RATE. The fractional
+// divider of the 12 MHz Flexcomm clock reaches 230400, 460800 and 921600 with an error of 0.16%
+#ifndef ESP_USART_BAUD_RATE_HIGH
+#define ESP_USART_BAUD_RATE_HIGH ESP_USART_BAUD_RATE
+#endif
+
+// Receive the data from the ESP8266 via DMA into a ring buffer instead of taking an interrupt for
+// every byte. If disabled, the bytes are passed to a FreeRTOS queue or the rx fifo by the ISR
+#ifndef ESP_USART_RX_DMA
+#define ESP_USART_RX_DMA 0
+#endif
+#define ESP_USART_DMA DMA0
+#define ESP_USART_DMA_IRQn DMA0_IRQn
+#define ESP_USART_DMA_IRQHandler DMA0_IRQHandler
+#define ESP_USART_RX_DMA_CHANNEL 10
+// The ring buffer consists of linked descriptors with the maximum transfer count of the DMA. The
+// size must be a power of two. It holds the next chunk of an update while the previous one is
+// written to flash, and absorbs 700ms of data at 115200 baud
+#define ESP_USART_RX_DMA_BLOCK_SIZE 1024
+#define ESP_USART_RX_DMA_BLOCKS 8
+#define ESP_USART_RX_DMA_BUF_SIZE (ESP_USART_RX_DMA_BLOCK_SIZE * ESP_USART_RX_DMA_BLOCKS)
+// The ISR pauses the ESP8266 via RTS if no more than this many bytes are free after a block was
+// received. As the ISR only runs once per block, at least one more block must still fit
+#define ESP_USART_RX_DMA_RTS_WATERMARK (2 * ESP_USART_RX_DMA_BLOCK_SIZE)
+// RTS is released by the reader once this many bytes are free again
+#define ESP_USART_RX_DMA_RTS_RESUME (ESP_USART_RX_DMA_BUF_SIZE / 2)
+
+// Print the throughput of the received socket data every ESP_USART_RX_BENCHMARK_BYTES
+#ifndef ESP_USART_RX_BENCHMARK
+#define ESP_USART_RX_BENCHMARK 0
+#endif
+#define ESP_USART_RX_BENCHMARK_BYTES 0x10000
+
 // Types ===========================================================================================
 
 /**
@@ -48,6 +84,20 @@ extern volatile lzport_usart_fifo_t lzport_usart_tx_fifo_esp;
 extern volatile lzport_usart_fifo_t lzport_usart_rx_fifo_esp;
 
 void lzport_usart_init_esp(void);
+void lzport_usart_set_baud_rate_esp(uint32_t baud_rate);
+
+#if (1 == ESP_USART_RX_DMA)
+/**
+ * Reads up to len bytes received from the ESP8266 from the DMA ring buffer without blocking.
+ * Releases RTS if the ring buffer was drained below the watermark
+ *
+ * @param buf The buffer to copy the received bytes to
+ * @param len The size of the buffer
+ * @param len_read The number of bytes copied to buf, may be zero
+ * @return LZ_SUCCESS, or LZ_ERROR if the ring buffer overflowed and data was lost
+ */
+LZ_RESULT lzport_usart_rx_dma_read(uint8_t *buf, uint32_t len, uint32_t *len_read);
+#endif
 
 void lzport_usart_buffer_init(volatile lzport_usart_fifo_t *buffer);
 void lzport_usart_buffer_write(volatile lzport_usart_fifo_t *buffer, uint8_t elem);